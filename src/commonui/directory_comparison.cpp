@@ -0,0 +1,241 @@
+#include "directory_comparison.h"
+
+#include <libfilezilla/local_filesys.hpp>
+#include <libfilezilla/string.hpp>
+
+#include <algorithm>
+#include <deque>
+#include <unordered_map>
+
+namespace {
+// How many entries are processed between checks for cancellation
+size_t const cancel_check_interval = 4096;
+
+struct join_key final
+{
+	std::wstring_view path;
+	bool dir{};
+
+	bool operator==(join_key const& op) const {
+		return dir == op.dir && path == op.path;
+	}
+};
+
+struct join_key_hash final
+{
+	size_t operator()(join_key const& k) const noexcept {
+		return std::hash<std::wstring_view>()(k.path) ^ static_cast<size_t>(k.dir);
+	}
+};
+
+bool cancelled_now(std::atomic<bool> const* cancelled)
+{
+	return cancelled && cancelled->load(std::memory_order_relaxed);
+}
+
+directory_comparison::status compare_entries(comparison_tree::entry const& l, comparison_tree::entry const& r, directory_comparison::options const& o)
+{
+	if (o.compare_mode == directory_comparison::mode::size) {
+		if (l.dir || l.size == r.size) {
+			return directory_comparison::status::same;
+		}
+		return directory_comparison::status::different;
+	}
+
+	if (l.time.empty() || r.time.empty()) {
+		return directory_comparison::status::same;
+	}
+
+	// Dates closer than the threshold are considered equal
+	fz::datetime lt = l.time;
+	fz::datetime rt = r.time;
+	int dateCmp = lt.compare(rt);
+	if (dateCmp < 0) {
+		lt += o.threshold;
+	}
+	else if (dateCmp > 0) {
+		rt += o.threshold;
+	}
+	int adjustedDateCmp = lt.compare(rt);
+	if (dateCmp && dateCmp == -adjustedDateCmp) {
+		dateCmp = 0;
+	}
+
+	if (dateCmp < 0) {
+		return directory_comparison::status::right_newer;
+	}
+	else if (dateCmp > 0) {
+		return directory_comparison::status::left_newer;
+	}
+	return directory_comparison::status::same;
+}
+}
+
+void comparison_tree::add(std::wstring const& parent, std::wstring const& name, bool dir, int64_t size, fz::datetime const& time)
+{
+	entry e;
+	if (parent.empty()) {
+		e.path = name;
+	}
+	else {
+		e.path.reserve(parent.size() + 1 + name.size());
+		e.path = parent;
+		e.path += '/';
+		e.path += name;
+	}
+	e.size = dir ? -1 : size;
+	e.time = time;
+	e.dir = dir;
+	entries.emplace_back(std::move(e));
+}
+
+comparison_tree::local_result comparison_tree::add_local(CLocalPath const& root, std::vector<CFilter> const& filters, bool recursive, bool ignore_links, std::atomic<bool> const* cancelled)
+{
+	// Pairs of absolute local path and path relative to the root
+	std::deque<std::pair<CLocalPath, std::wstring>> dirs;
+	dirs.emplace_back(root, std::wstring());
+
+	fz::local_filesys fs;
+	while (!dirs.empty()) {
+		auto [localPath, relative] = std::move(dirs.front());
+		dirs.pop_front();
+
+		if (!fs.begin_find_files(fz::to_native(localPath.GetPath()))) {
+			if (relative.empty()) {
+				return local_result::failed;
+			}
+			unlisted.emplace_back(std::move(relative));
+			continue;
+		}
+
+		bool isLink{};
+		fz::native_string name;
+		fz::local_filesys::type t{};
+		int64_t size{};
+		fz::datetime time;
+		int attributes{};
+		size_t i = 0;
+		while (fs.get_next_file(name, isLink, t, &size, &time, &attributes)) {
+			if (!(++i % cancel_check_interval) && cancelled_now(cancelled)) {
+				return local_result::cancelled;
+			}
+			if (isLink && ignore_links) {
+				continue;
+			}
+
+			std::wstring const wname = fz::to_wstring(name);
+			bool const dir = t == fz::local_filesys::dir;
+			if (filter_manager::FilenameFiltered(filters, wname, localPath.GetPath(), dir, size, attributes, time)) {
+				continue;
+			}
+
+			add(relative, wname, dir, size, time);
+			if (dir && recursive) {
+				CLocalPath sub = localPath;
+				sub.AddSegment(wname);
+				dirs.emplace_back(std::move(sub), entries.back().path);
+			}
+		}
+
+		if (cancelled_now(cancelled)) {
+			return local_result::cancelled;
+		}
+	}
+
+	return local_result::ok;
+}
+
+comparison_tree::entry const* directory_comparison::result::left(size_t i) const
+{
+	size_t const index = items_[i].left;
+	return index != npos ? &left_.entries[index] : nullptr;
+}
+
+comparison_tree::entry const* directory_comparison::result::right(size_t i) const
+{
+	size_t const index = items_[i].right;
+	return index != npos ? &right_.entries[index] : nullptr;
+}
+
+std::wstring const& directory_comparison::result::path(size_t i) const
+{
+	auto const& item = items_[i];
+	if (item.left != npos) {
+		return left_.entries[item.left].path;
+	}
+	return right_.entries[item.right].path;
+}
+
+std::unique_ptr<directory_comparison::result> directory_comparison::compare(comparison_tree && left, comparison_tree && right, options const& o, std::atomic<bool> const* cancelled)
+{
+	auto const start = fz::monotonic_clock::now();
+
+	auto res = std::make_unique<result>();
+	res->left_ = std::move(left);
+	res->right_ = std::move(right);
+
+	auto const& l = res->left_.entries;
+	auto const& r = res->right_.entries;
+
+	// When folding case, the index has to refer to folded copies of the paths
+	std::vector<std::wstring> foldedLeft, foldedRight;
+	if (o.fold_case) {
+		foldedLeft.reserve(l.size());
+		for (auto const& e : l) {
+			foldedLeft.emplace_back(fz::str_tolower(e.path));
+		}
+		foldedRight.reserve(r.size());
+		for (auto const& e : r) {
+			foldedRight.emplace_back(fz::str_tolower(e.path));
+		}
+	}
+	auto const key = [&](std::vector<comparison_tree::entry> const& entries, std::vector<std::wstring> const& folded, size_t i) {
+		return join_key{o.fold_case ? std::wstring_view(folded[i]) : std::wstring_view(entries[i].path), entries[i].dir};
+	};
+
+	// Build phase
+	std::unordered_map<join_key, size_t, join_key_hash> index;
+	index.reserve(r.size());
+	for (size_t i = 0; i < r.size(); ++i) {
+		if (!(i % cancel_check_interval) && cancelled_now(cancelled)) {
+			return nullptr;
+		}
+		// Should there be duplicates, the first one wins, others end up as right_only
+		index.emplace(key(r, foldedRight, i), i);
+	}
+
+	// Probe phase
+	std::vector<bool> matched(r.size());
+	auto const add_item = [&](size_t li, size_t ri, status s) {
+		++res->counts_[static_cast<size_t>(s)];
+		if (s != status::same || !o.hide_identical) {
+			res->items_.push_back({li, ri, s});
+		}
+	};
+
+	res->items_.reserve(std::max(l.size(), r.size()));
+	for (size_t i = 0; i < l.size(); ++i) {
+		if (!(i % cancel_check_interval) && cancelled_now(cancelled)) {
+			return nullptr;
+		}
+
+		auto it = index.find(key(l, foldedLeft, i));
+		if (it == index.end() || matched[it->second]) {
+			add_item(i, result::npos, status::left_only);
+		}
+		else {
+			matched[it->second] = true;
+			add_item(i, it->second, compare_entries(l[i], r[it->second], o));
+		}
+	}
+
+	for (size_t i = 0; i < r.size(); ++i) {
+		if (!matched[i]) {
+			add_item(result::npos, i, status::right_only);
+		}
+	}
+
+	res->elapsed_ = fz::monotonic_clock::now() - start;
+
+	return res;
+}
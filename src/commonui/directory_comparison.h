@@ -0,0 +1,141 @@
+#ifndef FILEZILLA_COMMONUI_DIRECTORY_COMPARISON_HEADER
+#define FILEZILLA_COMMONUI_DIRECTORY_COMPARISON_HEADER
+
+#include "../include/local_path.h"
+
+#include "filter.h"
+#include "visibility.h"
+
+#include <libfilezilla/time.hpp>
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Flat representation of a directory tree. Paths are relative to the root of the
+// tree, with segments separated by a slash.
+class FZCUI_PUBLIC_SYMBOL comparison_tree final
+{
+public:
+	class entry final
+	{
+	public:
+		std::wstring path;
+		int64_t size{-1};
+		fz::datetime time;
+		bool dir{};
+	};
+
+	void add(std::wstring const& parent, std::wstring const& name, bool dir, int64_t size, fz::datetime const& time);
+
+	enum class local_result
+	{
+		ok,
+		failed, // The root could not be listed
+		cancelled
+	};
+
+	// Enumerates the given local directory, applying the filters.
+	// Subdirectories that cannot be listed are added to unlisted.
+	local_result add_local(CLocalPath const& root, std::vector<CFilter> const& filters, bool recursive, bool ignore_links = true, std::atomic<bool> const* cancelled = nullptr);
+
+	std::vector<entry> entries;
+
+	// Directories with unknown contents. Their absence from entries must
+	// not be mistaken for the directories being empty.
+	std::vector<std::wstring> unlisted;
+};
+
+// Compares two trees using a hash join: An index of the right tree is built,
+// which then gets probed with each entry of the left tree.
+//
+// Unlike a merge, this does not require either side to be sorted, so it can
+// be run on a worker thread over full recursive trees independent of the
+// sort order of the file lists.
+class FZCUI_PUBLIC_SYMBOL directory_comparison final
+{
+public:
+	enum class mode
+	{
+		size,
+		date
+	};
+
+	enum class status : unsigned char
+	{
+		same,
+		different, // Size differs
+		left_newer,
+		right_newer,
+		left_only,
+		right_only,
+
+		count
+	};
+
+	class options final
+	{
+	public:
+		mode compare_mode{mode::size};
+
+		// Modification times within this threshold are considered equal
+		fz::duration threshold;
+
+		// Omit identical entries from the result
+		bool hide_identical{};
+
+		// Match names case-insensitively
+		bool fold_case{};
+	};
+
+	// The result only holds indexes into both trees, views are expected to
+	// render the rows they need on demand.
+	class FZCUI_PUBLIC_SYMBOL result final
+	{
+	public:
+		static constexpr size_t npos = static_cast<size_t>(-1);
+
+		class item final
+		{
+		public:
+			size_t left{npos};
+			size_t right{npos};
+			status state{};
+		};
+
+		size_t size() const { return items_.size(); }
+		bool empty() const { return items_.empty(); }
+
+		item const& operator[](size_t i) const { return items_[i]; }
+
+		// Returns nullptr if there is no such entry on the respective side
+		comparison_tree::entry const* left(size_t i) const;
+		comparison_tree::entry const* right(size_t i) const;
+
+		// Path relative to the compared roots
+		std::wstring const& path(size_t i) const;
+
+		size_t count(status s) const { return counts_[static_cast<size_t>(s)]; }
+
+		comparison_tree const& left_tree() const { return left_; }
+		comparison_tree const& right_tree() const { return right_; }
+
+		// Time spent in the comparison itself, excluding tree enumeration
+		fz::duration elapsed() const { return elapsed_; }
+
+	private:
+		friend class directory_comparison;
+
+		comparison_tree left_;
+		comparison_tree right_;
+		std::vector<item> items_;
+		size_t counts_[static_cast<size_t>(status::count)]{};
+		fz::duration elapsed_;
+	};
+
+	// Returns null if cancelled.
+	static std::unique_ptr<result> compare(comparison_tree && left, comparison_tree && right, options const& o, std::atomic<bool> const* cancelled = nullptr);
+};
+
+#endif
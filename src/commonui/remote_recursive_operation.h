@@ -12,8 +12,8 @@
 
 #include <deque>
 #include <memory>
-#include <set>
 #include <string>
+#include <unordered_set>
 
 class ChmodData;
 
@@ -56,7 +56,7 @@ private:
 	};
 
 	CServerPath m_remoteStartDir;
-	std::set<CServerPath> m_visitedDirs;
+	std::unordered_set<CServerPath> m_visitedDirs;
 	std::deque<new_dir> m_dirsToVisit;
 	bool m_allowParent{};
 };
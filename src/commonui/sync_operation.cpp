@@ -0,0 +1,372 @@
+#include "sync_operation.h"
+
+#include <libfilezilla/string.hpp>
+
+#include <set>
+
+namespace {
+// Upper limit of actions planned but not yet taken by the main thread
+size_t const max_pending_actions = 20000;
+}
+
+uint64_t sync_operation::stats::entries_per_second() const
+{
+	auto const ms = elapsed.get_milliseconds();
+	if (ms <= 0) {
+		return 0;
+	}
+	return entries * 1000 / static_cast<uint64_t>(ms);
+}
+
+sync_operation::sync_operation(fz::thread_pool& pool)
+	: pool_(pool)
+{
+}
+
+sync_operation::~sync_operation()
+{
+	{
+		fz::scoped_lock l(mutex_);
+		stop_ = true;
+		cond_.signal(l);
+	}
+	thread_.join();
+}
+
+bool sync_operation::start(CLocalPath const& localRoot, CServerPath const& remoteRoot, options const& o, remote_lister && lister)
+{
+	if (active_ || localRoot.empty() || remoteRoot.empty() || !lister) {
+		return false;
+	}
+
+	thread_.join();
+
+	localRoot_ = localRoot;
+	remoteRoot_ = remoteRoot;
+	options_ = o;
+	lister_ = std::move(lister);
+
+	{
+		fz::scoped_lock l(mutex_);
+		planned_.clear();
+		pending_actions_ = 0;
+		finished_ = false;
+		stats_ = stats();
+		failed_directory_.clear();
+		stop_ = false;
+	}
+
+	thread_ = pool_.spawn([this]() { thread_entry(); });
+	if (!thread_) {
+		return false;
+	}
+
+	active_ = true;
+	return true;
+}
+
+void sync_operation::stop()
+{
+	{
+		fz::scoped_lock l(mutex_);
+		stop_ = true;
+		cond_.signal(l);
+	}
+	thread_.join();
+
+	fz::scoped_lock l(mutex_);
+	planned_.clear();
+	pending_actions_ = 0;
+	active_ = false;
+}
+
+sync_operation::stats sync_operation::get_stats() const
+{
+	fz::scoped_lock l(mutex_);
+	return stats_;
+}
+
+std::wstring sync_operation::failed_directory() const
+{
+	fz::scoped_lock l(mutex_);
+	return failed_directory_;
+}
+
+void sync_operation::fail(std::wstring const& directory)
+{
+	fz::scoped_lock l(mutex_);
+	planned_.clear();
+	pending_actions_ = 0;
+	failed_directory_ = directory;
+}
+
+bool sync_operation::take_plans(std::vector<directory_plan> & plans, size_t max_actions)
+{
+	fz::scoped_lock l(mutex_);
+
+	size_t taken{};
+	while (!planned_.empty() && taken < max_actions) {
+		taken += planned_.front().actions.size();
+		plans.emplace_back(std::move(planned_.front()));
+		planned_.pop_front();
+	}
+
+	if (taken) {
+		bool const was_full = pending_actions_ >= max_pending_actions;
+		pending_actions_ -= taken;
+		if (was_full && pending_actions_ < max_pending_actions) {
+			cond_.signal(l);
+		}
+	}
+
+	return finished_ && planned_.empty();
+}
+
+void sync_operation::thread_entry()
+{
+	auto const start = fz::monotonic_clock::now();
+
+	class pending_dir final
+	{
+	public:
+		CLocalPath localPath;
+		CServerPath remotePath;
+		bool local{};
+		bool remote{};
+		bool root{};
+	};
+
+	// Depth-first, so that only the siblings along the current path are kept
+	std::vector<pending_dir> dirs;
+	dirs.push_back({localRoot_, remoteRoot_, true, true, true});
+
+	while (!dirs.empty() && !stop_) {
+		pending_dir d = std::move(dirs.back());
+		dirs.pop_back();
+
+		comparison_tree local;
+		if (d.local) {
+			auto const res = local.add_local(d.localPath, options_.filters.first, false, true, &stop_);
+			if (res == comparison_tree::local_result::cancelled) {
+				break;
+			}
+			if (res == comparison_tree::local_result::failed) {
+				if (d.root) {
+					fail(d.localPath.GetPath());
+					break;
+				}
+
+				// An unreadable directory would look empty, which in
+				// mirror mode would delete everything on the remote side.
+				fz::scoped_lock l(mutex_);
+				++stats_.unreadable_directories;
+				continue;
+			}
+		}
+
+		comparison_tree remote;
+		if (d.remote) {
+			CDirectoryListing listing;
+			if (!lister_(d.remotePath, listing)) {
+				// Contents are unknown, do not guess.
+				fail(d.remotePath.GetPath());
+				break;
+			}
+
+			std::wstring const path = d.remotePath.GetPath();
+			for (size_t i = 0; i < listing.size(); ++i) {
+				CDirentry const& entry = listing[i];
+				if (entry.is_dir() && entry.is_link()) {
+					// Links may form cycles
+					continue;
+				}
+				if (filter_manager::FilenameFiltered(options_.filters.second, entry.name, path, entry.is_dir(), entry.size, 0, entry.time)) {
+					continue;
+				}
+				remote.add(std::wstring(), entry.name, entry.is_dir(), entry.size, entry.time);
+			}
+		}
+
+		uint64_t const entries = local.entries.size() + remote.entries.size();
+
+		directory_plan plan;
+		plan.localPath = d.localPath;
+		plan.remotePath = d.remotePath;
+
+		std::vector<subdir> subdirs;
+		uint64_t conflicts{};
+		plan_directory(std::move(local), std::move(remote), options_, plan, subdirs, conflicts);
+
+		// Reverse order so that subdirectories get visited in listing order
+		for (auto it = subdirs.rbegin(); it != subdirs.rend(); ++it) {
+			pending_dir sub;
+			sub.localPath = d.localPath;
+			sub.remotePath = d.remotePath;
+			if (!sub.localPath.AddSegment(it->name) || !sub.remotePath.AddSegment(it->name)) {
+				continue;
+			}
+			sub.local = it->local;
+			sub.remote = it->remote;
+			dirs.emplace_back(std::move(sub));
+		}
+
+		fz::scoped_lock l(mutex_);
+		++stats_.directories;
+		stats_.entries += entries;
+		stats_.actions += plan.actions.size();
+		stats_.conflicts += conflicts;
+		stats_.elapsed = fz::monotonic_clock::now() - start;
+
+		if (!plan.actions.empty()) {
+			while (pending_actions_ >= max_pending_actions && !stop_) {
+				cond_.wait(l);
+			}
+			if (stop_) {
+				break;
+			}
+
+			pending_actions_ += plan.actions.size();
+			planned_.emplace_back(std::move(plan));
+
+			// Hand off to GUI thread
+			if (planned_.size() == 1) {
+				l.unlock();
+				on_planned_directory();
+			}
+		}
+	}
+
+	{
+		fz::scoped_lock l(mutex_);
+		stats_.elapsed = fz::monotonic_clock::now() - start;
+		finished_ = true;
+	}
+	on_planned_directory();
+}
+
+void sync_operation::plan_directory(comparison_tree && local, comparison_tree && remote, options const& o, directory_plan & plan, std::vector<subdir> & subdirs, uint64_t & conflicts)
+{
+	directory_comparison::options co;
+	co.compare_mode = directory_comparison::mode::date;
+	co.threshold = o.threshold;
+	co.fold_case = o.fold_case;
+
+	auto const res = directory_comparison::compare(std::move(local), std::move(remote), co);
+	if (!res) {
+		return;
+	}
+
+	bool const upload = o.dir != direction::download;
+	bool const download = o.dir != direction::upload;
+	bool const mirror = o.mirror && o.dir != direction::newer;
+
+	auto const fold = [&o](std::wstring const& name) {
+		return o.fold_case ? fz::str_tolower(name) : name;
+	};
+
+	// A file on one side and a directory of the same name on the other side cannot be synchronized
+	std::set<std::wstring> localOnly;
+	std::set<std::wstring> conflicting;
+	for (size_t i = 0; i < res->size(); ++i) {
+		if ((*res)[i].state == directory_comparison::status::left_only) {
+			localOnly.insert(fold(res->path(i)));
+		}
+	}
+	if (!localOnly.empty()) {
+		for (size_t i = 0; i < res->size(); ++i) {
+			if ((*res)[i].state == directory_comparison::status::right_only) {
+				auto name = fold(res->path(i));
+				if (localOnly.find(name) != localOnly.end()) {
+					conflicting.insert(std::move(name));
+				}
+			}
+		}
+	}
+
+	// Nothing is known about the contents of unlisted directories, so nothing in them may be deleted
+	auto const unlisted = [](comparison_tree const& tree, std::wstring const& path) {
+		for (auto const& dir : tree.unlisted) {
+			if (fz::starts_with(path, dir) && (path.size() == dir.size() || path[dir.size()] == '/')) {
+				return true;
+			}
+		}
+		return false;
+	};
+
+	auto const add = [&plan](action_type type, comparison_tree::entry const& e, std::wstring const& target = std::wstring()) {
+		action a;
+		a.type = type;
+		a.name = e.path;
+		if (target != e.path) {
+			a.target = target;
+		}
+		a.size = e.size;
+		a.dir = e.dir;
+		plan.actions.emplace_back(std::move(a));
+	};
+
+	for (size_t i = 0; i < res->size(); ++i) {
+		auto const state = (*res)[i].state;
+		auto const* l = res->left(i);
+		auto const* r = res->right(i);
+
+		switch (state) {
+		case directory_comparison::status::left_only:
+			if (!conflicting.empty() && conflicting.find(fold(l->path)) != conflicting.end()) {
+				++conflicts;
+			}
+			else if (upload) {
+				if (l->dir) {
+					subdirs.push_back({l->path, true, false});
+				}
+				else {
+					add(action_type::upload, *l);
+				}
+			}
+			else if (mirror && !unlisted(res->right_tree(), l->path)) {
+				add(action_type::delete_local, *l);
+			}
+			break;
+		case directory_comparison::status::right_only:
+			if (!conflicting.empty() && conflicting.find(fold(r->path)) != conflicting.end()) {
+				// Already counted for the local side
+			}
+			else if (download) {
+				if (r->dir) {
+					subdirs.push_back({r->path, false, true});
+				}
+				else {
+					add(action_type::download, *r);
+				}
+			}
+			else if (mirror && !unlisted(res->left_tree(), r->path)) {
+				add(action_type::delete_remote, *r);
+			}
+			break;
+		default:
+			if (l->dir) {
+				subdirs.push_back({l->path, true, true});
+			}
+			else if (o.dir == direction::newer) {
+				if (state == directory_comparison::status::left_newer) {
+					add(action_type::upload, *l, r->path);
+				}
+				else if (state == directory_comparison::status::right_newer) {
+					add(action_type::download, *r, l->path);
+				}
+			}
+			else {
+				bool const sizeDiffers = l->size != r->size;
+				if (upload) {
+					if (sizeDiffers || (o.compare_dates && state == directory_comparison::status::left_newer)) {
+						add(action_type::upload, *l, r->path);
+					}
+				}
+				else if (sizeDiffers || (o.compare_dates && state == directory_comparison::status::right_newer)) {
+					add(action_type::download, *r, l->path);
+				}
+			}
+			break;
+		}
+	}
+}
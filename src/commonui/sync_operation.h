@@ -0,0 +1,161 @@
+#ifndef FILEZILLA_COMMONUI_SYNC_OPERATION_HEADER
+#define FILEZILLA_COMMONUI_SYNC_OPERATION_HEADER
+
+#include "../include/directorylisting.h"
+#include "../include/local_path.h"
+#include "../include/serverpath.h"
+
+#include "directory_comparison.h"
+#include "filter.h"
+#include "visibility.h"
+
+#include <libfilezilla/mutex.hpp>
+#include <libfilezilla/thread_pool.hpp>
+#include <libfilezilla/time.hpp>
+
+#include <atomic>
+#include <deque>
+#include <functional>
+#include <string>
+#include <vector>
+
+// Plans the synchronization of a local and a remote directory tree.
+//
+// Directory pairs are visited depth-first on a worker thread. The local side
+// is enumerated directly, remote listings are taken from the directory cache.
+// Each pair is compared on its own and the resulting plan is handed off to the
+// main thread. Memory use thus depends on the depth and width of the trees,
+// not on their total size. If the main thread falls behind, the worker waits.
+class FZCUI_PUBLIC_SYMBOL sync_operation
+{
+public:
+	enum class direction
+	{
+		upload,
+		download,
+		newer // Transfer in whichever direction the file is newer
+	};
+
+	class options final
+	{
+	public:
+		direction dir{direction::upload};
+
+		// Delete files and directories on the target side that do not exist on the source side.
+		// Ignored with direction::newer.
+		bool mirror{};
+
+		// If false, only sizes are compared
+		bool compare_dates{true};
+		fz::duration threshold;
+
+		bool fold_case{};
+
+		ActiveFilters filters;
+	};
+
+	enum class action_type : unsigned char
+	{
+		upload,
+		download,
+		delete_local,
+		delete_remote
+	};
+
+	class action final
+	{
+	public:
+		action_type type{};
+		std::wstring name;
+		std::wstring target; // Empty if same as name
+		int64_t size{-1};
+		bool dir{};
+	};
+
+	class directory_plan final
+	{
+	public:
+		CLocalPath localPath;
+		CServerPath remotePath;
+		std::vector<action> actions;
+	};
+
+	class subdir final
+	{
+	public:
+		std::wstring name;
+		bool local{};
+		bool remote{};
+	};
+
+	class stats final
+	{
+	public:
+		uint64_t directories{};
+		uint64_t entries{};
+		uint64_t actions{};
+		uint64_t unreadable_directories{}; // Local directories that could not be listed, nothing in them gets synchronized
+		uint64_t conflicts{};
+		fz::duration elapsed;
+
+		uint64_t entries_per_second() const;
+	};
+
+	// Looks up a remote listing, returns false if it is not available.
+	// A missing listing fails the synchronization, the caller has to list
+	// the remote tree beforehand. Called from the worker thread.
+	typedef std::function<bool(CServerPath const&, CDirectoryListing&)> remote_lister;
+
+	explicit sync_operation(fz::thread_pool& pool);
+	virtual ~sync_operation();
+
+	bool start(CLocalPath const& localRoot, CServerPath const& remoteRoot, options const& o, remote_lister && lister);
+	virtual void stop();
+
+	bool active() const { return active_; }
+
+	// May be called at any time to report planning progress
+	stats get_stats() const;
+
+	// If planning had to be aborted, returns the directory that could not be listed
+	std::wstring failed_directory() const;
+
+	// Compares the contents of a single directory pair. Subdirectories that need to
+	// be visited are appended to subdirs.
+	static void plan_directory(comparison_tree && local, comparison_tree && remote, options const& o, directory_plan & plan, std::vector<subdir> & subdirs, uint64_t & conflicts);
+
+protected:
+	// Called from the worker thread if plans become available or planning has finished
+	virtual void on_planned_directory() = 0;
+
+	// Moves planned directories into plans, up to about max_actions actions.
+	// Returns true once planning has finished and all plans have been taken.
+	bool take_plans(std::vector<directory_plan> & plans, size_t max_actions);
+
+	void thread_entry();
+
+	// Called from the worker thread, discards all plans not yet taken
+	void fail(std::wstring const& directory);
+
+	fz::thread_pool& pool_;
+	fz::async_task thread_;
+
+	mutable fz::mutex mutex_;
+	fz::condition cond_;
+
+	CLocalPath localRoot_;
+	CServerPath remoteRoot_;
+	options options_;
+	remote_lister lister_;
+
+	std::deque<directory_plan> planned_;
+	size_t pending_actions_{};
+	bool finished_{};
+	stats stats_;
+	std::wstring failed_directory_;
+
+	std::atomic<bool> stop_{};
+	bool active_{};
+};
+
+#endif
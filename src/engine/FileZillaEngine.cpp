@@ -26,6 +26,16 @@ std::unique_ptr<CNotification> CFileZillaEngine::GetNextNotification()
 	return impl_->GetNextNotification();
 }
 
+bool CFileZillaEngine::GetNotifications(std::vector<std::unique_ptr<CNotification>> & notifications)
+{
+	return impl_->GetNotifications(notifications);
+}
+
+CNotificationStats CFileZillaEngine::GetNotificationStats()
+{
+	return impl_->GetNotificationStats();
+}
+
 bool CFileZillaEngine::SetAsyncRequestReply(std::unique_ptr<CAsyncRequestNotification> && pNotification)
 {
 	return impl_->SetAsyncRequestReply(std::move(pNotification));
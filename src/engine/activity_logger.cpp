@@ -35,3 +35,14 @@ void activity_logger::set_notifier(std::function<void()> && notification_cb)
 		waiting_ = true;
 	}
 }
+
+void activity_logger::record_decoding(uint64_t encoded, uint64_t decoded)
+{
+	decoding_[0] += encoded;
+	decoding_[1] += decoded;
+}
+
+std::pair<uint64_t, uint64_t> activity_logger::decoding_totals() const
+{
+	return std::make_pair(decoding_[0].load(), decoding_[1].load());
+}
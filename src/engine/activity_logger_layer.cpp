@@ -15,6 +15,7 @@ activity_logger_layer::~activity_logger_layer()
 
 int activity_logger_layer::read(void* buffer, unsigned int size, int& error)
 {
+	++calls_;
 	int const read = next_layer_.read(buffer, size, error);
 	if (read > 0) {
 		activity_logger_.record(activity_logger::recv, read);
@@ -24,6 +25,7 @@ int activity_logger_layer::read(void* buffer, unsigned int size, int& error)
 
 int activity_logger_layer::write(void const* buffer, unsigned int size, int& error)
 {
+	++calls_;
 	int const written = next_layer_.write(buffer, size, error);
 	if (written > 0) {
 		activity_logger_.record(activity_logger::send, written);
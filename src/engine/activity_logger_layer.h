@@ -13,8 +13,12 @@ public:
 	virtual int read(void* buffer, unsigned int size, int& error) override;
 	virtual int write(void const* buffer, unsigned int size, int& error) override;
 
+	// Counts reads and writes. Allows telling whether a layer above passed a call through.
+	unsigned int calls() const { return calls_; }
+
 private:
 	activity_logger& activity_logger_;
+	unsigned int calls_{};
 };
 
 #endif
@@ -0,0 +1,387 @@
+#include "filezilla.h"
+
+#include "checksum.h"
+#include "engineprivate.h"
+
+#include <libfilezilla/encode.hpp>
+
+#include <algorithm>
+
+#include <zlib.h>
+
+std::wstring checksum_name(checksum_algorithm alg)
+{
+	switch (alg) {
+	case checksum_algorithm::crc32:
+		return L"CRC32";
+	case checksum_algorithm::md5:
+		return L"MD5";
+	case checksum_algorithm::sha1:
+		return L"SHA-1";
+	case checksum_algorithm::sha256:
+		return L"SHA-256";
+	case checksum_algorithm::sha512:
+		return L"SHA-512";
+	default:
+		break;
+	}
+	return std::wstring();
+}
+
+checksum_algorithm checksum_from_name(std::wstring_view name)
+{
+	std::wstring n = fz::str_toupper_ascii(name);
+	n.erase(std::remove(n.begin(), n.end(), '-'), n.end());
+	if (n == L"CRC32") {
+		return checksum_algorithm::crc32;
+	}
+	else if (n == L"MD5") {
+		return checksum_algorithm::md5;
+	}
+	else if (n == L"SHA1") {
+		return checksum_algorithm::sha1;
+	}
+	else if (n == L"SHA256") {
+		return checksum_algorithm::sha256;
+	}
+	else if (n == L"SHA512") {
+		return checksum_algorithm::sha512;
+	}
+	return checksum_algorithm::none;
+}
+
+namespace {
+size_t digest_size(checksum_algorithm alg)
+{
+	switch (alg) {
+	case checksum_algorithm::crc32:
+		return 4;
+	case checksum_algorithm::md5:
+		return 16;
+	case checksum_algorithm::sha1:
+		return 20;
+	case checksum_algorithm::sha256:
+		return 32;
+	case checksum_algorithm::sha512:
+		return 64;
+	default:
+		break;
+	}
+	return 0;
+}
+}
+
+checksum_accumulator::checksum_accumulator(checksum_algorithm alg)
+	: alg_(alg)
+{
+	switch (alg) {
+	case checksum_algorithm::crc32:
+		crc_ = ::crc32(0L, Z_NULL, 0);
+		break;
+	case checksum_algorithm::md5:
+		hash_ = std::make_unique<fz::hash_accumulator>(fz::hash_algorithm::md5);
+		break;
+	case checksum_algorithm::sha1:
+		hash_ = std::make_unique<fz::hash_accumulator>(fz::hash_algorithm::sha1);
+		break;
+	case checksum_algorithm::sha256:
+		hash_ = std::make_unique<fz::hash_accumulator>(fz::hash_algorithm::sha256);
+		break;
+	case checksum_algorithm::sha512:
+		hash_ = std::make_unique<fz::hash_accumulator>(fz::hash_algorithm::sha512);
+		break;
+	default:
+		break;
+	}
+}
+
+void checksum_accumulator::update(unsigned char const* data, size_t len)
+{
+	if (!len || finished_) {
+		return;
+	}
+
+	size_ += len;
+	if (hash_) {
+		hash_->update(data, len);
+	}
+	else if (alg_ == checksum_algorithm::crc32) {
+		// zlib takes the length as unsigned int
+		while (len) {
+			uInt const chunk = static_cast<uInt>(std::min(len, size_t(1024 * 1024 * 1024)));
+			crc_ = ::crc32(crc_, data, chunk);
+			data += chunk;
+			len -= chunk;
+		}
+	}
+}
+
+std::vector<uint8_t> const& checksum_accumulator::digest()
+{
+	if (!finished_) {
+		finished_ = true;
+		if (hash_) {
+			digest_ = hash_->digest();
+		}
+		else if (alg_ == checksum_algorithm::crc32) {
+			digest_ = {
+				static_cast<uint8_t>(crc_ >> 24),
+				static_cast<uint8_t>(crc_ >> 16),
+				static_cast<uint8_t>(crc_ >> 8),
+				static_cast<uint8_t>(crc_)
+			};
+		}
+	}
+	return digest_;
+}
+
+namespace {
+class checksum_writer final : public writer_base, public fz::event_handler
+{
+public:
+	checksum_writer(CFileZillaEnginePrivate & engine, fz::event_handler * handler, std::unique_ptr<writer_base> && writer, std::shared_ptr<checksum_accumulator> const& checksum)
+		: writer_base(writer->name(), engine, handler, false)
+		, fz::event_handler(engine.event_loop_)
+		, writer_(std::move(writer))
+		, checksum_(checksum)
+	{
+		writer_->set_handler(this);
+	}
+
+	~checksum_writer()
+	{
+		writer_.reset();
+		remove_handler();
+	}
+
+	virtual uint64_t size() const override
+	{
+		return writer_->size();
+	}
+
+	virtual aio_result preallocate(uint64_t size) override
+	{
+		return writer_->preallocate(size);
+	}
+
+	// The inner writer takes ownership of the written buffer in all three,
+	// so each buffer gets hashed exactly once.
+	virtual get_write_buffer_result get_write_buffer(fz::nonowning_buffer & last_written) override
+	{
+		checksum_->update(last_written.get(), last_written.size());
+		return writer_->get_write_buffer(last_written);
+	}
+
+	virtual aio_result retire(fz::nonowning_buffer & last_written) override
+	{
+		checksum_->update(last_written.get(), last_written.size());
+		return writer_->retire(last_written);
+	}
+
+	virtual aio_result finalize(fz::nonowning_buffer & last_written) override
+	{
+		checksum_->update(last_written.get(), last_written.size());
+		return writer_->finalize(last_written);
+	}
+
+private:
+	virtual void operator()(fz::event_base const&) override
+	{
+		if (handler_) {
+			handler_->operator()(write_ready_event(this));
+		}
+	}
+
+	std::unique_ptr<writer_base> writer_;
+	std::shared_ptr<checksum_accumulator> checksum_;
+};
+
+class checksum_reader final : public reader_base, public fz::event_handler
+{
+public:
+	checksum_reader(CFileZillaEnginePrivate & engine, fz::event_handler * handler, std::unique_ptr<reader_base> && reader, std::shared_ptr<checksum_accumulator> const& checksum)
+		: reader_base(reader->name(), engine, handler)
+		, fz::event_handler(engine.event_loop_)
+		, reader_(std::move(reader))
+		, checksum_(checksum)
+	{
+		reader_->set_handler(this);
+		size_ = reader_->size();
+	}
+
+	~checksum_reader()
+	{
+		reader_.reset();
+		remove_handler();
+	}
+
+	virtual aio_result seek(uint64_t, uint64_t = aio_base::nosize) override
+	{
+		return aio_result::error;
+	}
+
+	virtual read_result read() override
+	{
+		read_result ret = reader_->read();
+		if (ret.type_ == aio_result::ok) {
+			checksum_->update(ret.buffer_.get(), ret.buffer_.size());
+		}
+		return ret;
+	}
+
+private:
+	virtual void operator()(fz::event_base const&) override
+	{
+		if (handler_) {
+			handler_->operator()(read_ready_event(this));
+		}
+	}
+
+	std::unique_ptr<reader_base> reader_;
+	std::shared_ptr<checksum_accumulator> checksum_;
+};
+}
+
+std::unique_ptr<writer_base> make_checksum_writer(CFileZillaEnginePrivate & engine, fz::event_handler * handler, std::unique_ptr<writer_base> && writer, std::shared_ptr<checksum_accumulator> const& checksum)
+{
+	if (!writer || !checksum) {
+		return std::move(writer);
+	}
+	return std::make_unique<checksum_writer>(engine, handler, std::move(writer), checksum);
+}
+
+std::unique_ptr<reader_base> make_checksum_reader(CFileZillaEnginePrivate & engine, fz::event_handler * handler, std::unique_ptr<reader_base> && reader, std::shared_ptr<checksum_accumulator> const& checksum)
+{
+	if (!reader || !checksum) {
+		return std::move(reader);
+	}
+	return std::make_unique<checksum_reader>(engine, handler, std::move(reader), checksum);
+}
+
+bool VerifyChecksum(CFileZillaEnginePrivate & engine, checksum_accumulator & checksum, std::vector<uint8_t> const& remote)
+{
+	std::wstring const name = checksum_name(checksum.algorithm());
+	auto const& local = checksum.digest();
+
+	bool const matched = local == remote;
+	engine.AddNotification(std::make_unique<CChecksumNotification>(name, matched));
+	if (!matched) {
+		engine.GetLogger().log(logmsg::error, _("%s checksum mismatch, local file: %s, server: %s"), name, fz::hex_encode<std::wstring>(local), fz::hex_encode<std::wstring>(remote));
+		return false;
+	}
+
+	engine.GetLogger().log(logmsg::status, _("%s checksum verified: %s"), name, fz::hex_encode<std::wstring>(local));
+	return true;
+}
+
+bool ParseChecksumReply(std::wstring const& reply, checksum_algorithm alg, std::vector<uint8_t> & digest)
+{
+	size_t const size = digest_size(alg);
+	if (!size || reply.size() < 4 || reply[0] != '2') {
+		return false;
+	}
+
+	// HASH replies with "213 SHA-256 0-49 <hex> <filename>", the X commands
+	// with the plain hex value. Take the first token of the right length.
+	for (auto token : fz::strtok_view(std::wstring_view(reply).substr(4), L" ")) {
+		if (token.size() > 2 && (token.substr(0, 2) == L"0x" || token.substr(0, 2) == L"0X")) {
+			token = token.substr(2);
+		}
+
+		// Some servers drop the leading zeroes of CRCs
+		size_t const max = size * 2;
+		size_t const min = alg == checksum_algorithm::crc32 ? 1 : max;
+		if (token.size() < min || token.size() > max) {
+			continue;
+		}
+
+		std::vector<uint8_t> value(size);
+		size_t pos = max - token.size();
+		bool valid = true;
+		for (auto const& c : token) {
+			int const v = fz::hex_char_to_int(c);
+			if (v < 0) {
+				valid = false;
+				break;
+			}
+			value[pos / 2] |= (pos % 2) ? v : (v << 4);
+			++pos;
+		}
+		if (valid) {
+			digest = std::move(value);
+			return true;
+		}
+	}
+
+	return false;
+}
+
+namespace {
+checksum_algorithm http_digest_algorithm(std::string_view name)
+{
+	// RFC 3230 calls SHA-1 just SHA
+	if (fz::equal_insensitive_ascii(name, std::string_view("sha"))) {
+		return checksum_algorithm::sha1;
+	}
+	auto const alg = checksum_from_name(fz::to_wstring(name));
+	if (alg == checksum_algorithm::crc32) {
+		return checksum_algorithm::none;
+	}
+	return alg;
+}
+
+void parse_http_digests(std::string_view const& header, std::vector<std::pair<checksum_algorithm, std::vector<uint8_t>>> & digests)
+{
+	for (auto item : fz::strtok_view(header, ",")) {
+		item = fz::trimmed(item);
+		size_t const pos = item.find('=');
+		if (pos == std::string_view::npos) {
+			continue;
+		}
+
+		auto const alg = http_digest_algorithm(fz::trimmed(item.substr(0, pos)));
+		if (alg == checksum_algorithm::none) {
+			continue;
+		}
+
+		// Repr-Digest uses structured fields, the value being a byte
+		// sequence enclosed in colons, possibly followed by parameters
+		auto value = fz::trimmed(item.substr(pos + 1));
+		if (!value.empty() && value[0] == ':') {
+			value = value.substr(1);
+			value = value.substr(0, value.find(':'));
+		}
+		else {
+			value = value.substr(0, value.find(';'));
+		}
+
+		auto decoded = fz::base64_decode(value);
+		if (decoded.size() == digest_size(alg)) {
+			digests.emplace_back(alg, std::move(decoded));
+		}
+	}
+}
+}
+
+checksum_algorithm ParseHttpDigest(std::string_view const& repr_digest, std::string_view const& digest, std::string_view const& content_md5, std::vector<uint8_t> & out)
+{
+	std::vector<std::pair<checksum_algorithm, std::vector<uint8_t>>> digests;
+	parse_http_digests(repr_digest, digests);
+	parse_http_digests(digest, digests);
+
+	auto md5 = fz::base64_decode(fz::trimmed(content_md5));
+	if (md5.size() == digest_size(checksum_algorithm::md5)) {
+		digests.emplace_back(checksum_algorithm::md5, std::move(md5));
+	}
+
+	for (auto alg : {checksum_algorithm::sha512, checksum_algorithm::sha256, checksum_algorithm::sha1, checksum_algorithm::md5}) {
+		for (auto & d : digests) {
+			if (d.first == alg) {
+				out = std::move(d.second);
+				return alg;
+			}
+		}
+	}
+
+	return checksum_algorithm::none;
+}
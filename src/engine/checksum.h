@@ -0,0 +1,76 @@
+#ifndef FILEZILLA_ENGINE_CHECKSUM_HEADER
+#define FILEZILLA_ENGINE_CHECKSUM_HEADER
+
+#include "../include/reader.h"
+#include "../include/writer.h"
+
+#include <libfilezilla/hash.hpp>
+
+#include <string_view>
+
+enum class checksum_algorithm
+{
+	none,
+	crc32,
+	md5,
+	sha1,
+	sha256,
+	sha512
+};
+
+// Names as used by the FTP HASH command, e.g. "SHA-256"
+std::wstring FZC_PUBLIC_SYMBOL checksum_name(checksum_algorithm alg);
+
+// Case-insensitive, the dash is optional
+checksum_algorithm FZC_PUBLIC_SYMBOL checksum_from_name(std::wstring_view name);
+
+/*
+ * Computes a checksum incrementally. Gets shared between the hashing
+ * reader or writer and the operation comparing the result.
+ */
+class FZC_PUBLIC_SYMBOL checksum_accumulator final
+{
+public:
+	explicit checksum_accumulator(checksum_algorithm alg);
+
+	checksum_accumulator(checksum_accumulator const&) = delete;
+	checksum_accumulator& operator=(checksum_accumulator const&) = delete;
+
+	void update(unsigned char const* data, size_t len);
+
+	// Once called, further updates are ignored
+	std::vector<uint8_t> const& digest();
+
+	checksum_algorithm algorithm() const { return alg_; }
+
+	// Number of bytes hashed
+	uint64_t size() const { return size_; }
+
+private:
+	checksum_algorithm const alg_;
+	std::unique_ptr<fz::hash_accumulator> hash_;
+	unsigned long crc_{};
+	uint64_t size_{};
+
+	bool finished_{};
+	std::vector<uint8_t> digest_;
+};
+
+// Wrap a reader or writer, hashing the buffers passing through them.
+// Readers wrapped this way cannot seek.
+std::unique_ptr<writer_base> FZC_PUBLIC_SYMBOL make_checksum_writer(CFileZillaEnginePrivate & engine, fz::event_handler * handler, std::unique_ptr<writer_base> && writer, std::shared_ptr<checksum_accumulator> const& checksum);
+std::unique_ptr<reader_base> FZC_PUBLIC_SYMBOL make_checksum_reader(CFileZillaEnginePrivate & engine, fz::event_handler * handler, std::unique_ptr<reader_base> && reader, std::shared_ptr<checksum_accumulator> const& checksum);
+
+// Compares the local digest with the one reported by the server, logs the
+// outcome and notifies the client. Returns true if they match.
+bool FZC_PUBLIC_SYMBOL VerifyChecksum(CFileZillaEnginePrivate & engine, checksum_accumulator & checksum, std::vector<uint8_t> const& remote);
+
+// Extracts the digest from the reply to the FTP HASH command or to one of
+// XCRC, XMD5, XSHA1, XSHA256 and XSHA512
+bool FZC_PUBLIC_SYMBOL ParseChecksumReply(std::wstring const& reply, checksum_algorithm alg, std::vector<uint8_t> & digest);
+
+// Picks the strongest digest from the values of the Repr-Digest, Digest
+// and Content-MD5 headers of a HTTP response, any of which may be empty.
+checksum_algorithm FZC_PUBLIC_SYMBOL ParseHttpDigest(std::string_view const& repr_digest, std::string_view const& digest, std::string_view const& content_md5, std::vector<uint8_t> & out);
+
+#endif
@@ -3,6 +3,7 @@
 #include "controlsocket.h"
 #include "directorycache.h"
 #include "engineprivate.h"
+#include "happy_eyeballs.h"
 #include "lookup.h"
 #include "logging_private.h"
 #include "proxy.h"
@@ -219,7 +220,9 @@ int CControlSocket::ResetOperation(int nErrorCode)
 		oldOperation.reset();
 	}
 
-	engine_.transfer_status_.Reset();
+	if (!secondary_) {
+		engine_.transfer_status_.Reset();
+	}
 
 	if (m_invalidateCurrentPath) {
 		currentPath_.clear();
@@ -228,6 +231,9 @@ int CControlSocket::ResetOperation(int nErrorCode)
 
 	if (operations_.empty()) {
 		SetWait(false);
+		if (secondary_) {
+			return nErrorCode;
+		}
 		return engine_.ResetOperation(nErrorCode);
 	}
 	else {
@@ -309,6 +315,19 @@ CServer const& CControlSocket::GetCurrentServer() const
 	return currentServer_;
 }
 
+CCapabilities& CControlSocket::GetCapabilities() const
+{
+	if (!capabilities_) {
+		capabilities_ = &CServerCapabilities::Get(currentServer_);
+	}
+	return *capabilities_;
+}
+
+void CControlSocket::ResolveCapabilities()
+{
+	capabilities_ = &CServerCapabilities::Get(currentServer_);
+}
+
 bool CControlSocket::ParsePwdReply(std::wstring reply, CServerPath const& defaultPath)
 {
 	size_t pos1 = reply.find('"');
@@ -680,7 +699,7 @@ fz::duration CControlSocket::GetInferredTimezoneOffset() const
 	fz::duration ret;
 	if (currentServer_) {
 		int seconds = 0;
-		if (CServerCapabilities::GetCapability(currentServer_, inferred_timezone_offset, &seconds) == yes) {
+		if (GetCapabilities().GetCapability(inferred_timezone_offset, &seconds) == yes) {
 			ret = fz::duration::from_seconds(seconds);
 		}
 	}
@@ -751,9 +770,10 @@ int CRealControlSocket::Send(unsigned char const* buffer, unsigned int len)
 
 void CRealControlSocket::operator()(fz::event_base const& ev)
 {
-	if (!fz::dispatch<fz::socket_event, fz::hostaddress_event>(ev, this,
+	if (!fz::dispatch<fz::socket_event, fz::hostaddress_event, CHappyEyeballsEvent>(ev, this,
 		&CRealControlSocket::OnSocketEvent,
-		&CRealControlSocket::OnHostAddress))
+		&CRealControlSocket::OnHostAddress,
+		&CRealControlSocket::OnHappyEyeballs))
 	{
 		CControlSocket::operator()(ev);
 	}
@@ -869,45 +889,94 @@ int CRealControlSocket::DoConnect(std::wstring const& host, unsigned int port)
 	}
 
 	ResetSocket();
-	socket_ = std::make_unique<fz::socket>(engine_.GetThreadPool(), nullptr);
-	activity_logger_layer_ = std::make_unique<activity_logger_layer>(nullptr, *socket_, engine_.activity_logger_);
-	ratelimit_layer_ = std::make_unique<fz::rate_limited_layer>(this, *activity_logger_layer_, &engine_.GetRateLimiter());
-	active_layer_ = ratelimit_layer_.get();
+	happy_eyeballs_ = std::make_unique<CHappyEyeballs>(event_loop_, *this, engine_.GetThreadPool(), engine_.GetContext().GetResolverCache(), logger_);
+
+	fz::native_string connect_host;
+	unsigned int connect_port;
 
 	const int proxy_type = engine_.GetOptions().get_int(OPTION_PROXY_TYPE);
 	if (proxy_type > static_cast<int>(ProxyType::NONE) && proxy_type < static_cast<int>(ProxyType::count) && !currentServer_.GetBypassProxy()) {
 		log(logmsg::status, _("Connecting to %s through %s proxy"), currentServer_.Format(ServerFormat::with_optional_port), CProxySocket::Name(static_cast<ProxyType>(proxy_type)));
 
-		fz::native_string proxy_host = fz::to_native(engine_.GetOptions().get_string(OPTION_PROXY_HOST));
-
-		proxy_layer_ = std::make_unique<CProxySocket>(this, *active_layer_, this, static_cast<ProxyType>(proxy_type),
-			proxy_host, engine_.GetOptions().get_int(OPTION_PROXY_PORT),
-			engine_.GetOptions().get_string(OPTION_PROXY_USER),
-			engine_.GetOptions().get_string(OPTION_PROXY_PASS));
-		active_layer_ = proxy_layer_.get();
-
-		if (fz::get_address_type(proxy_host) == fz::address_type::unknown) {
-			log(logmsg::status, _("Resolving address of %s"), proxy_host);
-		}
+		connect_host = fz::to_native(engine_.GetOptions().get_string(OPTION_PROXY_HOST));
+		connect_port = engine_.GetOptions().get_int(OPTION_PROXY_PORT);
+		proxy_target_host_ = ConvertDomainName(host);
+		proxy_target_port_ = port;
 	}
 	else {
-		if (fz::get_address_type(host) == fz::address_type::unknown) {
-			log(logmsg::status, _("Resolving address of %s"), host);
-		}
+		connect_host = fz::to_native(ConvertDomainName(host));
+		connect_port = port;
+		proxy_target_host_.clear();
+		proxy_target_port_ = 0;
 	}
 
-	SetSocketBufferSizes();
+	if (fz::get_address_type(connect_host) == fz::address_type::unknown && engine_.GetContext().GetResolverCache().Lookup(connect_host).empty()) {
+		log(logmsg::status, _("Resolving address of %s"), connect_host);
+	}
 
-	int res = active_layer_->connect(fz::to_native(ConvertDomainName(host)), port);
+	SetSocketBufferSizes();
 
+	int res = happy_eyeballs_->connect(connect_host, connect_port);
 	if (res) {
+		happy_eyeballs_.reset();
 		log(logmsg::error, _("Could not connect to server: %s"), fz::socket_error_description(res));
-		return FZ_REPLY_DISCONNECTED | FZ_REPLY_ERROR; 
+		return FZ_REPLY_DISCONNECTED | FZ_REPLY_ERROR;
 	}
 
 	return FZ_REPLY_WOULDBLOCK;
 }
 
+void CRealControlSocket::OnHappyEyeballs(int error)
+{
+	if (!happy_eyeballs_) {
+		return;
+	}
+
+	if (error) {
+		happy_eyeballs_.reset();
+		OnSocketError(error);
+		return;
+	}
+
+	socket_ = happy_eyeballs_->take_socket();
+	fz::native_string const connected_host = happy_eyeballs_->host();
+	happy_eyeballs_.reset();
+	if (!socket_) {
+		OnSocketError(ECONNABORTED);
+		return;
+	}
+
+	fz::socket_interface* bottom = socket_.get();
+	if (proxy_target_host_.empty()) {
+		// The socket is connected to an address, upper layers need to see the name
+		hostname_layer_ = std::make_unique<hostname_layer>(nullptr, *socket_, connected_host);
+		bottom = hostname_layer_.get();
+	}
+	activity_logger_layer_ = std::make_unique<activity_logger_layer>(nullptr, *bottom, engine_.activity_logger_);
+	ratelimit_layer_ = std::make_unique<fz::rate_limited_layer>(this, *activity_logger_layer_, &engine_.GetRateLimiter());
+	active_layer_ = ratelimit_layer_.get();
+
+	if (proxy_target_host_.empty()) {
+		OnConnect();
+		return;
+	}
+
+	log(logmsg::status, _("Connection with proxy established, performing handshake..."));
+
+	const int proxy_type = engine_.GetOptions().get_int(OPTION_PROXY_TYPE);
+	proxy_layer_ = std::make_unique<CProxySocket>(this, *active_layer_, this, static_cast<ProxyType>(proxy_type),
+		connected_host, engine_.GetOptions().get_int(OPTION_PROXY_PORT),
+		engine_.GetOptions().get_string(OPTION_PROXY_USER),
+		engine_.GetOptions().get_string(OPTION_PROXY_PASS));
+	active_layer_ = proxy_layer_.get();
+
+	int res = proxy_layer_->connect(fz::to_native(proxy_target_host_), proxy_target_port_);
+	if (res) {
+		log(logmsg::error, _("Could not connect to server: %s"), fz::socket_error_description(res));
+		DoClose();
+	}
+}
+
 int CRealControlSocket::DoClose(int nErrorCode)
 {
 	log(logmsg::debug_debug, L"CRealControlSocket::DoClose(%d)", nErrorCode);
@@ -920,10 +989,13 @@ void CRealControlSocket::ResetSocket()
 {
 	active_layer_ = nullptr;
 
+	happy_eyeballs_.reset();
+
 	// Destroy in reverse order
 	proxy_layer_.reset();
 	ratelimit_layer_.reset();
 	activity_logger_layer_.reset();
+	hostname_layer_.reset();
 	socket_.reset();
 
 	send_buffer_.clear();
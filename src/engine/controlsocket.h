@@ -8,6 +8,7 @@
 
 #include "logging_private.h"
 #include "oplock_manager.h"
+#include "servercapabilities.h"
 
 #include <libfilezilla/buffer.hpp>
 #include <libfilezilla/socket.hpp>
@@ -222,6 +223,9 @@ public:
 
 	CServer const& GetCurrentServer() const;
 
+	// Capabilities of the current server, shared with all connections to the same server
+	CCapabilities& GetCapabilities() const;
+
 	// Conversion function which convert between local and server charset.
 	std::wstring ConvToLocal(char const* buffer, size_t len);
 	std::string ConvToServer(std::wstring const&, bool force_utf8 = false);
@@ -298,12 +302,16 @@ protected:
 
 	virtual void Push(std::unique_ptr<COpData> && pNewOpData);
 
+	// Needs to be called whenever currentServer_ changes
+	void ResolveCapabilities();
+
 	OpLock Lock(locking_reason reason, CServerPath const& path, bool inclusive = false);
 
 	std::vector<std::unique_ptr<COpData>> operations_;
 	CFileZillaEnginePrivate & engine_;
 	CServer currentServer_;
 	Credentials credentials_;
+	mutable CCapabilities* capabilities_{};
 
 	CServerPath currentPath_;
 
@@ -318,6 +326,11 @@ protected:
 	bool m_invalidateCurrentPath{};
 	ServerHandle handle_;
 
+	// Set on additional connections serving an operation of another control
+	// socket. The engine does not know of them, so their operations neither
+	// report to it nor reset its transfer status.
+	bool secondary_{};
+
 	fz::logger_interface& logger_;
 
 	virtual void operator()(fz::event_base const& ev);
@@ -327,7 +340,9 @@ protected:
 };
 
 class activity_logger_layer;
+class CHappyEyeballs;
 class CProxySocket;
+class hostname_layer;
 
 namespace fz {
 class rate_limited_layer;
@@ -348,6 +363,7 @@ protected:
 	virtual void operator()(fz::event_base const& ev) override;
 	void OnSocketEvent(fz::socket_event_source* source, fz::socket_event_flag t, int error);
 	void OnHostAddress(fz::socket_event_source* source, std::string const& address);
+	void OnHappyEyeballs(int error);
 
 	virtual void OnConnect();
 	virtual void OnReceive();
@@ -361,7 +377,15 @@ protected:
 		return Send(reinterpret_cast<unsigned char const*>(buffer), len);
 	}
 
+	// Connects the socket, the layers are stacked once connected
+	std::unique_ptr<CHappyEyeballs> happy_eyeballs_;
+
+	// Where the proxy should connect to
+	std::wstring proxy_target_host_;
+	unsigned int proxy_target_port_{};
+
 	std::unique_ptr<fz::socket> socket_;
+	std::unique_ptr<hostname_layer> hostname_layer_;
 	std::unique_ptr<activity_logger_layer> activity_logger_layer_;
 	std::unique_ptr<fz::rate_limited_layer> ratelimit_layer_;
 	std::unique_ptr<CProxySocket> proxy_layer_;
@@ -293,6 +293,7 @@ bool CDirectoryCache::InvalidateFile(CServer const& server, CServerPath const& p
 					dir = true;
 				}
 				entry.listing.get(i).flags |= CDirentry::flag_unsure;
+				entry.listing.Modified(i);
 			}
 		}
 		entry.listing.m_flags |= CDirectoryListing::unsure_unknown;
@@ -339,6 +340,7 @@ bool CDirectoryCache::UpdateFile(CServer const& server, CServerPath const& path,
 		for (i = 0; i < entry.listing.size(); ++i) {
 			if (!fz::stricmp(filename, entry.listing[i].name)) {
 				entry.listing.get(i).flags |= CDirentry::flag_unsure;
+				entry.listing.Modified(i);
 				if (entry.listing[i].name == filename) {
 					matchCase = true;
 					break;
@@ -437,6 +439,7 @@ bool CDirectoryCache::RemoveFile(CServer const& server, CServerPath const& path,
 			for (size_t i = 0; i < entry.listing.size(); ++i) {
 				if (!fz::stricmp(filename, entry.listing[i].name)) {
 					entry.listing.get(i).flags |= CDirentry::flag_unsure;
+					entry.listing.Modified(i);
 				}
 			}
 			entry.listing.m_flags |= CDirectoryListing::unsure_invalid;
@@ -560,6 +563,7 @@ void CDirectoryCache::Rename(CServer const& server, CServerPath const& pathFrom,
 					listing.get(i).flags |= CDirentry::flag_unsure;
 					listing.m_flags |= CDirectoryListing::unsure_unknown;
 					listing.ClearFindMap();
+					listing.Modified(i);
 				}
 			}
 			return;
@@ -612,6 +616,7 @@ void CDirectoryCache::UpdateOwnerGroup(CServer const& server, CServerPath const&
 		if (i != listing.size()) {
 			if (!listing[i].is_dir()) {
 				listing.get(i).ownerGroup.get() = ownerGroup;
+				listing.Modified(i);
 				listing.ClearFindMap();
 			}
 			return;
@@ -67,7 +67,7 @@ inline LookupResults& operator|=(LookupResults & lhs, LookupResults rhs)
 	return lhs;
 }
 
-class CDirectoryCache final
+class FZC_PUBLIC_SYMBOL CDirectoryCache final
 {
 public:
 	enum Filetype
@@ -88,6 +88,10 @@ void CDirectoryListing::Assign(std::vector<fz::shared_value<CDirentry>> && entri
 
 	m_searchmap_case.clear();
 	m_searchmap_nocase.clear();
+
+	// Replaced as a whole, changes recorded so far no longer apply
+	m_changesStart = revision() + 1;
+	m_changes.clear();
 }
 
 bool CDirectoryListing::RemoveEntry(size_t index)
@@ -107,11 +111,51 @@ bool CDirectoryListing::RemoveEntry(size_t index)
 	else {
 		m_flags |= CDirectoryListing::unsure_file_removed;
 	}
+	RecordChange(change_type::removed, index);
 	entries.erase(iter);
 
 	return true;
 }
 
+namespace {
+// Upper bound of recorded changes. Keeps copying the log cheap if a
+// listing shared with the interface gets changed over and over.
+size_t const max_changes = 1024;
+}
+
+void CDirectoryListing::RecordChange(change_type type, size_t index)
+{
+	auto & changes = m_changes.get();
+	if (changes.size() >= max_changes) {
+		size_t const drop = changes.size() / 2;
+		changes.erase(changes.begin(), changes.begin() + drop);
+		m_changesStart += drop;
+	}
+
+	CDirentry const& entry = *(*m_entries)[index];
+	changes.push_back(change{type, entry.is_dir(), index, entry.name});
+}
+
+void CDirectoryListing::Modified(size_t index)
+{
+	if (index < size()) {
+		RecordChange(change_type::modified, index);
+	}
+}
+
+bool CDirectoryListing::GetChanges(uint64_t since, std::vector<change> & changes) const
+{
+	changes.clear();
+	if (since < m_changesStart || since > revision()) {
+		return false;
+	}
+
+	if (m_changes) {
+		changes.assign(m_changes->begin() + (since - m_changesStart), m_changes->end());
+	}
+	return true;
+}
+
 void CDirectoryListing::GetFilenames(std::vector<std::wstring> &names) const
 {
 	names.reserve(size());
@@ -210,7 +254,9 @@ void CDirectoryListing::ClearFindMap()
 
 void CDirectoryListing::Append(CDirentry&& entry)
 {
-	m_entries.get().emplace_back(entry);
+	auto & entries = m_entries.get();
+	entries.emplace_back(entry);
+	RecordChange(change_type::added, entries.size() - 1);
 }
 
 bool CheckInclusion(const CDirectoryListing& listing1, const CDirectoryListing& listing2)
@@ -8,6 +8,8 @@
 #include "logging_private.h"
 #include "oplock_manager.h"
 #include "pathcache.h"
+#include "resolver_cache.h"
+#include "tracer.h"
 
 #include <libfilezilla/event_loop.hpp>
 #include <libfilezilla/rate_limiter.hpp>
@@ -110,6 +112,8 @@ public:
 	CDirectoryCache directory_cache_;
 	CPathCache path_cache_;
 	OpLockManager opLockManager_;
+	CResolverCache resolver_cache_{pool_};
+	CTraceRegistry trace_registry_;
 	fz::tls_system_trust_store tlsSystemTrustStore_;
 	activity_logger activity_logger_;
 };
@@ -155,6 +159,21 @@ OpLockManager& CFileZillaEngineContext::GetOpLockManager()
 	return impl_->opLockManager_;
 }
 
+CResolverCache& CFileZillaEngineContext::GetResolverCache()
+{
+	return impl_->resolver_cache_;
+}
+
+CTraceRegistry& CFileZillaEngineContext::GetTraceRegistry()
+{
+	return impl_->trace_registry_;
+}
+
+std::string CFileZillaEngineContext::ExportTrace()
+{
+	return impl_->trace_registry_.Export();
+}
+
 fz::tls_system_trust_store& CFileZillaEngineContext::GetTlsSystemTrustStore()
 {
 	return impl_->tlsSystemTrustStore_;
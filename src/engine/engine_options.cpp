@@ -80,7 +80,12 @@ unsigned int register_engine_options()
 		{ "Size decimal places", 1, option_flags::numeric_clamp, 0, 3 },
 		{ "TCP Keepalive Interval", 15, option_flags::numeric_clamp, 1, 10000 },
 		{ "Cache TTL", 600, option_flags::numeric_clamp, 30, 60*60*24 },
-		{ "Minimum TLS Version", 2, option_flags::numeric_clamp, 0, 3 }
+		{ "Minimum TLS Version", 2, option_flags::numeric_clamp, 0, 3 },
+		{ "Trace buffer size", 0, option_flags::numeric_clamp, 0, 1000000 },
+		{ "HTTP range connections", 3, option_flags::numeric_clamp, 0, 10 },
+		{ "Verify checksums", true, option_flags::normal },
+		{ "SFTP delta upload minimum size", 64, option_flags::numeric_clamp, 0, 1024 * 1024 },
+		{ "Zero-copy transfers", true, option_flags::normal }
 	});
 	return value;
 }
@@ -67,6 +67,10 @@ CFileZillaEnginePrivate::CFileZillaEnginePrivate(CFileZillaEngineContext& contex
 	options_.watch(OPTION_LOGGING_SHOW_DETAILED_LOGS, this);
 	options_.watch(OPTION_LOGGING_DEBUGLEVEL, this);
 	options_.watch(OPTION_LOGGING_RAWLISTING, this);
+
+	tracer_.SetCapacity(static_cast<size_t>(options_.get_int(OPTION_TRACE_BUFFER_SIZE)));
+	context_.GetTraceRegistry().Register(tracer_, m_engine_id);
+	options_.watch(OPTION_TRACE_BUFFER_SIZE, this);
 }
 
 bool CFileZillaEnginePrivate::ShouldQueueLogsFromOptions() const
@@ -105,6 +109,8 @@ void CFileZillaEnginePrivate::shutdown()
 	options_.unwatch_all(this);
 	remove_handler();
 
+	context_.GetTraceRegistry().Unregister(tracer_);
+
 	{
 		fz::scoped_lock lock(notification_mutex_);
 		m_maySendNotificationEvent = false;
@@ -121,10 +127,9 @@ void CFileZillaEnginePrivate::shutdown()
 	{
 		fz::scoped_lock lock(notification_mutex_);
 		// Delete notification list
-		for (auto & notification : m_NotificationList) {
-			delete notification;
-		}
 		m_NotificationList.clear();
+		m_NotificationPos = 0;
+		m_pendingTransferStatus = static_cast<size_t>(-1);
 	}
 
 	// Remove ourself from the engine list
@@ -161,7 +166,21 @@ bool CFileZillaEnginePrivate::IsConnected() const
 void CFileZillaEnginePrivate::AddNotification(fz::scoped_lock&, std::unique_ptr<CNotification> && notification)
 {
 	if (notification) {
-		m_NotificationList.push_back(notification.release());
+		if (notification->GetID() == nId_transferstatus) {
+			// Only the most recent transfer status is of interest
+			if (m_pendingTransferStatus < m_NotificationList.size() && m_NotificationList[m_pendingTransferStatus]) {
+				m_NotificationList[m_pendingTransferStatus].reset();
+				++notification_stats_.coalesced;
+			}
+			m_pendingTransferStatus = m_NotificationList.size();
+		}
+		m_NotificationList.emplace_back(std::move(notification));
+		++notification_stats_.added;
+
+		size_t const depth = m_NotificationList.size() - m_NotificationPos;
+		if (depth > notification_stats_.max_depth) {
+			notification_stats_.max_depth = depth;
+		}
 	}
 
 	if (m_maySendNotificationEvent && notification_cb_) {
@@ -183,8 +202,7 @@ void CFileZillaEnginePrivate::AddLogNotification(std::unique_ptr<CLogmsgNotifica
 	if (notification->msgType == logmsg::error) {
 		queue_logs_ = false;
 
-		m_NotificationList.insert(m_NotificationList.end(), queued_logs_.begin(), queued_logs_.end());
-		queued_logs_.clear();
+		AppendQueuedLogs(lock);
 		AddNotification(lock, std::move(notification));
 	}
 	else if (notification->msgType == logmsg::status) {
@@ -202,8 +220,7 @@ void CFileZillaEnginePrivate::AddLogNotification(std::unique_ptr<CLogmsgNotifica
 void CFileZillaEnginePrivate::SendQueuedLogs(bool reset_flag)
 {
 	fz::scoped_lock lock(notification_mutex_);
-	m_NotificationList.insert(m_NotificationList.end(), queued_logs_.begin(), queued_logs_.end());
-	queued_logs_.clear();
+	AppendQueuedLogs(lock);
 
 	if (reset_flag) {
 		queue_logs_ = ShouldQueueLogsFromOptions();
@@ -217,6 +234,15 @@ void CFileZillaEnginePrivate::SendQueuedLogs(bool reset_flag)
 	notification_cb_(&parent_);
 }
 
+void CFileZillaEnginePrivate::AppendQueuedLogs(fz::scoped_lock&)
+{
+	for (auto msg : queued_logs_) {
+		m_NotificationList.emplace_back(msg);
+	}
+	notification_stats_.added += queued_logs_.size();
+	queued_logs_.clear();
+}
+
 void CFileZillaEnginePrivate::ClearQueuedLogs(fz::scoped_lock&, bool reset_flag)
 {
 	for (auto msg : queued_logs_) {
@@ -762,14 +788,65 @@ std::unique_ptr<CNotification> CFileZillaEnginePrivate::GetNextNotification()
 {
 	fz::scoped_lock lock(notification_mutex_);
 
-	if (m_NotificationList.empty()) {
-		m_maySendNotificationEvent = true;
-		return nullptr;
+	while (m_NotificationPos < m_NotificationList.size()) {
+		std::unique_ptr<CNotification> pNotification = std::move(m_NotificationList[m_NotificationPos++]);
+		if (pNotification) {
+			return pNotification;
+		}
+	}
+
+	m_NotificationList.clear();
+	m_NotificationPos = 0;
+	m_pendingTransferStatus = static_cast<size_t>(-1);
+	m_maySendNotificationEvent = true;
+	return nullptr;
+}
+
+bool CFileZillaEnginePrivate::GetNotifications(std::vector<std::unique_ptr<CNotification>> & notifications)
+{
+	// Destroy previous contents outside the lock
+	notifications.clear();
+
+	fz::scoped_lock lock(notification_mutex_);
+
+	m_maySendNotificationEvent = true;
+	if (m_NotificationPos >= m_NotificationList.size()) {
+		m_NotificationList.clear();
+		m_NotificationPos = 0;
+		m_pendingTransferStatus = static_cast<size_t>(-1);
+		return false;
 	}
-	std::unique_ptr<CNotification> pNotification(m_NotificationList.front());
-	m_NotificationList.pop_front();
 
-	return pNotification;
+	// Hand over the whole list, the caller's empty vector keeps its capacity for reuse
+	notifications.swap(m_NotificationList);
+	m_NotificationPos = 0;
+	m_pendingTransferStatus = static_cast<size_t>(-1);
+	++notification_stats_.batches;
+	lock.unlock();
+
+	// Remove entries already taken by GetNextNotification and superseded ones
+	notifications.erase(std::remove(notifications.begin(), notifications.end(), nullptr), notifications.end());
+
+	return !notifications.empty();
+}
+
+CNotificationStats CFileZillaEnginePrivate::GetNotificationStats()
+{
+	fz::scoped_lock lock(notification_mutex_);
+
+	auto const now = fz::monotonic_clock::now();
+	if (notification_stats_time_) {
+		auto const ms = (now - notification_stats_time_).get_milliseconds();
+		if (ms > 0) {
+			notification_stats_.per_second = static_cast<double>(notification_stats_.added - notification_stats_added_) * 1000 / ms;
+		}
+	}
+	notification_stats_time_ = now;
+	notification_stats_added_ = notification_stats_.added;
+
+	notification_stats_.depth = m_NotificationList.size() - m_NotificationPos;
+
+	return notification_stats_;
 }
 
 bool CFileZillaEnginePrivate::SetAsyncRequestReply(std::unique_ptr<CAsyncRequestNotification> && pNotification)
@@ -834,8 +911,12 @@ int CFileZillaEnginePrivate::Cancel()
 	return FZ_REPLY_WOULDBLOCK;
 }
 
-void CFileZillaEnginePrivate::OnOptionsChanged(watched_options const&)
+void CFileZillaEnginePrivate::OnOptionsChanged(watched_options const& options)
 {
+	if (options.test(OPTION_TRACE_BUFFER_SIZE)) {
+		tracer_.SetCapacity(static_cast<size_t>(options_.get_int(OPTION_TRACE_BUFFER_SIZE)));
+	}
+
 	bool queue_logs = ShouldQueueLogsFromOptions();
 	if (queue_logs) {
 		fz::scoped_lock lock(notification_mutex_);
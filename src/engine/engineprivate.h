@@ -4,6 +4,7 @@
 #include "../include/engine_context.h"
 #include "../include/FileZillaEngine.h"
 #include "../include/optionsbase.h"
+#include "tracer.h"
 
 #include <libfilezilla/event.hpp>
 #include <libfilezilla/event_handler.hpp>
@@ -81,6 +82,8 @@ public:
 	void AddNotification(std::unique_ptr<CNotification> && notification);
 	void AddLogNotification(std::unique_ptr<CLogmsgNotification> && notification);
 	std::unique_ptr<CNotification> GetNextNotification();
+	bool GetNotifications(std::vector<std::unique_ptr<CNotification>> & notifications);
+	CNotificationStats GetNotificationStats();
 
 	COptionsBase& GetOptions() { return options_; }
 	fz::rate_limiter& GetRateLimiter() { return rate_limiter_; }
@@ -103,6 +106,8 @@ public:
 
 	CTransferStatusManager transfer_status_;
 
+	CTracer tracer_;
+
 	CustomEncodingConverterBase const& GetEncodingConverter() const { return encoding_converter_; }
 
 	OpLockManager & opLockManager_;
@@ -118,6 +123,7 @@ protected:
 	void SendQueuedLogs(bool reset_flag = false);
 	void ClearQueuedLogs(bool reset_flag);
 	void ClearQueuedLogs(fz::scoped_lock& lock, bool reset_flag);
+	void AppendQueuedLogs(fz::scoped_lock& lock);
 	bool ShouldQueueLogsFromOptions() const;
 
 	int CheckCommandPreconditions(CCommand const& command, bool checkBusy);
@@ -166,8 +172,15 @@ protected:
 	std::unique_ptr<CCommand> currentCommand_;
 
 	// Protect access to these with notification_mutex_
-	std::deque<CNotification*> m_NotificationList;
+	// Entries before m_NotificationPos have already been taken by GetNextNotification.
+	// Superseded transfer status notifications leave a null entry behind.
+	std::vector<std::unique_ptr<CNotification>> m_NotificationList;
+	size_t m_NotificationPos{};
+	size_t m_pendingTransferStatus{static_cast<size_t>(-1)};
 	bool m_maySendNotificationEvent{true};
+	CNotificationStats notification_stats_;
+	fz::monotonic_clock notification_stats_time_;
+	uint64_t notification_stats_added_{};
 	bool queue_logs_{true};
 	std::vector<CLogmsgNotification*> queued_logs_;
 
@@ -10,8 +10,57 @@
 #include <libfilezilla/file.hpp>
 #include <libfilezilla/local_filesys.hpp>
 
+#include <algorithm>
+
 #include <assert.h>
 
+namespace {
+struct x_command final
+{
+	checksum_algorithm alg_;
+	capabilityNames capability_;
+	wchar_t const* command_;
+};
+
+// Strongest first
+x_command const x_commands[] = {
+	{ checksum_algorithm::sha512, xsha512_command, L"XSHA512" },
+	{ checksum_algorithm::sha256, xsha256_command, L"XSHA256" },
+	{ checksum_algorithm::sha1, xsha1_command, L"XSHA1" },
+	{ checksum_algorithm::md5, xmd5_command, L"XMD5" },
+	{ checksum_algorithm::crc32, xcrc_command, L"XCRC" }
+};
+
+// Picks the strongest algorithm the server can compute, preferring HASH
+// over the X commands.
+checksum_algorithm SelectChecksum(CCapabilities const& capabilities, bool & hash)
+{
+	std::wstring algorithms;
+	if (capabilities.GetCapability(hash_command, &algorithms) == yes) {
+		// The currently selected one is marked with an asterisk
+		std::vector<checksum_algorithm> supported;
+		for (auto const& token : fz::strtok_view(algorithms, L";")) {
+			supported.push_back(checksum_from_name(fz::trimmed(token, L" *")));
+		}
+		for (auto const& x : x_commands) {
+			if (std::find(supported.cbegin(), supported.cend(), x.alg_) != supported.cend()) {
+				hash = true;
+				return x.alg_;
+			}
+		}
+	}
+
+	for (auto const& x : x_commands) {
+		if (capabilities.GetCapability(x.capability_) == yes) {
+			hash = false;
+			return x.alg_;
+		}
+	}
+
+	return checksum_algorithm::none;
+}
+}
+
 CFtpFileTransferOpData::CFtpFileTransferOpData(CFtpControlSocket& controlSocket, CFileTransferCommand const& cmd)
 	: CFileTransferOpData(L"CFtpFileTransferOpData", cmd)
 	, CFtpOpData(controlSocket)
@@ -91,7 +140,7 @@ int CFtpFileTransferOpData::Send()
 							log(logmsg::debug_info, L"No need to resume, remote file size matches local file size.");
 
 							if (options_.get_int(OPTION_PRESERVE_TIMESTAMPS) &&
-								CServerCapabilities::GetCapability(currentServer_, mfmt_command) == yes)
+								controlSocket_.GetCapabilities().GetCapability(mfmt_command) == yes)
 							{
 								localFileTime_ = reader_factory_.mtime();
 								if (!localFileTime_.empty()) {
@@ -107,6 +156,14 @@ int CFtpFileTransferOpData::Send()
 				engine_.transfer_status_.Init(reader_factory_.size(), resumeOffset, false);
 			}
 
+			checksum_.reset();
+			if (!resumeOffset && binary && options_.get_int(OPTION_VERIFY_CHECKSUMS)) {
+				auto const alg = SelectChecksum(controlSocket_.GetCapabilities(), hashCommand_);
+				if (alg != checksum_algorithm::none) {
+					checksum_ = std::make_shared<checksum_accumulator>(alg);
+				}
+			}
+
 			controlSocket_.m_pTransferSocket = std::make_unique<CTransferSocket>(engine_, controlSocket_, download() ? TransferMode::download : TransferMode::upload);
 			controlSocket_.m_pTransferSocket->m_binaryMode = binary;
 			if (download()) {
@@ -121,6 +178,7 @@ int CFtpFileTransferOpData::Send()
 						}
 					}
 				}
+				writer = make_checksum_writer(engine_, controlSocket_.m_pTransferSocket.get(), std::move(writer), checksum_);
 				controlSocket_.m_pTransferSocket->set_writer(std::move(writer), flags_ & ftp_transfer_flags::ascii);
 			}
 			else {
@@ -128,6 +186,7 @@ int CFtpFileTransferOpData::Send()
 				if (!reader) {
 					return FZ_REPLY_CRITICALERROR;
 				}
+				reader = make_checksum_reader(engine_, controlSocket_.m_pTransferSocket.get(), std::move(reader), checksum_);
 				controlSocket_.m_pTransferSocket->set_reader(std::move(reader), flags_ & ftp_transfer_flags::ascii);
 			}
 		}
@@ -136,7 +195,7 @@ int CFtpFileTransferOpData::Send()
 			cmd = L"RETR ";
 		}
 		else if (resume_ && resumeOffset != 0) {
-			if (CServerCapabilities::GetCapability(currentServer_, rest_stream) == yes) {
+			if (controlSocket_.GetCapabilities().GetCapability(rest_stream) == yes) {
 				cmd = L"STOR "; // In this case REST gets sent since resume offset was set earlier
 			}
 			else {
@@ -161,6 +220,24 @@ int CFtpFileTransferOpData::Send()
 
 		break;
 	}
+	case filetransfer_opts_hash:
+		cmd = L"OPTS HASH " + checksum_name(checksum_->algorithm());
+		break;
+	case filetransfer_hash:
+		if (hashCommand_) {
+			cmd = L"HASH ";
+		}
+		else {
+			for (auto const& x : x_commands) {
+				if (x.alg_ == checksum_->algorithm()) {
+					cmd = x.command_;
+					cmd += ' ';
+					break;
+				}
+			}
+		}
+		cmd += remotePath_.FormatFilename(remoteFile_, !tryAbsolutePath_);
+		break;
 	default:
 		log(logmsg::debug_warning, L"Unhandled opState: %d", opState);
 		return FZ_REPLY_ERROR;
@@ -183,7 +260,7 @@ int CFtpFileTransferOpData::TestResumeCapability()
 
 	for (int i = 0; i < 2; ++i) {
 		if (localFileSize_ >= (1ull << (i ? 31 : 32))) {
-			switch (CServerCapabilities::GetCapability(currentServer_, i ? resume2GBbug : resume4GBbug))
+			switch (controlSocket_.GetCapabilities().GetCapability(i ? resume2GBbug : resume4GBbug))
 			{
 			case yes:
 				if (static_cast<uint64_t>(remoteFileSize_) == localFileSize_) {
@@ -231,7 +308,7 @@ int CFtpFileTransferOpData::ParseResponse()
 	{
 	case filetransfer_size:
 		if (code != 2 && code != 3) {
-			if (CServerCapabilities::GetCapability(currentServer_, size_command) == yes ||
+			if (controlSocket_.GetCapabilities().GetCapability(size_command) == yes ||
 				fz::str_tolower_ascii(response.substr(4)) == L"file not found" ||
 				(fz::str_tolower_ascii(remotePath_.FormatFilename(remoteFile_)).find(L"file not found") == std::wstring::npos &&
 					fz::str_tolower_ascii(response).find(L"file not found") != std::wstring::npos))
@@ -252,8 +329,8 @@ int CFtpFileTransferOpData::ParseResponse()
 		else {
 			opState = filetransfer_mdtm;
 			if (response.substr(0, 4) == L"213 " && response.size() > 4) {
-				if (CServerCapabilities::GetCapability(currentServer_, size_command) == unknown) {
-					CServerCapabilities::SetCapability(currentServer_, size_command, yes);
+				if (controlSocket_.GetCapabilities().GetCapability(size_command) == unknown) {
+					controlSocket_.GetCapabilities().SetCapability(size_command, yes);
 				}
 				std::wstring str = response.substr(4);
 				int64_t size = 0;
@@ -291,6 +368,26 @@ int CFtpFileTransferOpData::ParseResponse()
 		break;
 	case filetransfer_mfmt:
 		return FZ_REPLY_OK;
+	case filetransfer_opts_hash:
+		if (code != 2) {
+			log(logmsg::status, _("Server cannot compute %s checksums, checksum not verified"), checksum_name(checksum_->algorithm()));
+			return PreserveTimestamp();
+		}
+		controlSocket_.m_hashAlgorithm = checksum_->algorithm();
+		opState = filetransfer_hash;
+		break;
+	case filetransfer_hash:
+		{
+			std::vector<uint8_t> remote;
+			if (code != 2 || !ParseChecksumReply(response, checksum_->algorithm(), remote)) {
+				log(logmsg::status, _("Server did not report the %s checksum of the file, checksum not verified"), checksum_name(checksum_->algorithm()));
+				return PreserveTimestamp();
+			}
+			if (!VerifyChecksum(engine_, *checksum_, remote)) {
+				return FZ_REPLY_CRITICALERROR;
+			}
+			return PreserveTimestamp();
+		}
 	default:
 		log(logmsg::debug_warning, L"Unknown op state");
 		return FZ_REPLY_INTERNALERROR;
@@ -311,7 +408,7 @@ int CFtpFileTransferOpData::SubcommandResult(int prevResult, COpData const&)
 				if (!dirDidExist) {
 					opState = filetransfer_waitlist;
 				}
-				else if (download() && options_.get_int(OPTION_PRESERVE_TIMESTAMPS) && CServerCapabilities::GetCapability(currentServer_, mdtm_command) == yes) {
+				else if (download() && options_.get_int(OPTION_PRESERVE_TIMESTAMPS) && controlSocket_.GetCapabilities().GetCapability(mdtm_command) == yes) {
 					opState = filetransfer_mdtm;
 				}
 				else {
@@ -332,7 +429,7 @@ int CFtpFileTransferOpData::SubcommandResult(int prevResult, COpData const&)
 						if (download() &&
 							!entry.has_time() &&
 							options_.get_int(OPTION_PRESERVE_TIMESTAMPS) &&
-							CServerCapabilities::GetCapability(currentServer_, mdtm_command) == yes)
+							controlSocket_.GetCapabilities().GetCapability(mdtm_command) == yes)
 						{
 							opState = filetransfer_mdtm;
 						}
@@ -373,7 +470,7 @@ int CFtpFileTransferOpData::SubcommandResult(int prevResult, COpData const&)
 				}
 				else if (download() &&
 					options_.get_int(OPTION_PRESERVE_TIMESTAMPS) &&
-					CServerCapabilities::GetCapability(currentServer_, mdtm_command) == yes)
+					controlSocket_.GetCapabilities().GetCapability(mdtm_command) == yes)
 				{
 					opState = filetransfer_mdtm;
 				}
@@ -391,7 +488,7 @@ int CFtpFileTransferOpData::SubcommandResult(int prevResult, COpData const&)
 					if (download() &&
 						!entry.has_time() &&
 						options_.get_int(OPTION_PRESERVE_TIMESTAMPS) &&
-						CServerCapabilities::GetCapability(currentServer_, mdtm_command) == yes)
+						controlSocket_.GetCapabilities().GetCapability(mdtm_command) == yes)
 					{
 						opState = filetransfer_mdtm;
 					}
@@ -416,33 +513,29 @@ int CFtpFileTransferOpData::SubcommandResult(int prevResult, COpData const&)
 		}
 	}
 	else if (opState == filetransfer_waittransfer) {
-		if (prevResult == FZ_REPLY_OK && options_.get_int(OPTION_PRESERVE_TIMESTAMPS)) {
-			if (!download() &&
-				CServerCapabilities::GetCapability(currentServer_, mfmt_command) == yes)
-			{
-				localFileTime_ = reader_factory_.mtime();
-				if (!localFileTime_.empty()) {
-					opState = filetransfer_mfmt;
-					return FZ_REPLY_CONTINUE;
-				}
+		if (prevResult != FZ_REPLY_OK) {
+			return prevResult;
+		}
+		if (checksum_) {
+			if (hashCommand_ && controlSocket_.m_hashAlgorithm != checksum_->algorithm()) {
+				opState = filetransfer_opts_hash;
 			}
-			else if (download() && !remoteFileTime_.empty()) {
-				if (!writer_factory_.set_mtime(remoteFileTime_)) {
-					log(logmsg::debug_warning, L"Could not set modification time");
-				}
+			else {
+				opState = filetransfer_hash;
 			}
+			return FZ_REPLY_CONTINUE;
 		}
-		return prevResult;
+		return PreserveTimestamp();
 	}
 	else if (opState == filetransfer_waitresumetest) {
 		if (prevResult != FZ_REPLY_OK) {
 			if (transferEndReason == TransferEndReason::failed_resumetest) {
 				if (localFileSize_ > (1ll << 32)) {
-					CServerCapabilities::SetCapability(currentServer_, resume4GBbug, yes);
+					controlSocket_.GetCapabilities().SetCapability(resume4GBbug, yes);
 					log(logmsg::error, _("Server does not support resume of files > 4GB."));
 				}
 				else {
-					CServerCapabilities::SetCapability(currentServer_, resume2GBbug, yes);
+					controlSocket_.GetCapabilities().SetCapability(resume2GBbug, yes);
 					log(logmsg::error, _("Server does not support resume of files > 2GB."));
 				}
 
@@ -451,10 +544,10 @@ int CFtpFileTransferOpData::SubcommandResult(int prevResult, COpData const&)
 			return prevResult;
 		}
 		if (localFileSize_ > (1ll << 32)) {
-			CServerCapabilities::SetCapability(currentServer_, resume4GBbug, no);
+			controlSocket_.GetCapabilities().SetCapability(resume4GBbug, no);
 		}
 		else {
-			CServerCapabilities::SetCapability(currentServer_, resume2GBbug, no);
+			controlSocket_.GetCapabilities().SetCapability(resume2GBbug, no);
 		}
 
 		opState = filetransfer_transfer;
@@ -462,3 +555,37 @@ int CFtpFileTransferOpData::SubcommandResult(int prevResult, COpData const&)
 
 	return FZ_REPLY_CONTINUE;
 }
+
+int CFtpFileTransferOpData::Reset(int result)
+{
+	// Hashing large files can take the server longer than the timeout. The
+	// file itself has been transferred completely at this point, losing the
+	// connection only means it could not be verified. The next command
+	// reconnects.
+	if ((opState == filetransfer_opts_hash || opState == filetransfer_hash) && (result & FZ_REPLY_DISCONNECTED) && (result & FZ_REPLY_CANCELED) != FZ_REPLY_CANCELED) {
+		log(logmsg::status, _("Server did not report the %s checksum of the file, checksum not verified"), checksum_name(checksum_->algorithm()));
+		return FZ_REPLY_OK;
+	}
+	return result;
+}
+
+int CFtpFileTransferOpData::PreserveTimestamp()
+{
+	if (options_.get_int(OPTION_PRESERVE_TIMESTAMPS)) {
+		if (!download() &&
+			controlSocket_.GetCapabilities().GetCapability(mfmt_command) == yes)
+		{
+			localFileTime_ = reader_factory_.mtime();
+			if (!localFileTime_.empty()) {
+				opState = filetransfer_mfmt;
+				return FZ_REPLY_CONTINUE;
+			}
+		}
+		else if (download() && !remoteFileTime_.empty()) {
+			if (!writer_factory_.set_mtime(remoteFileTime_)) {
+				log(logmsg::debug_warning, L"Could not set modification time");
+			}
+		}
+	}
+	return FZ_REPLY_OK;
+}
@@ -14,7 +14,9 @@ enum filetransferStates
 	filetransfer_transfer,
 	filetransfer_waittransfer,
 	filetransfer_waitresumetest,
-	filetransfer_mfmt
+	filetransfer_mfmt,
+	filetransfer_opts_hash,
+	filetransfer_hash
 };
 
 class CFtpFileTransferOpData final : public CFileTransferOpData, public CFtpTransferOpData, public CFtpOpData
@@ -25,10 +27,19 @@ public:
 	virtual int Send() override;
 	virtual int ParseResponse() override;
 	virtual int SubcommandResult(int prevResult, COpData const&) override;
+	virtual int Reset(int result) override;
 
 	int TestResumeCapability();
 
 	bool fileDidExist_{true};
+
+private:
+	int PreserveTimestamp();
+
+	// Computed while transferring if the server can compute the checksum
+	// of the remote file as well, using HASH or one of the X commands.
+	std::shared_ptr<checksum_accumulator> checksum_;
+	bool hashCommand_{};
 };
 
 #endif
@@ -178,6 +178,7 @@ void CFtpControlSocket::ParseLine(std::wstring line)
 void CFtpControlSocket::OnConnect()
 {
 	m_lastTypeBinary = -1;
+	m_hashAlgorithm = checksum_algorithm::none;
 	m_sentRestartOffset = false;
 	m_protectDataChannel = false;
 
@@ -211,6 +212,8 @@ void CFtpControlSocket::OnConnect()
 		log(logmsg::status, _("Connection established, waiting for welcome message..."));
 	}
 	m_pendingReplies = 1;
+	traced_commands_.clear();
+	TraceCommandStart("Welcome");
 }
 
 void CFtpControlSocket::ParseResponse()
@@ -223,6 +226,7 @@ void CFtpControlSocket::ParseResponse()
 	if (m_Response[0] != '1') {
 		if (m_pendingReplies > 0) {
 			--m_pendingReplies;
+			TraceCommandReply();
 		}
 		else {
 			log(logmsg::debug_warning, L"Unexpected reply, no reply was pending.");
@@ -276,6 +280,25 @@ void CFtpControlSocket::ParseResponse()
 	}
 }
 
+void CFtpControlSocket::TraceCommandStart(std::string_view name)
+{
+	traced_commands_.emplace_back();
+	auto & traced = traced_commands_.back();
+	traced.first.start(engine_.tracer_);
+	if (traced.first) {
+		traced.second = name;
+	}
+}
+
+void CFtpControlSocket::TraceCommandReply()
+{
+	if (!traced_commands_.empty()) {
+		auto & traced = traced_commands_.front();
+		traced.first.stop(engine_.tracer_, trace_category::command, traced.second);
+		traced_commands_.pop_front();
+	}
+}
+
 int CFtpControlSocket::GetReplyCode() const
 {
 	if (m_Response.empty()) {
@@ -309,6 +332,7 @@ int CFtpControlSocket::SendCommand(std::wstring const& str, bool maskArgs, bool
 	bool res = CRealControlSocket::Send(buffer.c_str(), buffer.size());
 	if (res) {
 		++m_pendingReplies;
+		TraceCommandStart(std::string_view(buffer).substr(0, buffer.find_first_of(" \r")));
 	}
 
 	if (measureRTT) {
@@ -540,7 +564,7 @@ bool CFtpControlSocket::SetAsyncRequestReply(CAsyncRequestNotification *pNotific
 				return false;
 			}
 			else {
-				CServerCapabilities::SetCapability(currentServer_, tls_resumption, no);
+				GetCapabilities().SetCapability(tls_resumption, no);
 				if (!operations_.empty() && operations_.back()->opId == PrivCommand::rawtransfer && m_pTransferSocket) {
 					m_pTransferSocket->ContinueWithoutSesssionResumption();
 				}	
@@ -706,6 +730,7 @@ void CFtpControlSocket::Connect(CServer const& server, Credentials const& creden
 	}
 
 	currentServer_ = server;
+	ResolveCapabilities();
 	credentials_ = credentials;
 
 	Push(std::make_unique<CFtpLogonOpData>(*this));
@@ -804,6 +829,7 @@ void CFtpControlSocket::ResetSocket()
 	tls_layer_.reset();
 	m_pendingReplies = 0;
 	m_repliesToSkip = 0;
+	traced_commands_.clear();
 	m_Response.clear();
 	m_MultilineResponseCode.clear();;
 	m_MultilineResponseLines.clear();
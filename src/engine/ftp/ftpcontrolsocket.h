@@ -1,10 +1,12 @@
 #ifndef FILEZILLA_ENGINE_FTP_FTPCONTROLSOCKET_HEADER
 #define FILEZILLA_ENGINE_FTP_FTPCONTROLSOCKET_HEADER
 
+#include "../checksum.h"
 #include "../logging_private.h"
 #include "../controlsocket.h"
 #include "../rtt.h"
 
+#include <deque>
 #include <regex>
 
 namespace PrivCommand {
@@ -108,6 +110,11 @@ protected:
 
 	int m_pendingReplies{1};
 
+	// Traced commands awaiting their final reply, in the order they were sent
+	std::deque<std::pair<trace_span, std::string>> traced_commands_;
+	void TraceCommandStart(std::string_view name);
+	void TraceCommandReply();
+
 	std::unique_ptr<CExternalIPResolver> m_pIPResolver;
 
 	std::unique_ptr<fz::tls_layer> tls_layer_;
@@ -115,6 +122,9 @@ protected:
 
 	int m_lastTypeBinary{-1};
 
+	// Algorithm selected for the HASH command using OPTS HASH, none if unknown
+	checksum_algorithm m_hashAlgorithm{};
+
 	// Used by keepalive code so that we're not using keep alive
 	// till the end of time. Stop after a couple of minutes.
 	fz::monotonic_clock m_lastCommandCompletionTime;
@@ -90,7 +90,7 @@ int CFtpListOpData::Send()
 
 		// Assume that a server supporting UTF-8 does not send EBCDIC listings.
 		listingEncoding::type encoding = listingEncoding::unknown;
-		if (CServerCapabilities::GetCapability(currentServer_, utf8_command) == yes) {
+		if (controlSocket_.GetCapabilities().GetCapability(utf8_command) == yes) {
 			encoding = listingEncoding::normal;
 		}
 
@@ -102,12 +102,12 @@ int CFtpListOpData::Send()
 		engine_.transfer_status_.Init(-1, 0, true);
 
 		opState = list_waittransfer;
-		if (CServerCapabilities::GetCapability(currentServer_, mlsd_command) == yes) {
+		if (controlSocket_.GetCapabilities().GetCapability(mlsd_command) == yes) {
 			controlSocket_.Transfer(L"MLSD", this);
 		}
 		else {
 			if (options_.get_int(OPTION_VIEW_HIDDEN_FILES)) {
-				capabilities cap = CServerCapabilities::GetCapability(currentServer_, list_hidden_support);
+				capabilities cap = controlSocket_.GetCapabilities().GetCapability(list_hidden_support);
 				if (cap == unknown) {
 					viewHiddenCheck_ = true;
 				}
@@ -149,7 +149,7 @@ int CFtpListOpData::ParseResponse()
 	std::wstring const& response = controlSocket_.m_Response;
 
 	// First condition prevents problems with concurrent MDTM
-	if (CServerCapabilities::GetCapability(currentServer_, inferred_timezone_offset) == unknown &&
+	if (controlSocket_.GetCapabilities().GetCapability(inferred_timezone_offset) == unknown &&
 	    response.substr(0, 4) == L"213 " && response.size() > 16)
 	{
 		fz::datetime date(response.substr(4), fz::datetime::utc);
@@ -178,15 +178,15 @@ int CFtpListOpData::ParseResponse()
 
 			// TODO: Correct cached listings
 
-			CServerCapabilities::SetCapability(currentServer_, inferred_timezone_offset, yes, serveroffset);
+			controlSocket_.GetCapabilities().SetCapability(inferred_timezone_offset, yes, serveroffset);
 		}
 		else {
-			CServerCapabilities::SetCapability(currentServer_, mdtm_command, no);
-			CServerCapabilities::SetCapability(currentServer_, inferred_timezone_offset, no);
+			controlSocket_.GetCapabilities().SetCapability(mdtm_command, no);
+			controlSocket_.GetCapabilities().SetCapability(inferred_timezone_offset, no);
 		}
 	}
 	else {
-		CServerCapabilities::SetCapability(currentServer_, inferred_timezone_offset, no);
+		controlSocket_.GetCapabilities().SetCapability(inferred_timezone_offset, no);
 	}
 
 	engine_.GetDirectoryCache().Store(directoryListing_, currentServer_);
@@ -246,11 +246,11 @@ int CFtpListOpData::SubcommandResult(int prevResult, COpData const&)
 				else {
 					if (CheckInclusion(listing, directoryListing_)) {
 						log(logmsg::debug_info, L"Server seems to support LIST -a");
-						CServerCapabilities::SetCapability(currentServer_, list_hidden_support, yes);
+						controlSocket_.GetCapabilities().SetCapability(list_hidden_support, yes);
 					}
 					else {
 						log(logmsg::debug_info, L"Server does not seem to support LIST -a");
-						CServerCapabilities::SetCapability(currentServer_, list_hidden_support, no);
+						controlSocket_.GetCapabilities().SetCapability(list_hidden_support, no);
 						listing = directoryListing_;
 					}
 				}
@@ -281,12 +281,12 @@ int CFtpListOpData::SubcommandResult(int prevResult, COpData const&)
 							// Less files with LIST -a
 							// Not supported
 							log(logmsg::debug_info, L"Server does not seem to support LIST -a");
-							CServerCapabilities::SetCapability(currentServer_, list_hidden_support, no);
+							controlSocket_.GetCapabilities().SetCapability(list_hidden_support, no);
 							listing = directoryListing_;
 						}
 						else {
 							log(logmsg::debug_info, L"Server seems to support LIST -a");
-							CServerCapabilities::SetCapability(currentServer_, list_hidden_support, yes);
+							controlSocket_.GetCapabilities().SetCapability(list_hidden_support, yes);
 						}
 					}
 					else {
@@ -325,7 +325,7 @@ int CFtpListOpData::SubcommandResult(int prevResult, COpData const&)
 					if (viewHidden_ &&
 						transferEndReason == TransferEndReason::transfer_command_failure_immediate)
 					{
-						CServerCapabilities::SetCapability(currentServer_, list_hidden_support, no);
+						controlSocket_.GetCapabilities().SetCapability(list_hidden_support, no);
 
 						int res = CheckTimezoneDetection(directoryListing_);
 						if (res != FZ_REPLY_OK) {
@@ -356,9 +356,9 @@ int CFtpListOpData::SubcommandResult(int prevResult, COpData const&)
 
 int CFtpListOpData::CheckTimezoneDetection(CDirectoryListing& listing)
 {
-	if (CServerCapabilities::GetCapability(currentServer_, inferred_timezone_offset) == unknown) {
-		if (CServerCapabilities::GetCapability(currentServer_, mdtm_command) != yes) {
-			CServerCapabilities::SetCapability(currentServer_, inferred_timezone_offset, no);
+	if (controlSocket_.GetCapabilities().GetCapability(inferred_timezone_offset) == unknown) {
+		if (controlSocket_.GetCapabilities().GetCapability(mdtm_command) != yes) {
+			controlSocket_.GetCapabilities().SetCapability(inferred_timezone_offset, no);
 		}
 		else {
 			size_t const count = listing.size();
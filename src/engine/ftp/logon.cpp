@@ -29,7 +29,7 @@ CFtpLogonOpData::CFtpLogonOpData(CFtpControlSocket& controlSocket)
 	}
 
 	const CharsetEncoding encoding = currentServer_.GetEncodingType();
-	if (encoding == ENCODING_AUTO && CServerCapabilities::GetCapability(currentServer_, utf8_command) != no) {
+	if (encoding == ENCODING_AUTO && controlSocket_.GetCapabilities().GetCapability(utf8_command) != no) {
 		controlSocket_.m_useUTF8 = true;
 	}
 	else if (encoding == ENCODING_UTF8) {
@@ -226,7 +226,7 @@ int CFtpLogonOpData::Send()
 	case LOGON_OPTSMLST:
 		{
 			std::wstring args;
-			CServerCapabilities::GetCapability(currentServer_, opst_mlst_command, &args);
+			controlSocket_.GetCapabilities().GetCapability(opst_mlst_command, &args);
 			return controlSocket_.SendCommand(L"OPTS MLST " + args);
 		}
 		break;
@@ -252,7 +252,7 @@ int CFtpLogonOpData::ParseResponse()
 	         opState == LOGON_AUTH_SSL)
 	{
 		if (code != 2 && code != 3) {
-			CServerCapabilities::SetCapability(currentServer_, (opState == LOGON_AUTH_TLS) ? auth_tls_command : auth_ssl_command, no);
+			controlSocket_.GetCapabilities().SetCapability((opState == LOGON_AUTH_TLS) ? auth_tls_command : auth_ssl_command, no);
 			if (opState == LOGON_AUTH_SSL) {
 				if (currentServer_.GetProtocol() == FTP) {
 					log(logmsg::status, _("Insecure server, it does not support FTP over TLS."));
@@ -267,7 +267,7 @@ int CFtpLogonOpData::ParseResponse()
 			}
 		}
 		else {
-			CServerCapabilities::SetCapability(currentServer_, (opState == LOGON_AUTH_TLS) ? auth_tls_command : auth_ssl_command, yes);
+			controlSocket_.GetCapabilities().SetCapability((opState == LOGON_AUTH_TLS) ? auth_tls_command : auth_ssl_command, yes);
 
 			log(logmsg::status, _("Initializing TLS..."));
 
@@ -365,23 +365,26 @@ int CFtpLogonOpData::ParseResponse()
 	}
 	else if (opState == LOGON_SYST) {
 		if (code == 2) {
-			CServerCapabilities::SetCapability(currentServer_, syst_command, yes, response.substr(4));
+			controlSocket_.GetCapabilities().SetCapability(syst_command, yes, response.substr(4));
 		}
 		else {
-			CServerCapabilities::SetCapability(currentServer_, syst_command, no);
+			controlSocket_.GetCapabilities().SetCapability(syst_command, no);
 		}
 
 		if (currentServer_.GetType() == DEFAULT && code == 2) {
 			if (response.size() > 7 && response.substr(3, 4) == L" MVS") {
 				currentServer_.SetType(MVS);
+				controlSocket_.ResolveCapabilities();
 			}
 			else if (response.size() > 12 && fz::str_toupper_ascii(response.substr(3, 9)) == L" NONSTOP ") {
 				currentServer_.SetType(HPNONSTOP);
+				controlSocket_.ResolveCapabilities();
 			}
 
 			if (!controlSocket_.m_MultilineResponseLines.empty() && fz::str_tolower_ascii(controlSocket_.m_MultilineResponseLines.front().substr(4, 4)) == L"z/vm") {
-				CServerCapabilities::SetCapability(currentServer_, syst_command, yes, controlSocket_.m_MultilineResponseLines.front().substr(4) + L" " + response.substr(4));
+				controlSocket_.GetCapabilities().SetCapability(syst_command, yes, controlSocket_.m_MultilineResponseLines.front().substr(4) + L" " + response.substr(4));
 				currentServer_.SetType(ZVM);
+				controlSocket_.ResolveCapabilities();
 			}
 		}
 
@@ -392,24 +395,24 @@ int CFtpLogonOpData::ParseResponse()
 	}
 	else if (opState == LOGON_FEAT) {
 		if (code == 2) {
-			CServerCapabilities::SetCapability(currentServer_, feat_command, yes);
-			if (CServerCapabilities::GetCapability(currentServer_, utf8_command) != yes) {
-				CServerCapabilities::SetCapability(currentServer_, utf8_command, no);
+			controlSocket_.GetCapabilities().SetCapability(feat_command, yes);
+			if (controlSocket_.GetCapabilities().GetCapability(utf8_command) != yes) {
+				controlSocket_.GetCapabilities().SetCapability(utf8_command, no);
 			}
-			if (CServerCapabilities::GetCapability(currentServer_, clnt_command) != yes) {
-				CServerCapabilities::SetCapability(currentServer_, clnt_command, no);
+			if (controlSocket_.GetCapabilities().GetCapability(clnt_command) != yes) {
+				controlSocket_.GetCapabilities().SetCapability(clnt_command, no);
 			}
 		}
 		else {
-			CServerCapabilities::SetCapability(currentServer_, feat_command, no);
+			controlSocket_.GetCapabilities().SetCapability(feat_command, no);
 		}
 
-		if (CServerCapabilities::GetCapability(currentServer_, tvfs_support) != yes) {
-			CServerCapabilities::SetCapability(currentServer_, tvfs_support, no);
+		if (controlSocket_.GetCapabilities().GetCapability(tvfs_support) != yes) {
+			controlSocket_.GetCapabilities().SetCapability(tvfs_support, no);
 		}
 
 		const CharsetEncoding encoding = currentServer_.GetEncodingType();
-		if (encoding == ENCODING_AUTO && CServerCapabilities::GetCapability(currentServer_, utf8_command) != yes) {
+		if (encoding == ENCODING_AUTO && controlSocket_.GetCapabilities().GetCapability(utf8_command) != yes) {
 			log(logmsg::status, _("Server does not support non-ASCII characters."));
 			controlSocket_.m_useUTF8 = false;
 		}
@@ -440,7 +443,7 @@ int CFtpLogonOpData::ParseResponse()
 		}
 		else if (opState == LOGON_SYST) {
 			std::wstring system;
-			capabilities cap = CServerCapabilities::GetCapability(currentServer_, syst_command, &system);
+			capabilities cap = controlSocket_.GetCapabilities().GetCapability(syst_command, &system);
 			if (cap == unknown) {
 				break;
 			}
@@ -448,12 +451,15 @@ int CFtpLogonOpData::ParseResponse()
 				if (currentServer_.GetType() == DEFAULT) {
 					if (system.substr(0, 3) == L"MVS") {
 						currentServer_.SetType(MVS);
+						controlSocket_.ResolveCapabilities();
 					}
 					else if (fz::str_toupper_ascii(system.substr(0, 4)) == L"Z/VM") {
 						currentServer_.SetType(ZVM);
+						controlSocket_.ResolveCapabilities();
 					}
 					else if (fz::str_toupper_ascii(system.substr(0, 8)) == L"NONSTOP ") {
 						currentServer_.SetType(HPNONSTOP);
+						controlSocket_.ResolveCapabilities();
 					}
 				}
 
@@ -464,12 +470,12 @@ int CFtpLogonOpData::ParseResponse()
 			}
 		}
 		else if (opState == LOGON_FEAT) {
-			capabilities cap = CServerCapabilities::GetCapability(currentServer_, feat_command);
+			capabilities cap = controlSocket_.GetCapabilities().GetCapability(feat_command);
 			if (cap == unknown) {
 				break;
 			}
 			const CharsetEncoding encoding = currentServer_.GetEncodingType();
-			if (encoding == ENCODING_AUTO && CServerCapabilities::GetCapability(currentServer_, utf8_command) != yes) {
+			if (encoding == ENCODING_AUTO && controlSocket_.GetCapabilities().GetCapability(utf8_command) != yes) {
 				log(logmsg::status, _("Server does not support non-ASCII characters."));
 				controlSocket_.m_useUTF8 = false;
 			}
@@ -479,7 +485,7 @@ int CFtpLogonOpData::ParseResponse()
 				continue;
 			}
 
-			if (CServerCapabilities::GetCapability(currentServer_, clnt_command) == yes) {
+			if (controlSocket_.GetCapabilities().GetCapability(clnt_command) == yes) {
 				break;
 			}
 		}
@@ -488,16 +494,16 @@ int CFtpLogonOpData::ParseResponse()
 				continue;
 			}
 
-			if (CServerCapabilities::GetCapability(currentServer_, utf8_command) == yes) {
+			if (controlSocket_.GetCapabilities().GetCapability(utf8_command) == yes) {
 				break;
 			}
 		}
 		else if (opState == LOGON_OPTSMLST) {
 			std::wstring facts;
-			if (CServerCapabilities::GetCapability(currentServer_, mlsd_command, &facts) != yes) {
+			if (controlSocket_.GetCapabilities().GetCapability(mlsd_command, &facts) != yes) {
 				continue;
 			}
-			capabilities cap = CServerCapabilities::GetCapability(currentServer_, opst_mlst_command);
+			capabilities cap = controlSocket_.GetCapabilities().GetCapability(opst_mlst_command);
 			if (cap == unknown) {
 				facts = fz::str_tolower_ascii(facts);
 
@@ -555,11 +561,11 @@ int CFtpLogonOpData::ParseResponse()
 				}
 
 				if (had_unset) {
-					CServerCapabilities::SetCapability(currentServer_, opst_mlst_command, yes, opts_facts);
+					controlSocket_.GetCapabilities().SetCapability(opst_mlst_command, yes, opts_facts);
 					break;
 				}
 				else {
-					CServerCapabilities::SetCapability(currentServer_, opst_mlst_command, no);
+					controlSocket_.GetCapabilities().SetCapability(opst_mlst_command, no);
 				}
 			}
 			else if (cap == yes) {
@@ -791,15 +797,15 @@ void CFtpLogonOpData::ParseFeat(std::wstring line)
 	std::wstring up = fz::str_toupper_ascii(line);
 
 	if (HasFeature(up, L"UTF8")) {
-		CServerCapabilities::SetCapability(currentServer_, utf8_command, yes);
+		controlSocket_.GetCapabilities().SetCapability(utf8_command, yes);
 	}
 	else if (HasFeature(up, L"CLNT")) {
-		CServerCapabilities::SetCapability(currentServer_, clnt_command, yes);
+		controlSocket_.GetCapabilities().SetCapability(clnt_command, yes);
 	}
 	else if (HasFeature(up, L"MLSD")) {
 		std::wstring facts;
 		// FEAT output for MLST overrides MLSD
-		if (CServerCapabilities::GetCapability(currentServer_, mlsd_command, &facts) != yes || facts.empty()) {
+		if (controlSocket_.GetCapabilities().GetCapability(mlsd_command, &facts) != yes || facts.empty()) {
 			if (line.size() > 5) {
 				facts = line.substr(5);
 			}
@@ -807,10 +813,10 @@ void CFtpLogonOpData::ParseFeat(std::wstring line)
 				facts.clear();
 			}
 		}
-		CServerCapabilities::SetCapability(currentServer_, mlsd_command, yes, facts);
+		controlSocket_.GetCapabilities().SetCapability(mlsd_command, yes, facts);
 
 		// MLST/MLSD specs require use of UTC
-		CServerCapabilities::SetCapability(currentServer_, inferred_timezone_offset, no);
+		controlSocket_.GetCapabilities().SetCapability(inferred_timezone_offset, no);
 	}
 	else if (HasFeature(up, L"MLST")) {
 		std::wstring facts;
@@ -819,34 +825,52 @@ void CFtpLogonOpData::ParseFeat(std::wstring line)
 		}
 		// FEAT output for MLST overrides MLSD
 		if (facts.empty()) {
-			if (CServerCapabilities::GetCapability(currentServer_, mlsd_command, &facts) != yes) {
+			if (controlSocket_.GetCapabilities().GetCapability(mlsd_command, &facts) != yes) {
 				facts.clear();
 			}
 		}
-		CServerCapabilities::SetCapability(currentServer_, mlsd_command, yes, facts);
+		controlSocket_.GetCapabilities().SetCapability(mlsd_command, yes, facts);
 
 		// MLST/MLSD specs require use of UTC
-		CServerCapabilities::SetCapability(currentServer_, inferred_timezone_offset, no);
+		controlSocket_.GetCapabilities().SetCapability(inferred_timezone_offset, no);
 	}
 	else if (HasFeature(up, L"MODE Z")) {
-		CServerCapabilities::SetCapability(currentServer_, mode_z_support, yes);
+		controlSocket_.GetCapabilities().SetCapability(mode_z_support, yes);
 	}
 	else if (HasFeature(up, L"MFMT")) {
-		CServerCapabilities::SetCapability(currentServer_, mfmt_command, yes);
+		controlSocket_.GetCapabilities().SetCapability(mfmt_command, yes);
 	}
 	else if (HasFeature(up, L"MDTM")) {
-		CServerCapabilities::SetCapability(currentServer_, mdtm_command, yes);
+		controlSocket_.GetCapabilities().SetCapability(mdtm_command, yes);
 	}
 	else if (HasFeature(up, L"SIZE")) {
-		CServerCapabilities::SetCapability(currentServer_, size_command, yes);
+		controlSocket_.GetCapabilities().SetCapability(size_command, yes);
 	}
 	else if (HasFeature(up, L"TVFS")) {
-		CServerCapabilities::SetCapability(currentServer_, tvfs_support, yes);
+		controlSocket_.GetCapabilities().SetCapability(tvfs_support, yes);
 	}
 	else if (HasFeature(up, L"REST STREAM")) {
-		CServerCapabilities::SetCapability(currentServer_, rest_stream, yes);
+		controlSocket_.GetCapabilities().SetCapability(rest_stream, yes);
 	}
 	else if (HasFeature(up, L"EPSV")) {
-		CServerCapabilities::SetCapability(currentServer_, epsv_command, yes);
+		controlSocket_.GetCapabilities().SetCapability(epsv_command, yes);
+	}
+	else if (HasFeature(up, L"HASH")) {
+		controlSocket_.GetCapabilities().SetCapability(hash_command, yes, up.size() > 5 ? up.substr(5) : std::wstring());
+	}
+	else if (HasFeature(up, L"XCRC")) {
+		controlSocket_.GetCapabilities().SetCapability(xcrc_command, yes);
+	}
+	else if (HasFeature(up, L"XMD5")) {
+		controlSocket_.GetCapabilities().SetCapability(xmd5_command, yes);
+	}
+	else if (HasFeature(up, L"XSHA1")) {
+		controlSocket_.GetCapabilities().SetCapability(xsha1_command, yes);
+	}
+	else if (HasFeature(up, L"XSHA256")) {
+		controlSocket_.GetCapabilities().SetCapability(xsha256_command, yes);
+	}
+	else if (HasFeature(up, L"XSHA512")) {
+		controlSocket_.GetCapabilities().SetCapability(xsha512_command, yes);
 	}
 }
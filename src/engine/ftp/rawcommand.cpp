@@ -11,6 +11,7 @@ int CFtpRawCommandOpData::Send()
 	currentPath_.clear();
 
 	controlSocket_.m_lastTypeBinary = -1;
+	controlSocket_.m_hashAlgorithm = checksum_algorithm::none;
 
 	return controlSocket_.SendCommand(command_, false, false);
 }
@@ -401,7 +401,7 @@ std::wstring CFtpRawTransferOpData::GetPassiveCommand()
 	if (controlSocket_.proxy_layer_) {
 		// We don't actually know the address family the other end of the proxy uses to reach the server. Hence prefer EPSV
 		// if the server supports it.
-		if (CServerCapabilities::GetCapability(currentServer_, epsv_command) == yes) {
+		if (controlSocket_.GetCapabilities().GetCapability(epsv_command) == yes) {
 			ret = L"EPSV";
 		}
 	}
@@ -18,6 +18,16 @@
 #define HAVE_ASCII_TRANSFORM 1
 #endif
 
+#ifdef __linux__
+#include <algorithm>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/sendfile.h>
+#include <unistd.h>
+#endif
+
 #if HAVE_ASCII_TRANSFORM
 namespace {
 class ascii_writer final : public writer_base, public fz::event_handler
@@ -186,6 +196,52 @@ private:
 }
 #endif
 
+#ifdef __linux__
+namespace {
+// Bounds the time a single call spends on the event loop
+size_t const direct_chunk_size{1024 * 1024};
+
+void close_pipe(int (&p)[2])
+{
+	for (auto & fd : p) {
+		if (fd != -1) {
+			::close(fd);
+			fd = -1;
+		}
+	}
+}
+
+// Unlike send, sendfile has no flag to keep a vanished peer from raising
+// SIGPIPE. Block it for the call and discard it if it got raised by it.
+ssize_t sendfile_nosignal(int out_fd, int in_fd, off_t * offset, size_t count)
+{
+	sigset_t pipe_set;
+	sigemptyset(&pipe_set);
+	sigaddset(&pipe_set, SIGPIPE);
+
+	sigset_t pending;
+	sigpending(&pending);
+	bool const was_pending = sigismember(&pending, SIGPIPE) == 1;
+
+	sigset_t old_set;
+	pthread_sigmask(SIG_BLOCK, &pipe_set, &old_set);
+
+	ssize_t const res = sendfile(out_fd, in_fd, offset, count);
+	int const error = errno;
+
+	if (res < 0 && error == EPIPE && !was_pending) {
+		timespec const zero{};
+		while (sigtimedwait(&pipe_set, nullptr, &zero) == -1 && errno == EINTR) {
+		}
+	}
+
+	pthread_sigmask(SIG_SETMASK, &old_set, nullptr);
+	errno = error;
+	return res;
+}
+}
+#endif
+
 CTransferSocket::CTransferSocket(CFileZillaEnginePrivate & engine, CFtpControlSocket & controlSocket, TransferMode transferMode)
 : fz::event_handler(controlSocket.event_loop_)
 , engine_(engine)
@@ -204,6 +260,10 @@ CTransferSocket::~CTransferSocket()
 	
 	reader_.reset();
 	writer_.reset();
+
+#ifdef __linux__
+	close_pipe(pipe_);
+#endif
 }
 
 void CTransferSocket::set_reader(std::unique_ptr<reader_base> && reader, bool ascii)
@@ -253,6 +313,7 @@ void CTransferSocket::ResetSocket()
 std::wstring CTransferSocket::SetupActiveTransfer(std::string const& ip)
 {
 	ResetSocket();
+	connect_span_.start(engine_.tracer_);
 	socketServer_ = CreateSocketServer();
 
 	if (!socketServer_) {
@@ -323,6 +384,7 @@ void CTransferSocket::OnSocketEvent(fz::socket_event_source* source, fz::socket_
 			OnSocketError(error);
 		}
 		else {
+			TraceSocketReady();
 			OnReceive();
 		}
 		break;
@@ -331,6 +393,7 @@ void CTransferSocket::OnSocketEvent(fz::socket_event_source* source, fz::socket_
 			OnSocketError(error);
 		}
 		else {
+			TraceSocketReady();
 			OnSend();
 		}
 		break;
@@ -383,12 +446,14 @@ void CTransferSocket::OnConnect()
 		return;
 	}
 
+	connect_span_.stop(engine_.tracer_, trace_category::connection, tls_layer_ ? "Connect+TLS" : "Connect");
+
 	if (tls_layer_) {
-		auto const cap = CServerCapabilities::GetCapability(controlSocket_.currentServer_, tls_resumption);
+		auto const cap = controlSocket_.GetCapabilities().GetCapability(tls_resumption);
 		if (tls_layer_->resumed_session()) {
 			if (cap != yes) {
 				engine_.AddNotification(std::make_unique<FtpTlsResumptionNotification>(controlSocket_.currentServer_));
-				CServerCapabilities::SetCapability(controlSocket_.currentServer_, tls_resumption, yes);
+				controlSocket_.GetCapabilities().SetCapability(tls_resumption, yes);
 			}
 		}
 		else {
@@ -427,6 +492,9 @@ void CTransferSocket::OnReceive()
 	if (activity_block_) {
 		controlSocket_.log(logmsg::debug_verbose, L"Postponing receive, m_bActive was false.");
 		m_postponedReceive = true;
+		if (!postponed_span_) {
+			postponed_span_.start(engine_.tracer_);
+		}
 		return;
 	}
 
@@ -469,8 +537,19 @@ void CTransferSocket::OnReceive()
 			return;
 		}
 		else if (m_transferMode == TransferMode::download) {
+#ifdef __linux__
+			if (!direct_checked_) {
+				InitDirectTransfer();
+			}
+			if (direct_fd_ != -1) {
+				DirectReceive();
+				return;
+			}
+#endif
+
 			int error;
 			int numread;
+			unsigned int calls{};
 
 			// Only do a certain number of iterations in one go to keep the event loop going.
 			// Otherwise this behaves like a livelock on very large files written to a very fast
@@ -481,6 +560,7 @@ void CTransferSocket::OnReceive()
 				}
 
 				size_t to_read = buffer_.capacity() - buffer_.size();
+				calls = activity_logger_layer_->calls();
 				numread = active_layer_->read(buffer_.get(to_read), static_cast<unsigned int>(to_read), error);
 				if (numread <= 0) {
 					break;
@@ -500,6 +580,9 @@ void CTransferSocket::OnReceive()
 					controlSocket_.log(logmsg::error, L"Could not read from transfer socket: %s", fz::socket_error_description(error));
 					TransferEnd(TransferEndReason::transfer_failure);
 				}
+				else {
+					TraceSocketWait(calls);
+				}
 			}
 			else if (!numread) {
 				FinalizeWrite();
@@ -577,6 +660,9 @@ void CTransferSocket::OnSend()
 	if (activity_block_) {
 		controlSocket_.log(logmsg::debug_verbose, L"Postponing send");
 		m_postponedSend = true;
+		if (!postponed_span_) {
+			postponed_span_.start(engine_.tracer_);
+		}
 		return;
 	}
 
@@ -584,8 +670,19 @@ void CTransferSocket::OnSend()
 		return;
 	}
 
+#ifdef __linux__
+	if (!direct_checked_) {
+		InitDirectTransfer();
+	}
+	if (direct_fd_ != -1) {
+		DirectSend();
+		return;
+	}
+#endif
+
 	int error;
 	int written;
+	unsigned int calls{};
 
 	// Only do a certain number of iterations in one go to keep the event loop going.
 	// Otherwise this behaves like a livelock on very large files read from a very fast
@@ -595,6 +692,7 @@ void CTransferSocket::OnSend()
 			return;
 		}
 
+		calls = activity_logger_layer_->calls();
 		written = active_layer_->write(buffer_.get(), static_cast<int>(buffer_.size()), error);
 		if (written <= 0) {
 			break;
@@ -613,6 +711,7 @@ void CTransferSocket::OnSend()
 
 	if (written < 0) {
 		if (error == EAGAIN) {
+			TraceSocketWait(calls);
 			if (!m_madeProgress) {
 				controlSocket_.log(logmsg::debug_debug, L"First EAGAIN in CTransferSocket::OnSend()");
 				m_madeProgress = 1;
@@ -629,6 +728,251 @@ void CTransferSocket::OnSend()
 	}
 }
 
+#ifdef __linux__
+void CTransferSocket::InitDirectTransfer()
+{
+	direct_checked_ = true;
+
+	// Only the rate limiter and the activity logger may sit on top of the
+	// socket, other layers need to see the data.
+	if (!socket_ || tls_layer_ || proxy_layer_) {
+		return;
+	}
+
+	auto & options = engine_.GetOptions();
+	if (!options.get_int(OPTION_ZERO_COPY)) {
+		return;
+	}
+
+	// Bypassing the rate limiter is fine as long as it does not limit this
+	// direction. Limits enabled later on apply from the next transfer.
+	if (options.get_int(OPTION_SPEEDLIMIT_ENABLE) && options.get_int(m_transferMode == TransferMode::upload ? OPTION_SPEEDLIMIT_OUTBOUND : OPTION_SPEEDLIMIT_INBOUND) > 0) {
+		return;
+	}
+
+	// ASCII and checksum wrappers do not hand out the descriptor of the file
+	// they wrap.
+	if (m_transferMode == TransferMode::upload) {
+		if (reader_ && buffer_.empty()) {
+			direct_fd_ = reader_->direct_fd(direct_offset_, direct_remaining_);
+		}
+	}
+	else if (m_transferMode == TransferMode::download) {
+		if (writer_ && !buffer_) {
+			int const fd = writer_->direct_fd();
+			if (fd != -1 && !pipe2(pipe_, O_CLOEXEC | O_NONBLOCK)) {
+				// Fewer round trips between socket and file with a larger pipe
+				fcntl(pipe_[1], F_SETPIPE_SZ, static_cast<int>(direct_chunk_size));
+				int const size = fcntl(pipe_[1], F_GETPIPE_SZ);
+				pipe_size_ = size > 0 ? static_cast<size_t>(size) : 65536;
+				direct_fd_ = fd;
+			}
+		}
+	}
+
+	if (direct_fd_ != -1) {
+		controlSocket_.log(logmsg::debug_info, L"Using zero-copy transfer");
+	}
+}
+
+bool CTransferSocket::FallBackFromDirect()
+{
+	controlSocket_.log(logmsg::debug_info, L"Zero-copy transfer not supported, falling back to buffered transfer");
+
+	if (m_transferMode == TransferMode::upload && reader_->seek(direct_offset_, direct_remaining_) != aio_result::ok) {
+		return false;
+	}
+
+	direct_fd_ = -1;
+	close_pipe(pipe_);
+	return true;
+}
+
+void CTransferSocket::DirectProgress(uint64_t amount, bool record)
+{
+	controlSocket_.SetAlive();
+	if (m_transferMode == TransferMode::upload ? m_madeProgress == 1 : !m_madeProgress) {
+		m_madeProgress = 2;
+		engine_.transfer_status_.SetMadeProgress();
+	}
+	engine_.transfer_status_.Update(static_cast<int64_t>(amount));
+
+	// The activity logger layer only sees what passes through it
+	if (record) {
+		engine_.activity_logger_.record(m_transferMode == TransferMode::upload ? activity_logger::send : activity_logger::recv, amount);
+	}
+}
+
+void CTransferSocket::DirectSend()
+{
+	int const fd = socket_->get_descriptor();
+
+	// See the comment in OnSend
+	for (int i = 0; i < 100; ++i) {
+		if (!direct_remaining_) {
+			int r = active_layer_->shutdown();
+			if (r && r != EAGAIN) {
+				TransferEnd(TransferEndReason::transfer_failure);
+				return;
+			}
+			TransferEnd(TransferEndReason::successful);
+			return;
+		}
+
+		off_t offset = static_cast<off_t>(direct_offset_);
+		size_t const chunk = static_cast<size_t>(std::min(direct_remaining_, static_cast<uint64_t>(direct_chunk_size)));
+		ssize_t const sent = sendfile_nosignal(fd, direct_fd_, &offset, chunk);
+		if (sent > 0) {
+			direct_started_ = true;
+			direct_offset_ += static_cast<uint64_t>(sent);
+			direct_remaining_ -= static_cast<uint64_t>(sent);
+			DirectProgress(static_cast<uint64_t>(sent), true);
+			continue;
+		}
+		else if (!sent) {
+			controlSocket_.log(logmsg::debug_warning, L"'%s' got truncated while being read", reader_->name());
+			controlSocket_.log(logmsg::error, _("Could not read from '%s'."), reader_->name());
+			TransferEnd(TransferEndReason::transfer_failure_critical);
+			return;
+		}
+
+		int error = errno;
+		if (error == EINTR) {
+			continue;
+		}
+		else if (error != EAGAIN) {
+			if (!direct_started_ && (error == EINVAL || error == ENOSYS) && FallBackFromDirect()) {
+				OnSend();
+				return;
+			}
+			controlSocket_.log(logmsg::error, L"Could not write to transfer socket: %s", fz::socket_error_description(error));
+			TransferEnd(TransferEndReason::transfer_failure);
+			return;
+		}
+
+		// The socket only waits for becoming writable again after a write
+		// through it failed, it knows nothing about what got sent past it.
+		// So pass the next byte through the layers, with the send buffer
+		// being full that write almost always fails.
+		unsigned char c{};
+		if (pread(direct_fd_, &c, 1, static_cast<off_t>(direct_offset_)) != 1) {
+			controlSocket_.log(logmsg::error, _("Could not read from '%s'."), reader_->name());
+			TransferEnd(TransferEndReason::transfer_failure_critical);
+			return;
+		}
+
+		unsigned int const calls = activity_logger_layer_->calls();
+		int const written = active_layer_->write(&c, 1, error);
+		if (written == 1) {
+			++direct_offset_;
+			--direct_remaining_;
+			DirectProgress(1, false);
+			continue;
+		}
+
+		if (written < 0 && error == EAGAIN) {
+			TraceSocketWait(calls);
+			if (!m_madeProgress) {
+				controlSocket_.log(logmsg::debug_debug, L"First EAGAIN in CTransferSocket::DirectSend()");
+				m_madeProgress = 1;
+				engine_.transfer_status_.SetMadeProgress();
+			}
+		}
+		else {
+			controlSocket_.log(logmsg::error, L"Could not write to transfer socket: %s", fz::socket_error_description(error));
+			TransferEnd(TransferEndReason::transfer_failure);
+		}
+		return;
+	}
+
+	send_event<fz::socket_event>(active_layer_, fz::socket_event_flag::write, 0);
+}
+
+bool CTransferSocket::DrainPipe(size_t size)
+{
+	while (size) {
+		ssize_t const written = splice(pipe_[0], nullptr, direct_fd_, nullptr, size, SPLICE_F_MOVE);
+		if (written <= 0) {
+			if (written < 0 && errno == EINTR) {
+				continue;
+			}
+			controlSocket_.log(logmsg::error, _("Could not write to '%s'."), writer_->name());
+			TransferEnd(TransferEndReason::transfer_failure_critical);
+			return false;
+		}
+		size -= static_cast<size_t>(written);
+	}
+	return true;
+}
+
+void CTransferSocket::DirectReceive()
+{
+	int const fd = socket_->get_descriptor();
+
+	// See the comment in the download loop of OnReceive
+	for (int i = 0; i < 100; ++i) {
+		// Writing to the file at its current position keeps the writer's
+		// idea of how much got written intact.
+		ssize_t const received = splice(fd, nullptr, pipe_[1], nullptr, pipe_size_, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+		if (received > 0) {
+			direct_started_ = true;
+			if (!DrainPipe(static_cast<size_t>(received))) {
+				return;
+			}
+			DirectProgress(static_cast<uint64_t>(received), true);
+			continue;
+		}
+		else if (!received) {
+			FinalizeWrite();
+			return;
+		}
+
+		int error = errno;
+		if (error == EINTR) {
+			continue;
+		}
+		else if (error != EAGAIN) {
+			if (!direct_started_ && (error == EINVAL || error == ENOSYS) && FallBackFromDirect()) {
+				OnReceive();
+				return;
+			}
+			controlSocket_.log(logmsg::error, L"Could not read from transfer socket: %s", fz::socket_error_description(error));
+			TransferEnd(TransferEndReason::transfer_failure);
+			return;
+		}
+
+		// As in DirectSend, a read through the layers makes the socket wait
+		// for data. The pipe is always empty here, so the byte, if any, goes
+		// to the file in order.
+		unsigned char c{};
+		unsigned int const calls = activity_logger_layer_->calls();
+		int const numread = active_layer_->read(&c, 1, error);
+		if (numread == 1) {
+			if (::write(direct_fd_, &c, 1) != 1) {
+				controlSocket_.log(logmsg::error, _("Could not write to '%s'."), writer_->name());
+				TransferEnd(TransferEndReason::transfer_failure_critical);
+				return;
+			}
+			DirectProgress(1, false);
+			continue;
+		}
+		else if (!numread) {
+			FinalizeWrite();
+		}
+		else if (error == EAGAIN) {
+			TraceSocketWait(calls);
+		}
+		else {
+			controlSocket_.log(logmsg::error, L"Could not read from transfer socket: %s", fz::socket_error_description(error));
+			TransferEnd(TransferEndReason::transfer_failure);
+		}
+		return;
+	}
+
+	send_event<fz::socket_event>(active_layer_, fz::socket_event_flag::read, 0);
+}
+#endif
+
 void CTransferSocket::OnSocketError(int error)
 {
 	controlSocket_.log(logmsg::debug_verbose, L"CTransferSocket::OnSocketError(%d)", error);
@@ -646,6 +990,7 @@ bool CTransferSocket::SetupPassiveTransfer(std::wstring const& host, int port)
 	std::string ip = fz::to_utf8(host);
 
 	ResetSocket();
+	connect_span_.start(engine_.tracer_);
 
 	socket_ = std::make_unique<fz::socket>(engine_.GetThreadPool(), nullptr);
 
@@ -831,6 +1176,7 @@ bool CTransferSocket::CheckGetNextWriteBuffer()
 	if (buffer_.size() >= buffer_.capacity()) {
 		auto res = writer_->get_write_buffer(buffer_);
 		if (res == aio_result::wait) {
+			buffer_span_.start(engine_.tracer_);
 			return false;
 		}
 		else if (res == aio_result::error) {
@@ -849,6 +1195,7 @@ bool CTransferSocket::CheckGetNextReadBuffer()
 	if (buffer_.empty()) {
 		read_result res = reader_->read();
 		if (res == aio_result::wait) {
+			buffer_span_.start(engine_.tracer_);
 			return false;
 		}
 		else if (res == aio_result::error) {
@@ -873,6 +1220,8 @@ bool CTransferSocket::CheckGetNextReadBuffer()
 
 void CTransferSocket::OnInput(reader_base*)
 {
+	buffer_span_.stop(engine_.tracer_, trace_category::disk, "Read buffer");
+
 	if (activity_block_ || m_transferEndReason != TransferEndReason::none) {
 		return;
 	}
@@ -884,6 +1233,8 @@ void CTransferSocket::OnInput(reader_base*)
 
 void CTransferSocket::OnWrite(writer_base*)
 {
+	buffer_span_.stop(engine_.tracer_, trace_category::disk, "Write buffer");
+
 	if (activity_block_ || m_transferEndReason != TransferEndReason::none) {
 		return;
 	}
@@ -901,6 +1252,7 @@ void CTransferSocket::FinalizeWrite()
 
 	auto res = writer_->finalize(buffer_);
 	if (res == aio_result::wait) {
+		buffer_span_.start(engine_.tracer_);
 		return;
 	}
 
@@ -919,6 +1271,8 @@ void CTransferSocket::TriggerPostponedEvents()
 		return;
 	}
 
+	postponed_span_.stop(engine_.tracer_, trace_category::socket, "Postponed");
+
 	if (m_postponedReceive) {
 		controlSocket_.log(logmsg::debug_verbose, L"Executing postponed receive");
 		m_postponedReceive = false;
@@ -934,6 +1288,27 @@ void CTransferSocket::TriggerPostponedEvents()
 	}
 }
 
+void CTransferSocket::TraceSocketWait(unsigned int calls)
+{
+	if (!socket_span_ && engine_.tracer_.enabled()) {
+		// The rate limiter does not pass the call on to the layers below it
+		socket_span_ratelimit_ = activity_logger_layer_->calls() == calls;
+		socket_span_.start(engine_.tracer_);
+	}
+}
+
+void CTransferSocket::TraceSocketReady()
+{
+	if (socket_span_) {
+		if (socket_span_ratelimit_) {
+			socket_span_.stop(engine_.tracer_, trace_category::ratelimit, "Rate limit");
+		}
+		else {
+			socket_span_.stop(engine_.tracer_, trace_category::socket, m_transferMode == TransferMode::upload ? "Send" : "Receive");
+		}
+	}
+}
+
 void CTransferSocket::SetSocketBufferSizes(fz::socket_base& socket)
 {
 	const int size_read = engine_.GetOptions().get_int(OPTION_SOCKET_BUFFERSIZE_RECV);
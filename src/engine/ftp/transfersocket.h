@@ -104,6 +104,34 @@ protected:
 	size_t resumetest_{};
 
 	fz::buffer line_ending_buffer_;
+
+#ifdef __linux__
+	// Zero-copy path for plain data connections: Uploads get sent from the
+	// local file with sendfile, downloads get spliced into it through a pipe.
+	void InitDirectTransfer();
+	void DirectSend();
+	void DirectReceive();
+	bool DrainPipe(size_t size);
+	void DirectProgress(uint64_t amount, bool record);
+	bool FallBackFromDirect();
+
+	bool direct_checked_{};
+	int direct_fd_{-1};
+	uint64_t direct_offset_{};
+	uint64_t direct_remaining_{};
+	bool direct_started_{};
+	int pipe_[2]{-1, -1};
+	size_t pipe_size_{};
+#endif
+
+	void TraceSocketWait(unsigned int calls);
+	void TraceSocketReady();
+
+	trace_span connect_span_;
+	trace_span buffer_span_;
+	trace_span postponed_span_;
+	trace_span socket_span_;
+	bool socket_span_ratelimit_{};
 };
 
 #endif
@@ -0,0 +1,206 @@
+#include "filezilla.h"
+
+#include "happy_eyeballs.h"
+
+namespace {
+// Connection Attempt Delay recommended by RFC 8305
+fz::duration const attempt_delay = fz::duration::from_milliseconds(250);
+}
+
+CHappyEyeballs::CHappyEyeballs(fz::event_loop & loop, fz::event_handler & owner, fz::thread_pool & pool, CResolverCache & cache, fz::logger_interface & logger)
+	: fz::event_handler(loop)
+	, owner_(owner)
+	, pool_(pool)
+	, cache_(cache)
+	, logger_(logger)
+{
+}
+
+CHappyEyeballs::~CHappyEyeballs()
+{
+	cache_.RemoveHandler(*this);
+	remove_handler();
+}
+
+int CHappyEyeballs::connect(fz::native_string const& host, unsigned int port)
+{
+	if (resolving_ || !addresses_.empty() || socket_) {
+		return EALREADY;
+	}
+
+	if (host.empty() || port < 1 || port > 65535) {
+		return EINVAL;
+	}
+
+	host_ = host;
+	port_ = port;
+
+	if (fz::get_address_type(host) != fz::address_type::unknown) {
+		addresses_.push_back(fz::to_string(host));
+	}
+	else {
+		addresses_ = cache_.Lookup(host);
+		if (addresses_.empty()) {
+			resolving_ = true;
+			cache_.Resolve(host, *this);
+			return 0;
+		}
+		logger_.log(logmsg::debug_info, L"Using cached addresses of %s", host);
+	}
+
+	StartAttempt();
+	return 0;
+}
+
+void CHappyEyeballs::set_buffer_sizes(int size_read, int size_write)
+{
+	size_read_ = size_read;
+	size_write_ = size_write;
+}
+
+std::unique_ptr<fz::socket> CHappyEyeballs::take_socket()
+{
+	return std::move(socket_);
+}
+
+void CHappyEyeballs::operator()(fz::event_base const& ev)
+{
+	fz::dispatch<fz::socket_event, fz::timer_event, CResolveEvent>(ev, this,
+		&CHappyEyeballs::OnSocketEvent,
+		&CHappyEyeballs::OnTimer,
+		&CHappyEyeballs::OnResolved);
+}
+
+void CHappyEyeballs::OnResolved(fz::native_string const& host, std::vector<std::string> const& addresses, int error)
+{
+	if (!resolving_ || host != host_) {
+		return;
+	}
+	resolving_ = false;
+
+	if (error) {
+		logger_.log(logmsg::status, _("Connection attempt failed with \"%s\"."), fz::socket_error_description(error));
+		Finish(error);
+		return;
+	}
+
+	addresses_ = addresses;
+	StartAttempt();
+}
+
+void CHappyEyeballs::StartAttempt()
+{
+	stop_timer(timer_);
+	timer_ = 0;
+
+	while (next_ < addresses_.size()) {
+		std::string const& address = addresses_[next_++];
+		auto const type = fz::get_address_type(address);
+
+		auto socket = std::make_unique<fz::socket>(pool_, this);
+		if (size_read_ != -1 || size_write_ != -1) {
+			socket->set_buffer_sizes(size_read_, size_write_);
+		}
+
+		if (type == fz::address_type::ipv6) {
+			logger_.log(logmsg::status, _("Connecting to %s..."), fz::sprintf("[%s]:%u", address, port_));
+		}
+		else {
+			logger_.log(logmsg::status, _("Connecting to %s..."), fz::sprintf("%s:%u", address, port_));
+		}
+
+		int res = socket->connect(fz::to_native(address), port_, type);
+		if (res) {
+			logger_.log(logmsg::status, _("Connection attempt failed with \"%s\"."), fz::socket_error_description(res));
+			error_ = res;
+			continue;
+		}
+
+		attempts_.push_back({std::move(socket), address});
+
+		// Give this attempt a head start before racing the next address against it
+		if (next_ < addresses_.size()) {
+			timer_ = add_timer(attempt_delay, true);
+		}
+		return;
+	}
+
+	if (attempts_.empty()) {
+		Finish(error_ ? error_ : ECONNREFUSED);
+	}
+}
+
+void CHappyEyeballs::OnTimer(fz::timer_id id)
+{
+	if (id != timer_) {
+		return;
+	}
+	timer_ = 0;
+
+	StartAttempt();
+}
+
+void CHappyEyeballs::OnSocketEvent(fz::socket_event_source* source, fz::socket_event_flag t, int error)
+{
+	if (t != fz::socket_event_flag::connection) {
+		return;
+	}
+
+	auto it = attempts_.begin();
+	while (it != attempts_.end() && static_cast<fz::socket_event_source*>(it->socket_.get()) != source) {
+		++it;
+	}
+	if (it == attempts_.end()) {
+		return;
+	}
+
+	if (error) {
+		logger_.log(logmsg::status, _("Connection attempt failed with \"%s\"."), fz::socket_error_description(error));
+		error_ = error;
+		attempts_.erase(it);
+
+		// No need to wait for the timer
+		if (next_ < addresses_.size()) {
+			StartAttempt();
+		}
+		else if (attempts_.empty()) {
+			Finish(error);
+		}
+		return;
+	}
+
+	logger_.log(logmsg::debug_info, L"Connected to %s", it->address_);
+
+	socket_ = std::move(it->socket_);
+	socket_->set_event_handler(nullptr);
+	cache_.SetConnected(host_, it->address_);
+
+	// Closes the losing attempts
+	attempts_.clear();
+	stop_timer(timer_);
+	timer_ = 0;
+
+	Finish(0);
+}
+
+void CHappyEyeballs::Finish(int error)
+{
+	if (error && fz::get_address_type(host_) == fz::address_type::unknown) {
+		// The cached addresses might be outdated
+		cache_.Invalidate(host_);
+	}
+
+	owner_.send_event<CHappyEyeballsEvent>(error);
+}
+
+hostname_layer::hostname_layer(fz::event_handler* handler, fz::socket_interface& next_layer, fz::native_string const& host)
+	: fz::socket_layer(handler, next_layer, true)
+	, host_(host)
+{
+	next_layer.set_event_handler(handler);
+}
+
+hostname_layer::~hostname_layer()
+{
+	next_layer_.set_event_handler(nullptr);
+}
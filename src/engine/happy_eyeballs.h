@@ -0,0 +1,90 @@
+#ifndef FILEZILLA_ENGINE_HAPPY_EYEBALLS_HEADER
+#define FILEZILLA_ENGINE_HAPPY_EYEBALLS_HEADER
+
+#include "resolver_cache.h"
+
+#include <libfilezilla/event_handler.hpp>
+#include <libfilezilla/logger.hpp>
+#include <libfilezilla/socket.hpp>
+
+#include <memory>
+
+// Sent to the owner once connected, with an error code if all attempts failed
+struct happy_eyeballs_event_type;
+typedef fz::simple_event<happy_eyeballs_event_type, int> CHappyEyeballsEvent;
+
+/*
+ * Connects to a host, racing connection attempts to its addresses as
+ * described in RFC 8305. Host names are looked up through the resolver
+ * cache of the engine context.
+ *
+ * Once connected, the owner takes the socket and stacks its layers on it.
+ */
+class CHappyEyeballs final : public fz::event_handler
+{
+public:
+	CHappyEyeballs(fz::event_loop & loop, fz::event_handler & owner, fz::thread_pool & pool, CResolverCache & cache, fz::logger_interface & logger);
+	virtual ~CHappyEyeballs();
+
+	int connect(fz::native_string const& host, unsigned int port);
+
+	// Applied to each socket before connecting
+	void set_buffer_sizes(int size_read, int size_write);
+
+	fz::native_string const& host() const { return host_; }
+
+	std::unique_ptr<fz::socket> take_socket();
+
+private:
+	virtual void operator()(fz::event_base const& ev) override;
+
+	void OnResolved(fz::native_string const& host, std::vector<std::string> const& addresses, int error);
+	void OnSocketEvent(fz::socket_event_source* source, fz::socket_event_flag t, int error);
+	void OnTimer(fz::timer_id id);
+
+	void StartAttempt();
+	void Finish(int error);
+
+	fz::event_handler & owner_;
+	fz::thread_pool & pool_;
+	CResolverCache & cache_;
+	fz::logger_interface & logger_;
+
+	fz::native_string host_;
+	unsigned int port_{};
+
+	int size_read_{-1};
+	int size_write_{-1};
+
+	std::vector<std::string> addresses_;
+	size_t next_{};
+
+	struct attempt final
+	{
+		std::unique_ptr<fz::socket> socket_;
+		std::string address_;
+	};
+	std::vector<attempt> attempts_;
+
+	std::unique_ptr<fz::socket> socket_;
+
+	fz::timer_id timer_{};
+	int error_{};
+	bool resolving_{};
+};
+
+// Reports the host name instead of the address the socket got connected
+// to, TLS needs it for SNI and certificate verification.
+class hostname_layer final : public fz::socket_layer
+{
+public:
+	hostname_layer(fz::event_handler* handler, fz::socket_interface& next_layer, fz::native_string const& host);
+	virtual ~hostname_layer();
+
+	virtual fz::native_string peer_host() const override { return host_; }
+
+private:
+	fz::native_string const host_;
+};
+
+#endif
@@ -0,0 +1,149 @@
+#include "../filezilla.h"
+
+#include "contentencoding.h"
+
+#include <algorithm>
+#include <limits>
+
+#include <zlib.h>
+
+CHttpContentDecoder::CHttpContentDecoder(coding c)
+	: coding_(c)
+{
+}
+
+CHttpContentDecoder::~CHttpContentDecoder()
+{
+	if (initialized_) {
+		inflateEnd(stream_.get());
+	}
+}
+
+std::unique_ptr<CHttpContentDecoder> CHttpContentDecoder::create(std::string_view const& content_encoding)
+{
+	std::string_view v = content_encoding;
+	while (!v.empty() && (v.front() == ' ' || v.front() == '\t')) {
+		v.remove_prefix(1);
+	}
+	while (!v.empty() && (v.back() == ' ' || v.back() == '\t')) {
+		v.remove_suffix(1);
+	}
+
+	if (fz::equal_insensitive_ascii(v, std::string_view("gzip")) || fz::equal_insensitive_ascii(v, std::string_view("x-gzip"))) {
+		return std::make_unique<CHttpContentDecoder>(gzip);
+	}
+	if (fz::equal_insensitive_ascii(v, std::string_view("deflate"))) {
+		return std::make_unique<CHttpContentDecoder>(deflate);
+	}
+	return nullptr;
+}
+
+bool CHttpContentDecoder::init(unsigned char const* data)
+{
+	int bits = MAX_WBITS;
+	if (coding_ == gzip) {
+		// Makes zlib expect a gzip header
+		bits += 16;
+	}
+	else {
+		unsigned char const cmf = has_first_ ? first_ : data[0];
+		unsigned char const flg = has_first_ ? data[0] : data[1];
+		bool const zlib = (cmf & 0x0f) == Z_DEFLATED && (cmf >> 4) <= 7 && !(((cmf << 8) | flg) % 31);
+		if (!zlib) {
+			bits = -bits;
+		}
+	}
+
+	stream_ = std::make_unique<z_stream_s>();
+	if (inflateInit2(stream_.get(), bits) != Z_OK) {
+		stream_.reset();
+		return false;
+	}
+
+	initialized_ = true;
+	return true;
+}
+
+bool CHttpContentDecoder::decode(unsigned char const*& data, size_t & len, fz::buffer & out, size_t max_out)
+{
+	size_t const max_chunk = std::numeric_limits<uInt>::max();
+
+	while (max_out && (len || pending_)) {
+		if (finished_) {
+			if (coding_ == gzip && *data == 0x1f) {
+				// Next member
+				if (inflateReset(stream_.get()) != Z_OK) {
+					return false;
+				}
+				finished_ = false;
+			}
+			else {
+				encoded_ += len;
+				data += len;
+				len = 0;
+				break;
+			}
+		}
+
+		if (!initialized_) {
+			if (coding_ == deflate && !has_first_ && len < 2) {
+				first_ = *data++;
+				--len;
+				++encoded_;
+				has_first_ = true;
+				continue;
+			}
+			if (!init(data)) {
+				return false;
+			}
+		}
+
+		size_t in_len = std::min(len, max_chunk);
+		stream_->next_in = const_cast<unsigned char*>(data);
+		if (has_first_) {
+			stream_->next_in = &first_;
+			in_len = 1;
+		}
+		stream_->avail_in = static_cast<uInt>(in_len);
+
+		size_t const out_len = std::min(max_out, max_chunk);
+		stream_->next_out = out.get(out_len);
+		stream_->avail_out = static_cast<uInt>(out_len);
+
+		int const res = inflate(stream_.get(), Z_NO_FLUSH);
+
+		size_t const consumed = in_len - stream_->avail_in;
+		size_t const produced = out_len - stream_->avail_out;
+		if (has_first_) {
+			has_first_ = !consumed;
+		}
+		else {
+			data += consumed;
+			len -= consumed;
+			encoded_ += consumed;
+		}
+		out.add(produced);
+		decoded_ += produced;
+		max_out -= produced;
+
+		// Output space ran out, zlib might be holding back more
+		pending_ = !stream_->avail_out;
+
+		if (res == Z_STREAM_END) {
+			finished_ = true;
+			pending_ = false;
+		}
+		else if (res == Z_BUF_ERROR) {
+			// No progress possible, which is fine only if input is missing
+			pending_ = false;
+			if (len) {
+				return false;
+			}
+		}
+		else if (res != Z_OK) {
+			return false;
+		}
+	}
+
+	return true;
+}
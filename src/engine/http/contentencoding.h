@@ -0,0 +1,77 @@
+#ifndef FILEZILLA_ENGINE_HTTP_CONTENTENCODING_HEADER
+#define FILEZILLA_ENGINE_HTTP_CONTENTENCODING_HEADER
+
+#include "../../include/visibility.h"
+
+#include <libfilezilla/buffer.hpp>
+
+#include <memory>
+#include <string_view>
+
+struct z_stream_s;
+
+// Value of the Accept-Encoding header, lists the codings supported by
+// CHttpContentDecoder
+inline constexpr char http_accept_encoding[] = "gzip, deflate";
+
+/*
+ * Streaming decoder for the gzip and deflate content codings.
+ *
+ * gzip data may consist of multiple members. deflate data is supposed to
+ * be in zlib format, but some servers send raw deflate data instead, both
+ * are accepted. Anything following the end of the encoded data is ignored.
+ */
+class FZC_PUBLIC_SYMBOL CHttpContentDecoder final
+{
+public:
+	enum coding
+	{
+		gzip,
+		deflate
+	};
+
+	explicit CHttpContentDecoder(coding c);
+	~CHttpContentDecoder();
+
+	CHttpContentDecoder(CHttpContentDecoder const&) = delete;
+	CHttpContentDecoder& operator=(CHttpContentDecoder const&) = delete;
+
+	// Returns nullptr if the value of the Content-Encoding header does not
+	// name a supported coding.
+	static std::unique_ptr<CHttpContentDecoder> create(std::string_view const& content_encoding);
+
+	// Decodes data, advancing it and decreasing len by the amount consumed.
+	// At most max_out bytes get appended to out, input is left over only if
+	// that limit is reached. Returns false on malformed data.
+	bool decode(unsigned char const*& data, size_t & len, fz::buffer & out, size_t max_out);
+
+	// Whether decode can produce more output even without further input
+	bool pending() const { return pending_; }
+
+	// Whether the end of the encoded data has been reached
+	bool finished() const { return finished_; }
+
+	// Amount of data consumed and produced so far
+	uint64_t encoded() const { return encoded_; }
+	uint64_t decoded() const { return decoded_; }
+
+private:
+	// Needs the first two bytes of deflate data
+	bool init(unsigned char const* data);
+
+	coding const coding_;
+	std::unique_ptr<z_stream_s> stream_;
+	bool initialized_{};
+	bool pending_{};
+	bool finished_{};
+
+	// Telling zlib from raw deflate data takes the first two bytes, a
+	// single byte is kept until the next one arrives.
+	unsigned char first_{};
+	bool has_first_{};
+
+	uint64_t encoded_{};
+	uint64_t decoded_{};
+};
+
+#endif
@@ -1,6 +1,9 @@
 #include "../filezilla.h"
 
 #include "filetransfer.h"
+#include "ranges.h"
+
+#include "../../include/engine_options.h"
 
 #include <libfilezilla/local_filesys.hpp>
 
@@ -11,16 +14,29 @@ enum filetransferStates
 {
 	filetransfer_init = 0,
 	filetransfer_transfer,
-	filetransfer_waittransfer
+	filetransfer_waittransfer,
+	filetransfer_waitranges
 };
 
+namespace {
+// Compressed files are to be stored as they are. Servers tend to label them
+// with a content coding naming their format, e.g. .tar.gz as x-gzip.
+bool IsCompressedFile(std::string_view name)
+{
+	std::string const lower = fz::str_tolower_ascii(name);
+	return fz::ends_with(std::string_view(lower), std::string_view(".gz")) || fz::ends_with(std::string_view(lower), std::string_view(".tgz"));
+}
+}
+
 CHttpFileTransferOpData::CHttpFileTransferOpData(CHttpControlSocket & controlSocket, CFileTransferCommand const& cmd)
 	: CFileTransferOpData(L"CHttpFileTransferOpData", cmd)
 	, CHttpOpData(controlSocket)
 {
 	rr_.request_.uri_ = fz::uri(fz::to_utf8(currentServer_.Format(ServerFormat::url)) + fz::percent_encode(fz::to_utf8(remotePath_.FormatFilename(remoteFile_)), true));
 	rr_.request_.verb_ = "GET";
-
+	if (!IsCompressedFile(fz::to_utf8(remoteFile_))) {
+		rr_.request_.flags_ |= HttpRequest::flag_accept_content_coding;
+	}
 }
 
 CHttpFileTransferOpData::CHttpFileTransferOpData(CHttpControlSocket & controlSocket, CHttpRequestCommand const& cmd)
@@ -34,6 +50,14 @@ CHttpFileTransferOpData::CHttpFileTransferOpData(CHttpControlSocket & controlSoc
 	if (cmd.confidential_qs_) {
 		rr_.request_.flags_ |= HttpRequest::flag_confidential_querystring;
 	}
+	if (!IsCompressedFile(rr_.request_.uri_.path_)) {
+		rr_.request_.flags_ |= HttpRequest::flag_accept_content_coding;
+	}
+}
+
+CHttpFileTransferOpData::~CHttpFileTransferOpData()
+{
+	AbortRanges();
 }
 
 
@@ -71,7 +95,13 @@ int CHttpFileTransferOpData::Send()
 		}
 		return FZ_REPLY_CONTINUE;
 	case filetransfer_transfer:
-		if (resume_) {
+		rr_.request_.headers_.erase("Range");
+		rangeStart_ = resume_ ? static_cast<uint64_t>(localFileSize_) : 0;
+		rangeRequest_ = CanDownloadRanges();
+		if (rangeRequest_) {
+			rr_.request_.headers_["Range"] = fz::sprintf("bytes=%d-%d", rangeStart_, rangeStart_ + CHttpRangeDownload::chunk_size - 1);
+		}
+		else if (resume_) {
 			rr_.request_.headers_["Range"] = fz::sprintf("bytes=%d-", localFileSize_);
 		}
 
@@ -80,6 +110,11 @@ int CHttpFileTransferOpData::Send()
 		opState = filetransfer_waittransfer;
 		controlSocket_.Request(make_simple_rr(&rr_));
 		return FZ_REPLY_CONTINUE;
+	case filetransfer_waitranges:
+		if (!ranges_ || !ranges_->done()) {
+			return FZ_REPLY_WOULDBLOCK;
+		}
+		return FinishRanges();
 	default:
 		break;
 	}
@@ -109,31 +144,8 @@ int CHttpFileTransferOpData::OnHeader()
 			return FZ_REPLY_ERROR;
 		}
 
-		if (rr_.response_.code_ == 305) {
-			log(logmsg::error, _("Unsupported redirect"));
-			return FZ_REPLY_ERROR;
-		}
-
-		fz::uri location = fz::uri(rr_.response_.get_header("Location"));
-		if (!location.empty()) {
-			location.resolve(rr_.request_.uri_);
-		}
-
-		if (location.scheme_.empty() || location.host_.empty() || !location.is_absolute()) {
-			log(logmsg::error, _("Redirection to invalid or unsupported URI: %s"), location.to_string());
-			return FZ_REPLY_ERROR;
-		}
-
-		ServerProtocol protocol = CServer::GetProtocolFromPrefix(fz::to_wstring_from_utf8(location.scheme_));
-		if (protocol != HTTP && protocol != HTTPS) {
-			log(logmsg::error, _("Redirection to invalid or unsupported address: %s"), location.to_string());
-			return FZ_REPLY_ERROR;
-		}
-
-		// International domain names
-		std::wstring host = fz::to_wstring_from_utf8(location.host_);
-		if (host.empty()) {
-			log(logmsg::error, _("Invalid hostname: %s"), location.to_string());
+		fz::uri location = controlSocket_.GetRedirectLocation(rr_.request_, rr_.response_);
+		if (location.empty()) {
 			return FZ_REPLY_ERROR;
 		}
 
@@ -143,21 +155,54 @@ int CHttpFileTransferOpData::OnHeader()
 		return FZ_REPLY_OK;
 	}
 
+	uint64_t rangeEnd{};
+	uint64_t rangeTotal = aio_base::nosize;
+	if (rangeRequest_) {
+		rangeRequest_ = false;
+		if (rr_.response_.code_ == 206) {
+			uint64_t first{};
+			auto const ce = fz::str_tolower_ascii(rr_.response_.get_header("Content-Encoding"));
+			if (!ParseContentRange(rr_.response_.get_header("Content-Range"), first, rangeEnd, rangeTotal) || first != rangeStart_ || rangeTotal == aio_base::nosize || (!ce.empty() && ce != "identity")) {
+				log(logmsg::debug_info, L"Cannot use response to range request, requesting the file without range");
+				noRanges_ = true;
+				opState = filetransfer_transfer;
+				return FZ_REPLY_OK;
+			}
+			++rangeEnd;
+		}
+	}
+
 	// Check if the server disallowed resume
 	if (resume_ && rr_.response_.code_ != 206) {
 		resume_ = false;
 	}
 
+	checksum_.reset();
 	if (writer_factory_) {
 		auto writer = writer_factory_.open(resume_ ? localFileSize_ : 0, engine_, &controlSocket_, aio_base::shm_flag_none);
 		if (!writer) {
 			return FZ_REPLY_CRITICALERROR;
 		}
+
+		// The digests cover the encoded representation in its entirety
+		if (!resume_ && rangeTotal == aio_base::nosize && !rr_.response_.decoding() && engine_.GetOptions().get_int(OPTION_VERIFY_CHECKSUMS)) {
+			auto const alg = ParseHttpDigest(rr_.response_.get_header("Repr-Digest"), rr_.response_.get_header("Digest"), rr_.response_.get_header("Content-MD5"), expectedChecksum_);
+			if (alg != checksum_algorithm::none) {
+				checksum_ = std::make_shared<checksum_accumulator>(alg);
+				writer = make_checksum_writer(engine_, &controlSocket_, std::move(writer), checksum_);
+			}
+		}
 		rr_.response_.writer_ = std::move(writer);
 	}
 
-	int64_t totalSize = fz::to_integral<int64_t>(rr_.response_.get_header("Content-Length"), -1);
-	if (totalSize == -1) {
+	int64_t totalSize = -1;
+	if (!rr_.response_.decoding()) {
+		totalSize = fz::to_integral<int64_t>(rr_.response_.get_header("Content-Length"), -1);
+	}
+	if (rangeTotal != aio_base::nosize) {
+		totalSize = static_cast<int64_t>(rangeTotal);
+	}
+	else if (totalSize == -1) {
 		if (remoteFileSize_ != -1) {
 			totalSize = remoteFileSize_;
 		}
@@ -168,6 +213,15 @@ int CHttpFileTransferOpData::OnHeader()
 		engine_.transfer_status_.SetStartTime();
 	}
 
+	if (rangeTotal != aio_base::nosize && rangeEnd < rangeTotal) {
+		int const connections = engine_.GetOptions().get_int(OPTION_HTTP_RANGE_CONNECTIONS);
+		log(logmsg::debug_info, L"Downloading bytes %d-%d over up to %d additional connections", rangeEnd, rangeTotal - 1, connections);
+
+		firstRangeDone_ = false;
+		ranges_ = std::make_unique<CHttpRangeDownload>(controlSocket_, writer_factory_, rr_.request_);
+		ranges_->Start(rangeEnd, rangeTotal, connections);
+	}
+
 	return FZ_REPLY_CONTINUE;
 }
 
@@ -177,5 +231,86 @@ int CHttpFileTransferOpData::SubcommandResult(int prevResult, COpData const&)
 		return FZ_REPLY_CONTINUE;
 	}
 
+	if (ranges_ && prevResult == FZ_REPLY_OK) {
+		firstRangeDone_ = true;
+		if (!ranges_->done()) {
+			opState = filetransfer_waitranges;
+			return FZ_REPLY_WOULDBLOCK;
+		}
+		return FinishRanges();
+	}
+
+	if (checksum_ && prevResult == FZ_REPLY_OK) {
+		return VerifyChecksum(engine_, *checksum_, expectedChecksum_) ? FZ_REPLY_OK : FZ_REPLY_CRITICALERROR;
+	}
+
 	return prevResult;
 }
+
+bool CHttpFileTransferOpData::CanDownloadRanges() const
+{
+	if (noRanges_ || rr_.request_.verb_ != "GET" || rr_.request_.body_ || !writer_factory_.supports_ranges()) {
+		return false;
+	}
+
+	if (engine_.GetOptions().get_int(OPTION_HTTP_RANGE_CONNECTIONS) <= 0) {
+		return false;
+	}
+
+	// Not worth it if the rest fits into the first chunk anyhow
+	if (remoteFileSize_ >= 0 && remoteFileSize_ - static_cast<int64_t>(rangeStart_) <= static_cast<int64_t>(CHttpRangeDownload::chunk_size)) {
+		return false;
+	}
+
+	return true;
+}
+
+int CHttpFileTransferOpData::OnRangesDone(CHttpRangeDownload const* ranges)
+{
+	if (opState != filetransfer_waitranges || !ranges_ || ranges_.get() != ranges) {
+		return FZ_REPLY_WOULDBLOCK;
+	}
+
+	return FinishRanges();
+}
+
+int CHttpFileTransferOpData::FinishRanges()
+{
+	int const res = ranges_->result();
+	if (res == FZ_REPLY_OK) {
+		ranges_.reset();
+		return FZ_REPLY_OK;
+	}
+
+	if (res == FZ_REPLY_DISCONNECTED) {
+		// Continue on the control connection where the written data ends
+		uint64_t const offset = ranges_->contiguous();
+		ranges_.reset();
+		rr_.response_.writer_.reset();
+
+		log(logmsg::status, _("Additional connections failed, continuing download at offset %d"), offset);
+		noRanges_ = true;
+		resume_ = offset > 0;
+		localFileSize_ = static_cast<int64_t>(offset);
+		engine_.transfer_status_.Reset();
+		opState = filetransfer_transfer;
+		return FZ_REPLY_CONTINUE;
+	}
+
+	return res;
+}
+
+void CHttpFileTransferOpData::AbortRanges()
+{
+	if (!ranges_) {
+		return;
+	}
+
+	uint64_t const offset = firstRangeDone_ ? ranges_->contiguous() : rangeStart_;
+	ranges_.reset();
+	rr_.response_.writer_.reset();
+
+	// Chunks behind a gap might have been written, cut them off so that the
+	// download can be resumed.
+	writer_factory_.open(offset, engine_, nullptr, aio_base::shm_flag_none, false);
+}
@@ -3,8 +3,11 @@
 
 #include "httpcontrolsocket.h"
 
+#include "../checksum.h"
+
 #include <libfilezilla/file.hpp>
 
+class CHttpRangeDownload;
 class CServerPath;
 
 class CHttpFileTransferOpData final : public CFileTransferOpData, public CHttpOpData
@@ -12,17 +15,36 @@ class CHttpFileTransferOpData final : public CFileTransferOpData, public CHttpOp
 public:
 	CHttpFileTransferOpData(CHttpControlSocket & controlSocket, CFileTransferCommand const&);
 	CHttpFileTransferOpData(CHttpControlSocket & controlSocket, CHttpRequestCommand const&);
+	virtual ~CHttpFileTransferOpData();
 
 	virtual int Send() override;
 	virtual int ParseResponse() override { return FZ_REPLY_INTERNALERROR; }
 	virtual int SubcommandResult(int prevResult, COpData const& previousOperation) override;
 
+	int OnRangesDone(CHttpRangeDownload const* ranges);
+
 private:
 	int OnHeader();
 
+	bool CanDownloadRanges() const;
+	int FinishRanges();
+	void AbortRanges();
+
 	HttpRequestResponse rr_;
 
 	int redirectCount_{};
+
+	// Large files get downloaded in ranges over additional connections. The
+	// request of the control socket asks for the first chunk only.
+	bool rangeRequest_{};
+	bool noRanges_{};
+	bool firstRangeDone_{};
+	uint64_t rangeStart_{};
+	std::unique_ptr<CHttpRangeDownload> ranges_;
+
+	// Set if the response carries a digest of the complete file
+	std::shared_ptr<checksum_accumulator> checksum_;
+	std::vector<uint8_t> expectedChecksum_;
 };
 
 #endif
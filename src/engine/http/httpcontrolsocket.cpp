@@ -4,12 +4,14 @@
 #include "filetransfer.h"
 #include "httpcontrolsocket.h"
 #include "internalconnect.h"
+#include "ranges.h"
 #include "request.h"
 
 #include "../../include/engine_options.h"
 
 #include "../controlsocket.h"
 #include "../engineprivate.h"
+#include "../happy_eyeballs.h"
 #include "../tls.h"
 
 #include <libfilezilla/file.hpp>
@@ -45,7 +47,7 @@ uint64_t HttpRequest::update_content_length()
 
 int HttpRequest::reset()
 {
-	flags_ &= (flag_update_transferstatus | flag_confidential_querystring);
+	flags_ &= (flag_update_transferstatus | flag_confidential_querystring | flag_accept_content_coding);
 
 	if (body_) {
 		aio_result res = body_->rewind();
@@ -225,7 +227,7 @@ void CHttpControlSocket::OnConnect()
 			active_layer_ = tls_layer_.get();
 
 			tls_layer_->set_alpn("http/1.1");
-			if (!tls_layer_->client_handshake(&data)) {
+			if (!ClientHandshake(data)) {
 				tls_layer_->set_min_tls_ver(get_min_tls_ver(engine_.GetOptions()));
 				DoClose();
 			}
@@ -241,6 +243,44 @@ void CHttpControlSocket::OnConnect()
 	}
 }
 
+bool CHttpControlSocket::ClientHandshake(fz::event_handler & verification_handler)
+{
+	return tls_layer_->client_handshake(&verification_handler);
+}
+
+fz::uri CHttpControlSocket::GetRedirectLocation(HttpRequest const& request, HttpResponse const& response)
+{
+	if (response.code_ == 305) {
+		log(logmsg::error, _("Unsupported redirect"));
+		return fz::uri();
+	}
+
+	fz::uri location = fz::uri(response.get_header("Location"));
+	if (!location.empty()) {
+		location.resolve(request.uri_);
+	}
+
+	if (location.scheme_.empty() || location.host_.empty() || !location.is_absolute()) {
+		log(logmsg::error, _("Redirection to invalid or unsupported URI: %s"), location.to_string());
+		return fz::uri();
+	}
+
+	ServerProtocol protocol = CServer::GetProtocolFromPrefix(fz::to_wstring_from_utf8(location.scheme_));
+	if (protocol != HTTP && protocol != HTTPS) {
+		log(logmsg::error, _("Redirection to invalid or unsupported address: %s"), location.to_string());
+		return fz::uri();
+	}
+
+	// International domain names
+	std::wstring host = fz::to_wstring_from_utf8(location.host_);
+	if (host.empty()) {
+		log(logmsg::error, _("Invalid hostname: %s"), location.to_string());
+		return fz::uri();
+	}
+
+	return location;
+}
+
 void CHttpControlSocket::FileTransfer(CFileTransferCommand const& cmd)
 {
 	log(logmsg::debug_verbose, L"CHttpControlSocket::FileTransfer()");
@@ -346,6 +386,7 @@ int CHttpControlSocket::Disconnect()
 void CHttpControlSocket::Connect(CServer const& server, Credentials const& credentials)
 {
 	currentServer_ = server;
+	ResolveCapabilities();
 	credentials_ = credentials;
 	Push(std::make_unique<CHttpConnectOpData>(*this));
 }
@@ -363,7 +404,7 @@ int CHttpControlSocket::OnSend()
 
 void CHttpControlSocket::SetSocketBufferSizes()
 {
-	if (!socket_) {
+	if (!happy_eyeballs_) {
 		return;
 	}
 
@@ -373,5 +414,30 @@ void CHttpControlSocket::SetSocketBufferSizes()
 #else
 	const int size_write = engine_.GetOptions().get_int(OPTION_SOCKET_BUFFERSIZE_SEND);
 #endif
-	socket_->set_buffer_sizes(size_read, size_write);
+	happy_eyeballs_->set_buffer_sizes(size_read, size_write);
+}
+
+void CHttpControlSocket::operator()(fz::event_base const& ev)
+{
+	if (fz::dispatch<CHttpRangesDoneEvent>(ev, this, &CHttpControlSocket::OnRangesDone)) {
+		return;
+	}
+
+	CRealControlSocket::operator()(ev);
+}
+
+void CHttpControlSocket::OnRangesDone(CHttpRangeDownload* ranges)
+{
+	// While the initial request is still running, its completion picks up the result
+	if (operations_.empty() || operations_.back()->opId != Command::transfer) {
+		return;
+	}
+
+	int res = static_cast<CHttpFileTransferOpData&>(*operations_.back()).OnRangesDone(ranges);
+	if (res == FZ_REPLY_CONTINUE) {
+		SendNextCommand();
+	}
+	else if (res != FZ_REPLY_WOULDBLOCK) {
+		ResetOperation(res);
+	}
 }
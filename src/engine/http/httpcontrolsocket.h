@@ -70,7 +70,8 @@ public:
 		flag_sent_header = 0x02,
 		flag_sent_body = 0x04,
 		flag_update_transferstatus = 0x08,
-		flag_confidential_querystring = 0x10
+		flag_confidential_querystring = 0x10,
+		flag_accept_content_coding = 0x20 // The response body may be sent compressed and gets decoded
 	};
 	int flags_{};
 
@@ -105,7 +106,8 @@ public:
 		flag_got_header = 0x02,
 		flag_got_body = 0x04,
 		flag_no_body = 0x08, // e.g. on HEAD requests, or 204/304 responses
-		flag_ignore_body = 0x10 // If set, on_data_ isn't called
+		flag_ignore_body = 0x10, // If set, on_data_ isn't called
+		flag_decoding = 0x20 // The body gets decoded according to its Content-Encoding, Content-Length does not apply to the decoded data
 	};
 	int flags_{};
 
@@ -113,6 +115,7 @@ public:
 	bool got_header() const { return flags_ & flag_got_header; }
 	bool got_body() const { return (flags_ & (flag_got_body | flag_no_body | flag_ignore_body)) == flag_got_body; }
 	bool no_body() const { return flags_ & flag_no_body; }
+	bool decoding() const { return flags_ & flag_decoding; }
 
 	// Called once the complete header has been received.
 	// Return one of:
@@ -168,6 +171,8 @@ namespace fz {
 class tls_layer;
 }
 
+class CHttpRangeDownload;
+
 class RequestThrottler final
 {
 public:
@@ -214,6 +219,14 @@ protected:
 
 	std::unique_ptr<fz::tls_layer> tls_layer_;
 
+	// Starts the handshake on tls_layer_, certificate verification events
+	// go to the given handler.
+	virtual bool ClientHandshake(fz::event_handler & verification_handler);
+
+	// Returns the target of a redirect response, resolved against the URI of
+	// the request. Returns an empty URI and logs why if it cannot be followed.
+	fz::uri GetRedirectLocation(HttpRequest const& request, HttpResponse const& response);
+
 	virtual void OnConnect() override;
 	virtual void OnSocketError(int error) override;
 	virtual void OnReceive() override;
@@ -223,9 +236,13 @@ protected:
 
 	virtual void SetSocketBufferSizes() override;
 
+	virtual void operator()(fz::event_base const& ev) override;
+	void OnRangesDone(CHttpRangeDownload* ranges);
+
 	friend class CProtocolOpData<CHttpControlSocket>;
 	friend class CHttpFileTransferOpData;
 	friend class CHttpInternalConnectOpData;
+	friend class CHttpRangeDownload;
 	friend class CHttpRequestOpData;
 
 private:
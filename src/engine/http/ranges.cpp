@@ -0,0 +1,461 @@
+#include "../filezilla.h"
+
+#include "ranges.h"
+
+#include "../engineprivate.h"
+#include "../tls.h"
+
+#include <algorithm>
+
+namespace {
+// A chunk failing this often in a row without progress fails the download
+int const max_chunk_failures = 5;
+
+// A connection that fails this often in a row gets dropped
+int const max_connection_failures = 2;
+
+struct range_request_done_event_type;
+typedef fz::simple_event<range_request_done_event_type, int> CHttpRangeRequestDoneEvent;
+
+bool parse_number(std::string_view const& s, uint64_t & out)
+{
+	if (s.empty() || s.size() > 19) {
+		return false;
+	}
+	out = 0;
+	for (auto const c : s) {
+		if (c < '0' || c > '9') {
+			return false;
+		}
+		out = out * 10 + static_cast<uint64_t>(c - '0');
+	}
+	return true;
+}
+}
+
+bool ParseContentRange(std::string_view const& value, uint64_t & first, uint64_t & last, uint64_t & total)
+{
+	std::string_view v = value;
+	if (v.size() < 6 || !fz::equal_insensitive_ascii(v.substr(0, 6), std::string_view("bytes "))) {
+		return false;
+	}
+	v = v.substr(6);
+	while (!v.empty() && v.front() == ' ') {
+		v.remove_prefix(1);
+	}
+
+	auto const dash = v.find('-');
+	auto const slash = v.find('/');
+	if (dash == std::string_view::npos || slash == std::string_view::npos || dash > slash) {
+		return false;
+	}
+
+	if (!parse_number(v.substr(0, dash), first) || !parse_number(v.substr(dash + 1, slash - dash - 1), last) || last < first) {
+		return false;
+	}
+
+	auto const t = v.substr(slash + 1);
+	if (t == "*") {
+		total = aio_base::nosize;
+	}
+	else if (!parse_number(t, total) || last >= total) {
+		return false;
+	}
+
+	return true;
+}
+
+class CHttpRangeSocket final : public CHttpControlSocket
+{
+public:
+	explicit CHttpRangeSocket(CHttpRangeDownload & owner);
+	virtual ~CHttpRangeSocket();
+
+	// Takes the next range and requests it
+	void Next();
+
+	bool idle() const { return !busy_ && !retired_; }
+
+protected:
+	virtual int ResetOperation(int result) override;
+	virtual bool ClientHandshake(fz::event_handler & verification_handler) override;
+	virtual void OnReceive() override;
+	virtual void operator()(fz::event_base const& ev) override;
+
+private:
+	void SendRangeRequest();
+	int OnHeader();
+	void OnRequestDone(int result);
+
+	CHttpRangeDownload & owner_;
+
+	CHttpRangeDownload::range range_;
+	HttpRequestResponse rr_;
+
+	// Redirects apply to the following requests of this connection
+	fz::uri uri_;
+	int redirects_{};
+	bool redirected_{};
+
+	// End of the range the server actually sends
+	uint64_t end_{};
+
+	// Set once the server started sending the range
+	bool started_{};
+
+	int failures_{};
+	bool busy_{};
+	bool retired_{};
+};
+
+CHttpRangeSocket::CHttpRangeSocket(CHttpRangeDownload & owner)
+	: CHttpControlSocket(owner.controlSocket_.GetEngine())
+	, owner_(owner)
+	, uri_(owner.uri_)
+{
+	secondary_ = true;
+	currentServer_ = owner.controlSocket_.GetCurrentServer();
+	ResolveCapabilities();
+}
+
+CHttpRangeSocket::~CHttpRangeSocket()
+{
+	remove_handler();
+
+	// The request operation refers to rr_, drop it without a result
+	while (!operations_.empty()) {
+		operations_.pop_back();
+	}
+}
+
+void CHttpRangeSocket::Next()
+{
+	if (busy_ || retired_) {
+		return;
+	}
+
+	if (!owner_.Take(range_)) {
+		ResetSocket();
+		return;
+	}
+
+	busy_ = true;
+	redirects_ = 0;
+	SendRangeRequest();
+}
+
+void CHttpRangeSocket::SendRangeRequest()
+{
+	started_ = false;
+	redirected_ = false;
+	end_ = range_.end_;
+
+	rr_.request_.uri_ = uri_;
+	rr_.request_.verb_ = "GET";
+	rr_.request_.headers_ = owner_.headers_;
+	rr_.request_.headers_["Connection"] = "keep-alive";
+	rr_.request_.headers_["Range"] = fz::sprintf("bytes=%d-%d", range_.start_, range_.end_ - 1);
+	rr_.request_.flags_ = owner_.confidential_qs_ ? HttpRequest::flag_confidential_querystring : 0;
+	rr_.response_.writer_.reset();
+	rr_.response_.on_header_ = [this](auto const&) { return this->OnHeader(); };
+
+	log(logmsg::debug_info, L"Requesting bytes %d-%d on additional connection", range_.start_, range_.end_ - 1);
+	Request(make_simple_rr(&rr_));
+	SendNextCommand();
+}
+
+int CHttpRangeSocket::OnHeader()
+{
+	auto const& response = rr_.response_;
+
+	if (response.code_ >= 300 && response.code_ < 400) {
+		if (++redirects_ >= 6) {
+			log(logmsg::error, _("Too many redirects"));
+			return FZ_REPLY_ERROR;
+		}
+
+		fz::uri location = GetRedirectLocation(rr_.request_, response);
+		if (location.empty()) {
+			return FZ_REPLY_ERROR;
+		}
+
+		uri_ = location;
+		redirected_ = true;
+		return FZ_REPLY_OK;
+	}
+
+	// Refusals such as 429 or 503 count against the connection, not the range
+	if (response.code_ != 206) {
+		log(logmsg::debug_warning, L"Server responded with %u to range request on additional connection", response.code_);
+		return FZ_REPLY_ERROR;
+	}
+
+	uint64_t first{};
+	uint64_t last{};
+	uint64_t total{};
+	if (!ParseContentRange(response.get_header("Content-Range"), first, last, total) || first != range_.start_ || last >= range_.end_) {
+		log(logmsg::debug_warning, L"Server sent wrong range: %s", response.get_header("Content-Range"));
+		return FZ_REPLY_ERROR;
+	}
+
+	auto const ce = fz::str_tolower_ascii(response.get_header("Content-Encoding"));
+	if (!ce.empty() && ce != "identity") {
+		log(logmsg::debug_warning, L"Unsupported encoding of range response on additional connection");
+		return FZ_REPLY_ERROR;
+	}
+
+	// Without a length, a closed connection cannot be told apart from the end of the range
+	auto const cl = response.get_header("Content-Length");
+	if (cl.empty()) {
+		if (fz::str_tolower_ascii(response.get_header("Transfer-Encoding")) != "chunked") {
+			log(logmsg::debug_warning, L"Range response on additional connection has no length");
+			return FZ_REPLY_ERROR;
+		}
+	}
+	else if (fz::to_integral<uint64_t>(cl, aio_base::nosize) != last - first + 1) {
+		log(logmsg::debug_warning, L"Content-Length does not match range on additional connection");
+		return FZ_REPLY_ERROR;
+	}
+
+	rr_.response_.writer_ = owner_.writer_factory_.open_range(first, engine_, this, aio_base::shm_flag_none);
+	if (!rr_.response_.writer_) {
+		return FZ_REPLY_CRITICALERROR;
+	}
+
+	end_ = last + 1;
+	started_ = true;
+	return FZ_REPLY_CONTINUE;
+}
+
+int CHttpRangeSocket::ResetOperation(int result)
+{
+	bool const last = operations_.size() == 1;
+	result = CHttpControlSocket::ResetOperation(result);
+	if (last && operations_.empty()) {
+		// Handled once the request operation has fully unwound
+		send_event<CHttpRangeRequestDoneEvent>(result);
+	}
+	return result;
+}
+
+void CHttpRangeSocket::OnRequestDone(int result)
+{
+	if (!busy_) {
+		return;
+	}
+
+	busy_ = false;
+	rr_.response_.writer_.reset();
+
+	if (result == FZ_REPLY_OK && redirected_) {
+		busy_ = true;
+		SendRangeRequest();
+		return;
+	}
+
+	if (result == FZ_REPLY_OK && started_) {
+		failures_ = 0;
+		owner_.Done(range_, end_ - range_.start_, false);
+	}
+	else if ((result & FZ_REPLY_CRITICALERROR) == FZ_REPLY_CRITICALERROR) {
+		retired_ = true;
+		ResetSocket();
+		owner_.Finish(FZ_REPLY_CRITICALERROR);
+		return;
+	}
+	else {
+		// If nothing got received, it is the connection that failed, not the range.
+		// The range gets requested anew, whatever got written is overwritten.
+		owner_.Done(range_, 0, started_);
+		if (++failures_ >= max_connection_failures) {
+			retired_ = true;
+			ResetSocket();
+			owner_.Retire();
+			return;
+		}
+	}
+
+	Next();
+}
+
+bool CHttpRangeSocket::ClientHandshake(fz::event_handler &)
+{
+	// Only the certificate accepted on the control connection is good
+	tls_layer_->set_min_tls_ver(get_min_tls_ver(engine_.GetOptions()));
+	return tls_layer_->client_handshake(owner_.certificate_, owner_.session_, owner_.session_host_);
+}
+
+void CHttpRangeSocket::OnReceive()
+{
+	// The control socket waits for the ranges, keep it from timing out
+	owner_.controlSocket_.SetAlive();
+	CHttpControlSocket::OnReceive();
+}
+
+void CHttpRangeSocket::operator()(fz::event_base const& ev)
+{
+	if (fz::dispatch<CHttpRangeRequestDoneEvent>(ev, this, &CHttpRangeSocket::OnRequestDone)) {
+		return;
+	}
+
+	CHttpControlSocket::operator()(ev);
+}
+
+
+CHttpRangeDownload::CHttpRangeDownload(CHttpControlSocket & controlSocket, writer_factory_holder const& writer_factory, HttpRequest const& request)
+	: controlSocket_(controlSocket)
+	, writer_factory_(writer_factory)
+	, uri_(request.uri_)
+	, headers_(request.headers_)
+	, confidential_qs_(request.flags_ & HttpRequest::flag_confidential_querystring)
+{
+	for (auto const& name : {"Host", "Connection", "User-Agent", "Range", "Content-Length", "Accept-Encoding"}) {
+		headers_.erase(name);
+	}
+
+	tls_ = uri_.scheme_ == "https";
+
+	if (tls_ && controlSocket_.tls_layer_) {
+		certificate_ = controlSocket_.tls_layer_->get_raw_certificate();
+		session_ = controlSocket_.tls_layer_->get_session_parameters();
+		session_host_ = controlSocket_.tls_layer_->peer_host();
+	}
+}
+
+CHttpRangeDownload::~CHttpRangeDownload()
+{
+	// Connections write through their own writers, which need to be closed
+	// before the caller touches the file again.
+	connections_.clear();
+}
+
+void CHttpRangeDownload::Start(uint64_t begin, uint64_t end, int connections)
+{
+	begin_ = begin;
+	for (uint64_t pos = begin; pos < end; pos += chunk_size) {
+		pending_.push_back(range{pos, std::min(end, pos + chunk_size), 0});
+	}
+
+	if (tls_ && certificate_.empty()) {
+		// Without the certificate of the control connection the server
+		// cannot be verified.
+		Finish(FZ_REPLY_DISCONNECTED);
+		return;
+	}
+
+	size_t const count = std::min(static_cast<size_t>(std::max(connections, 1)), pending_.size());
+	for (size_t i = 0; i < count; ++i) {
+		connections_.push_back(std::make_unique<CHttpRangeSocket>(*this));
+	}
+	alive_ = static_cast<int>(count);
+
+	// Index-based, connections may retire while others get started
+	for (size_t i = 0; i < count && !done_; ++i) {
+		connections_[i]->Next();
+	}
+	Check();
+}
+
+bool CHttpRangeDownload::Take(range & r)
+{
+	if (done_ || pending_.empty()) {
+		return false;
+	}
+
+	r = pending_.front();
+	pending_.pop_front();
+	++in_flight_;
+	return true;
+}
+
+void CHttpRangeDownload::Done(range const& r, uint64_t written, bool failed)
+{
+	--in_flight_;
+	if (done_) {
+		return;
+	}
+
+	if (written) {
+		uint64_t start = r.start_;
+		uint64_t end = r.start_ + written;
+
+		auto next = completed_.lower_bound(start);
+		if (next != completed_.end() && next->first == end) {
+			end = next->second;
+			next = completed_.erase(next);
+		}
+		if (next != completed_.begin()) {
+			auto prev = std::prev(next);
+			if (prev->second == start) {
+				start = prev->first;
+				completed_.erase(prev);
+			}
+		}
+		completed_[start] = end;
+	}
+
+	if (r.start_ + written < r.end_) {
+		range rest{r.start_ + written, r.end_, written ? 0 : r.failures_};
+		if (failed && ++rest.failures_ >= max_chunk_failures) {
+			controlSocket_.log(logmsg::error, _("Downloading bytes %d-%d failed repeatedly"), rest.start_, rest.end_ - 1);
+			Finish(FZ_REPLY_ERROR);
+			return;
+		}
+
+		// In front, so that the data written without gaps keeps growing
+		pending_.push_front(rest);
+	}
+
+	Check();
+}
+
+void CHttpRangeDownload::Retire()
+{
+	--alive_;
+	if (done_) {
+		return;
+	}
+
+	// Whatever the connection left behind is for the others to take
+	for (size_t i = 0; i < connections_.size() && !done_ && !pending_.empty(); ++i) {
+		if (connections_[i]->idle()) {
+			connections_[i]->Next();
+		}
+	}
+	Check();
+}
+
+void CHttpRangeDownload::Check()
+{
+	if (done_) {
+		return;
+	}
+
+	if (pending_.empty() && !in_flight_) {
+		Finish(FZ_REPLY_OK);
+	}
+	else if (alive_ <= 0) {
+		controlSocket_.log(logmsg::debug_info, L"No additional connections left, %d ranges remaining", pending_.size() + in_flight_);
+		Finish(FZ_REPLY_DISCONNECTED);
+	}
+}
+
+void CHttpRangeDownload::Finish(int result)
+{
+	if (done_) {
+		return;
+	}
+
+	done_ = true;
+	result_ = result;
+	controlSocket_.send_event<CHttpRangesDoneEvent>(this);
+}
+
+uint64_t CHttpRangeDownload::contiguous() const
+{
+	auto it = completed_.find(begin_);
+	if (it == completed_.end()) {
+		return begin_;
+	}
+	return it->second;
+}
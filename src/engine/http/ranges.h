@@ -0,0 +1,119 @@
+#ifndef FILEZILLA_ENGINE_HTTP_RANGES_HEADER
+#define FILEZILLA_ENGINE_HTTP_RANGES_HEADER
+
+#include "httpcontrolsocket.h"
+
+#include <deque>
+#include <map>
+#include <string_view>
+
+class CHttpRangeDownload;
+
+// Sent to the control socket once all ranges are downloaded or the
+// download cannot continue
+struct http_ranges_done_event_type;
+typedef fz::simple_event<http_ranges_done_event_type, CHttpRangeDownload*> CHttpRangesDoneEvent;
+
+class CHttpRangeSocket;
+
+// Parses a Content-Range header value of the form "bytes first-last/total",
+// the total is aio_base::nosize if unknown.
+bool FZC_PUBLIC_SYMBOL ParseContentRange(std::string_view const& value, uint64_t & first, uint64_t & last, uint64_t & total);
+
+/*
+ * Downloads ranges of a file over additional connections to the same
+ * server, alongside the connection of the control socket.
+ *
+ * Each additional connection is an HTTP control socket of its own, its
+ * requests go through the same request operation as those of the control
+ * socket. Proxies, chunked responses and redirects are thus handled the
+ * same way.
+ *
+ * The ranges get split into chunks that the connections take from a
+ * shared queue, each chunk gets written at its offset through its own
+ * writer. A chunk that fails after the server started sending it gets
+ * retried, possibly on another connection. A connection that cannot be
+ * established or gets refused by the server gets dropped without counting
+ * against the chunk.
+ *
+ * The result is one of
+ *   FZ_REPLY_OK: Everything got downloaded
+ *   FZ_REPLY_DISCONNECTED: No connection is left to download the
+ *     remaining chunks, contiguous() tells where to continue from
+ *   FZ_REPLY_ERROR or FZ_REPLY_CRITICALERROR: The download failed
+ */
+class CHttpRangeDownload final
+{
+public:
+	// The connections request the same URI with the same headers as the
+	// request of the control socket and need to present the certificate
+	// accepted on it.
+	CHttpRangeDownload(CHttpControlSocket & controlSocket, writer_factory_holder const& writer_factory, HttpRequest const& request);
+	~CHttpRangeDownload();
+
+	CHttpRangeDownload(CHttpRangeDownload const&) = delete;
+	CHttpRangeDownload& operator=(CHttpRangeDownload const&) = delete;
+
+	// Downloads [begin, end) over up to the given number of connections
+	void Start(uint64_t begin, uint64_t end, int connections);
+
+	bool done() const { return done_; }
+	int result() const { return result_; }
+
+	// End of the data written without gaps, starting at begin
+	uint64_t contiguous() const;
+
+	// Size of the chunks, the initial request of a transfer asks for one
+	// chunk only to find out whether the server supports ranges.
+	static uint64_t const chunk_size{8 * 1024 * 1024};
+
+private:
+	friend class CHttpRangeSocket;
+
+	struct range final
+	{
+		uint64_t start_{};
+		uint64_t end_{};
+		int failures_{};
+	};
+
+	bool Take(range & r);
+
+	// Called for every taken range. The part of it that has not been
+	// written goes back into the queue.
+	void Done(range const& r, uint64_t written, bool failed);
+
+	// Called if a connection gives up
+	void Retire();
+
+	void Check();
+	void Finish(int result);
+
+	CHttpControlSocket & controlSocket_;
+	writer_factory_holder writer_factory_;
+
+	fz::uri uri_;
+	HttpHeaders headers_;
+	bool confidential_qs_{};
+
+	// The TLS session of the control connection gets resumed if possible
+	bool tls_{};
+	std::vector<uint8_t> certificate_;
+	std::vector<uint8_t> session_;
+	fz::native_string session_host_;
+
+	std::vector<std::unique_ptr<CHttpRangeSocket>> connections_;
+	int alive_{};
+
+	std::deque<range> pending_;
+	size_t in_flight_{};
+
+	// Completed ranges, by their start, adjacent ones get merged
+	std::map<uint64_t, uint64_t> completed_;
+	uint64_t begin_{};
+
+	int result_{FZ_REPLY_OK};
+	bool done_{};
+};
+
+#endif
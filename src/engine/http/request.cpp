@@ -13,7 +13,7 @@ CHttpRequestOpData::CHttpRequestOpData(CHttpControlSocket & controlSocket, std::
 {
 	opState = request_init | request_reading;
 
-	request->request().flags_ &= (HttpRequest::flag_update_transferstatus | HttpRequest::flag_confidential_querystring);
+	request->request().flags_ &= (HttpRequest::flag_update_transferstatus | HttpRequest::flag_confidential_querystring | HttpRequest::flag_accept_content_coding);
 	request->response().flags_ = 0;
 
 	requests_.emplace_back(request);
@@ -26,7 +26,7 @@ CHttpRequestOpData::CHttpRequestOpData(CHttpControlSocket & controlSocket, std::
 	, requests_(requests)
 {
 	for (auto & rr : requests_) {
-		rr->request().flags_ &= (HttpRequest::flag_update_transferstatus | HttpRequest::flag_confidential_querystring);
+		rr->request().flags_ &= (HttpRequest::flag_update_transferstatus | HttpRequest::flag_confidential_querystring | HttpRequest::flag_accept_content_coding);
 		rr->response().flags_ = 0;
 	}
 	opState = request_init | request_reading;
@@ -70,7 +70,7 @@ void CHttpRequestOpData::AddRequest(std::shared_ptr<HttpRequestResponseInterface
 			}
 		}
 	}
-	rr->request().flags_ &= (HttpRequest::flag_update_transferstatus | HttpRequest::flag_confidential_querystring);
+	rr->request().flags_ &= (HttpRequest::flag_update_transferstatus | HttpRequest::flag_confidential_querystring | HttpRequest::flag_accept_content_coding);
 	rr->response().flags_ = 0;
 	requests_.push_back(rr);
 }
@@ -130,6 +130,14 @@ int CHttpRequestOpData::Send()
 		}
 		req.headers_["User-Agent"] = fz::replaced_substrings(PACKAGE_STRING, " ", "/");
 
+		// Ranges would refer to the encoded data
+		if ((req.flags_ & HttpRequest::flag_accept_content_coding) && req.get_header("Range").empty()) {
+			req.headers_["Accept-Encoding"] = http_accept_encoding;
+		}
+		else {
+			req.headers_.erase("Accept-Encoding");
+		}
+
 		opState &= ~request_init;
 		opState |= request_wait_connect;
 		return FZ_REPLY_CONTINUE;
@@ -344,6 +352,11 @@ int CHttpRequestOpData::FinalizeResponseBody()
 	if (shared_response) {
 		auto & response = shared_response->response();
 		if (!(response.flags_ & (HttpResponse::flag_ignore_body | HttpResponse::flag_no_body))) {
+			auto const& decoder = read_state_.decoder_;
+			if (decoder && decoder->encoded() && !decoder->finished()) {
+				log(logmsg::error, _("Compressed response body is incomplete"));
+				return FZ_REPLY_ERROR;
+			}
 			response.flags_ |= HttpResponse::flag_got_body;
 			if (response.success() && response.writer_) {
 				auto r = response.writer_->finalize(read_state_.writer_buffer_);
@@ -395,6 +408,15 @@ int CHttpRequestOpData::ParseReceiveBuffer()
 		}
 	}
 
+	if (!read_state_.decoded_.empty()) {
+		// Left over from when the writer was full
+		size_t len{};
+		int res = ProcessData(nullptr, len);
+		if (res != FZ_REPLY_CONTINUE || read_state_.done_) {
+			return res;
+		}
+	}
+
 	if (read_state_.transfer_encoding_ == chunked) {
 		int res = ParseChunkedData();
 		if (read_state_.eof_ && res == (FZ_REPLY_WOULDBLOCK | FZ_REPLY_CONTINUE)) {
@@ -469,6 +491,9 @@ int CHttpRequestOpData::OnReceive(bool repeatedProcessing)
 
 			if (res == FZ_REPLY_OK) {
 				log(logmsg::debug_info, L"Finished a response");
+				if (read_state_.decoder_) {
+					log(logmsg::debug_info, L"Decoded %u bytes of response body into %u bytes", read_state_.decoder_->encoded(), read_state_.decoder_->decoded());
+				}
 				if (requests_.front()) {
 					if (requests_.front()->request().body_) {
 						requests_.front()->request().body_->set_handler(nullptr);
@@ -715,6 +740,21 @@ int CHttpRequestOpData::ProcessCompleteHeader()
 	}
 	else {
 		read_state_.responseContentLength_ = length;
+
+		// Compressed files served as such can come with a content coding
+		// naming their format, e.g. .tar.gz as x-gzip, they are to be stored
+		// as they are.
+		auto const ce = response.get_header("Content-Encoding");
+		if (!ce.empty() && (request.flags_ & HttpRequest::flag_accept_content_coding) && request.get_header("Range").empty()) {
+			auto type = fz::str_tolower_ascii(response.get_header("Content-Type"));
+			type = fz::trimmed(std::string_view(type).substr(0, type.find(';')));
+			if (type != "application/gzip" && type != "application/x-gzip") {
+				read_state_.decoder_ = CHttpContentDecoder::create(ce);
+				if (read_state_.decoder_) {
+					response.flags_ |= HttpResponse::flag_decoding;
+				}
+			}
+		}
 	}
 
 	read_state_.keep_alive_ = response.keep_alive() && request.keep_alive();
@@ -854,54 +894,40 @@ int CHttpRequestOpData::ProcessData(unsigned char* data, size_t & remaining)
 	int res = FZ_REPLY_CONTINUE;
 	size_t initial = remaining;
 
+	auto & decoder = read_state_.decoder_;
 	auto & shared_response = requests_.front();
-	if (shared_response) {
-		auto & response = shared_response->response();
-
-		if (!(response.flags_ & HttpResponse::flag_ignore_body)) {
-			if (response.success()) {
-				if (response.writer_) {
-					while (remaining) {
-						if (read_state_.writer_buffer_.size() >= read_state_.writer_buffer_.capacity()) {
-							auto r = response.writer_->get_write_buffer(read_state_.writer_buffer_);
-							if (r == aio_result::wait) {
-								res = FZ_REPLY_WOULDBLOCK;
-								break;
-							}
-							else if (r == aio_result::error) {
-								res =  FZ_REPLY_CRITICALERROR;
-								break;
-							}
-
-							read_state_.writer_buffer_ = r.buffer_;
-						}
-
-						size_t s = std::min(remaining, read_state_.writer_buffer_.capacity() - read_state_.writer_buffer_.size());
-						read_state_.writer_buffer_.append(data, s);
-						data += s;
-						remaining -= s;
-					}
-				}
-				else {
-					if (response.body_.size() < 1024*1024*16) {
-						response.body_.append(data, remaining);
-					}
-					remaining = 0;
+	if (decoder && shared_response && !(shared_response->response().flags_ & HttpResponse::flag_ignore_body)) {
+		uint64_t const encoded = decoder->encoded();
+		uint64_t const decoded = decoder->decoded();
+
+		// Decoding is done in steps to not blow up the memory use, the
+		// output is passed on before more input gets decoded.
+		size_t const decode_size = 64 * 1024;
+		unsigned char const* p = data;
+		auto & buffer = read_state_.decoded_;
+		for (;;) {
+			if (!buffer.empty()) {
+				size_t len = buffer.size();
+				res = DeliverData(buffer.get(), len);
+				buffer.consume(buffer.size() - len);
+				if (res != FZ_REPLY_CONTINUE) {
+					break;
 				}
 			}
-			else {
-				if (response.body_.size() < 1024*1024*16) {
-					response.body_.append(data, remaining);
-				}
-				remaining = 0;
+			if (!remaining && !decoder->pending()) {
+				break;
+			}
+			if (!decoder->decode(p, remaining, buffer, decode_size)) {
+				log(logmsg::error, _("Could not decode response body with content coding %s"), shared_response->response().get_header("Content-Encoding"));
+				res = FZ_REPLY_ERROR;
+				break;
 			}
 		}
-		else {
-			remaining = 0;
-		}
+
+		engine_.activity_logger_.record_decoding(decoder->encoded() - encoded, decoder->decoded() - decoded);
 	}
 	else {
-		remaining = 0;
+		res = DeliverData(data, remaining);
 	}
 
 	read_state_.receivedData_ += initial - remaining;
@@ -914,6 +940,50 @@ int CHttpRequestOpData::ProcessData(unsigned char* data, size_t & remaining)
 	return res;
 }
 
+int CHttpRequestOpData::DeliverData(unsigned char const* data, size_t & remaining)
+{
+	auto & shared_response = requests_.front();
+	if (!shared_response) {
+		remaining = 0;
+		return FZ_REPLY_CONTINUE;
+	}
+
+	auto & response = shared_response->response();
+	if (response.flags_ & HttpResponse::flag_ignore_body) {
+		remaining = 0;
+		return FZ_REPLY_CONTINUE;
+	}
+
+	if (response.success() && response.writer_) {
+		while (remaining) {
+			if (read_state_.writer_buffer_.size() >= read_state_.writer_buffer_.capacity()) {
+				auto r = response.writer_->get_write_buffer(read_state_.writer_buffer_);
+				if (r == aio_result::wait) {
+					return FZ_REPLY_WOULDBLOCK;
+				}
+				else if (r == aio_result::error) {
+					return FZ_REPLY_CRITICALERROR;
+				}
+
+				read_state_.writer_buffer_ = r.buffer_;
+			}
+
+			size_t s = std::min(remaining, read_state_.writer_buffer_.capacity() - read_state_.writer_buffer_.size());
+			read_state_.writer_buffer_.append(data, s);
+			data += s;
+			remaining -= s;
+		}
+	}
+	else {
+		if (response.body_.size() < 1024*1024*16) {
+			response.body_.append(data, remaining);
+		}
+		remaining = 0;
+	}
+
+	return FZ_REPLY_CONTINUE;
+}
+
 int CHttpRequestOpData::Reset(int result)
 {
 	if (result != FZ_REPLY_OK) {
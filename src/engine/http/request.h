@@ -1,6 +1,7 @@
 #ifndef FILEZILLA_ENGINE_HTTP_REQUEST_HEADER
 #define FILEZILLA_ENGINE_HTTP_REQUEST_HEADER
 
+#include "contentencoding.h"
 #include "httpcontrolsocket.h"
 
 #include <libfilezilla/buffer.hpp>
@@ -47,6 +48,7 @@ private:
 	int ProcessCompleteHeader();
 	int ParseChunkedData();
 	int ProcessData(unsigned char* data, size_t & len);
+	int DeliverData(unsigned char const* data, size_t & len);
 	int FinalizeResponseBody();
 
 	std::deque<std::shared_ptr<HttpRequestResponseInterface>> requests_;
@@ -78,6 +80,12 @@ private:
 
 		fz::nonowning_buffer writer_buffer_;
 
+		// Set if the body has a supported content coding
+		std::unique_ptr<CHttpContentDecoder> decoder_;
+
+		// Decoded data not yet passed on
+		fz::buffer decoded_;
+
 		bool done_{};
 		bool keep_alive_{};
 		bool eof_{};
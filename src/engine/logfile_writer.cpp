@@ -0,0 +1,405 @@
+#include "filezilla.h"
+
+#include "logfile_writer.h"
+
+#include <algorithm>
+
+#include <errno.h>
+
+#ifndef FZ_WINDOWS
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include <fcntl.h>
+#endif
+
+namespace {
+// Upper limit of queued data before lines get dropped
+size_t const max_pending_bytes = 8 * 1024 * 1024;
+
+#ifndef FZ_WINDOWS
+// Number of lines passed to a single writev call, well below IOV_MAX
+size_t const max_iov = 64;
+#endif
+
+#ifdef FZ_WINDOWS
+CLogFileWriter::fd_type const invalid_fd = INVALID_HANDLE_VALUE;
+#else
+CLogFileWriter::fd_type const invalid_fd = -1;
+#endif
+}
+
+CLogFileWriter::CLogFileWriter(fz::thread_pool & pool, fd_type fd, fz::native_string const& file, int64_t max_size)
+	: fd_(fd)
+	, file_(file)
+	, max_size_(max_size)
+{
+#ifdef FZ_WINDOWS
+	LARGE_INTEGER size;
+	if (GetFileSizeEx(fd_, &size)) {
+		size_ = size.QuadPart;
+	}
+#else
+	struct stat buf;
+	if (!fstat(fd_, &buf)) {
+		size_ = buf.st_size;
+	}
+#endif
+
+	task_ = pool.spawn([this]() { run(); });
+}
+
+CLogFileWriter::~CLogFileWriter()
+{
+	{
+		fz::scoped_lock l(mutex_);
+		quit_ = true;
+		cond_.signal(l);
+	}
+	task_.join();
+
+	// In case the task could not be spawned
+	entry* e = head_.exchange(nullptr);
+	while (e) {
+		entry* next = e->next;
+		delete e;
+		e = next;
+	}
+
+	close();
+}
+
+bool CLogFileWriter::write(std::string && line, bool important)
+{
+	size_t const len = line.size();
+	if (!important && pending_bytes_.load(std::memory_order_relaxed) + len > max_pending_bytes) {
+		++dropped_;
+		return false;
+	}
+	pending_bytes_ += len;
+
+	entry* e = new entry;
+	e->line = std::move(line);
+
+	entry* old = head_.load(std::memory_order_relaxed);
+	do {
+		e->next = old;
+	} while (!head_.compare_exchange_weak(old, e, std::memory_order_release, std::memory_order_relaxed));
+
+	if (!old) {
+		// The writer might be idle
+		fz::scoped_lock l(mutex_);
+		cond_.signal(l);
+	}
+
+	return true;
+}
+
+std::wstring CLogFileWriter::take_error()
+{
+	if (!has_error_.load(std::memory_order_relaxed)) {
+		return std::wstring();
+	}
+
+	fz::scoped_lock l(mutex_);
+	has_error_ = false;
+	return std::move(error_);
+}
+
+void CLogFileWriter::set_error(std::wstring && error)
+{
+	fz::scoped_lock l(mutex_);
+	error_ = std::move(error);
+	has_error_ = true;
+}
+
+void CLogFileWriter::run()
+{
+	std::vector<entry*> batch;
+	while (true) {
+		entry* e = head_.exchange(nullptr, std::memory_order_acquire);
+		if (!e) {
+			fz::scoped_lock l(mutex_);
+			if (quit_) {
+				if (!head_.load(std::memory_order_acquire)) {
+					break;
+				}
+			}
+			else if (!head_.load(std::memory_order_acquire)) {
+				cond_.wait(l);
+			}
+			continue;
+		}
+
+		// The stack is in reverse order
+		batch.clear();
+		for (; e; e = e->next) {
+			batch.push_back(e);
+		}
+		std::reverse(batch.begin(), batch.end());
+
+		write_batch(batch);
+
+		for (auto * b : batch) {
+			pending_bytes_ -= b->line.size();
+			delete b;
+		}
+	}
+}
+
+void CLogFileWriter::write_batch(std::vector<entry*> const& batch)
+{
+	if (fd_ == invalid_fd) {
+		return;
+	}
+
+	if (max_size_ && size_ > max_size_) {
+		if (!rotate()) {
+			return;
+		}
+	}
+
+	std::vector<std::string const*> lines;
+	lines.reserve(batch.size() + 1);
+	for (auto const* e : batch) {
+		lines.push_back(&e->line);
+	}
+
+	std::string note;
+	uint64_t const dropped = dropped_;
+	if (dropped != reported_dropped_) {
+		note = fz::sprintf("%u log lines could not be written in time and have been dropped"
+#ifdef FZ_WINDOWS
+			"\r\n",
+#else
+			"\n",
+#endif
+			dropped - reported_dropped_);
+		reported_dropped_ = dropped;
+		lines.push_back(&note);
+	}
+
+	if (!write_buffers(lines)) {
+		close();
+	}
+}
+
+bool CLogFileWriter::write_buffers(std::vector<std::string const*> const& lines)
+{
+#ifdef FZ_WINDOWS
+	std::string buffer;
+	for (auto const* line : lines) {
+		buffer += *line;
+	}
+
+	DWORD len = static_cast<DWORD>(buffer.size());
+	DWORD written;
+	BOOL res = WriteFile(fd_, buffer.c_str(), len, &written, nullptr);
+	if (!res || written != len) {
+		DWORD err = GetLastError();
+		set_error(fz::sprintf(_("Could not write to log file: %s"), GetSystemErrorDescription(err)));
+		return false;
+	}
+	size_ += len;
+#else
+	size_t i = 0;
+	while (i < lines.size()) {
+		iovec iov[max_iov];
+		size_t n = 0;
+		size_t total = 0;
+		for (; n < max_iov && i + n < lines.size(); ++n) {
+			auto const& line = *lines[i + n];
+			iov[n].iov_base = const_cast<char*>(line.data());
+			iov[n].iov_len = line.size();
+			total += line.size();
+		}
+
+		ssize_t written;
+		while ((written = writev(fd_, iov, static_cast<int>(n))) == -1 && errno == EINTR);
+		if (written < 0) {
+			int err = errno;
+			set_error(fz::sprintf(_("Could not write to log file: %s"), GetSystemErrorDescription(err)));
+			return false;
+		}
+
+		// Short write, write out the remainder line by line
+		size_t skip = static_cast<size_t>(written);
+		for (size_t j = 0; j < n && skip < total; ++j) {
+			if (skip >= iov[j].iov_len) {
+				skip -= iov[j].iov_len;
+				continue;
+			}
+			char const* p = static_cast<char const*>(iov[j].iov_base) + skip;
+			size_t remaining = iov[j].iov_len - skip;
+			skip = 0;
+			while (remaining) {
+				ssize_t w = ::write(fd_, p, remaining);
+				if (w < 0) {
+					if (errno == EINTR) {
+						continue;
+					}
+					int err = errno;
+					set_error(fz::sprintf(_("Could not write to log file: %s"), GetSystemErrorDescription(err)));
+					return false;
+				}
+				p += w;
+				remaining -= static_cast<size_t>(w);
+			}
+		}
+
+		size_ += static_cast<int64_t>(total);
+		i += n;
+	}
+#endif
+	return true;
+}
+
+void CLogFileWriter::close()
+{
+	if (fd_ != invalid_fd) {
+#ifdef FZ_WINDOWS
+		CloseHandle(fd_);
+#else
+		::close(fd_);
+#endif
+		fd_ = invalid_fd;
+	}
+}
+
+bool CLogFileWriter::rotate()
+{
+#ifdef FZ_WINDOWS
+	LARGE_INTEGER size;
+	if (GetFileSizeEx(fd_, &size) && size.QuadPart <= max_size_) {
+		// Another process might have rotated it already
+		size_ = size.QuadPart;
+		return true;
+	}
+
+	close();
+
+	// fd_ might no longer be the original file.
+	// Recheck on a new handle. Proteced with a mutex against other processes
+	HANDLE hMutex = ::CreateMutexW(nullptr, true, L"FileZilla 3 Logrotate Mutex");
+	if (!hMutex) {
+		DWORD err = GetLastError();
+		set_error(fz::sprintf(_("Could not create logging mutex: %s"), GetSystemErrorDescription(err)));
+		return false;
+	}
+
+	HANDLE hFile = CreateFileW(file_.c_str(), FILE_APPEND_DATA, FILE_SHARE_DELETE | FILE_SHARE_WRITE | FILE_SHARE_READ, nullptr, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (hFile == INVALID_HANDLE_VALUE) {
+		DWORD err = GetLastError();
+
+		// Oh dear..
+		ReleaseMutex(hMutex);
+		CloseHandle(hMutex);
+
+		set_error(fz::sprintf(_("Could not open log file: %s"), GetSystemErrorDescription(err)));
+		return false;
+	}
+
+	DWORD err{};
+	if (GetFileSizeEx(hFile, &size) && size.QuadPart > max_size_) {
+		CloseHandle(hFile);
+
+		// MoveFileEx can fail if trying to access a deleted file for which another process still has
+		// a handle. Move it far away first.
+		// Todo: Handle the case in which logdir and tmpdir are on different volumes.
+		// (Why is everthing so needlessly complex on MSW?)
+
+		wchar_t tempDir[MAX_PATH + 1];
+		DWORD res = GetTempPath(MAX_PATH, tempDir);
+		if (res && res <= MAX_PATH) {
+			tempDir[MAX_PATH] = 0;
+
+			wchar_t tempFile[MAX_PATH + 1];
+			res = GetTempFileNameW(tempDir, L"fz3", 0, tempFile);
+			if (res) {
+				tempFile[MAX_PATH] = 0;
+				MoveFileExW((file_ + L".1").c_str(), tempFile, MOVEFILE_REPLACE_EXISTING);
+				DeleteFileW(tempFile);
+			}
+		}
+		MoveFileExW(file_.c_str(), (file_ + L".1").c_str(), MOVEFILE_REPLACE_EXISTING);
+		fd_ = CreateFileW(file_.c_str(), FILE_APPEND_DATA, FILE_SHARE_DELETE | FILE_SHARE_WRITE | FILE_SHARE_READ, nullptr, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+		if (fd_ == INVALID_HANDLE_VALUE) {
+			err = GetLastError();
+		}
+	}
+	else {
+		fd_ = hFile;
+	}
+
+	ReleaseMutex(hMutex);
+	CloseHandle(hMutex);
+
+	if (err) {
+		set_error(fz::sprintf(_("Could not open log file: %s"), GetSystemErrorDescription(err)));
+		return false;
+	}
+
+	size_ = 0;
+	if (GetFileSizeEx(fd_, &size)) {
+		size_ = size.QuadPart;
+	}
+#else
+	struct stat buf;
+	int rc = fstat(fd_, &buf);
+	while (!rc && buf.st_size > max_size_) {
+		struct flock lock = {};
+		lock.l_type = F_WRLCK;
+		lock.l_whence = SEEK_SET;
+		lock.l_start = 0;
+		lock.l_len = 1;
+
+		// Retry through signals
+		while ((rc = fcntl(fd_, F_SETLKW, &lock)) == -1 && errno == EINTR);
+
+		// Ignore any other failures
+		int fd = open(file_.c_str(), O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0644);
+		if (fd == -1) {
+			int err = errno;
+			close();
+			set_error(fz::sprintf(_("Could not open log file: %s"), GetSystemErrorDescription(err)));
+			return false;
+		}
+		struct stat buf2;
+		rc = fstat(fd, &buf2);
+
+		// Different files
+		if (!rc && buf.st_ino != buf2.st_ino) {
+			::close(fd_); // Releases the lock
+			fd_ = fd;
+			buf = buf2;
+			continue;
+		}
+
+		// The file is indeed the log file and we are holding a lock on it.
+
+		// Rename it
+		rc = rename(file_.c_str(), (file_ + ".1").c_str());
+		::close(fd_);
+		::close(fd);
+
+		// Get the new file
+		fd_ = open(file_.c_str(), O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0644);
+		if (fd_ == -1) {
+			int err = errno;
+			set_error(fz::sprintf(_("Could not open log file: %s"), GetSystemErrorDescription(err)));
+			return false;
+		}
+
+		if (!rc) {
+			// Rename didn't fail
+			rc = fstat(fd_, &buf);
+		}
+	}
+
+	// If the size cannot be determined, start counting anew rather than
+	// attempting to rotate on every batch.
+	size_ = rc ? 0 : buf.st_size;
+#endif
+
+	return true;
+}
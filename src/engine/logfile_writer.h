@@ -0,0 +1,84 @@
+#ifndef FILEZILLA_ENGINE_LOGFILE_WRITER_HEADER
+#define FILEZILLA_ENGINE_LOGFILE_WRITER_HEADER
+
+#include <libfilezilla/mutex.hpp>
+#include <libfilezilla/string.hpp>
+#include <libfilezilla/thread_pool.hpp>
+
+#include <atomic>
+#include <string>
+#include <vector>
+
+// Writes lines to the log file from a single worker.
+//
+// Producers push onto a lock-free stack, the writer takes everything pending
+// at once and writes it in a single batch. The mutex is only taken to wake up
+// an idle writer.
+//
+// The file size is tracked from the written bytes, the file is only checked
+// and rotated once the tracked size exceeds the limit.
+//
+// If the disk cannot keep up, lines get dropped once too much data is pending,
+// and a note with the number of dropped lines is written later on. Lines
+// marked as important are never dropped.
+class CLogFileWriter final
+{
+public:
+#ifdef FZ_WINDOWS
+	typedef HANDLE fd_type;
+#else
+	typedef int fd_type;
+#endif
+
+	// Takes ownership of the file descriptor
+	CLogFileWriter(fz::thread_pool & pool, fd_type fd, fz::native_string const& file, int64_t max_size);
+
+	// Writes out all pending lines
+	~CLogFileWriter();
+
+	CLogFileWriter(CLogFileWriter const&) = delete;
+	CLogFileWriter& operator=(CLogFileWriter const&) = delete;
+
+	// Returns false if the line has been dropped
+	bool write(std::string && line, bool important);
+
+	// Returns and clears the description of the last error, if any
+	std::wstring take_error();
+
+	uint64_t dropped() const { return dropped_; }
+
+private:
+	struct entry final
+	{
+		entry* next{};
+		std::string line;
+	};
+
+	void run();
+	void write_batch(std::vector<entry*> const& batch);
+	bool write_buffers(std::vector<std::string const*> const& lines);
+	bool rotate();
+	void close();
+	void set_error(std::wstring && error);
+
+	std::atomic<entry*> head_{};
+	std::atomic<size_t> pending_bytes_{};
+	std::atomic<uint64_t> dropped_{};
+	std::atomic<bool> has_error_{};
+
+	fz::mutex mutex_{false};
+	fz::condition cond_;
+	bool quit_{};
+	std::wstring error_;
+
+	// Only accessed by the worker
+	fd_type fd_;
+	fz::native_string const file_;
+	int64_t const max_size_;
+	int64_t size_{};
+	uint64_t reported_dropped_{};
+
+	fz::async_task task_;
+};
+
+#endif
@@ -9,17 +9,12 @@
 #include <errno.h>
 
 #ifndef FZ_WINDOWS
-#include <sys/stat.h>
 #include <unistd.h>
 #include <fcntl.h>
 #endif
 
-bool CLogging::m_logfile_initialized = false;
-#ifdef FZ_WINDOWS
-HANDLE CLogging::m_log_fd = INVALID_HANDLE_VALUE;
-#else
-int CLogging::m_log_fd = -1;
-#endif
+std::atomic<bool> CLogging::m_logfile_initialized{false};
+std::unique_ptr<CLogFileWriter> CLogging::m_writer;
 std::string CLogging::m_prefixes[sizeof(logmsg::type) * 8];
 unsigned int CLogging::m_pid;
 int CLogging::m_max_size;
@@ -75,17 +70,8 @@ CLogging::~CLogging()
 	--m_refcount;
 
 	if (!m_refcount) {
-#ifdef FZ_WINDOWS
-		if (m_log_fd != INVALID_HANDLE_VALUE) {
-			CloseHandle(m_log_fd);
-			m_log_fd = INVALID_HANDLE_VALUE;
-		}
-#else
-		if (m_log_fd != -1) {
-			close(m_log_fd);
-			m_log_fd = -1;
-		}
-#endif
+		// Writes out whatever is still pending
+		m_writer.reset();
 		m_logfile_initialized = false;
 	}
 }
@@ -93,25 +79,25 @@ CLogging::~CLogging()
 bool CLogging::InitLogFile(fz::scoped_lock& l)
 {
 	if (m_logfile_initialized) {
-		return true;
+		return m_writer != nullptr;
 	}
 
-	m_logfile_initialized = true;
-
 	m_file = fz::to_native(engine_.GetOptions().get_string(OPTION_LOGGING_FILE));
 	if (m_file.empty()) {
+		m_logfile_initialized = true;
 		return false;
 	}
 
 #ifdef FZ_WINDOWS
-	m_log_fd = CreateFile(m_file.c_str(), FILE_APPEND_DATA, FILE_SHARE_DELETE | FILE_SHARE_WRITE | FILE_SHARE_READ, nullptr, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
-	if (m_log_fd == INVALID_HANDLE_VALUE) {
+	HANDLE fd = CreateFile(m_file.c_str(), FILE_APPEND_DATA, FILE_SHARE_DELETE | FILE_SHARE_WRITE | FILE_SHARE_READ, nullptr, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (fd == INVALID_HANDLE_VALUE) {
 		DWORD err = GetLastError();
 #else
-	m_log_fd = open(m_file.c_str(), O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0644);
-	if (m_log_fd == -1) {
+	int fd = open(m_file.c_str(), O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0644);
+	if (fd == -1) {
 		int err = errno;
 #endif
+		m_logfile_initialized = true;
 		l.unlock(); //Avoid recursion
 		log(logmsg::error, _("Could not open log file: %s"), GetSystemErrorDescription(err));
 		return false;
@@ -142,29 +128,34 @@ bool CLogging::InitLogFile(fz::scoped_lock& l)
 	}
 	m_max_size *= 1024 * 1024;
 
+	m_writer = std::make_unique<CLogFileWriter>(engine_.GetThreadPool(), fd, m_file, m_max_size);
+
+	// Publishes the writer and the prefixes to the lock-free path in LogToFile
+	m_logfile_initialized.store(true, std::memory_order_release);
+
 	return true;
 }
 
 void CLogging::LogToFile(logmsg::type nMessageType, std::wstring const& msg, fz::datetime const& now)
 {
-	fz::scoped_lock l(mutex_);
-
-	if (!m_logfile_initialized) {
+	if (!m_logfile_initialized.load(std::memory_order_acquire)) {
+		fz::scoped_lock l(mutex_);
 		if (!InitLogFile(l)) {
 			return;
 		}
 	}
-#ifdef FZ_WINDOWS
-	if (m_log_fd == INVALID_HANDLE_VALUE) {
+	if (!m_writer) {
 		return;
 	}
-#else
-	if (m_log_fd == -1) {
-		return;
+
+	// Errors are reported by the writer thread, pass them on to the UI only.
+	// Logging them through the file again could recurse.
+	std::wstring error = m_writer->take_error();
+	if (!error.empty()) {
+		engine_.AddLogNotification(std::make_unique<CLogmsgNotification>(logmsg::error, std::move(error), now));
 	}
-#endif
 
-	std::string const out = fz::sprintf("%s %u %u %s %s"
+	std::string out = fz::sprintf("%s %u %u %s %s"
 #ifdef FZ_WINDOWS
 		"\r\n",
 #else
@@ -172,160 +163,7 @@ void CLogging::LogToFile(logmsg::type nMessageType, std::wstring const& msg, fz:
 #endif
 		now.format("%Y-%m-%d %H:%M:%S", fz::datetime::local), m_pid, engine_.GetEngineId(), m_prefixes[fz::bitscan_reverse(nMessageType)], fz::to_utf8(msg));
 
-#ifdef FZ_WINDOWS
-	if (m_max_size) {
-		LARGE_INTEGER size;
-		if (!GetFileSizeEx(m_log_fd, &size) || size.QuadPart > m_max_size) {
-			CloseHandle(m_log_fd);
-			m_log_fd = INVALID_HANDLE_VALUE;
-
-			// m_log_fd might no longer be the original file.
-			// Recheck on a new handle. Proteced with a mutex against other processes
-			HANDLE hMutex = ::CreateMutexW(nullptr, true, L"FileZilla 3 Logrotate Mutex");
-			if (!hMutex) {
-				DWORD err = GetLastError();
-				l.unlock();
-				log(logmsg::error, _("Could not create logging mutex: %s"), GetSystemErrorDescription(err));
-				return;
-			}
-
-			HANDLE hFile = CreateFileW(m_file.c_str(), FILE_APPEND_DATA, FILE_SHARE_DELETE | FILE_SHARE_WRITE | FILE_SHARE_READ, nullptr, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
-			if (hFile == INVALID_HANDLE_VALUE) {
-				DWORD err = GetLastError();
-
-				// Oh dear..
-				ReleaseMutex(hMutex);
-				CloseHandle(hMutex);
-
-				l.unlock(); // Avoid recursion
-				log(logmsg::error, _("Could not open log file: %s"), GetSystemErrorDescription(err));
-				return;
-			}
-
-			DWORD err{};
-			if (GetFileSizeEx(hFile, &size) && size.QuadPart > m_max_size) {
-				CloseHandle(hFile);
-
-				// MoveFileEx can fail if trying to access a deleted file for which another process still has
-				// a handle. Move it far away first.
-				// Todo: Handle the case in which logdir and tmpdir are on different volumes.
-				// (Why is everthing so needlessly complex on MSW?)
-
-				wchar_t tempDir[MAX_PATH + 1];
-				DWORD res = GetTempPath(MAX_PATH, tempDir);
-				if (res && res <= MAX_PATH) {
-					tempDir[MAX_PATH] = 0;
-
-					wchar_t tempFile[MAX_PATH + 1];
-					res = GetTempFileNameW(tempDir, L"fz3", 0, tempFile);
-					if (res) {
-						tempFile[MAX_PATH] = 0;
-						MoveFileExW((m_file + L".1").c_str(), tempFile, MOVEFILE_REPLACE_EXISTING);
-						DeleteFileW(tempFile);
-					}
-				}
-				MoveFileExW(m_file.c_str(), (m_file + L".1").c_str(), MOVEFILE_REPLACE_EXISTING);
-				m_log_fd = CreateFileW(m_file.c_str(), FILE_APPEND_DATA, FILE_SHARE_DELETE | FILE_SHARE_WRITE | FILE_SHARE_READ, nullptr, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
-				if (m_log_fd == INVALID_HANDLE_VALUE) {
-					// If this function would return bool, I'd return FILE_NOT_FOUND here.
-					err = GetLastError();
-				}
-			}
-			else {
-				m_log_fd = hFile;
-			}
-
-			if (hMutex) {
-				ReleaseMutex(hMutex);
-				CloseHandle(hMutex);
-			}
-
-			if (err) {
-				l.unlock(); // Avoid recursion
-				log(logmsg::error, _("Could not open log file: %s"), GetSystemErrorDescription(err));
-				return;
-			}
-		}
-	}
-	DWORD len = static_cast<DWORD>(out.size());
-	DWORD written;
-	BOOL res = WriteFile(m_log_fd, out.c_str(), len, &written, nullptr);
-	if (!res || written != len) {
-		DWORD err = GetLastError();
-		CloseHandle(m_log_fd);
-		m_log_fd = INVALID_HANDLE_VALUE;
-		l.unlock(); // Avoid recursion
-		log(logmsg::error, _("Could not write to log file: %s"), GetSystemErrorDescription(err));
-	}
-#else
-	if (m_max_size) {
-		struct stat buf;
-		int rc = fstat(m_log_fd, &buf);
-		while (!rc && buf.st_size > m_max_size) {
-			struct flock lock = {};
-			lock.l_type = F_WRLCK;
-			lock.l_whence = SEEK_SET;
-			lock.l_start = 0;
-			lock.l_len = 1;
-
-			// Retry through signals
-			while ((rc = fcntl(m_log_fd, F_SETLKW, &lock)) == -1 && errno == EINTR);
-
-			// Ignore any other failures
-			int fd = open(m_file.c_str(), O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0644);
-			if (fd == -1) {
-				int err = errno;
-
-				close(m_log_fd);
-				m_log_fd = -1;
-
-				l.unlock(); // Avoid recursion
-				log(logmsg::error, _("Could not open log file: %s"), GetSystemErrorDescription(err));
-				return;
-			}
-			struct stat buf2;
-			rc = fstat(fd, &buf2);
-
-			// Different files
-			if (!rc && buf.st_ino != buf2.st_ino) {
-				close(m_log_fd); // Releases the lock
-				m_log_fd = fd;
-				buf = buf2;
-				continue;
-			}
-
-			// The file is indeed the log file and we are holding a lock on it.
-
-			// Rename it
-			rc = rename(m_file.c_str(), (m_file + ".1").c_str());
-			close(m_log_fd);
-			close(fd);
-
-			// Get the new file
-			m_log_fd = open(m_file.c_str(), O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0644);
-			if (m_log_fd == -1) {
-				int err = errno;
-				l.unlock(); // Avoid recursion
-				log(logmsg::error, _("Could not open log file: %s"), GetSystemErrorDescription(err));
-				return;
-			}
-
-			if (!rc) {
-				// Rename didn't fail
-				rc = fstat(m_log_fd, &buf);
-			}
-		}
-	}
-	size_t written = write(m_log_fd, out.c_str(), out.size());
-	if (written != out.size()) {
-		int err = errno;
-		close(m_log_fd);
-		m_log_fd = -1;
-
-		l.unlock(); // Avoid recursion
-		log(logmsg::error, _("Could not write to log file: %s"), GetSystemErrorDescription(err));
-	}
-#endif
+	m_writer->write(std::move(out), nMessageType == logmsg::error);
 }
 
 void CLogging::UpdateLogLevel(COptionsBase & options)
@@ -2,8 +2,10 @@
 #define FILEZILLA_ENGINE_LOGGING_PRIVATE_HEADER
 
 #include "engineprivate.h"
+#include "logfile_writer.h"
 #include <libfilezilla/format.hpp>
 #include <libfilezilla/mutex.hpp>
+#include <atomic>
 #include <utility>
 
 class CLoggingOptionsChanged;
@@ -31,12 +33,8 @@ private:
 	bool InitLogFile(fz::scoped_lock& l);
 	void LogToFile(logmsg::type nMessageType, std::wstring const& msg, fz::datetime const& now);
 
-	static bool m_logfile_initialized;
-#ifdef FZ_WINDOWS
-	static HANDLE m_log_fd;
-#else
-	static int m_log_fd;
-#endif
+	static std::atomic<bool> m_logfile_initialized;
+	static std::unique_ptr<CLogFileWriter> m_writer;
 	static std::string m_prefixes[sizeof(logmsg::type) * 8];
 	static unsigned int m_pid;
 	static int m_max_size;
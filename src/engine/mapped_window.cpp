@@ -0,0 +1,175 @@
+#include "mapped_window.h"
+
+#ifndef FZ_WINDOWS
+
+#include <atomic>
+#include <mutex>
+
+#include <signal.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+struct sigbus_slot
+{
+	// A claimed slot has an end of at least 1
+	std::atomic<uintptr_t> start_{};
+	std::atomic<uintptr_t> end_{};
+	std::atomic<bool> faulted_{};
+};
+
+namespace {
+// Enough for a window per transfer of every engine
+sigbus_slot slots[256];
+
+struct sigaction previous_action{};
+
+uintptr_t page_size{};
+
+void sigbus_handler(int sig, siginfo_t * info, void * context)
+{
+	uintptr_t const addr = reinterpret_cast<uintptr_t>(info->si_addr);
+	for (auto & slot : slots) {
+		uintptr_t const end = slot.end_.load();
+		uintptr_t const start = slot.start_.load();
+		if (addr >= start && addr < end) {
+			// The faulting access gets repeated once the handler returns
+			void * page = reinterpret_cast<void*>(addr & ~(page_size - 1));
+			if (mmap(page, page_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED, -1, 0) != MAP_FAILED) {
+				slot.faulted_ = true;
+				return;
+			}
+			break;
+		}
+	}
+
+	// Not ours
+	if (previous_action.sa_flags & SA_SIGINFO) {
+		if (previous_action.sa_sigaction) {
+			previous_action.sa_sigaction(sig, info, context);
+			return;
+		}
+	}
+	else if (previous_action.sa_handler != SIG_DFL && previous_action.sa_handler != SIG_IGN) {
+		previous_action.sa_handler(sig);
+		return;
+	}
+
+	// Repeating the access now terminates the process like it would have without us
+	struct sigaction action{};
+	action.sa_handler = SIG_DFL;
+	sigemptyset(&action.sa_mask);
+	sigaction(sig, &action, nullptr);
+}
+
+void install_sigbus_handler()
+{
+	static std::once_flag flag;
+	std::call_once(flag, []() {
+		page_size = static_cast<uintptr_t>(sysconf(_SC_PAGESIZE));
+
+		struct sigaction action{};
+		action.sa_sigaction = &sigbus_handler;
+		action.sa_flags = SA_SIGINFO;
+		sigemptyset(&action.sa_mask);
+		sigaction(SIGBUS, &action, &previous_action);
+	});
+}
+
+sigbus_slot* claim_slot(uintptr_t start, uintptr_t end)
+{
+	for (auto & slot : slots) {
+		uintptr_t expected{};
+		if (slot.end_.compare_exchange_strong(expected, 1)) {
+			slot.faulted_ = false;
+			slot.start_ = start;
+			slot.end_ = end;
+			return &slot;
+		}
+	}
+	return nullptr;
+}
+
+void release_slot(sigbus_slot & slot)
+{
+	slot.end_ = 1;
+	slot.start_ = 0;
+	slot.end_ = 0;
+}
+}
+
+mapped_window::~mapped_window()
+{
+	unmap();
+}
+
+bool mapped_window::map(int fd, uint64_t offset, size_t size, bool writable)
+{
+	unmap();
+	if (!size) {
+		return false;
+	}
+
+	install_sigbus_handler();
+
+	uint64_t const aligned = offset - offset % page_size;
+	size_t const length = static_cast<size_t>(offset - aligned) + size;
+
+	void * p = mmap(nullptr, length, PROT_READ | PROT_WRITE, writable ? MAP_SHARED : MAP_PRIVATE, fd, static_cast<off_t>(aligned));
+	if (p == MAP_FAILED) {
+		return false;
+	}
+
+	uintptr_t const start = reinterpret_cast<uintptr_t>(p);
+	slot_ = claim_slot(start, start + length);
+	if (!slot_) {
+		munmap(p, length);
+		return false;
+	}
+
+	// Windows get consumed front to back exactly once. Reading ahead the
+	// whole window right away keeps the consumer from stalling on faults.
+	madvise(p, length, MADV_SEQUENTIAL);
+	if (!writable) {
+		madvise(p, length, MADV_WILLNEED);
+	}
+
+	base_ = static_cast<uint8_t*>(p);
+	length_ = length;
+	data_ = base_ + (offset - aligned);
+	offset_ = offset;
+	size_ = size;
+
+	return true;
+}
+
+void mapped_window::unmap()
+{
+	if (!base_) {
+		return;
+	}
+
+	munmap(base_, length_);
+	release_slot(*slot_);
+
+	base_ = nullptr;
+	length_ = 0;
+	data_ = nullptr;
+	offset_ = 0;
+	size_ = 0;
+	slot_ = nullptr;
+}
+
+bool mapped_window::faulted() const
+{
+	return slot_ && slot_->faulted_;
+}
+
+bool mapped_window::sync()
+{
+	if (!base_) {
+		return true;
+	}
+	return msync(base_, length_, MS_SYNC) == 0;
+}
+
+#endif
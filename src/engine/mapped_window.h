@@ -0,0 +1,61 @@
+#ifndef FILEZILLA_ENGINE_MAPPED_WINDOW_HEADER
+#define FILEZILLA_ENGINE_MAPPED_WINDOW_HEADER
+
+#include <libfilezilla/libfilezilla.hpp>
+
+#ifndef FZ_WINDOWS
+
+#include <stddef.h>
+#include <stdint.h>
+
+struct sigbus_slot;
+
+/*
+ * A range of a local file mapped into memory.
+ *
+ * Touching mapped pages beyond the end of the file raises SIGBUS. That
+ * happens if someone else truncates the file while it is mapped, or if
+ * the filesystem runs out of space while pages of a sparse file get
+ * written. While a window is mapped, a SIGBUS handler puts anonymous
+ * memory in place of the faulting pages inside it and marks the window
+ * as faulted, so that its owner can fail the transfer instead of the
+ * process getting killed.
+ */
+class mapped_window final
+{
+public:
+	mapped_window() = default;
+	~mapped_window();
+
+	mapped_window(mapped_window const&) = delete;
+	mapped_window& operator=(mapped_window const&) = delete;
+
+	// The offset need not be page-aligned. Writable windows are shared
+	// with the file, others are private copy-on-write mappings.
+	bool map(int fd, uint64_t offset, size_t size, bool writable);
+	void unmap();
+
+	bool contains(uint64_t offset) const { return data_ && offset >= offset_ && offset < offset_ + size_; }
+	uint8_t* at(uint64_t offset) const { return data_ + (offset - offset_); }
+	uint64_t end() const { return offset_ + size_; }
+
+	// Whether touching the window raised SIGBUS since it got mapped
+	bool faulted() const;
+
+	// Writes the dirty pages of the window back to the file
+	bool sync();
+
+private:
+	uint8_t* base_{};
+	size_t length_{};
+
+	uint8_t* data_{};
+	uint64_t offset_{};
+	size_t size_{};
+
+	sigbus_slot* slot_{};
+};
+
+#endif
+
+#endif
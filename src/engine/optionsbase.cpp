@@ -106,7 +106,7 @@ void set_default_value(size_t i, std::vector<option_def>& options, std::vector<C
 }
 
 template<typename Lock>
-bool do_add_missing(optionsIndex opt, Lock & l, fz::rwmutex & mtx, std::vector<option_def> & options, std::map<std::string, size_t, std::less<>> & name_to_option, std::vector<COptionsBase::option_value> & values)
+bool do_add_missing(optionsIndex opt, Lock & l, fz::rwmutex & mtx, std::vector<option_def> & options, std::map<std::string, size_t, std::less<>> & name_to_option, std::vector<COptionsBase::option_value> & values, COptionsBase::int_values & ints)
 {
 	l.unlock();
 
@@ -129,6 +129,7 @@ bool do_add_missing(optionsIndex opt, Lock & l, fz::rwmutex & mtx, std::vector<o
 	for (; i < options.size(); ++i) {
 		set_default_value(i, options, values);
 	}
+	ints.resize(values);
 	mtx.unlock_write();
 	l.lock();
 	return true;
@@ -137,7 +138,7 @@ bool do_add_missing(optionsIndex opt, Lock & l, fz::rwmutex & mtx, std::vector<o
 
 void COptionsBase::add_missing(fz::scoped_write_lock & l)
 {
-	do_add_missing(static_cast<optionsIndex>(0), l, mtx_, options_, name_to_option_, values_);
+	do_add_missing(static_cast<optionsIndex>(0), l, mtx_, options_, name_to_option_, values_, ints_);
 }
 
 int COptionsBase::get_int(optionsIndex opt)
@@ -146,8 +147,13 @@ int COptionsBase::get_int(optionsIndex opt)
 		return 0;
 	}
 
+	int v;
+	if (ints_.get(opt, v)) {
+		return v;
+	}
+
 	fz::scoped_read_lock l(mtx_);
-	if (static_cast<size_t>(opt) >= values_.size() && !do_add_missing(opt, l, mtx_, options_, name_to_option_, values_)) {
+	if (static_cast<size_t>(opt) >= values_.size() && !do_add_missing(opt, l, mtx_, options_, name_to_option_, values_, ints_)) {
 		return 0;
 	}
 
@@ -162,7 +168,7 @@ std::wstring COptionsBase::get_string(optionsIndex opt)
 	}
 
 	fz::scoped_read_lock l(mtx_);
-	if (static_cast<size_t>(opt) >= values_.size() && !do_add_missing(opt, l, mtx_, options_, name_to_option_, values_)) {
+	if (static_cast<size_t>(opt) >= values_.size() && !do_add_missing(opt, l, mtx_, options_, name_to_option_, values_, ints_)) {
 		return std::wstring();
 	}
 
@@ -178,7 +184,7 @@ pugi::xml_document COptionsBase::get_xml(optionsIndex opt)
 	}
 
 	fz::scoped_write_lock l(mtx_); // Aquire write lock as we don't know what pugixml does internally
-	if (static_cast<size_t>(opt) >= values_.size() && !do_add_missing(opt, l, mtx_, options_, name_to_option_, values_)) {
+	if (static_cast<size_t>(opt) >= values_.size() && !do_add_missing(opt, l, mtx_, options_, name_to_option_, values_, ints_)) {
 		return ret;
 	}
 
@@ -210,7 +216,7 @@ void COptionsBase::set(optionsIndex opt, int value)
 	}
 
 	fz::scoped_write_lock l(mtx_);
-	if (static_cast<size_t>(opt) >= values_.size() && !do_add_missing(opt, l, mtx_, options_, name_to_option_, values_)) {
+	if (static_cast<size_t>(opt) >= values_.size() && !do_add_missing(opt, l, mtx_, options_, name_to_option_, values_, ints_)) {
 		return;
 	}
 
@@ -236,7 +242,7 @@ void COptionsBase::set(optionsIndex opt, std::wstring_view const& value, bool pr
 	}
 
 	fz::scoped_write_lock l(mtx_);
-	if (static_cast<size_t>(opt) >= values_.size() && !do_add_missing(opt, l, mtx_, options_, name_to_option_, values_)) {
+	if (static_cast<size_t>(opt) >= values_.size() && !do_add_missing(opt, l, mtx_, options_, name_to_option_, values_, ints_)) {
 		return;
 	}
 
@@ -276,7 +282,7 @@ void COptionsBase::set(optionsIndex opt, pugi::xml_node const& value)
 	}
 
 	fz::scoped_write_lock l(mtx_);
-	if (static_cast<size_t>(opt) >= values_.size() && !do_add_missing(opt, l, mtx_, options_, name_to_option_, values_)) {
+	if (static_cast<size_t>(opt) >= values_.size() && !do_add_missing(opt, l, mtx_, options_, name_to_option_, values_, ints_)) {
 		return;
 	}
 
@@ -325,6 +331,7 @@ void COptionsBase::set(optionsIndex opt, option_def const& def, option_value& va
 
 	val.v_ = value;
 	val.str_ = fz::to_wstring(value);
+	ints_.set(opt, value);
 	++val.change_counter_;
 
 	set_changed(opt);
@@ -365,6 +372,7 @@ void COptionsBase::set(optionsIndex opt, option_def const& def, option_value& va
 		val.v_ = fz::to_integral<int>(value);
 		val.str_ = value;
 	}
+	ints_.set(opt, val.v_);
 	++val.change_counter_;
 
 	set_changed(opt);
@@ -392,6 +400,8 @@ void COptionsBase::set(optionsIndex opt, option_def const& def, option_value& va
 
 void COptionsBase::set_changed(optionsIndex opt)
 {
+	++generation_;
+
 	bool notify = can_notify_ && !changed_.any();
 	changed_.set(opt);
 	if (notify) {
@@ -554,6 +564,7 @@ void COptionsBase::unwatch_all(std::tuple<void*, watcher_notifier> handler)
 void COptionsBase::set_default_value(optionsIndex opt)
 {
 	::set_default_value(static_cast<size_t>(opt), options_, values_);
+	ints_.set(opt, values_[static_cast<size_t>(opt)].v_);
 }
 
 uint64_t COptionsBase::change_count(optionsIndex opt)
@@ -566,3 +577,43 @@ uint64_t COptionsBase::change_count(optionsIndex opt)
 	auto& val = values_[static_cast<size_t>(opt)];
 	return val.change_counter_;
 }
+
+COptionsBase::int_values::snapshot::snapshot(size_t size)
+	: values_(std::make_unique<std::atomic<int>[]>(size))
+	, size_(size)
+{
+}
+
+bool COptionsBase::int_values::get(optionsIndex opt, int& v) const
+{
+	auto const* s = current_.load(std::memory_order_acquire);
+	if (!s || static_cast<size_t>(opt) >= s->size_) {
+		return false;
+	}
+
+	v = s->values_[static_cast<size_t>(opt)].load(std::memory_order_acquire);
+	return true;
+}
+
+void COptionsBase::int_values::set(optionsIndex opt, int v)
+{
+	auto const* s = current_.load(std::memory_order_relaxed);
+	if (s && static_cast<size_t>(opt) < s->size_) {
+		s->values_[static_cast<size_t>(opt)].store(v, std::memory_order_release);
+	}
+}
+
+void COptionsBase::int_values::resize(std::vector<option_value> const& values)
+{
+	auto const* old = current_.load(std::memory_order_relaxed);
+	if (old && old->size_ >= values.size()) {
+		return;
+	}
+
+	auto s = std::make_unique<snapshot>(values.size());
+	for (size_t i = 0; i < values.size(); ++i) {
+		s->values_[i].store(values[i].v_, std::memory_order_relaxed);
+	}
+	current_.store(s.get(), std::memory_order_release);
+	snapshots_.emplace_back(std::move(s));
+}
@@ -65,7 +65,8 @@ int CProxySocket::connect(fz::native_string const& host, unsigned int port, fz::
 		}
 	}
 
-	if (next_layer_.get_state() != fz::socket_state::none && next_layer_.get_state() != fz::socket_state::connecting) {
+	auto const next_state = next_layer_.get_state();
+	if (next_state != fz::socket_state::none && next_state != fz::socket_state::connecting && next_state != fz::socket_state::connected) {
 		state_ = fz::socket_state::failed;
 		return EINVAL;
 	}
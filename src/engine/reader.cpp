@@ -1,13 +1,22 @@
 #include "../include/reader.h"
 
 #include "engineprivate.h"
+#include "mapped_window.h"
 
 #include <libfilezilla/buffer.hpp>
 #include <libfilezilla/local_filesys.hpp>
 #include <libfilezilla/translate.hpp>
 
+#include <algorithm>
+
 #include <string.h>
 
+#ifndef FZ_WINDOWS
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
 reader_factory::reader_factory(std::wstring const& name)
 	: name_(name)
 {}
@@ -104,6 +113,43 @@ std::unique_ptr<reader_base> file_reader_factory::open(uint64_t offset, CFileZil
 	return ret;
 }
 
+mmap_reader_factory::mmap_reader_factory(std::wstring const& file)
+	: reader_factory(file)
+{
+}
+
+std::unique_ptr<reader_factory> mmap_reader_factory::clone() const
+{
+	return std::make_unique<mmap_reader_factory>(*this);
+}
+
+uint64_t mmap_reader_factory::size() const
+{
+	return file_reader_factory(name()).size();
+}
+
+fz::datetime mmap_reader_factory::mtime() const
+{
+	return file_reader_factory(name()).mtime();
+}
+
+std::unique_ptr<reader_base> mmap_reader_factory::open(uint64_t offset, CFileZillaEnginePrivate & engine, fz::event_handler * handler, aio_base::shm_flag shm, uint64_t max_size)
+{
+#ifndef FZ_WINDOWS
+	// Child processes cannot see the mapping, the data would need to be
+	// copied into shared memory anyhow.
+	if (shm == aio_base::shm_flag_none) {
+		auto ret = std::make_unique<mmap_reader>(name(), engine, handler);
+		if (ret->open(offset, max_size) != aio_result::ok) {
+			ret.reset();
+		}
+		return ret;
+	}
+#endif
+
+	return file_reader_factory(name()).open(offset, engine, handler, shm, max_size);
+}
+
 namespace {
 void remove_reader_events(fz::event_handler * handler, reader_base const* reader)
 {
@@ -380,6 +426,179 @@ void file_reader::signal_capacity(fz::scoped_lock & l)
 	cond_.signal(l);
 }
 
+#ifndef FZ_WINDOWS
+int file_reader::direct_fd(uint64_t & offset, uint64_t & size)
+{
+	fz::scoped_lock l(mtx_);
+	if (error_ || called_read_ || !thread_) {
+		return -1;
+	}
+
+	// Whatever got read ahead is of no use anymore
+	quit_ = true;
+	cond_.signal(l);
+	l.unlock();
+	thread_.join();
+	l.lock();
+	remove_reader_events(handler_, this);
+
+	ready_count_ = 0;
+	ready_pos_ = 0;
+	processing_ = false;
+	handler_waiting_ = false;
+
+	// Makes the next seek start over
+	called_read_ = true;
+
+	offset = start_offset_;
+	size = size_;
+	return file_.fd();
+}
+#endif
+
+#ifndef FZ_WINDOWS
+namespace {
+// Small enough to keep the address space use low on 32-bit systems
+size_t const mmap_window_size{16 * 1024 * 1024};
+}
+
+mmap_reader::mmap_reader(std::wstring const& name, CFileZillaEnginePrivate & engine, fz::event_handler * handler)
+	: reader_base(name, engine, handler)
+	, window_(std::make_unique<mapped_window>())
+{
+}
+
+mmap_reader::~mmap_reader()
+{
+	close();
+}
+
+void mmap_reader::close()
+{
+	window_->unmap();
+	if (fd_ != -1) {
+		::close(fd_);
+		fd_ = -1;
+	}
+
+	reader_base::close();
+}
+
+aio_result mmap_reader::open(uint64_t offset, uint64_t max_size)
+{
+	fd_ = ::open(fz::to_native(name()).c_str(), O_RDONLY | O_CLOEXEC);
+	if (fd_ == -1) {
+		engine_.GetLogger().log(logmsg::error, fztranslate("Could not open '%s' for reading."), name_);
+		return aio_result::error;
+	}
+
+	return seek(offset, max_size);
+}
+
+aio_result mmap_reader::seek(uint64_t offset, uint64_t max_size)
+{
+	if (error_) {
+		return aio_result::error;
+	}
+
+	if (offset != aio_base::nosize) {
+		start_offset_ = offset;
+		max_size_ = max_size;
+	}
+
+	window_->unmap();
+	called_read_ = false;
+
+	struct stat buf{};
+	if (fstat(fd_, &buf) != 0 || buf.st_size < 0) {
+		engine_.GetLogger().log(logmsg::error, fztranslate("Could not obtain size of '%s'."), name_);
+		error_ = true;
+		return aio_result::error;
+	}
+	uint64_t const s = static_cast<uint64_t>(buf.st_size);
+	if (s < start_offset_) {
+		engine_.GetLogger().log(logmsg::error, fztranslate("Could not seek to offset %d in '%s' of size %d."), start_offset_, name_, s);
+		error_ = true;
+		return aio_result::error;
+	}
+
+	fz::scoped_lock l(mtx_);
+	size_ = s - start_offset_;
+	if (max_size_ != aio_base::nosize && max_size_ < size_) {
+		size_ = max_size_;
+	}
+	pos_ = start_offset_;
+	remaining_ = size_;
+
+	return aio_result::ok;
+}
+
+bool mmap_reader::check_size()
+{
+	struct stat buf{};
+	if (window_->faulted() || fstat(fd_, &buf) != 0 || buf.st_size < 0 || static_cast<uint64_t>(buf.st_size) < pos_ + remaining_) {
+		engine_.GetLogger().log(logmsg::debug_warning, L"'%s' got truncated while being read", name_);
+		engine_.GetLogger().log(logmsg::error, fztranslate("Could not read from '%s'."), name_);
+		error_ = true;
+		return false;
+	}
+	return true;
+}
+
+read_result mmap_reader::read()
+{
+	if (error_) {
+		return {aio_result::error, fz::nonowning_buffer()};
+	}
+
+	// The buffer handed out last has been consumed, so the window it
+	// points into can go. Whether the file got truncated while it was
+	// mapped gets checked before.
+	if (!remaining_) {
+		if (!check_size()) {
+			return {aio_result::error, fz::nonowning_buffer()};
+		}
+		window_->unmap();
+		return {aio_result::ok, fz::nonowning_buffer()};
+	}
+
+	if (!window_->contains(pos_)) {
+		if (!check_size()) {
+			return {aio_result::error, fz::nonowning_buffer()};
+		}
+		size_t const size = static_cast<size_t>(std::min(remaining_, static_cast<uint64_t>(mmap_window_size)));
+		if (!window_->map(fd_, pos_, size, false)) {
+			engine_.GetLogger().log(logmsg::debug_warning, L"Could not map %u bytes at offset %d of '%s', error %d", size, pos_, name_, errno);
+			engine_.GetLogger().log(logmsg::error, fztranslate("Could not read from '%s'."), name_);
+			error_ = true;
+			return {aio_result::error, fz::nonowning_buffer()};
+		}
+	}
+
+	size_t const len = static_cast<size_t>(std::min({remaining_, static_cast<uint64_t>(buffer_size_), window_->end() - pos_}));
+	fz::nonowning_buffer b(window_->at(pos_), len, len);
+	pos_ += len;
+	remaining_ -= len;
+	called_read_ = true;
+
+	return {aio_result::ok, b};
+}
+
+int mmap_reader::direct_fd(uint64_t & offset, uint64_t & size)
+{
+	if (error_ || called_read_) {
+		return -1;
+	}
+
+	window_->unmap();
+	called_read_ = true;
+
+	offset = start_offset_;
+	size = size_;
+	return fd_;
+}
+#endif
+
 memory_reader_factory::memory_reader_factory(std::wstring const& name, fz::buffer & data)
 	: reader_factory(name)
 	, data_(reinterpret_cast<char const*>(data.get()), data.size())
@@ -0,0 +1,260 @@
+#include "filezilla.h"
+
+#include "resolver_cache.h"
+
+#include <libfilezilla/event_handler.hpp>
+#include <libfilezilla/socket.hpp>
+
+#ifdef FZ_WINDOWS
+#include <ws2tcpip.h>
+#else
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netdb.h>
+#endif
+
+namespace {
+fz::duration const entry_ttl = fz::duration::from_seconds(60);
+size_t const max_entries = 256;
+
+int getaddresses(fz::native_string const& host, std::vector<std::string> & addresses)
+{
+#ifdef FZ_WINDOWS
+	ADDRINFOW hints{};
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	hints.ai_flags = AI_ADDRCONFIG;
+
+	ADDRINFOW* result{};
+	int res = GetAddrInfoW(host.c_str(), nullptr, &hints, &result);
+	if (res) {
+		return res;
+	}
+
+	for (ADDRINFOW* ai = result; ai; ai = ai->ai_next) {
+		auto address = fz::socket_base::address_to_string(ai->ai_addr, static_cast<int>(ai->ai_addrlen), false);
+		if (!address.empty()) {
+			addresses.push_back(std::move(address));
+		}
+	}
+	FreeAddrInfoW(result);
+#else
+	addrinfo hints{};
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	hints.ai_flags = AI_ADDRCONFIG;
+
+	addrinfo* result{};
+	int res = getaddrinfo(host.c_str(), nullptr, &hints, &result);
+	if (res) {
+		return res;
+	}
+
+	for (addrinfo* ai = result; ai; ai = ai->ai_next) {
+		auto address = fz::socket_base::address_to_string(ai->ai_addr, static_cast<int>(ai->ai_addrlen), false);
+		if (!address.empty()) {
+			addresses.push_back(std::move(address));
+		}
+	}
+	freeaddrinfo(result);
+#endif
+
+	return 0;
+}
+}
+
+CResolverCache::CResolverCache(fz::thread_pool & pool)
+	: pool_(pool)
+{
+#ifdef FZ_WINDOWS
+	WSADATA data{};
+	WSAStartup(MAKEWORD(2, 2), &data);
+#endif
+}
+
+CResolverCache::~CResolverCache()
+{
+	std::vector<fz::async_task> tasks;
+	{
+		fz::scoped_lock l(mutex_);
+		for (auto & p : pending_) {
+			p.second.handlers_.clear();
+			tasks.emplace_back(std::move(p.second.task_));
+		}
+		for (auto & t : finished_) {
+			tasks.emplace_back(std::move(t));
+		}
+		finished_.clear();
+	}
+
+	// Lookups cannot be aborted, wait for them.
+	for (auto & t : tasks) {
+		t.join();
+	}
+
+#ifdef FZ_WINDOWS
+	WSACleanup();
+#endif
+}
+
+std::vector<std::string> CResolverCache::Lookup(fz::native_string const& host)
+{
+	fz::scoped_lock l(mutex_);
+
+	auto it = entries_.find(host);
+	if (it == entries_.end() || it->second.addresses_.empty()) {
+		return {};
+	}
+
+	if (it->second.expiry_ < fz::monotonic_clock::now()) {
+		it->second.addresses_.clear();
+		return {};
+	}
+
+	return Order(it->second);
+}
+
+void CResolverCache::Resolve(fz::native_string const& host, fz::event_handler & handler)
+{
+	fz::scoped_lock l(mutex_);
+
+	// Collect lookups that have completed in the meantime
+	for (auto & t : finished_) {
+		t.join();
+	}
+	finished_.clear();
+
+	auto it = pending_.find(host);
+	if (it != pending_.end()) {
+		it->second.handlers_.push_back(&handler);
+		return;
+	}
+
+	auto & p = pending_[host];
+	p.handlers_.push_back(&handler);
+	p.task_ = pool_.spawn([this, host]() { DoResolve(host); });
+	if (!p.task_) {
+		pending_.erase(host);
+		handler.send_event<CResolveEvent>(host, std::vector<std::string>(), EAGAIN);
+	}
+}
+
+void CResolverCache::RemoveHandler(fz::event_handler & handler)
+{
+	fz::scoped_lock l(mutex_);
+	for (auto & p : pending_) {
+		auto & handlers = p.second.handlers_;
+		for (size_t i = 0; i < handlers.size(); ) {
+			if (handlers[i] == &handler) {
+				handlers[i] = handlers.back();
+				handlers.pop_back();
+			}
+			else {
+				++i;
+			}
+		}
+	}
+}
+
+void CResolverCache::DoResolve(fz::native_string const& host)
+{
+	std::vector<std::string> addresses;
+	int error = getaddresses(host, addresses);
+	if (!error && addresses.empty()) {
+		error = EHOSTUNREACH;
+	}
+
+	fz::scoped_lock l(mutex_);
+
+	auto it = pending_.find(host);
+	if (it == pending_.end()) {
+		return;
+	}
+
+	std::vector<std::string> ordered;
+	if (!error) {
+		auto & e = entries_[host];
+		e.addresses_ = std::move(addresses);
+		e.expiry_ = fz::monotonic_clock::now() + entry_ttl;
+		ordered = Order(e);
+		Prune();
+	}
+
+	// Handlers are only ever removed under the mutex, so they cannot
+	// go away while the events are sent.
+	for (auto * handler : it->second.handlers_) {
+		handler->send_event<CResolveEvent>(host, ordered, error);
+	}
+
+	finished_.emplace_back(std::move(it->second.task_));
+	pending_.erase(it);
+}
+
+void CResolverCache::SetConnected(fz::native_string const& host, std::string const& address)
+{
+	auto const type = fz::get_address_type(address);
+	if (type == fz::address_type::unknown) {
+		return;
+	}
+
+	fz::scoped_lock l(mutex_);
+	auto it = entries_.find(host);
+	if (it != entries_.end()) {
+		it->second.preferred_ = type;
+	}
+}
+
+void CResolverCache::Invalidate(fz::native_string const& host)
+{
+	fz::scoped_lock l(mutex_);
+	auto it = entries_.find(host);
+	if (it != entries_.end()) {
+		it->second.addresses_.clear();
+	}
+}
+
+std::vector<std::string> CResolverCache::Order(entry const& e) const
+{
+	// As per RFC 8305 section 4, alternate between the address families,
+	// starting with the preferred one. Within a family keep the order
+	// returned by the system, it already implements RFC 6724.
+	std::vector<std::string const*> first;
+	std::vector<std::string const*> second;
+	for (auto const& address : e.addresses_) {
+		if (fz::get_address_type(address) == e.preferred_) {
+			first.push_back(&address);
+		}
+		else {
+			second.push_back(&address);
+		}
+	}
+
+	std::vector<std::string> ret;
+	ret.reserve(e.addresses_.size());
+	for (size_t i = 0; i < first.size() || i < second.size(); ++i) {
+		if (i < first.size()) {
+			ret.push_back(*first[i]);
+		}
+		if (i < second.size()) {
+			ret.push_back(*second[i]);
+		}
+	}
+	return ret;
+}
+
+void CResolverCache::Prune()
+{
+	if (entries_.size() <= max_entries) {
+		return;
+	}
+
+	auto const now = fz::monotonic_clock::now();
+	for (auto it = entries_.begin(); it != entries_.end(); ) {
+		if (it->second.expiry_ < now) {
+			it = entries_.erase(it);
+		}
+		else {
+			++it;
+		}
+	}
+}
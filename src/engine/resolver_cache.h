@@ -0,0 +1,83 @@
+#ifndef FILEZILLA_ENGINE_RESOLVER_CACHE_HEADER
+#define FILEZILLA_ENGINE_RESOLVER_CACHE_HEADER
+
+#include <libfilezilla/event.hpp>
+#include <libfilezilla/iputils.hpp>
+#include <libfilezilla/mutex.hpp>
+#include <libfilezilla/thread_pool.hpp>
+#include <libfilezilla/time.hpp>
+
+#include <map>
+#include <string>
+#include <vector>
+
+namespace fz {
+class event_handler;
+}
+
+// Carries the host name, its addresses in the order they should be
+// connected to, and an error code if the lookup failed.
+struct resolve_event_type;
+typedef fz::simple_event<resolve_event_type, fz::native_string, std::vector<std::string>, int> CResolveEvent;
+
+/*
+ * Host name lookups shared by all engines of a context.
+ *
+ * getaddrinfo does not tell the TTL of the records, so entries expire
+ * after a fixed amount of time, or early if connecting to all of the
+ * addresses of a host failed.
+ */
+class CResolverCache final
+{
+public:
+	explicit CResolverCache(fz::thread_pool & pool);
+	~CResolverCache();
+
+	CResolverCache(CResolverCache const&) = delete;
+	CResolverCache& operator=(CResolverCache const&) = delete;
+
+	// Returns the cached addresses of the host in connection order,
+	// or nothing if there is no valid entry.
+	std::vector<std::string> Lookup(fz::native_string const& host);
+
+	// Resolves the host on the thread pool. The handler receives a CResolveEvent.
+	// Concurrent lookups of the same host only resolve it once.
+	void Resolve(fz::native_string const& host, fz::event_handler & handler);
+
+	// Needs to be called before a handler with a pending lookup is destroyed
+	void RemoveHandler(fz::event_handler & handler);
+
+	// Successfully connected to the address, its family gets tried first next time.
+	void SetConnected(fz::native_string const& host, std::string const& address);
+
+	void Invalidate(fz::native_string const& host);
+
+private:
+	struct entry final
+	{
+		std::vector<std::string> addresses_;
+		fz::address_type preferred_{fz::address_type::ipv6};
+		fz::monotonic_clock expiry_;
+	};
+
+	struct pending final
+	{
+		std::vector<fz::event_handler*> handlers_;
+		fz::async_task task_;
+	};
+
+	void DoResolve(fz::native_string const& host);
+	std::vector<std::string> Order(entry const& e) const;
+	void Prune();
+
+	fz::thread_pool & pool_;
+
+	fz::mutex mutex_{false};
+	std::map<fz::native_string, entry> entries_;
+	std::map<fz::native_string, pending> pending_;
+
+	// Lookups that have finished but whose tasks have not been joined yet
+	std::vector<fz::async_task> finished_;
+};
+
+#endif
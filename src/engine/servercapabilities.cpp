@@ -3,108 +3,93 @@
 
 #include <assert.h>
 
-std::map<CServer, CCapabilities> CServerCapabilities::m_serverMap;
-fz::mutex CServerCapabilities::m_(false);
+CServerCapabilities::shard CServerCapabilities::shards_[CServerCapabilities::shard_count];
 
 capabilities CCapabilities::GetCapability(capabilityNames name, std::wstring* pOption) const
 {
-	const std::map<capabilityNames, CCapabilities::t_cap>::const_iterator iter = m_capabilityMap.find(name);
-	if (iter == m_capabilityMap.end()) {
-		return unknown;
+	if (!pOption) {
+		return caps_[name].load(std::memory_order_acquire);
 	}
 
-	if (iter->second.cap == yes && pOption) {
-		*pOption = iter->second.option;
+	fz::scoped_lock l(mutex_);
+	capabilities const cap = caps_[name].load(std::memory_order_relaxed);
+	if (cap == yes) {
+		*pOption = options_[name];
 	}
-	return iter->second.cap;
+	return cap;
 }
 
 capabilities CCapabilities::GetCapability(capabilityNames name, int* pOption) const
 {
-	const std::map<capabilityNames, CCapabilities::t_cap>::const_iterator iter = m_capabilityMap.find(name);
-	if (iter == m_capabilityMap.end()) {
-		return unknown;
+	if (!pOption) {
+		return caps_[name].load(std::memory_order_acquire);
 	}
 
-	if (iter->second.cap == yes && pOption) {
-		*pOption = iter->second.number;
+	fz::scoped_lock l(mutex_);
+	capabilities const cap = caps_[name].load(std::memory_order_relaxed);
+	if (cap == yes) {
+		*pOption = numbers_[name];
 	}
-	return iter->second.cap;
+	return cap;
 }
 
 void CCapabilities::SetCapability(capabilityNames name, capabilities cap, std::wstring const& option)
 {
 	assert(cap == yes || option.empty());
 
-	CCapabilities::t_cap tcap;
-	tcap.cap = cap;
-	tcap.option = option;
-	tcap.number = 0;
-
-	m_capabilityMap[name] = tcap;
+	fz::scoped_lock l(mutex_);
+	options_[name] = option;
+	numbers_[name] = 0;
+	caps_[name].store(cap, std::memory_order_release);
 }
 
 void CCapabilities::SetCapability(capabilityNames name, capabilities cap, int option)
 {
 	assert(cap == yes || option == 0);
 
-	CCapabilities::t_cap tcap;
-	tcap.cap = cap;
-	tcap.number = option;
+	fz::scoped_lock l(mutex_);
+	options_[name].clear();
+	numbers_[name] = option;
+	caps_[name].store(cap, std::memory_order_release);
+}
 
-	m_capabilityMap[name] = tcap;
+size_t CServerCapabilities::server_hash::operator()(CServer const& server) const
+{
+	// Only fields that are part of the ordering
+	size_t h = std::hash<std::wstring>()(server.GetHost());
+	h ^= std::hash<std::wstring>()(server.GetUser()) + 0x9e3779b9 + (h << 6) + (h >> 2);
+	h ^= (static_cast<size_t>(server.GetPort()) << 8) ^ (static_cast<size_t>(server.GetProtocol()) << 4) ^ static_cast<size_t>(server.GetType());
+	return h;
 }
 
-capabilities CServerCapabilities::GetCapability(const CServer& server, capabilityNames name, std::wstring* pOption)
+CCapabilities& CServerCapabilities::Get(CServer const& server)
 {
-	fz::scoped_lock l(m_);
+	auto & s = shards_[server_hash()(server) % shard_count];
 
-	const std::map<CServer, CCapabilities>::const_iterator iter = m_serverMap.find(server);
-	if (iter == m_serverMap.end()) {
-		return unknown;
+	fz::scoped_lock l(s.mutex_);
+	auto & caps = s.servers_[server];
+	if (!caps) {
+		caps = std::make_unique<CCapabilities>();
 	}
+	return *caps;
+}
 
-	return iter->second.GetCapability(name, pOption);
+capabilities CServerCapabilities::GetCapability(const CServer& server, capabilityNames name, std::wstring* pOption)
+{
+	return Get(server).GetCapability(name, pOption);
 }
 
 capabilities CServerCapabilities::GetCapability(const CServer& server, capabilityNames name, int* pOption)
 {
-	fz::scoped_lock l(m_);
-
-	const std::map<CServer, CCapabilities>::const_iterator iter = m_serverMap.find(server);
-	if (iter == m_serverMap.end()) {
-		return unknown;
-	}
-
-	return iter->second.GetCapability(name, pOption);
+	return Get(server).GetCapability(name, pOption);
 }
 
 void CServerCapabilities::SetCapability(const CServer& server, capabilityNames name, capabilities cap, std::wstring const& option)
 {
-	fz::scoped_lock l(m_);
-
-	const std::map<CServer, CCapabilities>::iterator iter = m_serverMap.find(server);
-	if (iter == m_serverMap.end()) {
-		CCapabilities capabilities;
-		capabilities.SetCapability(name, cap, option);
-		m_serverMap[server] = capabilities;
-		return;
-	}
-
-	iter->second.SetCapability(name, cap, option);
+	Get(server).SetCapability(name, cap, option);
 }
 
 void CServerCapabilities::SetCapability(const CServer& server, capabilityNames name, capabilities cap, int option)
 {
-	fz::scoped_lock l(m_);
-
-	const std::map<CServer, CCapabilities>::iterator iter = m_serverMap.find(server);
-	if (iter == m_serverMap.end()) {
-		CCapabilities capabilities;
-		capabilities.SetCapability(name, cap, option);
-		m_serverMap[server] = capabilities;
-		return;
-	}
-
-	iter->second.SetCapability(name, cap, option);
+	Get(server).SetCapability(name, cap, option);
 }
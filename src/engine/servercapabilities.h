@@ -5,7 +5,9 @@
 
 #include <libfilezilla/mutex.hpp>
 
-#include <map>
+#include <atomic>
+#include <memory>
+#include <unordered_map>
 
 enum capabilities
 {
@@ -46,30 +48,47 @@ enum capabilityNames
 	auth_tls_command,
 	auth_ssl_command,
 
-	tls_resumption
+	tls_resumption,
+
+	// Checksums of remote files
+	hash_command, // Algorithms listed in the FEAT reply as option
+	xcrc_command,
+	xmd5_command,
+	xsha1_command,
+	xsha256_command,
+	xsha512_command,
+
+	capability_count
 };
 
+// Capabilities of a single server, safe to use from multiple threads.
+// Querying a capability without its option is a single atomic load.
 class CCapabilities final
 {
 public:
+	// If return value isn't 'yes', pOptions remains unchanged
 	capabilities GetCapability(capabilityNames name, std::wstring* pOption = nullptr) const;
 	capabilities GetCapability(capabilityNames name, int* pOption) const;
 	void SetCapability(capabilityNames name, capabilities cap, std::wstring const& option = std::wstring());
 	void SetCapability(capabilityNames name, capabilities cap, int option);
 
 protected:
-	struct t_cap
-	{
-		capabilities cap{unknown};
-		std::wstring option;
-		int number{};
-	};
-	std::map<capabilityNames, t_cap> m_capabilityMap;
+	std::atomic<capabilities> caps_[capability_count]{};
+
+	// Guards the options
+	mutable fz::mutex mutex_{false};
+	std::wstring options_[capability_count];
+	int numbers_[capability_count]{};
 };
 
 class CServerCapabilities final
 {
 public:
+	// Returns the capabilities of the given server, creating an empty set if needed.
+	// The returned object is never destroyed, connections resolve it once and
+	// keep using it for as long as their server does not change.
+	static CCapabilities& Get(CServer const& server);
+
 	// If return value isn't 'yes', pOptions remains unchanged
 	static capabilities GetCapability(const CServer& server, capabilityNames name, std::wstring* pOption = nullptr);
 	static capabilities GetCapability(const CServer& server, capabilityNames name, int* option);
@@ -78,9 +97,27 @@ public:
 	static void SetCapability(const CServer& server, capabilityNames name, capabilities cap, int option);
 
 protected:
-	static std::map<CServer, CCapabilities> m_serverMap;
+	struct server_hash final
+	{
+		size_t operator()(CServer const& server) const;
+	};
+
+	// Same equivalence as the ordering of CServer, which does not include all fields
+	struct server_equal final
+	{
+		bool operator()(CServer const& lhs, CServer const& rhs) const {
+			return !(lhs < rhs) && !(rhs < lhs);
+		}
+	};
+
+	struct shard final
+	{
+		fz::mutex mutex_{false};
+		std::unordered_map<CServer, std::unique_ptr<CCapabilities>, server_hash, server_equal> servers_;
+	};
 
-	static fz::mutex m_;
+	static size_t const shard_count = 16;
+	static shard shards_[shard_count];
 };
 
 #endif
@@ -1,6 +1,10 @@
 #include "filezilla.h"
 #include "../include/serverpath.h"
 
+#include <libfilezilla/mutex.hpp>
+
+#include <unordered_map>
+
 #define FTP_MVS_DOUBLE_QUOTE (wchar_t)0xDC
 
 struct CServerTypeTraits
@@ -30,17 +34,178 @@ static const CServerTypeTraits traits[SERVERTYPE_MAX] = {
 	{ L"/\\", false,    0,    0,    false, 0, 0,   true,  false } // DOS with forwardslashes
 };
 
-bool CServerPathData::operator==(CServerPathData const& cmp) const
+namespace {
+typedef std::shared_ptr<CServerPathData const> path_node;
+
+// Mutable form of a path, used while parsing and building paths
+class mutable_path final
 {
-	if (m_prefix != cmp.m_prefix) {
-		return false;
+public:
+	std::vector<std::wstring> m_segments;
+	fz::sparse_optional<std::wstring> m_prefix;
+};
+
+size_t combine_hash(size_t seed, size_t v)
+{
+	return seed ^ (v + static_cast<size_t>(0x9e3779b9) + (seed << 6) + (seed >> 2));
+}
+
+// Holds weak references to all path data in use. A node is created at most
+// once, nodes remove themselves from the table on destruction.
+class path_table final
+{
+public:
+	path_node get(mutable_path const& data);
+	path_node get_child(path_node const& parent, std::wstring const& segment);
+
+	void remove(CServerPathData const* node);
+
+private:
+	class entry final
+	{
+	public:
+		CServerPathData const* node_{};
+		std::weak_ptr<CServerPathData const> ref_;
+	};
+
+	// These expect mtx_ to be held
+	path_node lookup_root(fz::sparse_optional<std::wstring> const& prefix);
+	path_node lookup_child(path_node const& parent, std::wstring const& segment);
+
+	template<typename Matches, typename Create>
+	path_node lookup(size_t hash, Matches const& matches, Create const& create);
+
+	// A single lock, so that a path gets interned with one acquisition
+	// regardless of its depth
+	fz::mutex mtx_{false};
+	std::unordered_multimap<size_t, entry> entries_;
+};
+
+path_table& get_path_table()
+{
+	// Deliberately leaked, paths might still get destroyed during static deinitialization
+	static path_table* table = new path_table;
+	return *table;
+}
+
+template<typename Matches, typename Create>
+path_node path_table::lookup(size_t hash, Matches const& matches, Create const& create)
+{
+	auto range = entries_.equal_range(hash);
+	for (auto it = range.first; it != range.second; ++it) {
+		// Nodes only get deleted after being removed from the table,
+		// so they can be safely accessed while holding the lock.
+		if (matches(*it->second.node_)) {
+			path_node node = it->second.ref_.lock();
+			if (node) {
+				return node;
+			}
+
+			// Last reference is gone, the node is about to be removed.
+			entries_.erase(it);
+			break;
+		}
 	}
 
-	if (m_segments != cmp.m_segments) {
-		return false;
+	CServerPathData* data = new CServerPathData;
+	create(*data);
+	data->m_hash = hash;
+
+	path_node node(data, [](CServerPathData const* p) {
+		get_path_table().remove(p);
+		delete p;
+	});
+	entries_.emplace(hash, entry{data, node});
+
+	return node;
+}
+
+path_node path_table::lookup_root(fz::sparse_optional<std::wstring> const& prefix)
+{
+	size_t const hash = prefix ? combine_hash(1, std::hash<std::wstring>()(*prefix)) : 0;
+	return lookup(hash,
+		[&](CServerPathData const& n) {
+			return !n.m_parent && n.m_prefix == prefix;
+		},
+		[&](CServerPathData & n) {
+			n.m_prefix = prefix;
+		});
+}
+
+path_node path_table::lookup_child(path_node const& parent, std::wstring const& segment)
+{
+	size_t const hash = combine_hash(parent->m_hash, std::hash<std::wstring>()(segment));
+	return lookup(hash,
+		[&](CServerPathData const& n) {
+			return n.m_parent == parent && n.m_segment == segment;
+		},
+		[&](CServerPathData & n) {
+			n.m_segment = segment;
+			n.m_prefix = parent->m_prefix;
+			n.m_parent = parent;
+			n.m_depth = parent->m_depth + 1;
+		});
+}
+
+path_node path_table::get(mutable_path const& data)
+{
+	fz::scoped_lock l(mtx_);
+
+	// Each node keeps its parent alive, so no node can get
+	// destroyed, and thus take the lock, while walking down.
+	path_node node = lookup_root(data.m_prefix);
+	for (auto const& segment : data.m_segments) {
+		node = lookup_child(node, segment);
 	}
+	return node;
+}
 
-	return true;
+path_node path_table::get_child(path_node const& parent, std::wstring const& segment)
+{
+	fz::scoped_lock l(mtx_);
+	return lookup_child(parent, segment);
+}
+
+void path_table::remove(CServerPathData const* node)
+{
+	fz::scoped_lock l(mtx_);
+
+	auto range = entries_.equal_range(node->m_hash);
+	for (auto it = range.first; it != range.second; ++it) {
+		if (it->second.node_ == node) {
+			entries_.erase(it);
+			break;
+		}
+	}
+}
+
+path_node intern(mutable_path const& data)
+{
+	return get_path_table().get(data);
+}
+
+// The segments from first to last, nodes only store their last segment
+std::vector<std::wstring const*> segments(CServerPathData const& node)
+{
+	std::vector<std::wstring const*> ret(node.m_depth);
+	for (auto const* n = &node; n->m_depth; n = n->m_parent.get()) {
+		ret[n->m_depth - 1] = &n->m_segment;
+	}
+	return ret;
+}
+
+mutable_path copy(path_node const& node)
+{
+	mutable_path data;
+	if (node) {
+		data.m_segments.reserve(node->m_depth);
+		for (auto const* segment : segments(*node)) {
+			data.m_segments.push_back(*segment);
+		}
+		data.m_prefix = node->m_prefix;
+	}
+	return data;
+}
 }
 
 CServerPath::CServerPath()
@@ -69,7 +234,7 @@ CServerPath::CServerPath(std::wstring const& path, ServerType type)
 
 void CServerPath::clear()
 {
-	m_data.clear();
+	m_data.reset();
 }
 
 bool CServerPath::SetPath(std::wstring newPath)
@@ -120,7 +285,7 @@ bool CServerPath::SetPath(std::wstring &newPath, bool isFile)
 		}
 	}
 
-	m_data.clear();
+	m_data.reset();
 
 	if (!ChangePath(path, isFile)) {
 		return false;
@@ -160,13 +325,14 @@ std::wstring CServerPath::GetPath() const
 	if (traits[m_type].left_enclosure != 0) {
 		path += traits[m_type].left_enclosure;
 	}
-	if (data.m_segments.empty() && (!traits[m_type].has_root || !data.m_prefix || traits[m_type].separator_after_prefix)) {
+	if (!data.m_depth && (!traits[m_type].has_root || !data.m_prefix || traits[m_type].separator_after_prefix)) {
 		path += traits[m_type].separators[0];
 	}
 
-	for (auto iter = data.m_segments.cbegin(); iter != data.m_segments.cend(); ++iter) {
-		std::wstring const& segment = *iter;
-		if (iter != data.m_segments.cbegin()) {
+	auto const segs = segments(data);
+	for (auto iter = segs.cbegin(); iter != segs.cend(); ++iter) {
+		std::wstring const& segment = **iter;
+		if (iter != segs.cbegin()) {
 			path += traits[m_type].separators[0];
 		}
 		else if (traits[m_type].has_root) {
@@ -195,7 +361,7 @@ std::wstring CServerPath::GetPath() const
 
 	// DOS is strange.
 	// C: is current working dir on drive C, C:\ the drive root.
-	if ((m_type == DOS || m_type == DOS_FWD_SLASHES) && data.m_segments.size() == 1) {
+	if ((m_type == DOS || m_type == DOS_FWD_SLASHES) && data.m_depth == 1) {
 		path += traits[m_type].separators[0];
 	}
 
@@ -209,10 +375,10 @@ bool CServerPath::HasParent() const
 	}
 
 	if (!traits[m_type].has_root) {
-		return m_data->m_segments.size() > 1;
+		return m_data->m_depth > 1;
 	}
 
-	return !m_data->m_segments.empty();
+	return m_data->m_depth != 0;
 }
 
 CServerPath CServerPath::GetParent() const
@@ -227,13 +393,14 @@ CServerPath& CServerPath::MakeParent()
 	if (empty() || !HasParent()) {
 		clear();
 	}
-	else {
-		CServerPathData& data = m_data.get();
+	else if (m_type == MVS) {
+		mutable_path data = copy(m_data);
 		data.m_segments.pop_back();
-
-		if (m_type == MVS) {
-			data.m_prefix = fz::sparse_optional<std::wstring>(L".");
-		}
+		data.m_prefix = fz::sparse_optional<std::wstring>(L".");
+		m_data = intern(data);
+	}
+	else {
+		m_data = m_data->m_parent;
 	}
 
 	return *this;
@@ -245,13 +412,11 @@ std::wstring CServerPath::GetFirstSegment() const
 		return std::wstring();
 	}
 
-	CServerPathData const& data = *m_data;
-	if (!data.m_segments.empty()) {
-		return data.m_segments.front();
-	}
-	else {
-		return std::wstring();
+	auto const* node = m_data.get();
+	while (node->m_depth > 1) {
+		node = node->m_parent.get();
 	}
+	return node->m_segment;
 }
 
 std::wstring CServerPath::GetLastSegment() const
@@ -260,13 +425,7 @@ std::wstring CServerPath::GetLastSegment() const
 		return std::wstring();
 	}
 
-	CServerPathData const& data = *m_data;
-	if (!data.m_segments.empty()) {
-		return data.m_segments.back();
-	}
-	else {
-		return std::wstring();
-	}
+	return m_data->m_segment;
 }
 
 // libc sprintf can be so slow at times...
@@ -301,9 +460,10 @@ std::wstring CServerPath::GetSafePath() const
 		+ INTLENGTH; // Max length of prefix
 
 	auto const& data = *m_data;
+	auto const segs = segments(data);
 	len += data.m_prefix ? data.m_prefix->size() : 0;
-	for (auto const& segment : data.m_segments) {
-		len += segment.size() + 2 + INTLENGTH;
+	for (auto const* segment : segs) {
+		len += segment->size() + 2 + INTLENGTH;
 	}
 
 	std::wstring safepath;
@@ -321,12 +481,12 @@ std::wstring CServerPath::GetSafePath() const
 		t += data.m_prefix->size();
 	}
 
-	for (auto const& segment : data.m_segments) {
+	for (auto const* segment : segs) {
 		*(t++) = ' ';
-		t = fast_sprint_number(t, segment.size());
+		t = fast_sprint_number(t, segment->size());
 		*(t++) = ' ';
-		tstrcpy(t, segment.c_str());
-		t += segment.size();
+		tstrcpy(t, segment->c_str());
+		t += segment->size();
 	}
 	safepath.resize(t - start);
 	safepath.shrink_to_fit();
@@ -346,9 +506,7 @@ bool CServerPath::SetSafePath(std::wstring const& path)
 
 bool CServerPath::DoSetSafePath(std::wstring const& path)
 {
-	CServerPathData& data = m_data.get();
-	data.m_prefix.clear();
-	data.m_segments.clear();
+	mutable_path data;
 
 	// Optimized for speed, avoid expensive wxString functions
 	// Before the optimization this function was responsible for
@@ -396,6 +554,7 @@ bool CServerPath::DoSetSafePath(std::wstring const& path)
 		}
 		else {
 			// Is root directory, like / on unix like systems.
+			m_data = intern(data);
 			return true;
 		}
 	}
@@ -439,6 +598,7 @@ bool CServerPath::DoSetSafePath(std::wstring const& path)
 		p += segment_len + 1;
 	}
 
+	m_data = intern(data);
 	return true;
 }
 
@@ -474,6 +634,20 @@ bool CServerPath::IsSubdirOf(CServerPath const& path, bool cmpNoCase, bool allow
 	
 	auto const& ld = *m_data;
 	auto const& rd = *path.m_data;
+
+	if (!cmpNoCase && traits[m_type].prefixmode != 1) {
+		// Ancestors are shared, walk up to the depth of the other path
+		size_t const depth = rd.m_depth;
+		if (ld.m_depth < depth || (ld.m_depth == depth && !allowEqual)) {
+			return false;
+		}
+		auto const* node = &ld;
+		while (node->m_depth > depth) {
+			node = node->m_parent.get();
+		}
+		return node == &rd;
+	}
+
 	if (traits[m_type].prefixmode != 1) {
 		if (cmpNoCase ) {
 			if (ld.m_prefix && !rd.m_prefix) {
@@ -497,18 +671,20 @@ bool CServerPath::IsSubdirOf(CServerPath const& path, bool cmpNoCase, bool allow
 		return false;
 	}
 
-	auto iter1 = ld.m_segments.cbegin();
-	auto iter2 = rd.m_segments.cbegin();
-	while (iter1 != ld.m_segments.cend()) {
-		if (iter2 == rd.m_segments.cend()) {
+	auto const lsegs = segments(ld);
+	auto const rsegs = segments(rd);
+	auto iter1 = lsegs.cbegin();
+	auto iter2 = rsegs.cbegin();
+	while (iter1 != lsegs.cend()) {
+		if (iter2 == rsegs.cend()) {
 			return true;
 		}
 		if (cmpNoCase) {
-			if (fz::stricmp(*iter1, *iter2)) {
+			if (fz::stricmp(**iter1, **iter2)) {
 				return false;
 			}
 		}
-		else if (*iter1 != *iter2) {
+		else if (**iter1 != **iter2) {
 			return false;
 		}
 
@@ -516,7 +692,7 @@ bool CServerPath::IsSubdirOf(CServerPath const& path, bool cmpNoCase, bool allow
 		++iter2;
 	}
 
-	if (allowEqual && iter2 == rd.m_segments.cend()) {
+	if (allowEqual && iter2 == rsegs.cend()) {
 		return true;
 	}
 
@@ -559,7 +735,7 @@ bool CServerPath::DoChangePath(std::wstring &subdir, bool isFile)
 	}
 
 	bool const was_empty = empty();
-	CServerPathData& data = m_data.get();
+	mutable_path data = copy(m_data);
 
 	switch (m_type)
 	{
@@ -838,6 +1014,7 @@ bool CServerPath::DoChangePath(std::wstring &subdir, bool isFile)
 		subdir = file;
 	}
 
+	m_data = intern(data);
 	return true;
 }
 
@@ -869,6 +1046,9 @@ bool CServerPath::operator<(CServerPath const& op) const
 	else if (op.empty()) {
 		return false;
 	}
+	else if (m_data == op.m_data && m_type == op.m_type) {
+		return false;
+	}
 
 	auto const& ld = *m_data;
 	auto const& rd = *op.m_data;
@@ -889,13 +1069,16 @@ bool CServerPath::operator<(CServerPath const& op) const
 		return true;
 	}
 
-	tConstSegmentIter iter1, iter2;
-	for (iter1 = ld.m_segments.cbegin(), iter2 = rd.m_segments.cbegin(); iter1 != ld.m_segments.cend(); ++iter1, ++iter2) {
-		if (iter2 == rd.m_segments.cend()) {
+	auto const lsegs = segments(ld);
+	auto const rsegs = segments(rd);
+	auto iter1 = lsegs.cbegin();
+	auto iter2 = rsegs.cbegin();
+	for (; iter1 != lsegs.cend(); ++iter1, ++iter2) {
+		if (iter2 == rsegs.cend()) {
 			return false;
 		}
 
-		const int cmp = std::wcscmp(iter1->c_str(), iter2->c_str());
+		const int cmp = std::wcscmp((*iter1)->c_str(), (*iter2)->c_str());
 		if (cmp < 0) {
 			return true;
 		}
@@ -904,7 +1087,7 @@ bool CServerPath::operator<(CServerPath const& op) const
 		}
 	}
 
-	return iter2 != rd.m_segments.cend();
+	return iter2 != rsegs.cend();
 }
 
 std::wstring CServerPath::FormatFilename(std::wstring const& filename, bool omitPath) const
@@ -924,7 +1107,7 @@ std::wstring CServerPath::FormatFilename(std::wstring const& filename, bool omit
 
 	switch (m_type) {
 		case VXWORKS:
-			if (!result.empty() && !IsSeparator(result.back()) && !m_data->m_segments.empty()) {
+			if (!result.empty() && !IsSeparator(result.back()) && m_data->m_depth) {
 				result += traits[m_type].separators[0];
 			}
 			break;
@@ -960,6 +1143,9 @@ int CServerPath::CmpNoCase(CServerPath const& op) const
 	else if (empty()) {
 		return 0;
 	}
+	else if (m_data == op.m_data && m_type == op.m_type) {
+		return 0;
+	}
 
 	auto const& ld = *m_data;
 	auto const& rd = *op.m_data;
@@ -971,17 +1157,19 @@ int CServerPath::CmpNoCase(CServerPath const& op) const
 		return 1;
 	}
 
-	if (ld.m_segments.size() > rd.m_segments.size()) {
+	if (ld.m_depth > rd.m_depth) {
 		return 1;
 	}
-	else if (ld.m_segments.size() < rd.m_segments.size()) {
+	else if (ld.m_depth < rd.m_depth) {
 		return -1;
 	}
 
-	auto iter = ld.m_segments.cbegin();
-	auto iter2 = rd.m_segments.cbegin();
-	while (iter != ld.m_segments.cend()) {
-		int res = fz::stricmp(*(iter++), *(iter2++));
+	auto const lsegs = segments(ld);
+	auto const rsegs = segments(rd);
+	auto iter = lsegs.cbegin();
+	auto iter2 = rsegs.cbegin();
+	while (iter != lsegs.cend()) {
+		int res = fz::stricmp(**(iter++), **(iter2++));
 		if (res) {
 			return res;
 		}
@@ -997,7 +1185,7 @@ bool CServerPath::AddSegment(std::wstring const& segment)
 	}
 
 	// TODO: Check for invalid characters
-	m_data.get().m_segments.push_back(segment);
+	m_data = get_path_table().get_child(m_data, segment);
 
 	return true;
 }
@@ -1041,10 +1229,12 @@ CServerPath CServerPath::GetCommonParent(CServerPath const& path) const
 	CServerPath parent;
 	parent.m_type = m_type;
 
-	CServerPathData& parentData = parent.m_data.get();
+	mutable_path parentData;
 
-	auto last = ld.m_segments.cend();
-	auto last2 = rd.m_segments.cend();
+	auto const lsegs = segments(ld);
+	auto const rsegs = segments(rd);
+	auto last = lsegs.cend();
+	auto last2 = rsegs.cend();
 	if (traits[m_type].prefixmode == 1) {
 		if (!ld.m_prefix) {
 			--last;
@@ -1058,24 +1248,23 @@ CServerPath CServerPath::GetCommonParent(CServerPath const& path) const
 		parentData.m_prefix = ld.m_prefix;
 	}
 
-	auto iter = ld.m_segments.cbegin();
-	auto iter2 = rd.m_segments.cbegin();
+	auto iter = lsegs.cbegin();
+	auto iter2 = rsegs.cbegin();
 	while (iter != last && iter2 != last2) {
-		if (*iter != *iter2) {
+		if (**iter != **iter2) {
 			if (!traits[m_type].has_root && parentData.m_segments.empty()) {
 				return CServerPath();
 			}
-			else {
-				return parent;
-			}
+			break;
 		}
 
-		parentData.m_segments.push_back(*iter);
+		parentData.m_segments.push_back(**iter);
 
 		++iter;
 		++iter2;
 	}
 
+	parent.m_data = intern(parentData);
 	return parent;
 }
 
@@ -1182,7 +1371,7 @@ bool CServerPath::ExtractFile(std::wstring& dir, std::wstring& file)
 
 size_t CServerPath::SegmentCount() const
 {
-	return empty() ? 0 : m_data->m_segments.size();
+	return empty() ? 0 : m_data->m_depth;
 }
 
 bool CServerPath::IsSeparator(wchar_t c) const
@@ -68,6 +68,11 @@ int CSftpConnectOpData::Send()
 			if (options_.get_int(OPTION_SFTP_COMPRESSION)) {
 				args.push_back(fzT("-C"));
 			}
+			if (options_.get_int(OPTION_FTP_SENDKEEPALIVE)) {
+				// Same interval as the keepalive commands sent over idle FTP connections
+				args.push_back(fzT("-keepalive"));
+				args.push_back(fzT("30"));
+			}
 #ifndef FZ_WINDOWS
 			if (controlSocket_.shm_fd_ == -1) {
 #if HAVE_MEMFD_CREATE
@@ -78,8 +78,15 @@ int CSftpFileTransferOpData::Send()
 		}
 		else {
 			engine_.transfer_status_.Init(localFileSize_, resume_ ? remoteFileSize_ : 0, false);
-			cmd += "put ";
-			logstr += L"put ";
+			if (!resume_ && remoteFileSize_ > 0 && (flags_ & sftp_transfer_flags::delta)) {
+				// Compares block hashes with the existing file, only sending what differs
+				cmd += "dput ";
+				logstr += L"dput ";
+			}
+			else {
+				cmd += "put ";
+				logstr += L"put ";
+			}
 
 			std::wstring localFile = controlSocket_.QuoteFilename(localName_);
 			cmd += fz::to_utf8(localFile) + " ";
@@ -57,6 +57,7 @@ void CSftpControlSocket::Connect(CServer const& server, Credentials const& crede
 	}
 
 	currentServer_ = server;
+	ResolveCapabilities();
 	credentials_ = credentials;
 
 	Push(std::make_unique<CSftpConnectOpData>(*this));
@@ -337,6 +338,13 @@ int CSftpControlSocket::SendCommand(std::wstring const& cmd, std::wstring const&
 		return FZ_REPLY_INTERNALERROR;
 	}
 
+	helper_span_.start(engine_.tracer_);
+	if (helper_span_) {
+		// Name it like the log does, the command itself might be a password
+		std::wstring const& name = show.empty() ? cmd : show;
+		helper_command_ = fz::to_utf8(name.substr(0, name.find(' ')));
+	}
+
 	return AddToStream(cmd + L"\n");
 }
 
@@ -464,6 +472,8 @@ void CSftpControlSocket::ChangeDir(CServerPath const& path, std::wstring const&
 
 void CSftpControlSocket::ProcessReply(int result, std::wstring const& reply)
 {
+	helper_span_.stop(engine_.tracer_, trace_category::helper, helper_command_);
+
 	result_ = result;
 	response_.clear();
 
@@ -508,6 +518,7 @@ void CSftpControlSocket::FileTransfer(CFileTransferCommand const& cmd)
 
 int CSftpControlSocket::DoClose(int nErrorCode)
 {
+	helper_span_.reset();
 	remove_bucket();
 	if (process_) {
 		process_->kill();
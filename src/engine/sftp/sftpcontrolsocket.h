@@ -69,6 +69,10 @@ protected:
 	int result_{};
 	std::wstring response_;
 
+	// Round trip of the current command through fzsftp
+	trace_span helper_span_;
+	std::string helper_command_;
+
 	friend class CProtocolOpData<CSftpControlSocket>;
 	friend class CSftpChangeDirOpData;
 	friend class CSftpChmodOpData;
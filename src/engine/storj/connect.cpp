@@ -35,6 +35,7 @@ int CStorjConnectOpData::Send()
 				auto const hash = fz::hex_encode<std::wstring>(fz::sha256(fz::to_utf8(controlSocket_.credentials_.GetPass())));
 				if (hash != currentServer_.GetExtraParameter("credentials_hash")) {
 					currentServer_.SetExtraParameter("credentials_hash", hash);
+					controlSocket_.ResolveCapabilities();
 					controlSocket_.engine_.AddNotification(std::make_unique<ServerChangeNotification>(controlSocket_.currentServer_));
 				}
 			}
@@ -43,6 +44,7 @@ int CStorjConnectOpData::Send()
 				auto const passphraseHash = fz::hex_encode<std::wstring>(fz::hmac_sha256(fz::to_utf8(controlSocket_.currentServer_.GetUser()), fz::to_utf8(controlSocket_.credentials_.GetPass())));
 				if (passphraseHash != controlSocket_.currentServer_.GetExtraParameter("passphrase_hash")) {
 					controlSocket_.currentServer_.SetExtraParameter("passphrase_hash", passphraseHash);
+					controlSocket_.ResolveCapabilities();
 					controlSocket_.engine_.AddNotification(std::make_unique<ServerChangeNotification>(controlSocket_.currentServer_));
 				}
 			}
@@ -43,6 +43,7 @@ CStorjControlSocket::~CStorjControlSocket()
 void CStorjControlSocket::Connect(CServer const &server, Credentials const& credentials)
 {
 	currentServer_ = server;
+	ResolveCapabilities();
 	credentials_ = credentials;
 
 	Push(std::make_unique<CStorjConnectOpData>(*this));
@@ -0,0 +1,142 @@
+#include "filezilla.h"
+
+#include "tracer.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace {
+char const* const category_names[] = {
+	"Commands",
+	"Data connection",
+	"Disk",
+	"Socket",
+	"Rate limit",
+	"Helper"
+};
+static_assert(sizeof(category_names) / sizeof(*category_names) == static_cast<size_t>(trace_category::count), "Category name missing");
+
+void append_escaped(std::string & out, char const* s)
+{
+	for (; *s; ++s) {
+		unsigned char const c = static_cast<unsigned char>(*s);
+		if (c == '"' || c == '\\') {
+			out += '\\';
+			out += *s;
+		}
+		else if (c >= 0x20) {
+			out += *s;
+		}
+	}
+}
+}
+
+void CTracer::SetCapacity(size_t capacity)
+{
+	fz::scoped_lock l(mutex_);
+
+	if (capacity == spans_.size()) {
+		return;
+	}
+
+	spans_.clear();
+	spans_.shrink_to_fit();
+	spans_.resize(capacity);
+	next_ = 0;
+	wrapped_ = false;
+
+	enabled_ = capacity != 0;
+}
+
+void CTracer::Add(trace_category category, std::string_view name, fz::monotonic_clock const& start, fz::monotonic_clock const& end)
+{
+	fz::scoped_lock l(mutex_);
+
+	if (spans_.empty()) {
+		return;
+	}
+
+	auto & s = spans_[next_];
+	s.start_ = start;
+	s.duration_ = end - start;
+	s.category_ = category;
+
+	size_t const len = std::min(name.size(), sizeof(s.name_) - 1);
+	memcpy(s.name_, name.data(), len);
+	s.name_[len] = 0;
+
+	if (++next_ == spans_.size()) {
+		next_ = 0;
+		wrapped_ = true;
+	}
+}
+
+void CTracer::Export(std::string & out, unsigned int engine_id, fz::monotonic_clock const& epoch) const
+{
+	fz::scoped_lock l(mutex_);
+
+	if (spans_.empty()) {
+		return;
+	}
+
+	out += fz::sprintf("{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%u,\"args\":{\"name\":\"Engine %u\"}},\n", engine_id, engine_id);
+	for (size_t i = 0; i < static_cast<size_t>(trace_category::count); ++i) {
+		out += fz::sprintf("{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%u,\"tid\":%u,\"args\":{\"name\":\"%s\"}},\n", engine_id, i, category_names[i]);
+	}
+
+	size_t const count = wrapped_ ? spans_.size() : next_;
+	size_t i = wrapped_ ? next_ : 0;
+	for (size_t n = 0; n < count; ++n) {
+		auto const& s = spans_[i];
+		if (++i == spans_.size()) {
+			i = 0;
+		}
+
+		if (s.start_ < epoch) {
+			continue;
+		}
+
+		out += "{\"name\":\"";
+		append_escaped(out, s.name_);
+		out += fz::sprintf("\",\"ph\":\"X\",\"ts\":%d,\"dur\":%d,\"pid\":%u,\"tid\":%u},\n",
+			(s.start_ - epoch).get_microseconds(), s.duration_.get_microseconds(), engine_id, static_cast<unsigned int>(s.category_));
+	}
+}
+
+CTraceRegistry::CTraceRegistry()
+	: epoch_(fz::monotonic_clock::now())
+{
+}
+
+void CTraceRegistry::Register(CTracer & tracer, unsigned int engine_id)
+{
+	fz::scoped_lock l(mutex_);
+	tracers_.emplace_back(&tracer, engine_id);
+}
+
+void CTraceRegistry::Unregister(CTracer & tracer)
+{
+	fz::scoped_lock l(mutex_);
+	auto it = std::find_if(tracers_.begin(), tracers_.end(), [&tracer](auto const& t) { return t.first == &tracer; });
+	if (it != tracers_.end()) {
+		tracers_.erase(it);
+	}
+}
+
+std::string CTraceRegistry::Export() const
+{
+	std::string out = "{\"traceEvents\":[\n";
+	{
+		fz::scoped_lock l(mutex_);
+		for (auto const& t : tracers_) {
+			t.first->Export(out, t.second, epoch_);
+		}
+	}
+
+	// Strip the trailing comma
+	if (out.size() > 2 && out[out.size() - 2] == ',') {
+		out.erase(out.size() - 2, 1);
+	}
+	out += "],\"displayTimeUnit\":\"ms\"}\n";
+	return out;
+}
@@ -0,0 +1,115 @@
+#ifndef FILEZILLA_ENGINE_TRACER_HEADER
+#define FILEZILLA_ENGINE_TRACER_HEADER
+
+#include <libfilezilla/mutex.hpp>
+#include <libfilezilla/time.hpp>
+
+#include <atomic>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+// Each category gets its own row in the timeline
+enum class trace_category : unsigned char
+{
+	command,    // Control connection command until its final reply
+	connection, // Data connection setup
+	disk,       // Waiting for the reader or writer
+	socket,     // Waiting for the socket or for a postponed event
+	ratelimit,  // Stalled by the rate limiter
+	helper,     // Round trip to a helper process such as fzsftp
+
+	count
+};
+
+/*
+ * Records timed spans of an engine into a fixed-size ring buffer, oldest
+ * spans get overwritten. Recording is disabled while the capacity is 0.
+ *
+ * Spans can be added from any thread.
+ */
+class CTracer final
+{
+public:
+	CTracer() = default;
+
+	CTracer(CTracer const&) = delete;
+	CTracer& operator=(CTracer const&) = delete;
+
+	void SetCapacity(size_t capacity);
+
+	bool enabled() const { return enabled_.load(std::memory_order_relaxed); }
+
+	// Names longer than a few characters get truncated
+	void Add(trace_category category, std::string_view name, fz::monotonic_clock const& start, fz::monotonic_clock const& end = fz::monotonic_clock::now());
+
+	// Appends the spans as Chrome trace events, each followed by a comma.
+	// Timestamps are relative to the epoch.
+	void Export(std::string & out, unsigned int engine_id, fz::monotonic_clock const& epoch) const;
+
+private:
+	struct span final
+	{
+		fz::monotonic_clock start_;
+		fz::duration duration_;
+		trace_category category_{};
+		char name_[23]{};
+	};
+
+	std::atomic<bool> enabled_{};
+
+	mutable fz::mutex mutex_{false};
+	std::vector<span> spans_;
+	size_t next_{};
+	bool wrapped_{};
+};
+
+// Start time of a span that is in progress. Only taken if tracing is enabled,
+// so stopping a span that has not been started is cheap.
+class trace_span final
+{
+public:
+	void start(CTracer const& tracer)
+	{
+		if (tracer.enabled()) {
+			start_ = fz::monotonic_clock::now();
+		}
+	}
+
+	void stop(CTracer & tracer, trace_category category, std::string_view name)
+	{
+		if (start_) {
+			tracer.Add(category, name, start_);
+			start_ = fz::monotonic_clock();
+		}
+	}
+
+	void reset() { start_ = fz::monotonic_clock(); }
+
+	explicit operator bool() const { return static_cast<bool>(start_); }
+
+private:
+	fz::monotonic_clock start_;
+};
+
+// Tracers of all engines of a context
+class CTraceRegistry final
+{
+public:
+	CTraceRegistry();
+
+	void Register(CTracer & tracer, unsigned int engine_id);
+	void Unregister(CTracer & tracer);
+
+	// Returns all recorded spans as a Chrome trace JSON document
+	std::string Export() const;
+
+private:
+	fz::monotonic_clock const epoch_;
+
+	mutable fz::mutex mutex_{false};
+	std::vector<std::pair<CTracer*, unsigned int>> tracers_;
+};
+
+#endif
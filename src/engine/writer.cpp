@@ -1,10 +1,19 @@
 #include "../include/writer.h"
 #include "engineprivate.h"
+#include "mapped_window.h"
 #include <libfilezilla/local_filesys.hpp>
 #include <libfilezilla/translate.hpp>
 
+#include <algorithm>
+
 #include <string.h>
 
+#ifndef FZ_WINDOWS
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
 writer_factory_holder::writer_factory_holder(writer_factory_holder const& op)
 {
 	if (op.impl_) {
@@ -105,7 +114,84 @@ std::unique_ptr<writer_base> file_writer_factory::open(uint64_t offset, CFileZil
 	return ret;
 }
 
+std::unique_ptr<writer_base> file_writer_factory::open_range(uint64_t offset, CFileZillaEnginePrivate & engine, fz::event_handler * handler, aio_base::shm_flag shm, bool update_transfer_status)
+{
+	auto ret = std::make_unique<file_writer>(name(), engine, handler, update_transfer_status);
+
+	if (ret->open(offset, fsync_, shm, false) != aio_result::ok) {
+		ret.reset();
+	}
+
+	return ret;
+}
+
+mmap_writer_factory::mmap_writer_factory(std::wstring const& file, bool fsync)
+	: writer_factory(file)
+	, fsync_(fsync)
+{
+}
+
+std::unique_ptr<writer_factory> mmap_writer_factory::clone() const
+{
+	return std::make_unique<mmap_writer_factory>(*this);
+}
+
+uint64_t mmap_writer_factory::size() const
+{
+	return file_writer_factory(name()).size();
+}
+
+fz::datetime mmap_writer_factory::mtime() const
+{
+	return file_writer_factory(name()).mtime();
+}
+
+bool mmap_writer_factory::set_mtime(fz::datetime const& t)
+{
+	return file_writer_factory(name()).set_mtime(t);
+}
+
+std::unique_ptr<writer_base> mmap_writer_factory::open(uint64_t offset, CFileZillaEnginePrivate & engine, fz::event_handler * handler, aio_base::shm_flag shm, bool update_transfer_status)
+{
+#ifndef FZ_WINDOWS
+	// Child processes cannot see the mapping, the data would need to be
+	// copied out of shared memory anyhow.
+	if (shm == aio_base::shm_flag_none) {
+		auto ret = std::make_unique<mmap_writer>(name(), engine, handler, update_transfer_status);
+		if (ret->open(offset, fsync_) != aio_result::ok) {
+			ret.reset();
+		}
+		return ret;
+	}
+#endif
+
+	return file_writer_factory(name(), fsync_).open(offset, engine, handler, shm, update_transfer_status);
+}
+
+std::unique_ptr<writer_base> mmap_writer_factory::open_range(uint64_t offset, CFileZillaEnginePrivate & engine, fz::event_handler * handler, aio_base::shm_flag shm, bool update_transfer_status)
+{
+	// Windows of several writers would need to be kept from overlapping
+	return file_writer_factory(name(), fsync_).open_range(offset, engine, handler, shm, update_transfer_status);
+}
+
 namespace {
+void create_parent_dirs(CFileZillaEnginePrivate & engine, std::wstring const& name)
+{
+	std::wstring tmp;
+	CLocalPath local_path(name, &tmp);
+	if (local_path.HasParent()) {
+		fz::native_string last_created;
+		fz::mkdir(fz::to_native(local_path.GetPath()), true, fz::mkdir_permissions::normal, &last_created);
+		if (!last_created.empty()) {
+			// Send out notification
+			auto n = std::make_unique<CLocalDirCreatedNotification>();
+			if (n->dir.SetPath(fz::to_wstring(last_created))) {
+				engine.AddNotification(std::move(n));
+			}
+		}
+	}
+}
+
 void remove_writer_events(fz::event_handler * handler, writer_base const* writer)
 {
 	if (!handler) {
@@ -296,7 +382,7 @@ void file_writer::close()
 	}
 }
 
-aio_result file_writer::open(uint64_t offset, bool fsync, shm_flag shm)
+aio_result file_writer::open(uint64_t offset, bool fsync, shm_flag shm, bool truncate)
 {
 	fsync_ = fsync;
 
@@ -305,21 +391,9 @@ aio_result file_writer::open(uint64_t offset, bool fsync, shm_flag shm)
 		return aio_result::error;
 	}
 
-	std::wstring tmp;
-	CLocalPath local_path(name(), &tmp);
-	if (local_path.HasParent()) {
-		fz::native_string last_created;
-		fz::mkdir(fz::to_native(local_path.GetPath()), true, fz::mkdir_permissions::normal, &last_created);
-		if (!last_created.empty()) {
-			// Send out notification
-			auto n = std::make_unique<CLocalDirCreatedNotification>();
-			if (n->dir.SetPath(fz::to_wstring(last_created))) {
-				engine_.AddNotification(std::move(n));
-			}
-		}
-	}
+	create_parent_dirs(engine_, name());
 
-	if (!file_.open(fz::to_native(name()), fz::file::writing, offset ? fz::file::existing : fz::file::empty)) {
+	if (!file_.open(fz::to_native(name()), fz::file::writing, (offset || !truncate) ? fz::file::existing : fz::file::empty)) {
 		engine_.GetLogger().log(logmsg::error, fztranslate("Could not open '%s' for writing."), name_);
 		return aio_result::error;
 	}
@@ -330,12 +404,12 @@ aio_result file_writer::open(uint64_t offset, bool fsync, shm_flag shm)
 			engine_.GetLogger().log(logmsg::error, fztranslate("Could not seek to offset %d in '%s'."), ofs, name_);
 			return aio_result::error;
 		}
-		if (!file_.truncate()) {
+		if (truncate && !file_.truncate()) {
 			engine_.GetLogger().log(logmsg::error, fztranslate("Could not truncate '%s' to offset %d."), name_, ofs);
 			return aio_result::error;
 		}
 	}
-	else {
+	else if (truncate) {
 		from_beginning_ = true;
 	}
 
@@ -416,6 +490,19 @@ uint64_t file_writer::size() const
 	}
 }
 
+#ifndef FZ_WINDOWS
+int file_writer::direct_fd()
+{
+	fz::scoped_lock l(mtx_);
+	if (error_ || finalized_ || processing_ || ready_count_) {
+		return -1;
+	}
+
+	// The worker thread stays idle as no buffer ever gets handed back
+	return file_.fd();
+}
+#endif
+
 aio_result file_writer::continue_finalize()
 {
 	if (fsync_) {
@@ -460,6 +547,222 @@ aio_result file_writer::preallocate(uint64_t size)
 	return aio_result::ok;
 }
 
+#ifndef FZ_WINDOWS
+namespace {
+// Small enough to keep the address space use low on 32-bit systems
+size_t const mmap_window_size{16 * 1024 * 1024};
+}
+
+mmap_writer::mmap_writer(std::wstring const& name, CFileZillaEnginePrivate & engine, fz::event_handler * handler, bool update_transfer_status)
+	: writer_base(name, engine, handler, update_transfer_status)
+	, window_(std::make_unique<mapped_window>())
+{
+}
+
+mmap_writer::~mmap_writer()
+{
+	close();
+}
+
+void mmap_writer::close()
+{
+	window_->unmap();
+
+	writer_base::close();
+
+	if (fd_ != -1) {
+		bool remove{};
+		if (from_beginning_ && !pos_ && !finalized_) {
+			// Freshly created file to which nothing has been written.
+			remove = true;
+		}
+		else if (allocated_ > pos_) {
+			// Cut off what got reserved for the mapping but not written
+			if (ftruncate(fd_, static_cast<off_t>(pos_)) != 0) {
+				engine_.GetLogger().log(logmsg::debug_warning, L"Could not truncate '%s' to offset %d, error %d", name_, pos_, errno);
+			}
+		}
+		::close(fd_);
+		fd_ = -1;
+
+		if (remove) {
+			engine_.GetLogger().log(logmsg::debug_verbose, L"Deleting empty file '%s'", name());
+			fz::remove_file(fz::to_native(name()));
+		}
+	}
+}
+
+aio_result mmap_writer::open(uint64_t offset, bool fsync)
+{
+	fsync_ = fsync;
+
+	create_parent_dirs(engine_, name());
+
+	// Shared writable mappings need the file to be opened for reading as well
+	int flags = O_RDWR | O_CREAT | O_CLOEXEC;
+	if (!offset) {
+		flags |= O_TRUNC;
+	}
+	fd_ = ::open(fz::to_native(name()).c_str(), flags, 0666);
+	if (fd_ == -1) {
+		engine_.GetLogger().log(logmsg::error, fztranslate("Could not open '%s' for writing."), name_);
+		return aio_result::error;
+	}
+
+	if (offset) {
+		if (ftruncate(fd_, static_cast<off_t>(offset)) != 0) {
+			engine_.GetLogger().log(logmsg::error, fztranslate("Could not truncate '%s' to offset %d."), name_, offset);
+			return aio_result::error;
+		}
+	}
+	else {
+		from_beginning_ = true;
+	}
+	pos_ = offset;
+	allocated_ = offset;
+
+	return aio_result::ok;
+}
+
+bool mmap_writer::reserve(uint64_t end)
+{
+	if (end <= allocated_) {
+		return true;
+	}
+
+#ifdef __linux__
+	// Allocating the blocks up front turns running out of space into an
+	// error here instead of a SIGBUS once the pages get written. Unlike
+	// posix_fallocate, this does not fall back to writing zeroes.
+	if (!fallocate(fd_, 0, static_cast<off_t>(allocated_), static_cast<off_t>(end - allocated_))) {
+		allocated_ = end;
+		return true;
+	}
+	int const res = errno;
+	if (res != EOPNOTSUPP) {
+		engine_.GetLogger().log(logmsg::debug_warning, L"fallocate failed for '%s' with error %d", name_, res);
+		engine_.GetLogger().log(logmsg::error, fztranslate("Could not write to '%s'."), name_);
+		error_ = true;
+		return false;
+	}
+#endif
+
+	// Filesystem cannot allocate, the file stays sparse
+	if (ftruncate(fd_, static_cast<off_t>(end)) != 0) {
+		engine_.GetLogger().log(logmsg::debug_warning, L"Could not extend '%s' to %d bytes, error %d", name_, end, errno);
+		engine_.GetLogger().log(logmsg::error, fztranslate("Could not write to '%s'."), name_);
+		error_ = true;
+		return false;
+	}
+	allocated_ = end;
+	return true;
+}
+
+bool mmap_writer::written(fz::nonowning_buffer & last_written)
+{
+	if (processing_ && !last_written.empty()) {
+		pos_ += last_written.size();
+		if (update_transfer_status_) {
+			engine_.transfer_status_.SetMadeProgress();
+			engine_.transfer_status_.Update(last_written.size());
+		}
+	}
+	last_written.reset();
+
+	if (window_->faulted()) {
+		engine_.GetLogger().log(logmsg::debug_warning, L"Writing to the mapping of '%s' raised SIGBUS", name_);
+		engine_.GetLogger().log(logmsg::error, fztranslate("Could not write to '%s'."), name_);
+		error_ = true;
+		return false;
+	}
+	return true;
+}
+
+get_write_buffer_result mmap_writer::get_write_buffer(fz::nonowning_buffer & last_written)
+{
+	if (error_ || !written(last_written)) {
+		return {aio_result::error, fz::nonowning_buffer()};
+	}
+
+	if (!window_->contains(pos_)) {
+		if (!reserve(pos_ + mmap_window_size)) {
+			return {aio_result::error, fz::nonowning_buffer()};
+		}
+		if (!window_->map(fd_, pos_, mmap_window_size, true)) {
+			engine_.GetLogger().log(logmsg::debug_warning, L"Could not map %u bytes at offset %d of '%s', error %d", mmap_window_size, pos_, name_, errno);
+			engine_.GetLogger().log(logmsg::error, fztranslate("Could not write to '%s'."), name_);
+			error_ = true;
+			return {aio_result::error, fz::nonowning_buffer()};
+		}
+	}
+
+	processing_ = true;
+	size_t const len = static_cast<size_t>(std::min(static_cast<uint64_t>(buffer_size_), window_->end() - pos_));
+	return {aio_result::ok, fz::nonowning_buffer(window_->at(pos_), len)};
+}
+
+aio_result mmap_writer::retire(fz::nonowning_buffer & last_written)
+{
+	if (error_ || !written(last_written)) {
+		return aio_result::error;
+	}
+	processing_ = false;
+	return aio_result::ok;
+}
+
+aio_result mmap_writer::finalize(fz::nonowning_buffer & last_written)
+{
+	if (error_ || !written(last_written)) {
+		return aio_result::error;
+	}
+	processing_ = false;
+	if (finalized_) {
+		return aio_result::ok;
+	}
+
+	if (fsync_ && !window_->sync()) {
+		engine_.GetLogger().log(logmsg::error, fztranslate("Could not sync '%s' to disk."), name_);
+		error_ = true;
+		return aio_result::error;
+	}
+	window_->unmap();
+
+	if (allocated_ > pos_) {
+		if (ftruncate(fd_, static_cast<off_t>(pos_)) != 0) {
+			engine_.GetLogger().log(logmsg::error, fztranslate("Could not truncate '%s' to offset %d."), name_, pos_);
+			error_ = true;
+			return aio_result::error;
+		}
+		allocated_ = pos_;
+	}
+
+	if (fsync_ && fsync(fd_) != 0) {
+		engine_.GetLogger().log(logmsg::error, fztranslate("Could not sync '%s' to disk."), name_);
+		error_ = true;
+		return aio_result::error;
+	}
+
+	finalized_ = true;
+	return aio_result::ok;
+}
+
+uint64_t mmap_writer::size() const
+{
+	return pos_;
+}
+
+aio_result mmap_writer::preallocate(uint64_t size)
+{
+	if (error_) {
+		return aio_result::error;
+	}
+
+	engine_.GetLogger().log(logmsg::debug_info, L"Preallocating %d bytes for the file \"%s\"", size, name_);
+
+	return reserve(pos_ + size) ? aio_result::ok : aio_result::error;
+}
+#endif
+
 
 #include <libfilezilla/buffer.hpp>
 
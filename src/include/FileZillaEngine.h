@@ -11,6 +11,21 @@ class CFileZillaEngineContext;
 class CFileZillaEnginePrivate;
 class CNotification;
 
+// Instrumentation of the notification delivery, see CFileZillaEngine::GetNotificationStats
+class FZC_PUBLIC_SYMBOL CNotificationStats final
+{
+public:
+	uint64_t added{}; // Total number of notifications added
+	uint64_t coalesced{}; // Transfer status notifications superseded before delivery
+	uint64_t batches{}; // Number of non-empty batches delivered by GetNotifications
+
+	size_t depth{}; // Currently pending notifications
+	size_t max_depth{};
+
+	// Notifications added per second since the previous call to GetNotificationStats
+	double per_second{};
+};
+
 class FZC_PUBLIC_SYMBOL CFileZillaEngine final
 {
 public:
@@ -37,6 +52,16 @@ public:
 	// See notification.h for details.
 	std::unique_ptr<CNotification> GetNextNotification();
 
+	// Moves all pending notifications into the passed vector, replacing its
+	// contents, and re-arms the callback. Unlike GetNextNotification, it only
+	// needs to be called once each time you get the pending notifications event.
+	// If multiple transfer status notifications are pending, only the most recent
+	// one is delivered.
+	// Returns false if there were no pending notifications.
+	bool GetNotifications(std::vector<std::unique_ptr<CNotification>> & notifications);
+
+	CNotificationStats GetNotificationStats();
+
 	// Sets the reply to an async request, e.g. a file exists request.
 	// See notifiction.h for details.
 	bool IsPendingAsyncRequestReply(std::unique_ptr<CAsyncRequestNotification> const& pNotification);
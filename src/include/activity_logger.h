@@ -27,8 +27,16 @@ public:
 
 	void set_notifier(std::function<void()> && notification_cb);
 
+	// Records received content that got decompressed, in bytes before
+	// and after decoding.
+	void record_decoding(uint64_t encoded, uint64_t decoded);
+
+	// Totals of all recorded decoding, not reset on extraction
+	std::pair<uint64_t, uint64_t> decoding_totals() const;
+
 private:
 	std::atomic_uint64_t amounts_[2]{};
+	std::atomic_uint64_t decoding_[2]{};
 
 	fz::mutex mtx_;
 	std::function<void()> notification_cb_;
@@ -220,6 +220,12 @@ namespace ftp_transfer_flags
 	auto constexpr ascii = transfer_flags::protocol_reserved_max;
 }
 
+namespace sftp_transfer_flags
+{
+	// Uploads over an existing file only write the blocks that differ
+	auto constexpr delta = transfer_flags::protocol_reserved_max;
+}
+
 class FZC_PUBLIC_SYMBOL CFileTransferCommand final : public CCommandHelper<CFileTransferCommand, Command::transfer>
 {
 public:
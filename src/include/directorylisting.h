@@ -8,6 +8,7 @@
 #include <libfilezilla/time.hpp>
 
 #include <unordered_map>
+#include <vector>
 
 class FZC_PUBLIC_SYMBOL CDirentry
 {
@@ -140,6 +141,34 @@ public:
 
 	bool RemoveEntry(size_t index);
 
+	// Changes made to a listing after it got retrieved, e.g. by the
+	// directory cache after a file got uploaded, deleted or renamed.
+	enum class change_type : unsigned char
+	{
+		added,    // Entry got appended
+		removed,  // Entry at the index got removed
+		modified  // Entry at the index got changed, it may have been renamed
+	};
+
+	struct change final
+	{
+		change_type type{};
+		bool dir{};
+		size_t index{};
+		std::wstring name;
+	};
+
+	// Increases with every change made to the listing
+	uint64_t revision() const { return m_changesStart + (m_changes ? m_changes->size() : 0); }
+
+	// Gets the changes made since the given revision, oldest first.
+	// Returns false if these are no longer known, the listing then needs
+	// to be processed as a whole.
+	bool GetChanges(uint64_t since, std::vector<change> & changes) const;
+
+	// Needs to be called after changing an entry obtained through get()
+	void Modified(size_t index);
+
 	void GetFilenames(std::vector<std::wstring> &names) const;
 
 protected:
@@ -149,6 +178,11 @@ protected:
 	mutable fz::shared_optional<std::unordered_multimap<std::wstring, size_t>> m_searchmap_case;
 	mutable fz::shared_optional<std::unordered_multimap<std::wstring, size_t>> m_searchmap_nocase;
 
+	void RecordChange(change_type type, size_t index);
+
+	fz::shared_optional<std::vector<change>> m_changes;
+	uint64_t m_changesStart{};
+
 public:
 	int m_flags{};
 };
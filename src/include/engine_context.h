@@ -4,11 +4,14 @@
 #include "visibility.h"
 
 #include <memory>
+#include <string>
 
 class activity_logger;
 class CDirectoryCache;
 class COptionsBase;
 class CPathCache;
+class CResolverCache;
+class CTraceRegistry;
 class OpLockManager;
 
 namespace fz {
@@ -43,9 +46,15 @@ public:
 	CPathCache& GetPathCache();
 	CustomEncodingConverterBase const& GetCustomEncodingConverter() { return customEncodingConverter_; }
 	OpLockManager& GetOpLockManager();
+	CResolverCache& GetResolverCache();
+	CTraceRegistry& GetTraceRegistry();
 	fz::tls_system_trust_store& GetTlsSystemTrustStore();
 	activity_logger& GetActivityLogger();
 
+	// Returns the spans recorded by all engines as Chrome trace JSON.
+	// Tracing is enabled through OPTION_TRACE_BUFFER_SIZE.
+	std::string ExportTrace();
+
 protected:
 	COptionsBase& options_;
 	CustomEncodingConverterBase const& customEncodingConverter_;
@@ -81,6 +81,16 @@ enum engineOptions : unsigned int
 
 	OPTION_MIN_TLS_VER,
 
+	OPTION_TRACE_BUFFER_SIZE, // Spans kept per engine for performance tracing, 0 disables tracing
+
+	OPTION_HTTP_RANGE_CONNECTIONS, // Additional connections to download large files over HTTP in ranges, 0 disables it
+
+	OPTION_VERIFY_CHECKSUMS, // Compare checksums of transferred files with those reported by the server
+
+	OPTION_SFTP_DELTA_MIN_SIZE, // Size in MiB from which SFTP uploads only write changed blocks of existing files, 0 disables it
+
+	OPTION_ZERO_COPY, // Move data of plain FTP transfers directly between data connection and local file where possible
+
 	OPTIONS_ENGINE_NUM
 };
 
@@ -10,7 +10,8 @@
 // Whenever the callback is called, CFileZillaEngine::GetNextNotification
 // has to be called until it returns 0 to re-arm the callback,
 // or you will lose important notifications or your memory will fill with
-// pending notifications.
+// pending notifications. Alternatively, call CFileZillaEngine::GetNotifications
+// once to take all pending notifications at once.
 //
 // Note: It may be called from a worker thread.
 
@@ -36,7 +37,8 @@ enum NotificationId : unsigned int
 	nId_sftp_encryption,	// information about key exchange, encryption algorithms and so on for SFTP
 	nId_local_dir_created,	// local directory has been created
 	nId_serverchange,		// With some protocols, actual server identity isn't known until after logon
-	nId_ftp_tls_resumption
+	nId_ftp_tls_resumption,
+	nId_checksum			// outcome of comparing the checksum of a transferred file with the one reported by the server
 };
 
 // Async request IDs
@@ -365,6 +367,18 @@ public:
 	CServer const server_;
 };
 
+class FZC_PUBLIC_SYMBOL CChecksumNotification final : public CNotificationHelper<nId_checksum>
+{
+public:
+	CChecksumNotification(std::wstring const& algorithm, bool matched)
+		: algorithm_(algorithm)
+		, matched_(matched)
+	{}
+
+	std::wstring const algorithm_;
+	bool const matched_;
+};
+
 class FZC_PUBLIC_SYMBOL FtpTlsNoResumptionNotification final : public CAsyncRequestNotification
 {
 public:
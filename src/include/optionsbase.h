@@ -3,6 +3,7 @@
 
 #include "visibility.h"
 
+#include <atomic>
 #include <memory>
 #include <string>
 #include <vector>
@@ -234,6 +235,12 @@ public:
 		return change_count(mapOption(opt));
 	}
 
+	// Incremented whenever any option changes. Cheap to poll, can be used
+	// to invalidate values derived from multiple options.
+	uint64_t generation() const {
+		return generation_.load(std::memory_order_acquire);
+	}
+
 	struct option_value final
 	{
 		std::wstring str_;
@@ -243,6 +250,36 @@ public:
 		bool predefined_{};
 	};
 
+	// Numeric option values, readable without taking mtx_.
+	//
+	// Readers only ever load the current snapshot and a single slot in it. The size
+	// of a snapshot is fixed. When options get registered later on, a larger copy
+	// is published. Replaced snapshots are kept alive until the options are
+	// destroyed as readers might still be using them. This happens at most once
+	// per call to register_options.
+	class int_values final
+	{
+	public:
+		// Returns false if opt is not in the current snapshot
+		bool get(optionsIndex opt, int& v) const;
+
+		// These require mtx_ to be held for writing
+		void set(optionsIndex opt, int v);
+		void resize(std::vector<option_value> const& values);
+
+	private:
+		struct snapshot final
+		{
+			explicit snapshot(size_t size);
+
+			std::unique_ptr<std::atomic<int>[]> values_;
+			size_t const size_;
+		};
+
+		std::atomic<snapshot const*> current_{};
+		std::vector<std::unique_ptr<snapshot>> snapshots_;
+	};
+
 protected:
 	template<typename T>
 	void set(T opt, std::wstring_view const& value, bool predefined)
@@ -280,6 +317,8 @@ protected:
 	std::vector<option_def> options_;
 	std::map<std::string, size_t, std::less<>> name_to_option_;
 	std::vector<option_value> values_;
+	int_values ints_;
+	std::atomic<uint64_t> generation_{};
 
 	bool can_notify_{};
 	watched_options changed_;
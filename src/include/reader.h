@@ -80,6 +80,21 @@ public:
 	virtual fz::datetime mtime() const override;
 };
 
+// Reads the file through a memory mapping, the buffers point directly
+// into the mapped pages. Opens a file_reader instead if the buffers need
+// to be in shared memory or if mapping files is not supported.
+class FZC_PUBLIC_SYMBOL mmap_reader_factory final : public reader_factory
+{
+public:
+	mmap_reader_factory(std::wstring const& file);
+
+	virtual std::unique_ptr<reader_base> open(uint64_t offset, CFileZillaEnginePrivate & engine, fz::event_handler * handler, aio_base::shm_flag shm, uint64_t max_size = aio_base::nosize) override;
+	virtual std::unique_ptr<reader_factory> clone() const override;
+
+	virtual uint64_t size() const override;
+	virtual fz::datetime mtime() const override;
+};
+
 struct read_result {
 	bool operator==(aio_result const t) const { return type_ == t; }
 
@@ -106,6 +121,14 @@ public:
 
 	void set_handler(fz::event_handler * handler);
 
+#ifndef FZ_WINDOWS
+	// For sending the data without it passing through the buffers: Returns
+	// the descriptor of the local file along with the range to send, or -1
+	// if not supported or if reading has already started. The reader keeps
+	// owning the descriptor but cannot be read from until seeked again.
+	virtual int direct_fd(uint64_t & /*offset*/, uint64_t & /*size*/) { return -1; }
+#endif
+
 protected:
 	uint64_t start_offset_{};
 	uint64_t max_size_{aio_base::nosize};
@@ -123,6 +146,10 @@ public:
 
 	virtual aio_result seek(uint64_t offset, uint64_t max_size = aio_base::nosize) override;
 
+#ifndef FZ_WINDOWS
+	virtual int direct_fd(uint64_t & offset, uint64_t & size) override;
+#endif
+
 protected:
 	virtual void signal_capacity(fz::scoped_lock & l) override;
 
@@ -140,7 +167,39 @@ private:
 	uint64_t remaining_{};
 };
 
+#ifndef FZ_WINDOWS
+class mapped_window;
 
+// Never waits, a read either hands out the next part of the mapped file
+// or fails.
+class mmap_reader final : public reader_base
+{
+public:
+	explicit mmap_reader(std::wstring const& name, CFileZillaEnginePrivate & engine, fz::event_handler * handler);
+	~mmap_reader();
+
+	virtual void close() override;
+
+	virtual aio_result seek(uint64_t offset, uint64_t max_size = aio_base::nosize) override;
+
+	virtual read_result read() override;
+
+	virtual int direct_fd(uint64_t & offset, uint64_t & size) override;
+
+private:
+	friend class mmap_reader_factory;
+	aio_result open(uint64_t offset, uint64_t max_size);
+
+	// Fails if the file got shorter than what is left to read
+	bool check_size();
+
+	int fd_{-1};
+	std::unique_ptr<mapped_window> window_;
+
+	uint64_t pos_{};
+	uint64_t remaining_{};
+};
+#endif
 
 
 namespace fz {
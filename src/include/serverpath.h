@@ -6,15 +6,26 @@
 #include <libfilezilla/optional.hpp>
 #include <libfilezilla/shared.hpp>
 
+#include <memory>
 #include <vector>
 
+// Path data is interned: Each distinct path exists only once, identified by its
+// parent and its last segment. Equal paths of the same type thus share the same
+// data, so that comparing them is a pointer comparison.
 class FZC_PUBLIC_SYMBOL CServerPathData final
 {
 public:
-	std::vector<std::wstring> m_segments;
+	// Only the last segment, the others are found through the parents
+	std::wstring m_segment;
 	fz::sparse_optional<std::wstring> m_prefix;
 
-	bool operator==(const CServerPathData& cmp) const;
+	// Same prefix, without the last segment. Empty if there are no segments.
+	std::shared_ptr<CServerPathData const> m_parent;
+
+	// Number of segments
+	size_t m_depth{};
+
+	size_t m_hash{};
 };
 
 class FZC_PUBLIC_SYMBOL CServerPath final
@@ -76,6 +87,11 @@ public:
 
 	size_t SegmentCount() const;
 
+	// Precomputed, does not depend on the length of the path
+	size_t hash() const {
+		return empty() ? 0 : (m_data->m_hash ^ static_cast<size_t>(m_type));
+	}
+
 	static CServerPath GetChanged(CServerPath const& oldPath, CServerPath const& newPath, std::wstring const& newSubdir);
 private:
 	bool FZC_PRIVATE_SYMBOL IsSeparator(wchar_t c) const;
@@ -91,8 +107,19 @@ private:
 	bool FZC_PRIVATE_SYMBOL SegmentizeAddSegment(std::wstring & segment, tSegmentList& segments, bool& append);
 	bool FZC_PRIVATE_SYMBOL ExtractFile(std::wstring& dir, std::wstring& file);
 
-	fz::shared_optional<CServerPathData> m_data;
+	std::shared_ptr<CServerPathData const> m_data;
 	ServerType m_type;
 };
 
+namespace std {
+template<>
+struct hash<CServerPath>
+{
+	size_t operator()(CServerPath const& path) const noexcept
+	{
+		return path.hash();
+	}
+};
+}
+
 #endif
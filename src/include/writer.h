@@ -30,6 +30,12 @@ public:
 
 	virtual std::unique_ptr<writer_base> open(uint64_t offset, CFileZillaEnginePrivate & engine, fz::event_handler * handler, aio_base::shm_flag shm, bool update_transfer_status = true) = 0;
 
+	// Opens the existing target for writing at the given offset without
+	// truncating it, so that several writers can fill different ranges of
+	// it at the same time. Only available if supports_ranges() is true.
+	virtual std::unique_ptr<writer_base> open_range(uint64_t, CFileZillaEnginePrivate &, fz::event_handler *, aio_base::shm_flag, bool = true) { return nullptr; }
+	virtual bool supports_ranges() const { return false; }
+
 	std::wstring name() const { return name_; }
 
 	virtual uint64_t size() const { return aio_base::nosize; }
@@ -67,6 +73,12 @@ public:
 		return impl_ ? impl_->open(offset, engine, handler, shm, update_transfer_status) : nullptr;
 	}
 
+	std::unique_ptr<writer_base> open_range(uint64_t offset, CFileZillaEnginePrivate & engine, fz::event_handler * handler, aio_base::shm_flag shm, bool update_transfer_status = true)
+	{
+		return impl_ ? impl_->open_range(offset, engine, handler, shm, update_transfer_status) : nullptr;
+	}
+	bool supports_ranges() const { return impl_ ? impl_->supports_ranges() : false; }
+
 	std::wstring name() const { return impl_ ? impl_->name() : std::wstring(); }
 	uint64_t size() const {	return impl_ ? impl_->size() : aio_base::nosize; }
 	fz::datetime mtime() const { return impl_ ? impl_->mtime() : fz::datetime(); }
@@ -84,6 +96,30 @@ public:
 	file_writer_factory(std::wstring const& file, bool fsync = false);
 
 	virtual std::unique_ptr<writer_base> open(uint64_t offset, CFileZillaEnginePrivate & engine, fz::event_handler * handler, aio_base::shm_flag shm, bool update_transfer_status = true) override;
+	virtual std::unique_ptr<writer_base> open_range(uint64_t offset, CFileZillaEnginePrivate & engine, fz::event_handler * handler, aio_base::shm_flag shm, bool update_transfer_status = true) override;
+	virtual bool supports_ranges() const override { return true; }
+	virtual std::unique_ptr<writer_factory> clone() const override;
+
+	virtual uint64_t size() const override;
+	virtual fz::datetime mtime() const override;
+
+	virtual bool set_mtime(fz::datetime const&) override;
+
+	bool fsync_{};
+};
+
+// Writes the file through a memory mapping, the buffers to fill point
+// directly into the mapped pages. Opens a file_writer instead if the
+// buffers need to be in shared memory, for ranges or if mapping files is
+// not supported.
+class FZC_PUBLIC_SYMBOL mmap_writer_factory final : public writer_factory
+{
+public:
+	mmap_writer_factory(std::wstring const& file, bool fsync = false);
+
+	virtual std::unique_ptr<writer_base> open(uint64_t offset, CFileZillaEnginePrivate & engine, fz::event_handler * handler, aio_base::shm_flag shm, bool update_transfer_status = true) override;
+	virtual std::unique_ptr<writer_base> open_range(uint64_t offset, CFileZillaEnginePrivate & engine, fz::event_handler * handler, aio_base::shm_flag shm, bool update_transfer_status = true) override;
+	virtual bool supports_ranges() const override { return true; }
 	virtual std::unique_ptr<writer_factory> clone() const override;
 
 	virtual uint64_t size() const override;
@@ -122,6 +158,14 @@ public:
 
 	void set_handler(fz::event_handler * handler);
 
+#ifndef FZ_WINDOWS
+	// For writing received data without it passing through the buffers:
+	// Returns the descriptor of the local file, to be written at its current
+	// position, or -1 if not supported or if a buffer has been requested
+	// already. The writer keeps owning the descriptor, finalize it as usual.
+	virtual int direct_fd() { return -1; }
+#endif
+
 protected:
 	virtual aio_result continue_finalize() { return aio_result::ok; }
 
@@ -141,13 +185,17 @@ public:
 
 	virtual aio_result preallocate(uint64_t size) override;
 
+#ifndef FZ_WINDOWS
+	virtual int direct_fd() override;
+#endif
+
 protected:
 	virtual void signal_capacity(fz::scoped_lock & l) override;
 	virtual aio_result continue_finalize() override;
 
 private:
 	friend class file_writer_factory;
-	aio_result open(uint64_t offset, bool fsync, shm_flag shm);
+	aio_result open(uint64_t offset, bool fsync, shm_flag shm, bool truncate = true);
 
 	void entry();
 
@@ -160,6 +208,48 @@ private:
 	bool preallocated_{};
 };
 
+#ifndef FZ_WINDOWS
+class mapped_window;
+
+// Never waits, the data is in the file as soon as a buffer is handed back.
+class FZC_PUBLIC_SYMBOL mmap_writer final : public writer_base
+{
+public:
+	explicit mmap_writer(std::wstring const& name, CFileZillaEnginePrivate & engine, fz::event_handler * handler, bool update_transfer_status);
+	~mmap_writer();
+
+	virtual void close() override;
+
+	virtual aio_result finalize(fz::nonowning_buffer & last_written) override;
+
+	virtual uint64_t size() const override;
+
+	virtual get_write_buffer_result get_write_buffer(fz::nonowning_buffer & last_written) override;
+
+	virtual aio_result retire(fz::nonowning_buffer & last_written) override;
+
+	virtual aio_result preallocate(uint64_t size) override;
+
+private:
+	friend class mmap_writer_factory;
+	aio_result open(uint64_t offset, bool fsync);
+
+	// Accounts for the data in the buffer handed back
+	bool written(fz::nonowning_buffer & last_written);
+
+	// Extends the file so that it can be mapped up to the given end
+	bool reserve(uint64_t end);
+
+	int fd_{-1};
+	std::unique_ptr<mapped_window> window_;
+
+	uint64_t pos_{};
+	uint64_t allocated_{};
+	bool from_beginning_{};
+	bool fsync_{};
+};
+#endif
+
 namespace fz {
 class buffer;
 }
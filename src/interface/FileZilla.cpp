@@ -5,6 +5,7 @@
 #include "filezillaapp.h"
 #include "Mainfrm.h"
 #include "Options.h"
+#include "file_watcher.h"
 #include "wrapengine.h"
 #include "buildinfo.h"
 #include "cmdline.h"
@@ -53,6 +54,7 @@ CFileZillaApp::CFileZillaApp()
 CFileZillaApp::~CFileZillaApp()
 {
 	themeProvider_.reset();
+	fileWatcher_.reset();
 }
 
 void CFileZillaApp::InitLocale()
@@ -234,6 +236,8 @@ USE AT OWN RISK"), _T("Important Information"));
 	m_pWrapEngine = std::make_unique<CWrapEngine>();
 	m_pWrapEngine->LoadCache();
 
+	fileWatcher_ = std::make_unique<CFileWatcher>();
+
 	bool welcome_skip = false;
 #ifdef USE_MAC_SANDBOX
 	OSXSandboxUserdirs::Get().Load();
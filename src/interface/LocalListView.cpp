@@ -21,6 +21,7 @@
 #include "dragdropmanager.h"
 #include "drop_target_ex.h"
 #include "edithandler.h"
+#include "file_watcher.h"
 #include "filelist_statusbar.h"
 #include "graphics.h"
 #include "local_recursive_operation.h"
@@ -311,14 +312,55 @@ CLocalListView::~CLocalListView()
 	wxString str = wxString::Format(_T("%d %d"), m_sortDirection, m_sortColumn);
 	options_.set(OPTION_LOCALFILELIST_SORTORDER, str.ToStdWstring());
 
+	m_listingCancelled = true;
+	m_listingTask.join();
+
+	CFileWatcher* watcher = wxGetApp().GetFileWatcher();
+	if (watcher) {
+		watcher->UnwatchAll(*this);
+	}
+
 #ifdef __WXMSW__
 	volumeEnumeratorThread_.reset();
 #endif
 }
 
+namespace {
+#ifdef __WXMSW__
+// The drive list and the list of shares are not read from the file system
+bool IsVirtualDir(CLocalPath const& dir)
+{
+	std::wstring const& path = dir.GetPath();
+	if (path == L"\\") {
+		return true;
+	}
+	if (path.substr(0, 2) == L"\\\\") {
+		auto pos = path.find('\\', 2);
+		return pos == std::wstring::npos || pos + 1 >= path.size();
+	}
+	return false;
+}
+#endif
+
+// Batches get passed to the view at most this often
+fz::duration const listingBatchInterval = fz::duration::from_milliseconds(100);
+}
+
 bool CLocalListView::DisplayDir(CLocalPath const& dirname)
 {
 	CancelLabelEdit();
+	CancelSort();
+	CancelListing();
+
+	bool regular = true;
+#ifdef __WXMSW__
+	regular = !IsVirtualDir(dirname);
+#endif
+
+	if (regular && m_dir == dirname) {
+		UpdateWatch();
+		return StartListing(true);
+	}
 
 	std::wstring focused;
 	int focusedItem = -1;
@@ -347,6 +389,7 @@ bool CLocalListView::DisplayDir(CLocalPath const& dirname)
 		// Remember which items were selected
 		selectedNames = RememberSelectedItems(focused, focusedItem);
 	}
+	UpdateWatch();
 
 	if (m_pFilelistStatusBar) {
 		m_pFilelistStatusBar->UnselectAll();
@@ -354,108 +397,313 @@ bool CLocalListView::DisplayDir(CLocalPath const& dirname)
 
 	const int oldItemCount = m_indexMapping.size();
 
-	m_fileData.clear();
-	m_indexMapping.clear();
-
-	m_hasParent = m_dir.HasLogicalParent();
-
-	if (m_hasParent) {
-		CLocalFileData data;
-		data.dir = true;
-		data.name = _T("..");
-		data.size = -1;
-		m_fileData.push_back(data);
-		m_indexMapping.push_back(0);
-	}
+	ClearListing();
 
 #ifdef __WXMSW__
-	if (m_dir.GetPath() == _T("\\")) {
-		DisplayDrives();
-	}
-	else if (m_dir.GetPath().substr(0, 2) == _T("\\\\")) {
-		auto pos = m_dir.GetPath().find('\\', 2);
-		if (pos != std::wstring::npos && pos + 1 < m_dir.GetPath().size()) {
-			goto regular_dir;
+	if (!regular) {
+		if (m_dir.GetPath() == _T("\\")) {
+			DisplayDrives();
+		}
+		else {
+			// UNC path without shares
+			DisplayShares(m_dir.GetPath());
 		}
 
-		// UNC path without shares
-		DisplayShares(m_dir.GetPath());
+		DisplayListing(selectedNames, focused, focusedItem, ensureVisible, oldItemCount);
+		return true;
 	}
-	else
-#endif
-	{
-#ifdef __WXMSW__
-regular_dir:
 #endif
-		CStateFilterManager const& filter = m_state.GetStateFilterManager();
-		fz::local_filesys local_filesys;
 
-		auto result = local_filesys.begin_find_files(fz::to_native(m_dir.GetPath()), false);
-		if (!result) {
+	SetInfoText(wxString());
+	if (m_pFilelistStatusBar) {
+		m_pFilelistStatusBar->SetDirectoryContents(0, 0, 0, 0, 0);
+	}
+	if (m_dropTarget != -1) {
+		SetItemState(m_dropTarget, 0, wxLIST_STATE_DROPHILITED);
+		m_dropTarget = -1;
+	}
+	if (oldItemCount != static_cast<int>(m_indexMapping.size())) {
+		SetItemCount(m_indexMapping.size());
+	}
+	RefreshListOnly();
 
-			if (result.error_ == fz::result::noperm) {
-				SetInfoText(_("You do not have permission to list this directory"));
-			}
-			else {
-				SetInfoText(_("Could not list directory contents"));
-			}
+	m_listingFocused = focused;
+	m_listingEnsureVisible = ensureVisible;
+	return StartListing(false);
+}
 
-			SetItemCount(1);
-			if (m_pFilelistStatusBar) {
-				m_pFilelistStatusBar->SetDirectoryContents(0, 0, 0, 0, 0);
-			}
+bool CLocalListView::StartListing(bool replace)
+{
+	m_listingCancelled = false;
+	m_listingReplace = replace;
+	m_listingBuffer.clear();
+	unsigned int const generation = ++m_listingGeneration;
 
-			return false;
+	m_listingTask = m_state.pool_.spawn([this, generation, path = m_dir.GetPath()]() {
+		fz::local_filesys local_filesys;
+		fz::result const result = local_filesys.begin_find_files(fz::to_native(path), false);
+		if (!result) {
+			CallAfter([this, generation, result]() {
+				std::vector<CLocalFileData> entries;
+				OnListingBatch(generation, entries, result, true, false);
+			});
+			return;
 		}
 
-		SetInfoText(wxString());
-
-		int64_t totalSize{};
-		int unknown_sizes = 0;
-		int totalFileCount = 0;
-		int totalDirCount = 0;
-		int hidden = 0;
+		// The entries get stat'ed relative to the open directory, their
+		// paths do not get resolved anew for every file.
+		std::vector<CLocalFileData> entries;
+		bool encodingError{};
+		fz::monotonic_clock lastBatch = fz::monotonic_clock::now();
 
-		int num = m_fileData.size();
 		CLocalFileData data;
 		bool wasLink{};
 		fz::local_filesys::type t{};
 		fz::native_string name;
 		while (local_filesys.get_next_file(name, wasLink, t, &data.size, &data.time, &data.attributes)) {
+			if (m_listingCancelled) {
+				return;
+			}
+
 			data.name = fz::to_wstring(name);
 			data.dir = t == fz::local_filesys::dir;
 			if (name.empty() || data.name.empty()) {
-				wxGetApp().DisplayEncodingWarning();
+				encodingError = true;
 				continue;
 			}
-
-			m_fileData.push_back(data);
-			if (!filter.FilenameFiltered(data.name, m_dir.GetPath(), data.dir, data.size, true, data.attributes, data.time)) {
-				if (data.dir) {
-					++totalDirCount;
+			entries.push_back(data);
+
+			if (!(entries.size() % 256)) {
+				auto const now = fz::monotonic_clock::now();
+				if (now - lastBatch >= listingBatchInterval) {
+					lastBatch = now;
+					CallAfter([this, generation, result, encodingError, entries = std::move(entries)]() mutable {
+						OnListingBatch(generation, entries, result, false, encodingError);
+					});
+					entries.clear();
+					encodingError = false;
 				}
-				else {
-					if (data.size != -1) {
-						totalSize += data.size;
-					}
-					else {
-						++unknown_sizes;
+			}
+		}
+
+		CallAfter([this, generation, result, encodingError, entries = std::move(entries)]() mutable {
+			OnListingBatch(generation, entries, result, true, encodingError);
+		});
+	});
+	if (!m_listingTask) {
+		return false;
+	}
+
+	m_listingPending = true;
+	return true;
+}
+
+void CLocalListView::CancelListing()
+{
+	if (!m_listingPending) {
+		return;
+	}
+
+	m_listingCancelled = true;
+	m_listingTask.join();
+	m_listingPending = false;
+	++m_listingGeneration;
+	m_listingBuffer.clear();
+	m_listingRefreshes.clear();
+}
+
+void CLocalListView::OnListingBatch(unsigned int generation, std::vector<CLocalFileData> & entries, fz::result const& result, bool done, bool encodingError)
+{
+	if (!m_listingPending || generation != m_listingGeneration) {
+		// Stale result
+		return;
+	}
+
+	if (encodingError) {
+		wxGetApp().DisplayEncodingWarning();
+	}
+
+	if (done) {
+		m_listingTask.join();
+		m_listingPending = false;
+	}
+
+	if (!result) {
+		OnListingFailed(result);
+		return;
+	}
+
+	if (m_listingReplace) {
+		if (m_listingBuffer.empty()) {
+			m_listingBuffer = std::move(entries);
+		}
+		else {
+			std::move(entries.begin(), entries.end(), std::back_inserter(m_listingBuffer));
+		}
+	}
+	else if (!entries.empty()) {
+		// The merge below needs the displayed order to be complete, a
+		// pending change of the sort order gets dropped.
+		CancelSort();
+
+		size_t const oldFileCount = m_fileData.size();
+		size_t const oldCount = m_indexMapping.size();
+		if (AddEntries(entries)) {
+			auto start = m_indexMapping.begin();
+			if (m_hasParent) {
+				++start;
+			}
+			auto const middle = m_indexMapping.begin() + oldCount;
+
+			std::unique_ptr<CFileListCtrlSortBase> compare = GetSortComparisonObject();
+			std::sort(middle, m_indexMapping.end(), SortPredicate(compare));
+			std::inplace_merge(start, middle, m_indexMapping.end(), SortPredicate(compare));
+
+			std::vector<int> added_indexes;
+#ifndef __WXMSW__
+			// GetNextItem is O(n) if nothing is selected, GetSelectedItemCount() is O(1)
+			if (GetSelectedItemCount())
+#endif
+			{
+				for (size_t i = 0; i < m_indexMapping.size(); ++i) {
+					if (m_indexMapping[i] >= oldFileCount) {
+						added_indexes.push_back(static_cast<int>(i));
 					}
-					++totalFileCount;
 				}
-				m_indexMapping.push_back(num);
-			}
-			else {
-				++hidden;
 			}
-			++num;
+
+			SetItemCount(m_indexMapping.size());
+			UpdateSelections_ItemsAdded(added_indexes);
+			RefreshListOnly(false);
 		}
+	}
+
+	if (done) {
+		OnListingDone();
+	}
+}
+
+void CLocalListView::OnListingDone()
+{
+	if (m_listingReplace) {
+		std::wstring focused;
+		int focusedItem = -1;
+		std::vector<std::wstring> selectedNames = RememberSelectedItems(focused, focusedItem);
 
 		if (m_pFilelistStatusBar) {
-			m_pFilelistStatusBar->SetDirectoryContents(totalFileCount, totalDirCount, totalSize, unknown_sizes, hidden);
+			m_pFilelistStatusBar->UnselectAll();
+			m_pFilelistStatusBar->SetDirectoryContents(0, 0, 0, 0, 0);
 		}
+
+		int const oldItemCount = m_indexMapping.size();
+		ClearListing();
+		SetInfoText(wxString());
+
+		AddEntries(m_listingBuffer);
+		m_listingBuffer.clear();
+		m_listingBuffer.shrink_to_fit();
+
+		DisplayListing(selectedNames, focused, focusedItem, false, oldItemCount);
+	}
+	else {
+		if (IsComparing()) {
+			// Comparison got requested while the listing was incomplete
+			m_originalIndexMapping.clear();
+			RefreshComparison();
+		}
+		ReselectItems(std::vector<std::wstring>(), m_listingFocused, -1, m_listingEnsureVisible);
+	}
+
+	auto refreshes = std::move(m_listingRefreshes);
+	m_listingRefreshes.clear();
+	for (auto const& file : refreshes) {
+		RefreshFile(file);
+	}
+}
+
+void CLocalListView::OnListingFailed(fz::result const& result)
+{
+	int const oldItemCount = m_indexMapping.size();
+	if (m_listingReplace) {
+		ClearSelection();
+		if (m_pFilelistStatusBar) {
+			m_pFilelistStatusBar->UnselectAll();
+		}
+		ClearListing();
+		m_listingBuffer.clear();
+	}
+	m_listingRefreshes.clear();
+
+	if (result.error_ == fz::result::noperm) {
+		SetInfoText(_("You do not have permission to list this directory"));
+	}
+	else {
+		SetInfoText(_("Could not list directory contents"));
 	}
 
+	if (oldItemCount != 1) {
+		SetItemCount(1);
+	}
+	if (m_pFilelistStatusBar) {
+		m_pFilelistStatusBar->SetDirectoryContents(0, 0, 0, 0, 0);
+	}
+	RefreshListOnly();
+}
+
+size_t CLocalListView::AddEntries(std::vector<CLocalFileData> & entries)
+{
+	CStateFilterManager const& filter = m_state.GetStateFilterManager();
+
+	size_t visible{};
+	m_fileData.reserve(m_fileData.size() + entries.size());
+	for (auto & data : entries) {
+		unsigned int const index = m_fileData.size();
+		m_fileData.push_back(std::move(data));
+		CLocalFileData const& entry = m_fileData.back();
+		if (filter.FilenameFiltered(entry.name, m_dir.GetPath(), entry.dir, entry.size, true, entry.attributes, entry.time)) {
+			continue;
+		}
+
+		if (m_pFilelistStatusBar) {
+			if (entry.dir) {
+				m_pFilelistStatusBar->AddDirectory();
+			}
+			else {
+				m_pFilelistStatusBar->AddFile(entry.size);
+			}
+		}
+		m_indexMapping.push_back(index);
+		++visible;
+	}
+
+	if (m_pFilelistStatusBar) {
+		m_pFilelistStatusBar->SetHidden(m_fileData.size() - m_indexMapping.size());
+	}
+
+	return visible;
+}
+
+void CLocalListView::ClearListing()
+{
+	CancelSort();
+
+	m_fileData.clear();
+	m_indexMapping.clear();
+
+	m_hasParent = m_dir.HasLogicalParent();
+
+	if (m_hasParent) {
+		CLocalFileData data;
+		data.dir = true;
+		data.name = _T("..");
+		data.size = -1;
+		m_fileData.push_back(data);
+		m_indexMapping.push_back(0);
+	}
+}
+
+void CLocalListView::DisplayListing(std::vector<std::wstring> const& selectedNames, std::wstring const& focused, int focusedItem, bool ensureVisible, int oldItemCount)
+{
 	if (m_dropTarget != -1) {
 		CLocalFileData* data = GetData(m_dropTarget);
 		if (!data || !data->dir) {
@@ -479,8 +727,6 @@ regular_dir:
 	ReselectItems(selectedNames, focused, focusedItem, ensureVisible);
 
 	RefreshListOnly();
-
-	return true;
 }
 
 // See comment to OnGetItemText
@@ -1173,6 +1419,7 @@ bool CLocalListView::OnAcceptRename(const wxListEvent& event)
 	}
 
 	data->name = newname;
+	data->sortKey.clear();
 #ifdef __WXMSW__
 	data->label.clear();
 #endif
@@ -1512,11 +1759,17 @@ void CLocalListView::OnBeginDrag(wxListEvent&)
 
 void CLocalListView::RefreshFile(std::wstring const& file)
 {
+	if (m_listingPending) {
+		m_listingRefreshes.push_back(file);
+		return;
+	}
+
 	CLocalFileData data;
 
 	bool wasLink;
 	fz::local_filesys::type type = fz::local_filesys::get_file_info(fz::to_native(m_dir.GetPath() + file), wasLink, &data.size, &data.time, &data.attributes);
 	if (type == fz::local_filesys::unknown) {
+		RemoveFile(file);
 		return;
 	}
 
@@ -1529,6 +1782,7 @@ void CLocalListView::RefreshFile(std::wstring const& file)
 	}
 
 	CancelLabelEdit();
+	CancelSort();
 
 	// Look if file data already exists
 	unsigned int i = 0;
@@ -1659,6 +1913,112 @@ void CLocalListView::RefreshFile(std::wstring const& file)
 	}
 }
 
+void CLocalListView::RemoveFile(std::wstring const& file)
+{
+	if (m_listingPending) {
+		m_listingRefreshes.push_back(file);
+		return;
+	}
+
+	size_t const start = m_hasParent ? 1 : 0;
+	auto const it = std::find_if(m_fileData.begin() + start, m_fileData.end(), [&file](CLocalFileData const& data) {
+		return data.comparison_flags != fill && data.name == file;
+	});
+	if (it == m_fileData.end()) {
+		return;
+	}
+
+	if (IsComparing()) {
+		// Let the comparison get rebuilt from scratch
+		DisplayDir(m_dir);
+		return;
+	}
+
+	CancelLabelEdit();
+	CancelSort();
+
+	unsigned int const index = it - m_fileData.begin();
+	auto const mapping = std::find(m_indexMapping.begin(), m_indexMapping.end(), index);
+	if (mapping != m_indexMapping.end()) {
+		int const item = mapping - m_indexMapping.begin();
+
+		if (m_pFilelistStatusBar) {
+			if (GetItemState(item, wxLIST_STATE_SELECTED)) {
+				if (it->dir) {
+					m_pFilelistStatusBar->UnselectDirectory();
+				}
+				else {
+					m_pFilelistStatusBar->UnselectFile(it->size);
+				}
+			}
+			if (it->dir) {
+				m_pFilelistStatusBar->RemoveDirectory();
+			}
+			else {
+				m_pFilelistStatusBar->RemoveFile(it->size);
+			}
+		}
+
+		// Move selections
+		for (unsigned int j = item; j + 1 < m_indexMapping.size(); ++j) {
+			int const state = GetItemState(j + 1, wxLIST_STATE_SELECTED | wxLIST_STATE_FOCUSED);
+			SetItemState(j, state, wxLIST_STATE_FOCUSED);
+			SetSelection(j, (state & wxLIST_STATE_SELECTED) != 0);
+		}
+		SetSelection(m_indexMapping.size() - 1, false);
+
+		m_indexMapping.erase(mapping);
+	}
+
+	m_fileData.erase(it);
+	for (auto & i : m_indexMapping) {
+		if (i > index) {
+			--i;
+		}
+	}
+
+	if (m_pFilelistStatusBar) {
+		m_pFilelistStatusBar->SetHidden(m_fileData.size() - m_indexMapping.size());
+	}
+
+	SetItemCount(m_indexMapping.size());
+	RefreshListOnly();
+}
+
+void CLocalListView::UpdateWatch()
+{
+	CFileWatcher* watcher = wxGetApp().GetFileWatcher();
+	if (!watcher || m_dir.GetPath() == m_watchedDir) {
+		return;
+	}
+
+	if (!m_watchedDir.empty()) {
+		watcher->Unwatch(*this, m_watchedDir);
+		m_watchedDir.clear();
+	}
+	if (watcher->Watch(*this, m_dir.GetPath())) {
+		m_watchedDir = m_dir.GetPath();
+	}
+}
+
+void CLocalListView::OnFilesChanged(std::wstring const& dir, std::vector<std::wstring> const& names)
+{
+	if (dir != m_watchedDir) {
+		return;
+	}
+
+	// Looking at single files is only cheaper than reading the whole
+	// directory if there are few of them
+	if (names.empty() || names.size() > 100) {
+		DisplayDir(m_dir);
+		return;
+	}
+
+	for (auto const& name : names) {
+		RefreshFile(name);
+	}
+}
+
 wxListItemAttr* CLocalListView::OnGetItemAttr(long item) const
 {
 	CLocalListView *pThis = const_cast<CLocalListView *>(this);
@@ -1689,6 +2049,11 @@ wxListItemAttr* CLocalListView::OnGetItemAttr(long item) const
 
 void CLocalListView::StartComparison()
 {
+	CancelSort();
+
+	// Make sure the cached sort keys match the current name sort mode
+	GetNameSortMode();
+
 	if (m_sortDirection || m_sortColumn != 0) {
 		wxASSERT(m_originalIndexMapping.empty());
 		SortList(0, 0);
@@ -1715,7 +2080,7 @@ void CLocalListView::StartComparison()
 	}
 }
 
-bool CLocalListView::get_next_file(std::wstring_view & name, std::wstring &, bool& dir, int64_t& size, fz::datetime& date)
+bool CLocalListView::get_next_file(std::wstring_view & name, std::string_view & sortKey, std::wstring &, bool& dir, int64_t& size, fz::datetime& date)
 {
 	if (++m_comparisonIndex >= (int)m_originalIndexMapping.size()) {
 		return false;
@@ -1726,9 +2091,10 @@ bool CLocalListView::get_next_file(std::wstring_view & name, std::wstring &, boo
 		return false;
 	}
 
-	CLocalFileData const& data = m_fileData[index];
+	CLocalFileData & data = m_fileData[index];
 
 	name = data.name;
+	sortKey = GetSortKey(data, data.name);
 	dir = data.dir;
 	size = data.size;
 	date = data.time;
@@ -1754,7 +2120,7 @@ void CLocalListView::FinishComparison()
 
 bool CLocalListView::CanStartComparison()
 {
-	return true;
+	return !m_listingPending;
 }
 
 wxString CLocalListView::GetItemText(int item, unsigned int column)
@@ -1,9 +1,12 @@
 #ifndef FILEZILLA_INTERFACE_LOCALLISTVIEW_HEADER
 #define FILEZILLA_INTERFACE_LOCALLISTVIEW_HEADER
 
+#include "file_watcher.h"
 #include "filelistctrl.h"
 #include "state.h"
 
+#include <libfilezilla/fsresult.hpp>
+
 class CInfoText;
 class CQueueView;
 class CLocalListViewDropTarget;
@@ -27,7 +30,7 @@ public:
 	bool is_dir() const { return dir; }
 };
 
-class CLocalListView final : public CFileListCtrl<CLocalFileData>, CStateEventHandler
+class CLocalListView final : public CFileListCtrl<CLocalFileData>, CStateEventHandler, CFileWatchHandler
 {
 	friend class CLocalListViewDropTarget;
 	friend class CLocalListViewSortType;
@@ -64,7 +67,7 @@ protected:
 public:
 	virtual bool CanStartComparison();
 	virtual void StartComparison();
-	virtual bool get_next_file(std::wstring_view & name, std::wstring & path, bool &dir, int64_t &size, fz::datetime& date) override;
+	virtual bool get_next_file(std::wstring_view & name, std::string_view & sortKey, std::wstring & path, bool &dir, int64_t &size, fz::datetime& date) override;
 	virtual void FinishComparison();
 
 	virtual bool ItemIsDir(int index) const;
@@ -77,8 +80,44 @@ protected:
 	CLocalFileData *GetData(unsigned int item);
 
 	virtual std::unique_ptr<CFileListCtrlSortBase> GetSortComparisonObject() override;
+	// While a listing is pending, it may replace m_fileData at any time. Sort synchronously then.
+	virtual fz::thread_pool* GetSortThreadPool() override { return m_listingPending ? nullptr : &m_state.pool_; }
 
 	void RefreshFile(std::wstring const& file);
+	void RemoveFile(std::wstring const& file);
+
+	// The displayed directory is watched for changes if possible
+	void UpdateWatch();
+	virtual void OnFilesChanged(std::wstring const& dir, std::vector<std::wstring> const& names) override;
+	std::wstring m_watchedDir;
+
+	// Directories get read on a worker thread which passes the entries back
+	// in batches. If a new directory is displayed, the batches get merged
+	// into the list as they arrive. On refresh, the old contents remain
+	// displayed until the new listing is complete.
+	bool StartListing(bool replace);
+	void CancelListing();
+	void OnListingBatch(unsigned int generation, std::vector<CLocalFileData> & entries, fz::result const& result, bool done, bool encodingError);
+	void OnListingDone();
+	void OnListingFailed(fz::result const& result);
+
+	// Adds the entries to the file data and the visible ones to the end of the
+	// index mapping. Returns the number of visible entries.
+	size_t AddEntries(std::vector<CLocalFileData> & entries);
+	void ClearListing();
+	void DisplayListing(std::vector<std::wstring> const& selectedNames, std::wstring const& focused, int focusedItem, bool ensureVisible, int oldItemCount);
+
+	fz::async_task m_listingTask;
+	std::atomic<bool> m_listingCancelled{};
+	unsigned int m_listingGeneration{};
+	bool m_listingPending{};
+	bool m_listingReplace{};
+	std::vector<CLocalFileData> m_listingBuffer;
+	std::wstring m_listingFocused;
+	bool m_listingEnsureVisible{};
+
+	// Files changed while the listing was pending
+	std::vector<std::wstring> m_listingRefreshes;
 
 	virtual void OnNavigationEvent(bool forward);
 
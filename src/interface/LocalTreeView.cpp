@@ -3,6 +3,7 @@
 #include "dndobjects.h"
 #include "dragdropmanager.h"
 #include "drop_target_ex.h"
+#include "file_watcher.h"
 #include "filezillaapp.h"
 #include "filter_manager.h"
 #include "file_utils.h"
@@ -285,6 +286,10 @@ CLocalTreeView::CLocalTreeView(wxWindow* parent, wxWindowID id, CState& state, C
 CLocalTreeView::~CLocalTreeView()
 {
 	COptions::Get()->unwatch_all(this);
+	CFileWatcher* watcher = wxGetApp().GetFileWatcher();
+	if (watcher) {
+		watcher->UnwatchAll(*this);
+	}
 #ifdef __WXMSW__
 	delete m_pVolumeEnumeratorThread;
 #endif
@@ -878,6 +883,101 @@ void CLocalTreeView::RefreshListing()
 #endif
 }
 
+void CLocalTreeView::RefreshSubdir(wxTreeItemId parent, std::wstring const& dir, std::wstring const& name)
+{
+	static int64_t const size(-1);
+
+	bool wasLink{};
+	int attributes{};
+	fz::datetime date;
+	bool exists = fz::local_filesys::get_file_info(fz::to_native(dir + name), wasLink, 0, &date, &attributes) == fz::local_filesys::dir;
+	if (exists) {
+		CFilterManager filter;
+		exists = !filter.FilenameFiltered(name, dir, true, size, true, attributes, date);
+	}
+
+	wxTreeItemIdValue value;
+	wxTreeItemId first = GetFirstChild(parent, value);
+	if (!first || GetItemText(first).empty()) {
+		// Children have not been read yet, only the expander needs to be right
+		if (first && !exists) {
+			CTreeItemData* pData = static_cast<CTreeItemData*>(GetItemData(first));
+			if (!pData || pData->m_known_subdir != name) {
+				return;
+			}
+			Delete(first);
+		}
+		else if (first || !exists) {
+			return;
+		}
+		CheckSubdirStatus(parent, dir);
+		return;
+	}
+
+	wxTreeItemId child = GetSubdir(parent, name);
+	if (exists && !child) {
+		std::wstring const fullName = dir + name;
+		wxTreeItemId item = AppendItem(parent, name, GetIconIndex(iconType::dir, fullName),
+#ifdef __WXMSW__
+				-1
+#else
+				GetIconIndex(iconType::opened_dir, fullName)
+#endif
+			);
+		CheckSubdirStatus(item, fullName);
+		SortChildren(parent);
+	}
+	else if (!exists && child) {
+		// Keep it if the selection is inside
+		wxTreeItemId sel = GetSelection();
+		while (sel && sel != child) {
+			sel = GetItemParent(sel);
+		}
+		if (!sel) {
+			Delete(child);
+		}
+	}
+}
+
+void CLocalTreeView::UpdateWatch()
+{
+	CFileWatcher* watcher = wxGetApp().GetFileWatcher();
+	std::wstring const dir = m_currentDir.ToStdWstring();
+	if (!watcher || dir == m_watchedDir) {
+		return;
+	}
+
+	if (!m_watchedDir.empty()) {
+		watcher->Unwatch(*this, m_watchedDir);
+		m_watchedDir.clear();
+	}
+	if (!dir.empty() && watcher->Watch(*this, dir)) {
+		m_watchedDir = dir;
+	}
+}
+
+void CLocalTreeView::OnFilesChanged(std::wstring const& dir, std::vector<std::wstring> const& names)
+{
+	if (dir != m_watchedDir) {
+		return;
+	}
+
+	if (names.empty()) {
+		RefreshListing();
+		return;
+	}
+
+	wxString subDirs = dir;
+	wxTreeItemId item = GetNearestParent(subDirs);
+	if (!item || !subDirs.empty()) {
+		return;
+	}
+
+	for (auto const& name : names) {
+		RefreshSubdir(item, dir, name);
+	}
+}
+
 void CLocalTreeView::OnSelectionChanged(wxTreeEvent& event)
 {
 	if (m_setSelection) {
@@ -910,6 +1010,7 @@ void CLocalTreeView::OnStateChange(t_statechange_notifications notification, std
 {
 	if (notification == STATECHANGE_LOCAL_DIR) {
 		SetDir(m_state.GetLocalDir().GetPath());
+		UpdateWatch();
 	}
 	else if (notification == STATECHANGE_SERVER) {
 		m_windowTinter->SetBackgroundTint(site_colour_to_wx(m_state.GetSite().m_colour));
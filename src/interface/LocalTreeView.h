@@ -1,6 +1,7 @@
 #ifndef FILEZILLA_INTERFACE_LOCALTREEVIEW_HEADER
 #define FILEZILLA_INTERFACE_LOCALTREEVIEW_HEADER
 
+#include "file_watcher.h"
 #include "option_change_event_handler.h"
 #include "systemimagelist.h"
 #include "state.h"
@@ -14,7 +15,7 @@ class CWindowTinter;
 class CVolumeDescriptionEnumeratorThread;
 #endif
 
-class CLocalTreeView final : public wxTreeCtrlEx, CSystemImageList, CStateEventHandler, public COptionChangeEventHandler
+class CLocalTreeView final : public wxTreeCtrlEx, CSystemImageList, CStateEventHandler, public COptionChangeEventHandler, CFileWatchHandler
 {
 	friend class CLocalTreeViewDropTarget;
 
@@ -33,6 +34,14 @@ protected:
 	void SetDir(wxString const& localDir);
 	void RefreshListing();
 
+	// Adds or removes a single subdirectory of the given item
+	void RefreshSubdir(wxTreeItemId parent, std::wstring const& dir, std::wstring const& name);
+
+	// The current directory is watched for changes if possible
+	void UpdateWatch();
+	virtual void OnFilesChanged(std::wstring const& dir, std::vector<std::wstring> const& names) override;
+	std::wstring m_watchedDir;
+
 #ifdef __WXMSW__
 	bool CreateRoot();
 	bool DisplayDrives(wxTreeItemId parent);
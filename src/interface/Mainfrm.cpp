@@ -42,6 +42,8 @@
 #include "splitter.h"
 #include "StatusView.h"
 #include "state.h"
+#include "sync_dialog.h"
+#include "sync_operation.h"
 #include "themeprovider.h"
 #include "toolbar.h"
 #include "update_dialog.h"
@@ -67,6 +69,8 @@
 #include <wx/combobox.h>
 #endif
 
+#include <libfilezilla/file.hpp>
+
 #include <functional>
 #include <limits>
 #include <map>
@@ -732,6 +736,23 @@ void CMainFrame::OnMenuHandler(wxCommandEvent &event)
 		}
 #endif
 	}
+	else if (event.GetId() == XRCID("ID_EXPORT_TRACE")) {
+		if (options_.get_int(OPTION_TRACE_BUFFER_SIZE) <= 0) {
+			wxMessageBoxEx(_("Recording of performance traces is disabled. It can be enabled in the debug settings."), _("Export performance trace"), wxICON_INFORMATION);
+			return;
+		}
+
+		wxFileDialog dlg(this, _("Export performance trace"), wxString(), _T("filezilla_trace.json"), _T("JSON files (*.json)|*.json"), wxFD_SAVE | wxFD_OVERWRITE_PROMPT);
+		if (dlg.ShowModal() != wxID_OK) {
+			return;
+		}
+
+		std::string const trace = m_engineContext.ExportTrace();
+		fz::file f(fz::to_native(dlg.GetPath().ToStdWstring()), fz::file::writing, fz::file::empty);
+		if (!f.opened() || f.write(trace.data(), static_cast<int64_t>(trace.size())) != static_cast<int64_t>(trace.size())) {
+			wxMessageBoxEx(wxString::Format(_("Could not write to %s"), dlg.GetPath()), _("Export performance trace"), wxICON_EXCLAMATION);
+		}
+	}
 	else if (event.GetId() == XRCID("ID_MENU_TRANSFER_FILEEXISTS")) {
 		CDefaultFileExistsDlg dlg;
 		dlg.Run(this, false);
@@ -883,6 +904,33 @@ void CMainFrame::OnMenuHandler(wxCommandEvent &event)
 		CManualTransfer dlg(m_pQueueView);
 		dlg.Run(this, pState);
 	}
+	else if (event.GetId() == XRCID("ID_MENU_TRANSFER_SYNCHRONIZE")) {
+		CState* pState = CContextManager::Get()->GetCurrentContext();
+		if (!pState || !pState->GetSyncOperation() || !pState->IsRemoteConnected() || !pState->IsRemoteIdle()) {
+			wxBell();
+			return;
+		}
+
+		CFilterManager filters;
+		if (filters.HasActiveFilters() && !filters.HasSameLocalAndRemoteFilters()) {
+			wxMessageBoxEx(_("Cannot synchronize directories, different filters for local and remote directories are enabled"), _("Synchronization failed"), wxICON_EXCLAMATION);
+			return;
+		}
+
+		sync_operation::options o;
+		CSyncDialog dlg;
+		if (!dlg.Run(this, o)) {
+			return;
+		}
+		o.threshold = fz::duration::from_minutes(options_.get_int(OPTION_COMPARISON_THRESHOLD));
+		// Same matching as the directory comparison: Only natural sort is case-insensitive throughout
+		o.fold_case = static_cast<NameSortMode>(options_.get_int(OPTION_FILELIST_NAMESORT)) == NameSortMode::natural;
+		o.filters = filters.GetActiveFilters();
+
+		if (!pState->GetSyncOperation()->StartSync(o)) {
+			wxBell();
+		}
+	}
 	else if (event.GetId() == XRCID("ID_BOOKMARK_ADD") || event.GetId() == XRCID("ID_BOOKMARK_MANAGE")) {
 		CState* pState = CContextManager::Get()->GetCurrentContext();
 		if (!pState) {
@@ -1005,8 +1053,13 @@ void CMainFrame::OnEngineEvent(CFileZillaEngine* engine)
 		return;
 	}
 
-	std::unique_ptr<CNotification> pNotification = pState->engine_->GetNextNotification();
-	while (pNotification) {
+	std::vector<std::unique_ptr<CNotification>> notifications;
+	if (!pState->engine_->GetNotifications(notifications)) {
+		return;
+	}
+
+	CStatusView::batch logBatch(notifications.size() > 1 ? m_pStatusView : nullptr);
+	for (auto & pNotification : notifications) {
 		switch (pNotification->GetID())
 		{
 		case nId_logmsg:
@@ -1082,8 +1135,6 @@ void CMainFrame::OnEngineEvent(CFileZillaEngine* engine)
 		default:
 			break;
 		}
-
-		pNotification = pState->engine_.get()->GetNextNotification();
 	}
 }
 
@@ -1352,6 +1403,9 @@ void CMainFrame::OnClose(wxCloseEvent &event)
 		if (pState->GetRemoteRecursiveOperation()) {
 			pState->GetRemoteRecursiveOperation()->StopRecursiveOperation();
 		}
+		if (pState->GetSyncOperation()) {
+			pState->GetSyncOperation()->stop();
+		}
 
 		if (pState->m_pCommandQueue) {
 			if (!pState->m_pCommandQueue->Quit()) {
@@ -34,6 +34,8 @@
 #include <wx/notifmsg.h>
 #endif
 
+#include <algorithm>
+
 #include <wx/dnd.h>
 #include <wx/menu.h>
 #include <wx/progdlg.h>
@@ -251,6 +253,7 @@ CQueueView::CQueueView(CQueue* parent, int index, CMainFrame* pMainFrame, CAsync
 #endif
 
 	m_resize_timer.SetOwner(this);
+	m_storage_timer.SetOwner(this);
 }
 
 CQueueView::~CQueueView()
@@ -259,6 +262,7 @@ CQueueView::~CQueueView()
 	DeleteEngines();
 
 	m_resize_timer.Stop();
+	m_storage_timer.Stop();
 }
 
 bool CQueueView::QueueFile(bool const queueOnly, bool const download,
@@ -324,6 +328,7 @@ void CQueueView::QueueFile_Finish(const bool start)
 
 	if (!m_activeMode && start) {
 		m_activeMode = 1;
+		m_rescheduleAll = true;
 		CContextManager::Get()->NotifyGlobalHandlers(STATECHANGE_QUEUEPROCESSING);
 	}
 
@@ -421,15 +426,18 @@ void CQueueView::OnEngineEvent(CFileZillaEngine* engine)
 		return;
 	}
 
-	std::unique_ptr<CNotification> pNotification = pEngineData->pEngine->GetNextNotification();
-	while (pNotification) {
+	std::vector<std::unique_ptr<CNotification>> notifications;
+	if (!pEngineData->pEngine->GetNotifications(notifications)) {
+		return;
+	}
+
+	CStatusView::batch logBatch(notifications.size() > 1 ? m_pMainFrame->GetStatusView() : nullptr);
+	for (auto & pNotification : notifications) {
 		ProcessNotification(pEngineData, std::move(pNotification));
 
 		if (m_engineData.empty() || !pEngineData->pEngine) {
 			break;
 		}
-
-		pNotification = pEngineData->pEngine->GetNextNotification();
 	}
 }
 
@@ -493,7 +501,7 @@ void CQueueView::ProcessNotification(t_EngineData* pEngineData, std::unique_ptr<
 				m_pAsyncRequestQueue->AddRequest(pEngineData->pEngine, std::move(asyncRequestNotification));
 			}
 			else {
-				if (pEngineData->active && asyncRequestNotification->GetRequestID() != reqId_fileexists) {
+				if ((pEngineData->active || pEngineData->state == t_EngineData::preconnect) && asyncRequestNotification->GetRequestID() != reqId_fileexists) {
 					m_pAsyncRequestQueue->AddRequest(pEngineData->pEngine, std::move(asyncRequestNotification));
 				}
 			}
@@ -539,6 +547,13 @@ void CQueueView::ProcessNotification(t_EngineData* pEngineData, std::unique_ptr<
 		cert_store_.SetSessionResumptionSupport(fz::to_utf8(notification.server_.GetHost()), notification.server_.GetPort(), true, true);
 		break;
 	}
+	case nId_checksum:
+		if (pEngineData->pItem && pEngineData->pItem->GetType() == QueueItemType::File) {
+			auto const& notification = static_cast<CChecksumNotification const&>(*pNotification.get());
+			pEngineData->pItem->SetStatusMessage(notification.matched_ ? CFileItem::Status::checksum_verified : CFileItem::Status::checksum_mismatch);
+			RefreshItem(pEngineData->pItem);
+		}
+		break;
 	default:
 		break;
 	}
@@ -554,6 +569,15 @@ bool CQueueView::CanStartTransfer(CServerItem const & server_item, t_EngineData
 
 	int active_count = server_item.m_activeCount;
 
+	// Connections opened ahead of time count against the limit as well
+	if (m_preconnectCount) {
+		for (auto const* engineData : m_engineData) {
+			if (engineData->state == t_EngineData::preconnect && engineData->lastSite == site) {
+				++active_count;
+			}
+		}
+	}
+
 	CState* browsingStateOnSameServer = 0;
 	const std::vector<CState*> *pStates = CContextManager::Get()->GetAllStates();
 	for (auto pState : *pStates) {
@@ -605,6 +629,48 @@ bool CQueueView::CanStartTransfer(CServerItem const & server_item, t_EngineData
 	return true;
 }
 
+void CQueueView::ScheduleAllServers()
+{
+	m_rescheduleAll = false;
+
+	m_scheduler.Clear();
+	for (auto * serverItem : m_serverList) {
+		CFileItem* item = serverItem->GetIdleChild(m_activeMode == 1, TransferDirection::both);
+		if (item) {
+			m_scheduler.Ready(serverItem, item->GetPriority());
+		}
+	}
+}
+
+void CQueueView::LogSchedulerStats()
+{
+	auto const& stats = m_scheduler.GetStats();
+	if (stats.started && options_.get_int(OPTION_LOGGING_DEBUGLEVEL) >= 2) {
+		m_pMainFrame->GetStatusView()->AddToLog(logmsg::debug_info, fz::sprintf(L"Started %d transfers, average wait for a slot %d ms, longest wait %d ms, average scheduling time %d us",
+			stats.started, stats.total_wait.get_milliseconds() / stats.started, stats.max_wait.get_milliseconds(), stats.total_selection.get_microseconds() / stats.started), fz::datetime::now());
+	}
+	m_scheduler.ResetStats();
+}
+
+void CQueueView::LogNotificationStats()
+{
+	if (m_engineData.empty() || options_.get_int(OPTION_LOGGING_DEBUGLEVEL) < 2) {
+		return;
+	}
+
+	CNotificationStats total;
+	for (auto const* engineData : m_engineData) {
+		auto const stats = engineData->pEngine->GetNotificationStats();
+		total.added += stats.added;
+		total.coalesced += stats.coalesced;
+		total.batches += stats.batches;
+		total.max_depth = std::max(total.max_depth, stats.max_depth);
+		total.per_second += stats.per_second;
+	}
+	m_pMainFrame->GetStatusView()->AddToLog(logmsg::debug_info, fz::sprintf(L"Notifications from %d queue engines: %u added, %u coalesced, %u batches, %.1f per second, maximum queue depth %u",
+		m_engineData.size(), total.added, total.coalesced, total.batches, total.per_second, total.max_depth), fz::datetime::now());
+}
+
 bool CQueueView::TryStartNextTransfer()
 {
 	if (m_quit || !m_activeMode) {
@@ -635,6 +701,12 @@ bool CQueueView::TryStartNextTransfer()
 		wantedDirection = TransferDirection::both;
 	}
 
+	if (m_rescheduleAll) {
+		ScheduleAllServers();
+	}
+
+	fz::monotonic_clock const passStart = fz::monotonic_clock::now();
+
 	struct t_bestMatch
 	{
 		t_bestMatch()
@@ -647,16 +719,31 @@ bool CQueueView::TryStartNextTransfer()
 		t_EngineData* pEngineData;
 	} bestMatch;
 
-	// Find inactive file. Check all servers for
-	// the file with the highest priority
-	for (auto const& currentServerItem : m_serverList) {
-		t_EngineData* pEngineData = 0;
+	// Find inactive file. The ready set of the scheduler is ordered by
+	// priority, servers of equal priority take turns.
+	while (CServerItem* currentServerItem = m_scheduler.Top()) {
+		CFileItem* newFileItem = currentServerItem->GetIdleChild(m_activeMode == 1, wantedDirection);
+		if (!newFileItem) {
+			if (wantedDirection != TransferDirection::both && currentServerItem->GetIdleChild(m_activeMode == 1, TransferDirection::both)) {
+				m_scheduler.Park(currentServerItem, (wantedDirection == TransferDirection::upload) ? CTransferScheduler::wait_reason::download : CTransferScheduler::wait_reason::upload);
+			}
+			else {
+				m_scheduler.Idle(currentServerItem);
+			}
+			continue;
+		}
 
-		if (!CanStartTransfer(*currentServerItem, pEngineData)) {
+		if (newFileItem->GetPriority() != m_scheduler.TopPriority()) {
+			// Priority of the server was just an upper bound
+			m_scheduler.Update(currentServerItem, newFileItem->GetPriority());
 			continue;
 		}
 
-		CFileItem* newFileItem = currentServerItem->GetIdleChild(m_activeMode == 1, wantedDirection);
+		t_EngineData* pEngineData = 0;
+		if (!CanStartTransfer(*currentServerItem, pEngineData)) {
+			m_scheduler.Park(currentServerItem, CTransferScheduler::wait_reason::connection);
+			continue;
+		}
 
 		while (newFileItem && newFileItem->Download() && newFileItem->GetType() == QueueItemType::Folder) {
 			CLocalPath localPath(newFileItem->GetLocalPath());
@@ -681,14 +768,10 @@ bool CQueueView::TryStartNextTransfer()
 			continue;
 		}
 
-		if (!bestMatch.fileItem || newFileItem->GetPriority() > bestMatch.fileItem->GetPriority()) {
-			bestMatch.serverItem = currentServerItem;
-			bestMatch.fileItem = newFileItem;
-			bestMatch.pEngineData = pEngineData;
-			if (newFileItem->GetPriority() == QueuePriority::highest) {
-				break;
-			}
-		}
+		bestMatch.serverItem = currentServerItem;
+		bestMatch.fileItem = newFileItem;
+		bestMatch.pEngineData = pEngineData;
+		break;
 	}
 	if (!bestMatch.fileItem) {
 		return false;
@@ -718,6 +801,14 @@ bool CQueueView::TryStartNextTransfer()
 	pEngineData->m_idleDisconnectTimer = 0;
 	bestMatch.serverItem->m_activeCount++;
 	m_activeCount++;
+
+	int weight = bestMatch.serverItem->GetSite().server.MaximumMultipleConnections();
+	if (weight <= 0) {
+		weight = options_.get_int(OPTION_NUMTRANSFERS);
+	}
+	m_scheduler.Started(bestMatch.serverItem, weight, passStart);
+	DisplaySchedulerStats();
+
 	if (bestMatch.fileItem->Download()) {
 		m_activeCountDown++;
 	}
@@ -730,6 +821,7 @@ bool CQueueView::TryStartNextTransfer()
 
 	if (pEngineData->state != t_EngineData::waitprimary) {
 		if (!pEngineData->pEngine->IsConnected()) {
+			++m_poolMisses;
 			if (CLoginManager::Get().GetPassword(pEngineData->lastSite, true)) {
 				pEngineData->state = t_EngineData::connect;
 			}
@@ -738,14 +830,19 @@ bool CQueueView::TryStartNextTransfer()
 			}
 		}
 		else if (oldSite != bestMatch.serverItem->GetSite()) {
+			++m_poolMisses;
 			pEngineData->state = t_EngineData::disconnect;
 		}
-		else if (pEngineData->pItem->GetType() == QueueItemType::File) {
-			pEngineData->state = t_EngineData::transfer;
-		}
 		else {
-			pEngineData->state = t_EngineData::mkdir;
+			++m_poolHits;
+			if (pEngineData->pItem->GetType() == QueueItemType::File) {
+				pEngineData->state = t_EngineData::transfer;
+			}
+			else {
+				pEngineData->state = t_EngineData::mkdir;
+			}
 		}
+		DisplayConnectionPool();
 	}
 
 	if (bestMatch.fileItem->GetType() == QueueItemType::File) {
@@ -790,6 +887,11 @@ void CQueueView::ProcessReply(t_EngineData* pEngineData, COperationNotification
 	// Process reply from the engine
 	int replyCode = notification.replyCode_;
 
+	if (pEngineData->state == t_EngineData::preconnect) {
+		ConnectFinished(*pEngineData, replyCode);
+		return;
+	}
+
 	if ((replyCode & FZ_REPLY_CANCELED) == FZ_REPLY_CANCELED) {
 		ResetReason reason;
 		if (pEngineData->pItem) {
@@ -800,7 +902,8 @@ void CQueueView::ProcessReply(t_EngineData* pEngineData, COperationNotification
 				if (pEngineData->pItem->GetType() == QueueItemType::File && ((CFileItem*)pEngineData->pItem)->made_progress()) {
 					CFileItem* pItem = (CFileItem*)pEngineData->pItem;
 					pItem->set_made_progress(false);
-					pItem->m_onetime_action = CFileExistsNotification::resume;
+					// A partial delta upload leaves a mix of old and new blocks, only a new delta pass can repair it
+					pItem->m_onetime_action = IsDeltaUpload(*pEngineData, *pItem) ? CFileExistsNotification::overwrite : CFileExistsNotification::resume;
 				}
 				reason = ResetReason::reset;
 			}
@@ -836,6 +939,7 @@ void CQueueView::ProcessReply(t_EngineData* pEngineData, COperationNotification
 			return;
 		}
 		else if (replyCode == FZ_REPLY_OK) {
+			ConnectFinished(*pEngineData, replyCode);
 			if (pEngineData->pItem->GetType() == QueueItemType::File) {
 				pEngineData->state = t_EngineData::transfer;
 			}
@@ -888,13 +992,17 @@ void CQueueView::ProcessReply(t_EngineData* pEngineData, COperationNotification
 		// Increase error count only if item didn't make any progress. This keeps
 		// user interaction at a minimum if connection is unstable.
 
+		// A file failing checksum verification needs to be transferred anew,
+		// not resumed.
 		if (pEngineData->pItem->GetType() == QueueItemType::File && ((CFileItem*)pEngineData->pItem)->made_progress() &&
-			(replyCode & FZ_REPLY_WRITEFAILED) != FZ_REPLY_WRITEFAILED)
+			(replyCode & FZ_REPLY_WRITEFAILED) != FZ_REPLY_WRITEFAILED &&
+			pEngineData->pItem->GetStatus() != CFileItem::Status::checksum_mismatch)
 		{
 			// Don't increase error count if there has been progress
 			CFileItem* pItem = (CFileItem*)pEngineData->pItem;
 			pItem->set_made_progress(false);
-			pItem->m_onetime_action = CFileExistsNotification::resume;
+			// Never resume a delta upload, see above
+			pItem->m_onetime_action = IsDeltaUpload(*pEngineData, *pItem) ? CFileExistsNotification::overwrite : CFileExistsNotification::resume;
 		}
 		else {
 			if ((replyCode & FZ_REPLY_CANCELED) == FZ_REPLY_CANCELED) {
@@ -912,7 +1020,9 @@ void CQueueView::ProcessReply(t_EngineData* pEngineData, COperationNotification
 				return;
 			}
 			else if ((replyCode & FZ_REPLY_CRITICALERROR) == FZ_REPLY_CRITICALERROR) {
-				pEngineData->pItem->SetStatusMessage(CFileItem::Status::could_not_start);
+				if (pEngineData->pItem->GetStatus() != CFileItem::Status::checksum_mismatch) {
+					pEngineData->pItem->SetStatusMessage(CFileItem::Status::could_not_start);
+				}
 				ResetEngine(*pEngineData, ResetReason::failure);
 				return;
 			}
@@ -988,7 +1098,11 @@ void CQueueView::ResetEngine(t_EngineData& data, const ResetReason reason)
 			wxASSERT(pServerItem->m_activeCount > 0);
 			if (pServerItem->m_activeCount > 0)
 				pServerItem->m_activeCount--;
+
+			// The item might get retried
+			m_scheduler.Ready(pServerItem, data.pItem->GetPriority());
 		}
+		m_scheduler.Unpark(data.pItem->Download() ? CTransferScheduler::wait_reason::download : CTransferScheduler::wait_reason::upload);
 
 		if (data.pItem->GetType() == QueueItemType::File) {
 			wxASSERT(data.pStatusLineCtrl);
@@ -1089,7 +1203,9 @@ void CQueueView::ResetEngine(t_EngineData& data, const ResetReason reason)
 					CServerItem* pNewServerItem = pQueueViewSuccessful->CreateServerItem(site);
 					data.pItem->UpdateTime();
 					data.pItem->SetParent(pNewServerItem);
-					data.pItem->SetStatusMessage(CFileItem::Status::none);
+					if (data.pItem->GetStatus() != CFileItem::Status::checksum_verified) {
+						data.pItem->SetStatusMessage(CFileItem::Status::none);
+					}
 					pQueueViewSuccessful->InsertItem(pNewServerItem, data.pItem);
 					pQueueViewSuccessful->CommitChanges();
 				}
@@ -1155,7 +1271,19 @@ bool CQueueView::RemoveItem(CQueueItem* item, bool destroy, bool updateItemCount
 		}
 	}
 
+	CServerItem* pServerItem = static_cast<CServerItem*>(item->GetTopLevelItem());
+	int64_t const serverStorageId = pServerItem->m_storageId;
+	if (item->GetType() == QueueItemType::File || item->GetType() == QueueItemType::Folder) {
+		m_queue_storage.RemoveItem(*static_cast<CFileItem*>(item));
+		QueueStorageChanged();
+	}
+
 	bool didRemoveParent = CQueueViewBase::RemoveItem(item, destroy, updateItemCount, updateSelections, forward);
+	if (didRemoveParent) {
+		// Item got deleted, pointer is only used as key
+		m_scheduler.Remove(pServerItem);
+		m_queue_storage.RemoveServer(pServerItem, serverStorageId);
+	}
 
 	UpdateStatusLinePositions();
 
@@ -1226,6 +1354,7 @@ void CQueueView::SendNextCommand(t_EngineData& engineData)
 			engineData.pItem->SetStatusMessage(CFileItem::Status::connecting);
 			RefreshItem(engineData.pItem);
 
+			engineData.connectStart = fz::monotonic_clock::now();
 			int res = engineData.pEngine->Execute(CConnectCommand(engineData.lastSite.server, engineData.lastSite.Handle(), engineData.lastSite.credentials, false));
 
 			wxASSERT((res & FZ_REPLY_BUSY) != FZ_REPLY_BUSY);
@@ -1265,8 +1394,12 @@ void CQueueView::SendNextCommand(t_EngineData& engineData)
 
 			int res;
 			if (!fileItem->Download()) {
+				transfer_flags flags = fileItem->flags();
+				if (IsDeltaUpload(engineData, *fileItem)) {
+					flags |= sftp_transfer_flags::delta;
+				}
 				auto cmd = CFileTransferCommand(file_reader_factory(fileItem->GetLocalPath().GetPath() + fileItem->GetLocalFile()),
-					fileItem->GetRemotePath(), fileItem->GetRemoteFile(), fileItem->flags());
+					fileItem->GetRemotePath(), fileItem->GetRemoteFile(), flags);
 				res = engineData.pEngine->Execute(cmd);
 			}
 			else {
@@ -1323,8 +1456,19 @@ void CQueueView::SendNextCommand(t_EngineData& engineData)
 	}
 }
 
+bool CQueueView::IsDeltaUpload(t_EngineData const& engineData, CFileItem const& item)
+{
+	if (item.Download() || engineData.lastSite.server.GetProtocol() != SFTP) {
+		return false;
+	}
+
+	int64_t const minSize = static_cast<int64_t>(options_.get_int(OPTION_SFTP_DELTA_MIN_SIZE)) * 1024 * 1024;
+	return minSize > 0 && item.GetSize() >= minSize;
+}
+
 bool CQueueView::SetActive(bool active)
 {
+	m_rescheduleAll = true;
 	if (!active) {
 		m_activeMode = 0;
 		for (auto const& serverItem : m_serverList) {
@@ -1356,6 +1500,9 @@ bool CQueueView::SetActive(bool active)
 		for (unsigned int engineIndex = 0; engineIndex < m_engineData.size(); ++engineIndex) {
 			t_EngineData* const pEngineData = m_engineData[engineIndex];
 			if (!pEngineData->active) {
+				if (pEngineData->state == t_EngineData::preconnect) {
+					pEngineData->pEngine->Cancel();
+				}
 				continue;
 			}
 
@@ -1447,11 +1594,14 @@ void CQueueView::CheckQueueState()
 		}
 	}
 
-	if (m_activeCount)
+	if (m_activeCount || m_preconnectCount)
 		return;
 
 	if (m_activeMode) {
 		m_activeMode = 0;
+		m_rescheduleAll = true;
+		LogSchedulerStats();
+		LogNotificationStats();
 		/* Users don't seem to like this, so comment it out for now.
 		 * maybe make it configureable in future?
 		if (!m_pQueue->GetSelection())
@@ -1480,6 +1630,10 @@ void CQueueView::CheckQueueState()
 bool CQueueView::IncreaseErrorCount(t_EngineData& engineData)
 {
 	++engineData.pItem->m_errorCount;
+	if (engineData.pItem->GetType() == QueueItemType::File) {
+		m_queue_storage.UpdateItem(*static_cast<CFileItem*>(engineData.pItem));
+		QueueStorageChanged();
+	}
 	if (engineData.pItem->m_errorCount <= options_.get_int(OPTION_RECONNECTCOUNT)) {
 		return true;
 	}
@@ -1552,6 +1706,25 @@ void CQueueView::DisplayQueueSize()
 	pStatusBar->DisplayQueueSize(m_totalQueueSize, m_filesWithUnknownSize != 0);
 }
 
+void CQueueView::DisplayConnectionPool()
+{
+	CStatusBar* pStatusBar = dynamic_cast<CStatusBar*>(m_pMainFrame->GetStatusBar());
+	if (!pStatusBar) {
+		return;
+	}
+	pStatusBar->DisplayConnectionPool(m_poolHits, m_poolMisses, m_poolConnects ? fz::duration::from_milliseconds(m_poolConnectTime.get_milliseconds() / m_poolConnects) : fz::duration());
+}
+
+void CQueueView::DisplaySchedulerStats()
+{
+	CStatusBar* pStatusBar = dynamic_cast<CStatusBar*>(m_pMainFrame->GetStatusBar());
+	auto const& stats = m_scheduler.GetStats();
+	if (!pStatusBar || !stats.started) {
+		return;
+	}
+	pStatusBar->DisplaySchedulerStats(fz::duration::from_milliseconds(stats.total_wait.get_milliseconds() / stats.started), stats.max_wait);
+}
+
 void CQueueView::SaveQueue(bool silent)
 {
 	// Kiosk mode 2 doesn't save queue
@@ -1563,12 +1736,29 @@ void CQueueView::SaveQueue(bool silent)
 	// just as extra precaution. Better 'save' than sorry.
 	CInterProcessMutex mutex(MUTEX_QUEUE);
 
-	if (!m_queue_storage.SaveQueue(m_serverList) && !silent) {
+	// Items are stored as they get queued, only pending changes remain to be written
+	m_storage_timer.Stop();
+	if (!m_queue_storage.Release() && !silent) {
 		wxString msg = wxString::Format(_("An error occurred saving the transfer queue to \"%s\".\nSome queue items might not have been saved."), m_queue_storage.GetDatabaseFilename());
 		wxMessageBoxEx(msg, _("Error saving queue"), wxICON_ERROR);
 	}
 }
 
+void CQueueView::QueueStorageChanged()
+{
+	if (!m_storage_timer.IsRunning()) {
+		m_storage_timer.Start(300, true);
+	}
+}
+
+void CQueueView::RewriteQueueStorage()
+{
+	for (auto * serverItem : m_serverList) {
+		m_queue_storage.RewriteServer(*serverItem);
+	}
+	QueueStorageChanged();
+}
+
 void CQueueView::LoadQueue()
 {
 	wxGetApp().AddStartupProfileRecord("CQueueView::LoadQueue");
@@ -1578,23 +1768,43 @@ void CQueueView::LoadQueue()
 
 	bool error = false;
 
+	// Kiosk mode 2 doesn't save queue, leave the database untouched
+	bool const persist = options_.get_int(OPTION_DEFAULT_KIOSKMODE) != 2;
+
 	if (!m_queue_storage.BeginTransaction()) {
 		error = true;
 	}
 	else {
+		if (!m_queue_storage.ClaimQueue()) {
+			error = true;
+		}
+
+		// Servers into which the items of several rows got merged
+		std::vector<CServerItem*> merged;
+
 		Site site;
-		int64_t const first_id = m_queue_storage.GetServer(site, true);
-		auto id = first_id;
+		int64_t id = m_queue_storage.GetServer(site, true);
 		for (; id > 0; id = m_queue_storage.GetServer(site, false)) {
 			m_insertionStart = -1;
 			m_insertionCount = 0;
 			CServerItem *pServerItem = CreateServerItem(site);
+			if (!pServerItem->m_storageId) {
+				pServerItem->m_storageId = id;
+			}
+			else if (pServerItem->m_storageId != id) {
+				// Rewriting the server only replaces its own row, drop the duplicate
+				m_queue_storage.RemoveServer(nullptr, id);
+				if (std::find(merged.cbegin(), merged.cend(), pServerItem) == merged.cend()) {
+					merged.push_back(pServerItem);
+				}
+			}
 
 			CFileItem* fileItem = 0;
 			int64_t fileId;
 			for (fileId = m_queue_storage.GetFile(&fileItem, id); fileItem; fileId = m_queue_storage.GetFile(&fileItem, 0)) {
 				fileItem->SetParent(pServerItem);
 				fileItem->SetPriority(fileItem->GetPriority());
+				fileItem->m_storageId = fileId;
 				InsertItem(pServerItem, fileItem);
 			}
 			if (fileId < 0) {
@@ -1604,6 +1814,8 @@ void CQueueView::LoadQueue()
 			if (!pServerItem->GetChild(0)) {
 				m_itemCount--;
 				m_serverList.pop_back();
+				m_scheduler.Remove(pServerItem);
+				m_queue_storage.RemoveServer(pServerItem, pServerItem->m_storageId);
 				delete pServerItem;
 			}
 		}
@@ -1611,29 +1823,27 @@ void CQueueView::LoadQueue()
 			error = true;
 		}
 
-		if (error || first_id > 0) {
-			if (options_.get_int(OPTION_DEFAULT_KIOSKMODE) != 2) {
-				if (!m_queue_storage.Clear()) {
-					error = true;
-				}
-			}
-
-			if (!m_queue_storage.EndTransaction()) {
-				error = true;
-			}
-
-			if (!m_queue_storage.Vacuum()) {
-				error = true;
-			}
+		for (auto * pServerItem : merged) {
+			m_queue_storage.RewriteServer(*pServerItem);
 		}
-		else {
-			// Queue was already empty. No need to commit
-			if (!m_queue_storage.EndTransaction(true)) {
-				error = true;
-			}
+
+		if (!m_queue_storage.EndTransaction(!persist)) {
+			error = true;
 		}
 	}
 
+	if (!persist) {
+		m_queue_storage.StopTracking();
+	}
+	else if (error) {
+		// Write what could be loaded anew, dropping whatever is unreadable
+		m_queue_storage.Purge();
+		RewriteQueueStorage();
+	}
+	if (m_queue_storage.HasChanges()) {
+		QueueStorageChanged();
+	}
+
 	m_insertionStart = -1;
 	m_insertionCount = 0;
 	CommitChanges();
@@ -1753,6 +1963,7 @@ void CQueueView::ImportQueue(pugi::xml_node element, bool updateSelections)
 			if (!pServerItem->GetChild(0)) {
 				m_itemCount--;
 				m_serverList.pop_back();
+				m_scheduler.Remove(pServerItem);
 				delete pServerItem;
 			}
 			else if (updateSelections) {
@@ -1937,9 +2148,12 @@ void CQueueView::RemoveAll()
 	m_itemCount = 0;
 	for (auto iter = m_serverList.begin(); iter != m_serverList.end(); ++iter) {
 		if ((*iter)->TryRemoveAll()) {
+			m_scheduler.Remove(*iter);
+			m_queue_storage.RemoveServer(*iter, (*iter)->m_storageId);
 			delete *iter;
 		}
 		else {
+			m_queue_storage.RewriteServer(**iter);
 			newServerList.push_back(*iter);
 			m_itemCount += 1 + (*iter)->GetChildrenCount(true);
 		}
@@ -2116,6 +2330,7 @@ void CQueueView::SetDefaultFileExistsAction(CFileExistsNotification::OverwriteAc
 {
 	for (auto iter = m_serverList.begin(); iter != m_serverList.end(); ++iter)
 		(*iter)->SetDefaultFileExistsAction(action, direction);
+	RewriteQueueStorage();
 }
 
 void CQueueView::OnSetDefaultFileExistsAction(wxCommandEvent &)
@@ -2227,6 +2442,7 @@ void CQueueView::OnSetDefaultFileExistsAction(wxCommandEvent &)
 					}
 					pFileItem->m_defaultFileExistsAction = uploadAction;
 				}
+				m_queue_storage.UpdateItem(*pFileItem);
 			}
 			break;
 		case QueueItemType::Server:
@@ -2238,12 +2454,14 @@ void CQueueView::OnSetDefaultFileExistsAction(wxCommandEvent &)
 				if (has_upload) {
 					pServerItem->SetDefaultFileExistsAction(uploadAction, TransferDirection::upload);
 				}
+				m_queue_storage.RewriteServer(*pServerItem);
 			}
 			break;
 		default:
 			break;
 		}
 	}
+	QueueStorageChanged();
 }
 
 t_EngineData* CQueueView::GetIdleEngine(Site const& site, bool allowTransient)
@@ -2254,7 +2472,7 @@ t_EngineData* CQueueView::GetIdleEngine(Site const& site, bool allowTransient)
 
 	int transient = 0;
 	for (unsigned int i = 0; i < m_engineData.size(); ++i) {
-		if (m_engineData[i]->active) {
+		if (m_engineData[i]->active || m_engineData[i]->state == t_EngineData::preconnect) {
 			continue;
 		}
 
@@ -2282,16 +2500,156 @@ t_EngineData* CQueueView::GetIdleEngine(Site const& site, bool allowTransient)
 		// Check whether we can create another engine
 		const int newEngineCount = options_.get_int(OPTION_NUMTRANSFERS);
 		if (newEngineCount > static_cast<int>(m_engineData.size()) - transient) {
-			pFirstIdle = new t_EngineData;
-			pFirstIdle->pEngine = new CFileZillaEngine(m_pMainFrame->GetEngineContext(), fz::make_invoker(*this, [this](CFileZillaEngine* engine) { OnEngineEvent(engine); }));
-
-			m_engineData.push_back(pFirstIdle);
+			pFirstIdle = CreateEngineData();
 		}
 	}
 
 	return pFirstIdle;
 }
 
+t_EngineData* CQueueView::CreateEngineData()
+{
+	t_EngineData* pEngineData = new t_EngineData;
+	pEngineData->pEngine = new CFileZillaEngine(m_pMainFrame->GetEngineContext(), fz::make_invoker(*this, [this](CFileZillaEngine* engine) { OnEngineEvent(engine); }));
+
+	m_engineData.push_back(pEngineData);
+
+	return pEngineData;
+}
+
+bool CQueueView::HasQueuedItems(Site const& site)
+{
+	if (!m_activeMode) {
+		return false;
+	}
+
+	CServerItem* pServerItem = GetServerItem(site);
+	return pServerItem && pServerItem->GetIdleChild(m_activeMode == 1, TransferDirection::both);
+}
+
+void CQueueView::PreconnectEngines()
+{
+	if (m_quit || !m_activeMode) {
+		return;
+	}
+
+	int const numTransfers = options_.get_int(OPTION_NUMTRANSFERS);
+
+	for (auto * pServerItem : m_serverList) {
+		Site const& site = pServerItem->GetSite();
+		if (m_preconnectFailed.find(site.server) != m_preconnectFailed.end()) {
+			continue;
+		}
+
+		if (!pServerItem->GetIdleChild(m_activeMode == 1, TransferDirection::both)) {
+			continue;
+		}
+
+		int wanted = site.server.MaximumMultipleConnections();
+		if (!wanted || wanted > numTransfers) {
+			wanted = numTransfers;
+		}
+		int const queued = static_cast<int>(pServerItem->GetChildrenCount(false)) - pServerItem->m_activeCount;
+		if (wanted > pServerItem->m_activeCount + queued) {
+			wanted = pServerItem->m_activeCount + queued;
+		}
+
+		// The connection of a browsing state on the same server counts against the limit
+		for (auto const* pState : *CContextManager::Get()->GetAllStates()) {
+			if (pState->GetSite() && pState->GetSite().server == site.server) {
+				--wanted;
+				break;
+			}
+		}
+
+		int warm = pServerItem->m_activeCount;
+		for (auto const* engineData : m_engineData) {
+			if (engineData->active || engineData->transient || engineData->lastSite != site) {
+				continue;
+			}
+			if (engineData->state == t_EngineData::preconnect || engineData->pEngine->IsConnected()) {
+				++warm;
+			}
+		}
+
+		if (warm >= wanted) {
+			continue;
+		}
+
+		// Don't prompt for passwords on behalf of connections nobody asked for yet
+		Site connectSite = site;
+		if (!CLoginManager::Get().GetPassword(connectSite, true)) {
+			continue;
+		}
+
+		for (; warm < wanted; ++warm) {
+			t_EngineData* pEngineData = nullptr;
+			int transient = 0;
+			for (auto * engineData : m_engineData) {
+				if (engineData->transient) {
+					++transient;
+				}
+				else if (!pEngineData && !engineData->active && engineData->state == t_EngineData::none && !engineData->pEngine->IsConnected()) {
+					pEngineData = engineData;
+				}
+			}
+			if (!pEngineData) {
+				if (numTransfers <= static_cast<int>(m_engineData.size()) - transient) {
+					return;
+				}
+				pEngineData = CreateEngineData();
+			}
+
+			pEngineData->lastSite = connectSite;
+			pEngineData->connectStart = fz::monotonic_clock::now();
+			int res = pEngineData->pEngine->Execute(CConnectCommand(connectSite.server, connectSite.Handle(), connectSite.credentials, false));
+			if (res != FZ_REPLY_WOULDBLOCK) {
+				pEngineData->connectStart = fz::monotonic_clock();
+				break;
+			}
+
+			pEngineData->state = t_EngineData::preconnect;
+			++m_preconnectCount;
+		}
+	}
+}
+
+void CQueueView::ConnectFinished(t_EngineData& data, int replyCode)
+{
+	bool const preconnect = data.state == t_EngineData::preconnect;
+	if (preconnect) {
+		wxASSERT(m_preconnectCount > 0);
+		if (m_preconnectCount > 0) {
+			--m_preconnectCount;
+		}
+		data.state = t_EngineData::none;
+	}
+
+	if (replyCode == FZ_REPLY_OK) {
+		m_preconnectFailed.erase(data.lastSite.server);
+
+		if (data.connectStart) {
+			fz::duration const elapsed = fz::monotonic_clock::now() - data.connectStart;
+			++m_poolConnects;
+			m_poolConnectTime += elapsed;
+			if (options_.get_int(OPTION_LOGGING_DEBUGLEVEL) >= 2) {
+				m_pMainFrame->GetStatusView()->AddToLog(logmsg::debug_info, fz::sprintf(L"Connected to %s in %d ms. Connection pool: %d hits, %d misses, average connect time %d ms",
+					data.lastSite.Format(ServerFormat::with_optional_port), elapsed.get_milliseconds(), m_poolHits, m_poolMisses, m_poolConnectTime.get_milliseconds() / m_poolConnects), fz::datetime::now());
+			}
+			DisplayConnectionPool();
+		}
+	}
+	else if (preconnect && (replyCode & FZ_REPLY_CANCELED) != FZ_REPLY_CANCELED) {
+		// Leave it to the queue to connect and handle errors
+		m_preconnectFailed.insert(data.lastSite.server);
+	}
+	data.connectStart = fz::monotonic_clock();
+
+	if (preconnect) {
+		AdvanceQueue(false);
+	}
+}
+
 
 t_EngineData* CQueueView::GetEngineData(CFileZillaEngine const* pEngine)
 {
@@ -2433,6 +2791,8 @@ void CQueueView::UpdateItemSize(CFileItem* pItem, int64_t size)
 	}
 
 	pItem->SetSize(size);
+	m_queue_storage.UpdateItem(*pItem);
+	QueueStorageChanged();
 
 	DisplayQueueSize();
 }
@@ -2445,12 +2805,19 @@ void CQueueView::AdvanceQueue(bool refresh)
 	}
 
 	insideAdvanceQueue = true;
+
+	// Whatever a server at its connection limit waited for might have changed,
+	// e.g. a transfer finished or a browsing connection disconnected.
+	m_scheduler.Unpark(CTransferScheduler::wait_reason::connection);
+
 	while (TryStartNextTransfer()) {
 	}
 
+	PreconnectEngines();
+
 	// Set timer for connected, idle engines
 	for (unsigned int i = 0; i < m_engineData.size(); ++i) {
-		if (m_engineData[i]->active || m_engineData[i]->transient) {
+		if (m_engineData[i]->active || m_engineData[i]->transient || m_engineData[i]->state == t_EngineData::preconnect) {
 			continue;
 		}
 
@@ -2485,6 +2852,13 @@ void CQueueView::InsertItem(CServerItem* pServerItem, CQueueItem* pItem)
 {
 	CQueueViewBase::InsertItem(pServerItem, pItem);
 
+	if (pItem->GetType() == QueueItemType::File || pItem->GetType() == QueueItemType::Folder) {
+		m_scheduler.Ready(pServerItem, static_cast<CFileItem*>(pItem)->GetPriority());
+
+		m_queue_storage.AddItem(*pServerItem, *static_cast<CFileItem*>(pItem));
+		QueueStorageChanged();
+	}
+
 	if (pItem->GetType() == QueueItemType::File) {
 		CFileItem* pFileItem = (CFileItem*)pItem;
 
@@ -2523,8 +2897,24 @@ void CQueueView::OnTimer(wxTimerEvent& event)
 		return;
 	}
 
+	if (id == m_storage_timer.GetId()) {
+		CInterProcessMutex mutex(MUTEX_QUEUE);
+		if (!m_queue_storage.Flush() && m_queue_storage.HasChanges()) {
+			// Database is busy, try again
+			QueueStorageChanged();
+		}
+		return;
+	}
+
 	for (auto & pData : m_engineData) {
 		if (pData->m_idleDisconnectTimer && !pData->m_idleDisconnectTimer->IsRunning()) {
+			if (HasQueuedItems(pData->lastSite)) {
+				// Keep the connection warm while there are still items for this server,
+				// the engine sends keepalive commands in the meantime.
+				pData->m_idleDisconnectTimer->Start(60000, true);
+				continue;
+			}
+
 			delete pData->m_idleDisconnectTimer;
 			pData->m_idleDisconnectTimer = 0;
 
@@ -2546,6 +2936,7 @@ void CQueueView::DeleteEngines()
 		delete engineData;
 	}
 	m_engineData.clear();
+	m_preconnectCount = 0;
 }
 
 void CQueueView::OnSetPriority(wxCommandEvent& event)
@@ -2596,7 +2987,15 @@ void CQueueView::OnSetPriority(wxCommandEvent& event)
 		}
 
 		pItem->SetPriority(priority);
+		if (pItem->GetType() == QueueItemType::Server) {
+			m_queue_storage.RewriteServer(*static_cast<CServerItem*>(pItem));
+		}
+		else if (pItem->GetType() == QueueItemType::File || pItem->GetType() == QueueItemType::Folder) {
+			m_queue_storage.UpdateItem(*static_cast<CFileItem*>(pItem));
+		}
 	}
+	m_rescheduleAll = true;
+	QueueStorageChanged();
 
 	RefreshListOnly();
 }
@@ -2956,6 +3355,8 @@ void CQueueView::RenameFileInTransfer(CFileZillaEngine *pEngine, std::wstring co
 	else {
 		pFile->SetTargetFile(newName);
 	}
+	m_queue_storage.UpdateItem(*pFile);
+	QueueStorageChanged();
 
 	RefreshItem(pFile);
 }
@@ -3029,6 +3430,7 @@ WXLRESULT CQueueView::MSWWindowProc(WXUINT nMsg, WXWPARAM wParam, WXLPARAM lPara
 
 void CQueueView::OnOptionsChanged(watched_options const&)
 {
+	m_rescheduleAll = true;
 	if (m_activeMode) {
 		AdvanceQueue();
 	}
@@ -3086,6 +3488,7 @@ void CQueueView::OnStateChange(CState*, t_statechange_notifications notification
 			protect((*it)->GetCredentials());
 			++it;
 		}
+		RewriteQueueStorage();
 	}
 	else if (notification == STATECHANGE_QUITNOW) {
 		if (m_quit != 2) {
@@ -3103,6 +3506,8 @@ void CQueueView::OnColumnClicked(wxListEvent &event)
 	for (auto * serverItem : m_serverList) {
 		serverItem->Sort(col, reverse);
 	}
+	// Keep the stored order in sync
+	RewriteQueueStorage();
 
 	RefreshListOnly();
 	UpdateStatusLinePositions();
@@ -7,6 +7,7 @@
 #include "queue.h"
 #include "queue_storage.h"
 #include "state.h"
+#include "transfer_scheduler.h"
 
 #include "../include/libfilezilla_engine.h"
 #include "../include/notification.h"
@@ -72,13 +73,17 @@ struct t_EngineData final
 		list,
 		mkdir,
 		askpassword,
-		waitprimary
+		waitprimary,
+		preconnect
 	} state;
 
 	CFileItem* pItem;
 	Site lastSite;
 	CStatusLineCtrl* pStatusLineCtrl;
 	wxTimer* m_idleDisconnectTimer;
+
+	// Time the last connection attempt was started
+	fz::monotonic_clock connectStart;
 };
 
 class CMainFrame;
@@ -169,9 +174,21 @@ protected:
 	// whether it is allowed to start another transfer on that server item
 	bool CanStartTransfer(const CServerItem& server_item, t_EngineData *&pEngineData);
 
+	// Puts all servers with idle items into the ready set of the scheduler.
+	// Needed if changes cannot be attributed to individual servers.
+	void ScheduleAllServers();
+	void LogSchedulerStats();
+	void LogNotificationStats();
+
+	CTransferScheduler m_scheduler;
+	bool m_rescheduleAll{true};
+
 	void ProcessReply(t_EngineData* pEngineData, COperationNotification const& notification);
 	void SendNextCommand(t_EngineData& engineData);
 
+	// Whether the upload of the item replaces only the changed blocks of the remote file
+	bool IsDeltaUpload(t_EngineData const& engineData, CFileItem const& item);
+
 	enum class ResetReason
 	{
 		success,
@@ -196,6 +213,8 @@ protected:
 	void UpdateStatusLinePositions();
 	void CalculateQueueSize();
 	void DisplayQueueSize();
+	void DisplayConnectionPool();
+	void DisplaySchedulerStats();
 	void SaveQueue(bool silent = false);
 
 	bool IsActionAfter(ActionAfterState::type);
@@ -218,6 +237,23 @@ protected:
 
 	t_EngineData* GetIdleEngine(Site const& site = Site(), bool allowTransient = false);
 	t_EngineData* GetEngineData(const CFileZillaEngine* pEngine);
+	t_EngineData* CreateEngineData();
+
+	// Opens connections ahead of time to servers that have queued items,
+	// so that transfers can be handed to already logged in engines.
+	void PreconnectEngines();
+	bool HasQueuedItems(Site const& site);
+	void ConnectFinished(t_EngineData& data, int replyCode);
+
+	// Connection pool statistics
+	int m_poolHits{};
+	int m_poolMisses{};
+	int m_poolConnects{};
+	int m_preconnectCount{};
+	fz::duration m_poolConnectTime;
+
+	// Servers to which connecting ahead of time has failed
+	std::set<CServer> m_preconnectFailed;
 
 	std::vector<t_EngineData*> m_engineData;
 	std::list<CStatusLineCtrl*> m_statusLineList;
@@ -275,6 +311,11 @@ protected:
 
 	CQueueStorage m_queue_storage;
 
+	// Changes to the queue get written to the database in batches
+	void QueueStorageChanged();
+	void RewriteQueueStorage();
+	wxTimer m_storage_timer;
+
 	void OnEngineEvent(CFileZillaEngine* engine);
 
 	void OnAskPassword();
@@ -360,6 +360,8 @@ CRemoteListView::CRemoteListView(CView* pParent, CState& state, CQueueView* pQue
 
 CRemoteListView::~CRemoteListView()
 {
+	CancelSort();
+
 	auto str = fz::sprintf(L"%d %d", m_sortDirection, m_sortColumn);
 	options_.set(OPTION_REMOTEFILELIST_SORTORDER, str);
 }
@@ -490,74 +492,82 @@ void CRemoteListView::UpdateDirectoryListing_Added(std::shared_ptr<CDirectoryLis
 	wxASSERT(m_indexMapping.size() <= pDirectoryListing->size() + 1);
 }
 
-void CRemoteListView::UpdateDirectoryListing_Removed(std::shared_ptr<CDirectoryListing> const& pDirectoryListing)
+bool CRemoteListView::UpdateDirectoryListing_Changed(std::shared_ptr<CDirectoryListing> const& pDirectoryListing, std::vector<CDirectoryListing::change> const& changes)
 {
-	size_t const countRemoved = m_pDirectoryListing->size() - pDirectoryListing->size();
-	if (!countRemoved) {
-		m_pDirectoryListing = pDirectoryListing;
-		return;
-	}
-	wxASSERT(!IsComparing());
-
-	std::vector<size_t> removedItems;
-	{
-		// Get indexes of the removed items in the listing
-		size_t j = 0;
-		size_t i = 0;
-		while (i < pDirectoryListing->size() && j < m_pDirectoryListing->size()) {
-			const CDirentry& oldEntry = (*m_pDirectoryListing)[j];
-			const wxString& oldName = oldEntry.name;
-			const wxString& newName = (*pDirectoryListing)[i].name;
-			if (oldName == newName) {
-				++i;
-				++j;
-				continue;
+	unsigned int const none = static_cast<unsigned int>(-1);
+	size_t const oldCount = m_pDirectoryListing->size();
+	size_t const newCount = pDirectoryListing->size();
+
+	// Replay the changes on the indexes of the displayed listing. Added and
+	// modified entries get (re-)inserted, all others keep their order.
+	std::vector<unsigned int> origin(oldCount);
+	for (size_t i = 0; i < oldCount; ++i) {
+		origin[i] = static_cast<unsigned int>(i);
+	}
+	std::vector<bool> dirty(oldCount);
+	for (auto const& change : changes) {
+		switch (change.type) {
+		case CDirectoryListing::change_type::added:
+			if (change.index != origin.size()) {
+				return false;
+			}
+			origin.push_back(none);
+			dirty.push_back(true);
+			break;
+		case CDirectoryListing::change_type::removed:
+			if (change.index >= origin.size()) {
+				return false;
 			}
-
-			removedItems.push_back(j++);
-		}
-		for (; j < m_pDirectoryListing->size(); ++j) {
-			removedItems.push_back(j);
+			origin.erase(origin.begin() + change.index);
+			dirty.erase(dirty.begin() + change.index);
+			break;
+		case CDirectoryListing::change_type::modified:
+			if (change.index >= origin.size()) {
+				return false;
+			}
+			dirty[change.index] = true;
+			break;
 		}
-
-		wxASSERT(removedItems.size() == countRemoved);
+	}
+	if (origin.size() != newCount) {
+		return false;
 	}
 
-	std::list<int> selectedItems;
-
-	// Number of items left to remove
-	unsigned int toRemove = countRemoved;
-
-	std::list<int> removedIndexes;
-
-	const int size = m_indexMapping.size();
-	for (int i = size - 1; i >= 0; --i) {
-		bool removed = false;
-
-		unsigned int& index = m_indexMapping[i];
-
-		// j is the offset the index has to be adjusted
-		int j = 0;
-		for (auto iter = removedItems.cbegin(); iter != removedItems.cend(); ++iter, ++j) {
-			if (*iter > index) {
-				break;
-			}
-
-			if (*iter == index) {
-				removedIndexes.push_back(i);
-				removed = true;
-				--toRemove;
-				break;
-			}
+	std::vector<unsigned int> newIndex(oldCount + 1, none);
+	newIndex[oldCount] = newCount;
+	for (size_t i = 0; i < newCount; ++i) {
+		if (origin[i] != none) {
+			newIndex[origin[i]] = static_cast<unsigned int>(i);
 		}
+	}
 
-		// Get old selection
-		bool isSelected = GetItemState(i, wxLIST_STATE_SELECTED) != 0;
+	int focusedItem = -1;
+	unsigned int focusedIndex = none;
+	bool* selected = SortList_RememberSelections(focusedItem, focusedIndex);
+	bool* newSelected{};
+	if (selected) {
+		newSelected = new bool[newCount + 1];
+		for (size_t i = 0; i <= newCount; ++i) {
+			newSelected[i] = i == newCount ? selected[oldCount] : (origin[i] != none && selected[origin[i]]);
+		}
+	}
+	if (focusedIndex <= oldCount) {
+		focusedIndex = newIndex[focusedIndex];
+	}
+
+	// Drop removed and modified entries from the mapping
+	std::vector<unsigned int> mapping;
+	mapping.reserve(m_indexMapping.size() + changes.size());
+	for (auto const index : m_indexMapping) {
+		unsigned int const i = newIndex[index];
+		if (i != none && (index == oldCount || !dirty[i])) {
+			mapping.push_back(i);
+			continue;
+		}
 
-		// Update statusbar info
-		if (removed && m_pFilelistStatusBar) {
-			const CDirentry& oldEntry = (*m_pDirectoryListing)[index];
-			if (isSelected) {
+		if (m_pFilelistStatusBar) {
+			CDirentry const& oldEntry = (*m_pDirectoryListing)[index];
+			if (selected && selected[index]) {
 				if (oldEntry.is_dir()) {
 					m_pFilelistStatusBar->UnselectDirectory();
 				}
@@ -572,113 +582,114 @@ void CRemoteListView::UpdateDirectoryListing_Removed(std::shared_ptr<CDirectoryL
 				m_pFilelistStatusBar->RemoveFile(oldEntry.size);
 			}
 		}
+	}
 
-		// Update index
-		index -= j;
+	std::vector<CGenericFileData> fileData;
+	fileData.reserve(newCount + 1);
+	for (size_t i = 0; i < newCount; ++i) {
+		if (!dirty[i]) {
+			fileData.emplace_back(std::move(m_fileData[origin[i]]));
+			continue;
+		}
 
-		// Update selections
-		bool needSelection;
-		if (selectedItems.empty()) {
-			needSelection = false;
+		CDirentry const& entry = (*pDirectoryListing)[i];
+		CGenericFileData data;
+		if (entry.is_dir()) {
+			data.icon = m_dirIcon;
+#ifndef __WXMSW__
+			if (entry.is_link()) {
+				data.icon += 3;
+			}
+#endif
 		}
-		else if (selectedItems.front() == i) {
-			needSelection = true;
-			selectedItems.pop_front();
+		fileData.emplace_back(std::move(data));
+	}
+	fileData.emplace_back(std::move(m_fileData.back()));
+
+	m_pDirectoryListing = pDirectoryListing;
+	m_fileData = std::move(fileData);
+	m_indexMapping = std::move(mapping);
+
+	// Insert the added and modified entries at their sorted position
+	CFilterManager const& filter = m_state.GetStateFilterManager();
+	std::wstring const path = m_pDirectoryListing->path.GetPath();
+	std::unique_ptr<CFileListCtrlSortBase> compare = GetSortComparisonObject();
+	for (size_t i = 0; i < newCount; ++i) {
+		if (!dirty[i]) {
+			continue;
 		}
-		else {
-			needSelection = false;
+
+		CDirentry const& entry = (*m_pDirectoryListing)[i];
+		if (filter.FilenameFiltered(entry.name, path, entry.is_dir(), entry.size, false, 0, entry.time)) {
+			continue;
 		}
 
-		if (isSelected) {
-			if (!needSelection && (toRemove || removed)) {
-				SetSelection(i, false);
+		if (m_pFilelistStatusBar) {
+			if (entry.is_dir()) {
+				m_pFilelistStatusBar->AddDirectory();
 			}
-
-			if (!removed) {
-				selectedItems.push_back(i - toRemove);
+			else {
+				m_pFilelistStatusBar->AddFile(entry.size);
+			}
+			if (newSelected && newSelected[i]) {
+				if (entry.is_dir()) {
+					m_pFilelistStatusBar->SelectDirectory();
+				}
+				else {
+					m_pFilelistStatusBar->SelectFile(entry.size);
+				}
 			}
 		}
-		else if (needSelection) {
-			SetSelection(i, true);
-		}
-	}
 
-	// Erase file data
-	for (auto iter = removedItems.crbegin(); iter != removedItems.crend(); ++iter) {
-		m_fileData.erase(m_fileData.begin() + *iter);
+		auto const insertPos = std::lower_bound(m_indexMapping.begin() + (m_hasParent ? 1 : 0), m_indexMapping.end(), static_cast<unsigned int>(i), SortPredicate(compare));
+		m_indexMapping.insert(insertPos, static_cast<unsigned int>(i));
 	}
 
-	// Erase indexes
-	wxASSERT(!toRemove);
-	wxASSERT(removedIndexes.size() == countRemoved);
-	for (auto const& removedIndex : removedIndexes) {
-		m_indexMapping.erase(m_indexMapping.begin() + removedIndex);
-	}
-
-	wxASSERT(m_indexMapping.size() == pDirectoryListing->size() + 1);
-
-	m_pDirectoryListing = pDirectoryListing;
-
 	if (m_pFilelistStatusBar) {
 		m_pFilelistStatusBar->SetHidden(m_pDirectoryListing->size() + 1 - m_indexMapping.size());
 	}
 
 	SaveSetItemCount(m_indexMapping.size());
+	if (focusedItem >= static_cast<int>(m_indexMapping.size())) {
+		focusedItem = -1;
+	}
+	SortList_UpdateSelections(newSelected, focusedItem, focusedIndex);
+
+	delete [] selected;
+	delete [] newSelected;
+
+	return true;
 }
 
 bool CRemoteListView::UpdateDirectoryListing(std::shared_ptr<CDirectoryListing> const& pDirectoryListing)
 {
 	assert(!IsComparing());
 
-	const int unsure = pDirectoryListing->get_unsure_flags() & ~(CDirectoryListing::unsure_unknown);
-
-	if (!unsure) {
-		return false;
-	}
-
-	if (unsure & CDirectoryListing::unsure_invalid) {
+	// Replay the changes made by the directory cache since the displayed
+	// revision instead of filtering and sorting the whole listing again.
+	std::vector<CDirectoryListing::change> changes;
+	if (!pDirectoryListing->GetChanges(m_pDirectoryListing->revision(), changes)) {
 		return false;
 	}
 
-	if (!(unsure & ~(CDirectoryListing::unsure_dir_changed | CDirectoryListing::unsure_file_changed))) {
-		if (m_sortColumn != 0 && m_sortColumn != 2) {
-			// If not sorted by file or type, changing file attributes can influence
-			// sort order.
-			return false;
-		}
-
-		if (CFilterManager::HasActiveFilters()) {
-			return false;
-		}
-
-		assert(pDirectoryListing->size() == m_pDirectoryListing->size());
-		if (pDirectoryListing->size() != m_pDirectoryListing->size()) {
+	bool const onlyAdded = std::all_of(changes.cbegin(), changes.cend(), [](CDirectoryListing::change const& change) {
+		return change.type == CDirectoryListing::change_type::added;
+	});
+	if (onlyAdded) {
+		if (pDirectoryListing->size() != m_pDirectoryListing->size() + changes.size()) {
 			return false;
 		}
-
-		m_pDirectoryListing = pDirectoryListing;
-
-		// We don't have to do anything
-		return true;
-	}
-
-	if (unsure & (CDirectoryListing::unsure_dir_added | CDirectoryListing::unsure_file_added))
-	{
-		if (unsure & (CDirectoryListing::unsure_dir_removed | CDirectoryListing::unsure_file_removed)) {
-			return false; // Cannot handle both at the same time unfortunately
-		}
 		UpdateDirectoryListing_Added(pDirectoryListing);
 		return true;
 	}
 
-	assert(pDirectoryListing->size() <= m_pDirectoryListing->size());
-	UpdateDirectoryListing_Removed(pDirectoryListing);
-	return true;
+	return UpdateDirectoryListing_Changed(pDirectoryListing, changes);
 }
 
 void CRemoteListView::SetDirectoryListing(std::shared_ptr<CDirectoryListing> const& pDirectoryListing)
 {
 	CancelLabelEdit();
+	CancelSort();
 
 	bool reset = false;
 	if (!pDirectoryListing || !m_pDirectoryListing) {
@@ -687,12 +698,8 @@ void CRemoteListView::SetDirectoryListing(std::shared_ptr<CDirectoryListing> con
 	else if (m_pDirectoryListing->path != pDirectoryListing->path) {
 		reset = true;
 	}
-	else if (m_pDirectoryListing->m_firstListTime == pDirectoryListing->m_firstListTime && !IsComparing()
-		&& m_pDirectoryListing->size() > 200)
-	{
-		// Updated directory listing. Check if we can use process it in a different,
-		// more efficient way.
-		// Makes only sense for big listings though.
+	else if (m_pDirectoryListing->m_firstListTime == pDirectoryListing->m_firstListTime && !IsComparing()) {
+		// Updated directory listing, apply just the changes
 		if (UpdateDirectoryListing(pDirectoryListing)) {
 			wxASSERT(GetItemCount() == (int)m_indexMapping.size());
 			wxASSERT(GetItemCount() <= (int)m_fileData.size());
@@ -2409,6 +2416,11 @@ bool CRemoteListView::CanStartComparison()
 
 void CRemoteListView::StartComparison()
 {
+	CancelSort();
+
+	// Make sure the cached sort keys match the current name sort mode
+	GetNameSortMode();
+
 	if (m_sortDirection || m_sortColumn != 0) {
 		wxASSERT(m_originalIndexMapping.empty());
 		SortList(0, 0);
@@ -2433,7 +2445,7 @@ void CRemoteListView::StartComparison()
 	}
 }
 
-bool CRemoteListView::get_next_file(std::wstring_view & name, std::wstring &, bool& dir, int64_t& size, fz::datetime& date)
+bool CRemoteListView::get_next_file(std::wstring_view & name, std::string_view & sortKey, std::wstring &, bool& dir, int64_t& size, fz::datetime& date)
 {
 	if (++m_comparisonIndex >= (int)m_originalIndexMapping.size()) {
 		return false;
@@ -2446,6 +2458,7 @@ bool CRemoteListView::get_next_file(std::wstring_view & name, std::wstring &, bo
 
 	if (index == m_pDirectoryListing->size()) {
 		name = _T("..");
+		sortKey = GetSortKey(m_fileData[index], name);
 		dir = true;
 		size = -1;
 		return true;
@@ -2454,6 +2467,7 @@ bool CRemoteListView::get_next_file(std::wstring_view & name, std::wstring &, bo
 	CDirentry const& entry = (*m_pDirectoryListing)[index];
 
 	name = entry.name;
+	sortKey = GetSortKey(m_fileData[index], entry.name);
 	dir = entry.is_dir();
 	size = entry.size;
 	date = entry.time;
@@ -2566,7 +2580,7 @@ wxString CRemoteListView::GetItemText(int item, unsigned int column)
 
 std::unique_ptr<CFileListCtrlSortBase> CRemoteListView::GetSortComparisonObject()
 {
-	CFileListCtrlSort<CDirectoryListing>::DirSortMode dirSortMode = GetDirSortMode();
+	CFileListCtrlSortBase::DirSortMode dirSortMode = GetDirSortMode();
 	NameSortMode nameSortMode = GetNameSortMode();
 
 	CDirectoryListing const& directoryListing = *m_pDirectoryListing;
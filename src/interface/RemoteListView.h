@@ -21,7 +21,7 @@ public:
 
 	virtual bool CanStartComparison();
 	virtual void StartComparison();
-	virtual bool get_next_file(std::wstring_view & name, std::wstring & path, bool &dir, int64_t &size, fz::datetime& date) override;
+	virtual bool get_next_file(std::wstring_view & name, std::string_view & sortKey, std::wstring & path, bool &dir, int64_t &size, fz::datetime& date) override;
 	virtual void FinishComparison();
 	virtual void OnExitComparisonMode();
 
@@ -66,12 +66,13 @@ protected:
 	int GetItemIndex(unsigned int item) const;
 
 	virtual std::unique_ptr<CFileListCtrlSortBase> GetSortComparisonObject() override;
+	virtual fz::thread_pool* GetSortThreadPool() override { return &m_state.pool_; }
 
 	virtual void OnStateChange(t_statechange_notifications notification, std::wstring const& data, const void* data2) override;
 	void ApplyCurrentFilter();
 	void SetDirectoryListing(std::shared_ptr<CDirectoryListing> const& pDirectoryListing);
 	bool UpdateDirectoryListing(std::shared_ptr<CDirectoryListing> const& pDirectoryListing);
-	void UpdateDirectoryListing_Removed(std::shared_ptr<CDirectoryListing> const& pDirectoryListing);
+	bool UpdateDirectoryListing_Changed(std::shared_ptr<CDirectoryListing> const& pDirectoryListing, std::vector<CDirectoryListing::change> const& changes);
 	void UpdateDirectoryListing_Added(std::shared_ptr<CDirectoryListing> const& pDirectoryListing);
 
 #ifdef __WXDEBUG__
@@ -283,6 +283,7 @@ void CRemoteTreeView::SetDirectoryListing(std::shared_ptr<CDirectoryListing> con
 	m_busy = true;
 
 	if (!pListing) {
+		m_lastListingPath.clear();
 		m_ExpandAfterList = wxTreeItemId();
 		DeleteAllItems();
 		AddRoot(wxString());
@@ -303,6 +304,28 @@ void CRemoteTreeView::SetDirectoryListing(std::shared_ptr<CDirectoryListing> con
 	GetParent()->m_dirtyTabOrder = true;
 #endif
 
+	// Later notifications for the same listing only need their changes applied
+	bool const sameListing = pListing->path == m_lastListingPath && pListing->m_firstListTime == m_lastListingTime;
+	uint64_t const lastRevision = m_lastListingRevision;
+	m_lastListingPath = pListing->path;
+	m_lastListingTime = pListing->m_firstListTime;
+	m_lastListingRevision = pListing->revision();
+
+	std::vector<CDirectoryListing::change> changes;
+	if (!primary && sameListing && pListing->GetChanges(lastRevision, changes)) {
+#ifndef __WXMSW__
+		Freeze();
+#endif
+		bool const applied = ApplyChanges(*pListing, changes);
+#ifndef __WXMSW__
+		Thaw();
+#endif
+		if (applied) {
+			m_busy = false;
+			return;
+		}
+	}
+
 	if (pListing->get_unsure_flags() && !(pListing->get_unsure_flags() & ~(CDirectoryListing::unsure_unknown | CDirectoryListing::unsure_file_mask))) {
 		// Just files changed, does not affect directory tree
 		m_busy = false;
@@ -701,6 +724,139 @@ void CRemoteTreeView::RefreshItem(wxTreeItemId parent, const CDirectoryListing&
 	}
 }
 
+wxTreeItemId CRemoteTreeView::GetItemFromPath(CServerPath path)
+{
+	std::vector<std::wstring> pieces;
+	pieces.reserve(path.SegmentCount() + 1);
+	while (path.HasParent()) {
+		pieces.push_back(path.GetLastSegment());
+		path.MakeParent();
+	}
+	pieces.push_back(path.GetPath());
+
+	wxTreeItemId item = GetRootItem();
+	for (auto iter = pieces.crbegin(); iter != pieces.crend() && item; ++iter) {
+		wxTreeItemIdValue cookie;
+		wxTreeItemId child;
+		for (child = GetFirstChild(item, cookie); child; child = GetNextSibling(child)) {
+			if (GetItemText(child) == *iter) {
+				break;
+			}
+		}
+		item = child;
+	}
+
+	return item;
+}
+
+bool CRemoteTreeView::ApplyChanges(CDirectoryListing const& listing, std::vector<CDirectoryListing::change> const& changes)
+{
+	std::vector<std::wstring> dirs;
+	for (auto const& change : changes) {
+		if (change.dir && change.type != CDirectoryListing::change_type::modified) {
+			dirs.push_back(change.name);
+		}
+	}
+	if (dirs.empty()) {
+		// Just files changed, does not affect directory tree
+		return true;
+	}
+
+	wxTreeItemId const parent = GetItemFromPath(listing.path);
+	if (!parent) {
+		return false;
+	}
+
+	if (!IsExpanded(parent) && parent != m_ExpandAfterList) {
+		DeleteChildren(parent);
+		CFilterManager filter;
+		if (HasSubdirs(listing, filter)) {
+			AppendItem(parent, wxString(), -1, -1);
+		}
+		SetItemImages(parent, false);
+		return true;
+	}
+
+	wxTreeItemIdValue cookie;
+	wxTreeItemId child = GetFirstChild(parent, cookie);
+	if (!child || GetItemText(child).empty()) {
+		return false;
+	}
+
+	std::sort(dirs.begin(), dirs.end());
+	dirs.erase(std::unique(dirs.begin(), dirs.end()), dirs.end());
+	for (auto const& dir : dirs) {
+		UpdateSubdir(parent, listing, dir);
+	}
+
+	return true;
+}
+
+void CRemoteTreeView::UpdateSubdir(wxTreeItemId parent, CDirectoryListing const& listing, std::wstring const& name)
+{
+	CFilterManager filter;
+
+	bool exists{};
+	size_t const index = listing.FindFile_CmpCase(name);
+	if (index != std::wstring::npos && listing[index].is_dir()) {
+		exists = !filter.FilenameFiltered(name, listing.path.GetPath(), true, -1, false, 0, listing[index].time);
+	}
+
+	// Children are sorted, remember after which one to insert
+	wxTreeItemId previous;
+	wxTreeItemId child;
+	wxTreeItemIdValue cookie;
+	for (child = GetFirstChild(parent, cookie); child; child = GetNextSibling(child)) {
+		wxString const& childName = GetItemText(child);
+		if (childName == name) {
+			break;
+		}
+		if (sortFunction_(std::wstring_view(childName.data(), childName.size()), name) < 0) {
+			previous = child;
+		}
+	}
+
+	if (!exists) {
+		if (child) {
+			// Keep it if it contains the selection
+			wxTreeItemId sel = GetSelection();
+			while (sel && sel != child) {
+				sel = GetItemParent(sel);
+			}
+			if (!sel) {
+				Delete(child);
+			}
+		}
+		return;
+	}
+
+	CServerPath childPath = listing.path;
+	childPath.AddSegment(name);
+
+	CDirectoryListing subListing;
+	if (m_state.engine_->CacheLookup(childPath, subListing) == FZ_REPLY_OK) {
+		if (!child) {
+			child = InsertItem(parent, previous, name, 0, 2, 0);
+			if (!child) {
+				return;
+			}
+		}
+		if (!GetLastChild(child) && HasSubdirs(subListing, filter)) {
+			AppendItem(child, wxString(), -1, -1);
+		}
+		SetItemImages(child, false);
+	}
+	else {
+		if (!child) {
+			child = InsertItem(parent, previous, name, 1, 3, 0);
+			if (!child) {
+				return;
+			}
+		}
+		SetItemImages(child, true);
+	}
+}
+
 void CRemoteTreeView::OnItemExpanding(wxTreeEvent& event)
 {
 	if (m_busy) {
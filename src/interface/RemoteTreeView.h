@@ -26,6 +26,12 @@ protected:
 	void DisplayItem(wxTreeItemId parent, const CDirectoryListing& listing);
 	void RefreshItem(wxTreeItemId parent, const CDirectoryListing& listing, bool will_select_parent);
 
+	// Applies changes the directory cache made to an already processed listing.
+	// Returns false if the listing needs to be processed as a whole.
+	bool ApplyChanges(CDirectoryListing const& listing, std::vector<CDirectoryListing::change> const& changes);
+	void UpdateSubdir(wxTreeItemId parent, CDirectoryListing const& listing, std::wstring const& name);
+	wxTreeItemId GetItemFromPath(CServerPath path);
+
 	void SetItemImages(wxTreeItemId item, bool unknown);
 
 	bool HasSubdirs(const CDirectoryListing& listing, const CFilterManager& filter);
@@ -48,6 +54,11 @@ protected:
 
 	wxTreeItemId m_ExpandAfterList;
 
+	// Identifies the revision of the most recently processed listing
+	CServerPath m_lastListingPath;
+	fz::monotonic_clock m_lastListingTime;
+	uint64_t m_lastListingRevision{};
+
 	CServerPath MenuMkdir();
 
 	void UpdateSortMode();
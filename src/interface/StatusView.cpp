@@ -130,6 +130,25 @@ void CStatusView::OnSize(wxSizeEvent &)
 	}
 }
 
+CStatusView::batch::batch(CStatusView* view)
+{
+#ifndef __WXGTK__
+	if (view && view->m_shown && view->m_pTextCtrl) {
+		view_ = view;
+		view_->m_pTextCtrl->Freeze();
+	}
+#else
+	(void)view;
+#endif
+}
+
+CStatusView::batch::~batch()
+{
+	if (view_) {
+		view_->m_pTextCtrl->Thaw();
+	}
+}
+
 void CStatusView::AddToLog(CLogmsgNotification && notification)
 {
 	AddToLog(notification.msgType, std::move(notification.msg), std::move(notification.time_));
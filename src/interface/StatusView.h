@@ -21,6 +21,20 @@ public:
 	void AddToLog(CLogmsgNotification && pNotification);
 	void AddToLog(logmsg::type messagetype, std::wstring && message, fz::datetime const& time);
 
+	// While in scope, the log only gets redrawn once after adding a batch of messages
+	class batch final
+	{
+	public:
+		explicit batch(CStatusView* view);
+		~batch();
+
+		batch(batch const&) = delete;
+		batch& operator=(batch const&) = delete;
+
+	private:
+		CStatusView* view_{};
+	};
+
 	void InitDefAttr();
 
 	virtual void SetFocus();
@@ -17,6 +17,7 @@
 #include "RemoteTreeView.h"
 #include "sitemanager.h"
 #include "splitter.h"
+#include "sync_operation.h"
 #include "view.h"
 #include "viewheader.h"
 #include "xmlfunctions.h"
@@ -125,6 +126,7 @@ bool CContextControl::CreateTab(CLocalPath const& localPath, Site const& site, C
 
 		pState->GetLocalRecursiveOperation()->SetQueue(m_mainFrame.GetQueue());
 		pState->GetRemoteRecursiveOperation()->SetQueue(m_mainFrame.GetQueue());
+		pState->GetSyncOperation()->SetQueue(m_mainFrame.GetQueue());
 
 		if (localPath.empty() || !pState->SetLocalDir(localPath)) {
 #ifdef USE_MAC_SANDBOX
@@ -439,6 +441,7 @@ bool CContextControl::CloseTab(int tab)
 	pState->m_pCommandQueue->Cancel();
 	pState->GetLocalRecursiveOperation()->StopRecursiveOperation();
 	pState->GetRemoteRecursiveOperation()->StopRecursiveOperation();
+	pState->GetSyncOperation()->stop();
 
 	pState->GetComparisonManager()->SetListings(0, 0);
 
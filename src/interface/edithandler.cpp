@@ -265,6 +265,11 @@ void CEditHandler::Release()
 		RemoveTemporaryFilesInSpecificDir(m_localDir);
 	}
 
+	CFileWatcher* watcher = wxGetApp().GetFileWatcher();
+	if (watcher) {
+		watcher->UnwatchAll(*this);
+	}
+
 	m_pEditHandler = 0;
 	delete this;
 }
@@ -690,7 +695,10 @@ bool CEditHandler::LaunchEditor(CEditHandler::fileType type, t_fileData& data)
 void CEditHandler::CheckForModifications(bool emitEvent)
 {
 	static bool insideCheckForModifications = false;
+	static bool checkAgain = false;
 	if (insideCheckForModifications) {
+		// Changes may have been reported while a notification was shown
+		checkAgain = true;
 		return;
 	}
 
@@ -736,6 +744,10 @@ checkmodifications_loopbegin:
 			wxTopLevelWindow* pTopWindow = (wxTopLevelWindow*)wxTheApp->GetTopWindow();
 			if (pTopWindow && pTopWindow->IsIconized()) {
 				pTopWindow->RequestUserAttention(wxUSER_ATTENTION_INFO);
+				if (!m_timer.IsRunning()) {
+					// Not polling, look again once the window got restored
+					m_busyTimer.Start(1000, true);
+				}
 				insideCheckForModifications = false;
 				return;
 			}
@@ -776,6 +788,11 @@ checkmodifications_loopbegin:
 	SetTimerState();
 
 	insideCheckForModifications = false;
+
+	if (checkAgain) {
+		checkAgain = false;
+		QueueEvent(new wxCommandEvent(fzEDIT_CHANGEDFILE));
+	}
 }
 
 int CEditHandler::DisplayChangeNotification(CEditHandler::fileType type, CEditHandler::t_fileData const& data, bool& remove)
@@ -924,7 +941,7 @@ void CEditHandler::OnTimerEvent(wxTimerEvent&)
 
 void CEditHandler::SetTimerState()
 {
-	bool editing = GetFileCount(none, edit) != 0;
+	bool editing = UpdateWatches();
 
 	if (m_timer.IsRunning()) {
 		if (!editing) {
@@ -994,6 +1011,66 @@ void CEditHandler::OnChangedFileEvent(wxCommandEvent&)
 	CheckForModifications();
 }
 
+bool CEditHandler::UpdateWatches()
+{
+	std::set<std::wstring> dirs;
+	for (auto const& files : m_fileDataList) {
+		for (auto const& data : files) {
+			if (data.state != edit) {
+				continue;
+			}
+			size_t const pos = data.localFile.rfind(wxFileName::GetPathSeparator());
+			if (pos != std::wstring::npos) {
+				dirs.insert(data.localFile.substr(0, pos + 1));
+			}
+		}
+	}
+
+	CFileWatcher* watcher = wxGetApp().GetFileWatcher();
+	for (auto it = m_watchedDirs.begin(); it != m_watchedDirs.end(); ) {
+		if (dirs.find(*it) == dirs.end()) {
+			if (watcher) {
+				watcher->Unwatch(*this, *it);
+			}
+			it = m_watchedDirs.erase(it);
+		}
+		else {
+			++it;
+		}
+	}
+
+	bool unwatched = false;
+	for (auto const& dir : dirs) {
+		if (m_watchedDirs.find(dir) != m_watchedDirs.end()) {
+			continue;
+		}
+		if (watcher && watcher->Watch(*this, dir)) {
+			m_watchedDirs.insert(dir);
+		}
+		else {
+			unwatched = true;
+		}
+	}
+
+	return unwatched;
+}
+
+void CEditHandler::OnFilesChanged(std::wstring const& dir, std::vector<std::wstring> const& names)
+{
+	for (auto const& files : m_fileDataList) {
+		for (auto const& data : files) {
+			if (data.state != edit || data.localFile.size() <= dir.size() || data.localFile.compare(0, dir.size(), dir)) {
+				continue;
+			}
+
+			if (names.empty() || std::binary_search(names.cbegin(), names.cend(), data.localFile.substr(dir.size()))) {
+				CheckForModifications(true);
+				return;
+			}
+		}
+	}
+}
+
 std::wstring CEditHandler::GetTemporaryFile(std::wstring name)
 {
 	name = CQueueView::ReplaceInvalidCharacters(name, true);
@@ -2,12 +2,14 @@
 #define FILEZILLA_INTERFACE_EDITHANDLER_HEADER
 
 #include "dialogex.h"
+#include "file_watcher.h"
 #include "serverdata.h"
 
 #include <wx/timer.h>
 
 #include <list>
 #include <map>
+#include <set>
 
 // Handles all aspects about remote file viewing/editing
 
@@ -26,7 +28,7 @@ enum type
 }
 
 class CQueueView;
-class CEditHandler final : protected wxEvtHandler
+class CEditHandler final : protected wxEvtHandler, private CFileWatchHandler
 {
 public:
 	enum fileState
@@ -138,6 +140,12 @@ protected:
 
 	void SetTimerState();
 
+	// Watches the directories of the edited files. Returns true if some
+	// cannot be watched and modifications have to be polled for.
+	bool UpdateWatches();
+	virtual void OnFilesChanged(std::wstring const& dir, std::vector<std::wstring> const& names) override;
+	std::set<std::wstring> m_watchedDirs;
+
 	bool UploadFile(fileType type, std::list<t_fileData>::iterator iter, bool unedit);
 
 	std::list<t_fileData> m_fileDataList[2];
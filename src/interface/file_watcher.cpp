@@ -0,0 +1,273 @@
+#include "filezilla.h"
+#include "file_watcher.h"
+
+#ifdef __linux__
+#include <libfilezilla/glue/unix.hpp>
+
+#include <algorithm>
+
+#include <errno.h>
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+
+namespace {
+uint32_t const watch_mask = IN_CREATE | IN_DELETE | IN_CLOSE_WRITE | IN_ATTRIB | IN_MOVED_FROM | IN_MOVED_TO | IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR;
+
+// After an event, wait this long for more events before passing them on
+int const coalesce_ms = 50;
+
+// Events get passed on after this long even if more keep arriving
+fz::duration const max_delay = fz::duration::from_milliseconds(500);
+
+// Upper bound of events collected before passing them on
+size_t const max_events = 10000;
+}
+
+CFileWatcher::CFileWatcher()
+{
+	fd_ = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if (fd_ == -1) {
+		return;
+	}
+
+	if (!fz::create_pipe(wakeup_) || !thread_.run([this]() { Entry(); })) {
+		close(fd_);
+		fd_ = -1;
+	}
+}
+
+CFileWatcher::~CFileWatcher()
+{
+	if (fd_ != -1) {
+		char tmp = 0;
+		while (write(wakeup_[1], &tmp, 1) == -1 && errno == EINTR) {
+		}
+		thread_.join();
+		close(fd_);
+	}
+	for (int fd : wakeup_) {
+		if (fd != -1) {
+			close(fd);
+		}
+	}
+}
+
+bool CFileWatcher::Watch(CFileWatchHandler & handler, std::wstring const& dir)
+{
+	if (fd_ == -1 || dir.empty()) {
+		return false;
+	}
+
+	auto it = watches_.find(dir);
+	if (it == watches_.end()) {
+		int const wd = inotify_add_watch(fd_, fz::to_native(dir).c_str(), watch_mask);
+		if (wd == -1) {
+			return false;
+		}
+		it = watches_.emplace(dir, std::make_pair(wd, std::vector<CFileWatchHandler*>())).first;
+		dirs_.emplace(wd, dir);
+	}
+
+	auto & handlers = it->second.second;
+	if (std::find(handlers.cbegin(), handlers.cend(), &handler) == handlers.cend()) {
+		handlers.push_back(&handler);
+	}
+
+	return true;
+}
+
+void CFileWatcher::Unwatch(CFileWatchHandler & handler, std::wstring const& dir)
+{
+	auto it = watches_.find(dir);
+	if (it == watches_.end()) {
+		return;
+	}
+
+	auto & handlers = it->second.second;
+	handlers.erase(std::remove(handlers.begin(), handlers.end(), &handler), handlers.end());
+	if (handlers.empty()) {
+		RemoveWatch(it);
+	}
+}
+
+void CFileWatcher::UnwatchAll(CFileWatchHandler & handler)
+{
+	for (auto it = watches_.begin(); it != watches_.end(); ) {
+		auto & handlers = it->second.second;
+		handlers.erase(std::remove(handlers.begin(), handlers.end(), &handler), handlers.end());
+		if (handlers.empty()) {
+			RemoveWatch(it++);
+		}
+		else {
+			++it;
+		}
+	}
+}
+
+void CFileWatcher::RemoveWatch(std::map<std::wstring, std::pair<int, std::vector<CFileWatchHandler*>>>::iterator it)
+{
+	int const wd = it->second.first;
+
+	auto range = dirs_.equal_range(wd);
+	for (auto dit = range.first; dit != range.second; ++dit) {
+		if (dit->second == it->first) {
+			dirs_.erase(dit);
+			break;
+		}
+	}
+	if (dirs_.find(wd) == dirs_.end()) {
+		inotify_rm_watch(fd_, wd);
+	}
+
+	watches_.erase(it);
+}
+
+void CFileWatcher::Entry()
+{
+	alignas(inotify_event) char buf[16384];
+
+	std::vector<std::pair<int, std::wstring>> events;
+	bool overflow{};
+	fz::monotonic_clock first;
+
+	for (;;) {
+		pollfd fds[2]{};
+		fds[0].fd = fd_;
+		fds[0].events = POLLIN;
+		fds[1].fd = wakeup_[0];
+		fds[1].events = POLLIN;
+
+		bool const pending = overflow || !events.empty();
+		if (!pending) {
+			first = fz::monotonic_clock();
+		}
+		int const res = poll(fds, 2, pending ? coalesce_ms : -1);
+		if (res == -1) {
+			if (errno == EINTR) {
+				continue;
+			}
+			return;
+		}
+		if (fds[1].revents) {
+			return;
+		}
+
+		if (res) {
+			ssize_t const len = read(fd_, buf, sizeof(buf));
+			for (ssize_t pos = 0; pos + static_cast<ssize_t>(sizeof(inotify_event)) <= len; ) {
+				auto const& ev = *reinterpret_cast<inotify_event const*>(buf + pos);
+				pos += sizeof(inotify_event) + ev.len;
+
+				if (ev.mask & IN_Q_OVERFLOW) {
+					overflow = true;
+				}
+				else if (!(ev.mask & IN_IGNORED)) {
+					// The name is null-padded
+					std::wstring name = ev.len ? fz::to_wstring(std::string(ev.name)) : std::wstring();
+					events.emplace_back(ev.wd, std::move(name));
+				}
+			}
+			if (!first && (overflow || !events.empty())) {
+				first = fz::monotonic_clock::now();
+			}
+		}
+
+		if (!overflow && events.empty()) {
+			continue;
+		}
+		if (!res || events.size() >= max_events || fz::monotonic_clock::now() - first >= max_delay) {
+			if (events.size() >= max_events) {
+				// Too many to be worth looking at individually
+				events.clear();
+				overflow = true;
+			}
+			CallAfter([this, events = std::move(events), overflow]() mutable {
+				OnEvents(events, overflow);
+			});
+			events.clear();
+			overflow = false;
+		}
+	}
+}
+
+void CFileWatcher::OnEvents(std::vector<std::pair<int, std::wstring>> & events, bool overflow)
+{
+	struct change final
+	{
+		bool all{};
+		std::vector<std::wstring> names;
+	};
+	std::map<std::wstring, change> changes;
+
+	if (overflow) {
+		for (auto const& watch : watches_) {
+			changes[watch.first].all = true;
+		}
+	}
+	for (auto & event : events) {
+		auto range = dirs_.equal_range(event.first);
+		for (auto it = range.first; it != range.second; ++it) {
+			auto & c = changes[it->second];
+			if (event.second.empty()) {
+				c.all = true;
+			}
+			else if (!c.all) {
+				c.names.push_back(event.second);
+			}
+		}
+	}
+
+	std::vector<std::wstring> const none;
+	for (auto & c : changes) {
+		auto & names = c.second.names;
+		if (!c.second.all) {
+			std::sort(names.begin(), names.end());
+			names.erase(std::unique(names.begin(), names.end()), names.end());
+		}
+
+		auto watch = watches_.find(c.first);
+		if (watch == watches_.end()) {
+			continue;
+		}
+
+		// Handlers may unsubscribe while being notified
+		auto const handlers = watch->second.second;
+		for (auto * handler : handlers) {
+			watch = watches_.find(c.first);
+			if (watch == watches_.end()) {
+				break;
+			}
+			auto const& current = watch->second.second;
+			if (std::find(current.cbegin(), current.cend(), handler) == current.cend()) {
+				continue;
+			}
+			handler->OnFilesChanged(c.first, c.second.all ? none : names);
+		}
+	}
+}
+
+#else
+
+CFileWatcher::CFileWatcher()
+{
+}
+
+CFileWatcher::~CFileWatcher()
+{
+}
+
+bool CFileWatcher::Watch(CFileWatchHandler &, std::wstring const&)
+{
+	return false;
+}
+
+void CFileWatcher::Unwatch(CFileWatchHandler &, std::wstring const&)
+{
+}
+
+void CFileWatcher::UnwatchAll(CFileWatchHandler &)
+{
+}
+
+#endif
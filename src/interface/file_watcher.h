@@ -0,0 +1,70 @@
+#ifndef FILEZILLA_INTERFACE_FILE_WATCHER_HEADER
+#define FILEZILLA_INTERFACE_FILE_WATCHER_HEADER
+
+#include <wx/event.h>
+
+#ifdef __linux__
+#include <libfilezilla/thread.hpp>
+#endif
+
+#include <map>
+#include <string>
+#include <vector>
+
+class CFileWatchHandler
+{
+public:
+	virtual ~CFileWatchHandler() = default;
+
+	// The names are entries of the watched directory that got created,
+	// modified, removed or renamed, sorted and without duplicates. If the
+	// directory itself changed or events got lost, names is empty and the
+	// whole directory needs to be checked.
+	virtual void OnFilesChanged(std::wstring const& dir, std::vector<std::wstring> const& names) = 0;
+};
+
+/*
+ * Watches local directories for changes and notifies the subscribed
+ * handlers on the main thread. Events arriving in short succession get
+ * coalesced.
+ *
+ * Watching is implemented using inotify on Linux. On other platforms,
+ * Watch always fails and callers have to check for changes themselves.
+ */
+class CFileWatcher final : public wxEvtHandler
+{
+public:
+	CFileWatcher();
+	virtual ~CFileWatcher();
+
+	CFileWatcher(CFileWatcher const&) = delete;
+	CFileWatcher& operator=(CFileWatcher const&) = delete;
+
+	// Directories need to be separator-terminated. Returns false if the
+	// directory cannot be watched.
+	bool Watch(CFileWatchHandler & handler, std::wstring const& dir);
+	void Unwatch(CFileWatchHandler & handler, std::wstring const& dir);
+
+	// Needs to be called before a handler gets destroyed
+	void UnwatchAll(CFileWatchHandler & handler);
+
+private:
+#ifdef __linux__
+	void Entry();
+	void OnEvents(std::vector<std::pair<int, std::wstring>> & events, bool overflow);
+
+	void RemoveWatch(std::map<std::wstring, std::pair<int, std::vector<CFileWatchHandler*>>>::iterator it);
+
+	// Handlers by directory, along with the watch descriptor
+	std::map<std::wstring, std::pair<int, std::vector<CFileWatchHandler*>>> watches_;
+
+	// The same directory may be watched under multiple names
+	std::multimap<int, std::wstring> dirs_;
+
+	int fd_{-1};
+	int wakeup_[2]{-1, -1};
+	fz::thread thread_;
+#endif
+};
+
+#endif
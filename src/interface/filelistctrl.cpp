@@ -294,9 +294,46 @@ template<class CFileData> CFileListCtrl<CFileData>::CFileListCtrl(wxWindow* pPar
 #endif
 }
 
-template<class CFileData> void CFileListCtrl<CFileData>::SortList(int column /*=-1*/, int direction /*=-1*/, bool updateSelections /*=true*/)
+template<class CFileData> CFileListCtrl<CFileData>::~CFileListCtrl()
+{
+	m_sortCancelled = true;
+	m_sortTask.join();
+}
+
+namespace {
+// Listings with at least this many entries get sorted in the background
+// if the user changes the sort order.
+size_t const backgroundSortThreshold = 20000;
+
+// Sorts in chunks which then get merged so that cancellation gets noticed
+// in a timely manner.
+template<typename Iterator, typename Compare>
+bool CancellableSort(Iterator first, Iterator last, Compare comp, std::atomic<bool> const& cancelled)
+{
+	size_t const chunk = 8192;
+	size_t const size = last - first;
+	for (size_t i = 0; i < size; i += chunk) {
+		if (cancelled) {
+			return false;
+		}
+		std::sort(first + i, first + std::min(size, i + chunk), comp);
+	}
+	for (size_t width = chunk; width < size; width *= 2) {
+		for (size_t i = 0; i + width < size; i += 2 * width) {
+			if (cancelled) {
+				return false;
+			}
+			std::inplace_merge(first + i, first + i + width, first + std::min(size, i + 2 * width), comp);
+		}
+	}
+	return !cancelled;
+}
+}
+
+template<class CFileData> void CFileListCtrl<CFileData>::SortList(int column /*=-1*/, int direction /*=-1*/, bool updateSelections /*=true*/, bool background /*=false*/)
 {
 	CancelLabelEdit();
+	CancelSort();
 
 	if (column != -1) {
 		if (column != m_sortColumn) {
@@ -335,26 +372,7 @@ template<class CFileData> void CFileListCtrl<CFileData>::SortList(int column /*=
 	unsigned int focused_index{};
 
 	if (updateSelections) {
-#ifndef __WXMSW__
-		// GetNextItem is O(n) if nothing is selected, GetSelectedItemCount() is O(1)
-		if (GetSelectedItemCount())
-#endif
-		{
-			int item = GetNextItem(-1, wxLIST_NEXT_ALL, wxLIST_STATE_SELECTED);
-			if (item != -1) {
-				selected = new bool[m_fileData.size()];
-				memset(selected, 0, sizeof(bool) * m_fileData.size());
-
-				do {
-					selected[m_indexMapping[item]] = 1;
-					item = GetNextItem(item, wxLIST_NEXT_ALL, wxLIST_STATE_SELECTED);
-				} while (item != -1);
-			}
-		}
-		focused_item = GetNextItem(-1, wxLIST_NEXT_ALL, wxLIST_STATE_FOCUSED);
-		if (focused_item >= 0 && static_cast<size_t>(focused_item) < m_indexMapping.size()) {
-			focused_index = m_indexMapping[focused_item];
-		}
+		selected = SortList_RememberSelections(focused_item, focused_index);
 	}
 
 	const int dirSortOption = options_.get_int(OPTION_FILELIST_DIRSORT);
@@ -379,6 +397,11 @@ template<class CFileData> void CFileListCtrl<CFileData>::SortList(int column /*=
 		return;
 	}
 
+	if (background && m_indexMapping.size() >= backgroundSortThreshold && StartBackgroundSort(column, direction)) {
+		delete [] selected;
+		return;
+	}
+
 	m_sortDirection = direction;
 	m_sortColumn = column;
 
@@ -401,6 +424,136 @@ template<class CFileData> void CFileListCtrl<CFileData>::SortList(int column /*=
 	}
 }
 
+template<class CFileData> bool* CFileListCtrl<CFileData>::SortList_RememberSelections(int & focused_item, unsigned int & focused_index)
+{
+	bool *selected = 0;
+
+#ifndef __WXMSW__
+	// GetNextItem is O(n) if nothing is selected, GetSelectedItemCount() is O(1)
+	if (GetSelectedItemCount())
+#endif
+	{
+		int item = GetNextItem(-1, wxLIST_NEXT_ALL, wxLIST_STATE_SELECTED);
+		if (item != -1) {
+			selected = new bool[m_fileData.size()];
+			memset(selected, 0, sizeof(bool) * m_fileData.size());
+
+			do {
+				selected[m_indexMapping[item]] = 1;
+				item = GetNextItem(item, wxLIST_NEXT_ALL, wxLIST_STATE_SELECTED);
+			} while (item != -1);
+		}
+	}
+	focused_item = GetNextItem(-1, wxLIST_NEXT_ALL, wxLIST_STATE_FOCUSED);
+	if (focused_item >= 0 && static_cast<size_t>(focused_item) < m_indexMapping.size()) {
+		focused_index = m_indexMapping[focused_item];
+	}
+
+	return selected;
+}
+
+template<class CFileData> bool CFileListCtrl<CFileData>::StartBackgroundSort(int column, int direction)
+{
+	fz::thread_pool* pool = GetSortThreadPool();
+	if (!pool) {
+		return false;
+	}
+
+	// The comparison object depends on sort column and direction. The new
+	// order only gets committed once the sorted mapping gets applied.
+	int const oldColumn = m_sortColumn;
+	int const oldDirection = m_sortDirection;
+	m_sortColumn = column;
+	m_sortDirection = direction;
+	std::shared_ptr<CFileListCtrlSortBase> object = GetSortComparisonObject();
+	m_sortColumn = oldColumn;
+	m_sortDirection = oldDirection;
+
+	std::vector<unsigned int> mapping(m_indexMapping.begin() + (m_hasParent ? 1 : 0), m_indexMapping.end());
+	object->PrepareBackgroundSort(mapping);
+
+	m_sortCancelled = false;
+	unsigned int const generation = ++m_sortGeneration;
+	m_sortTask = pool->spawn([this, object, generation, column, direction, mapping = std::move(mapping)]() mutable {
+		object->Precompute(mapping);
+
+		auto const comp = [&object](unsigned int lhs, unsigned int rhs) {
+			return (*object)(lhs, rhs);
+		};
+		if (!CancellableSort(mapping.begin(), mapping.end(), comp, m_sortCancelled)) {
+			return;
+		}
+
+		CallAfter([this, generation, column, direction, mapping = std::move(mapping)]() mutable {
+			OnBackgroundSortDone(generation, column, direction, mapping);
+		});
+	});
+	if (!m_sortTask) {
+		return false;
+	}
+
+	m_sortPending = true;
+	m_pendingSortColumn = column;
+
+	return true;
+}
+
+template<class CFileData> void CFileListCtrl<CFileData>::OnBackgroundSortDone(unsigned int generation, int column, int direction, std::vector<unsigned int> & mapping)
+{
+	if (!m_sortPending || generation != m_sortGeneration) {
+		// Stale result
+		return;
+	}
+
+	m_sortTask.join();
+	m_sortPending = false;
+
+	size_t const offset = m_hasParent ? 1 : 0;
+	if (mapping.size() + offset != m_indexMapping.size()) {
+		// Cannot happen, any modification of the listing cancels the sort.
+		wxFAIL;
+		SortList(column, direction);
+		return;
+	}
+
+	int focused_item = -1;
+	unsigned int focused_index{};
+	bool* selected = SortList_RememberSelections(focused_item, focused_index);
+
+	m_sortColumn = column;
+	m_sortDirection = direction;
+	std::copy(mapping.cbegin(), mapping.cend(), m_indexMapping.begin() + offset);
+
+	SortList_UpdateSelections(selected, focused_item, focused_index);
+	delete [] selected;
+
+	RefreshListOnly(false);
+}
+
+template<class CFileData> void CFileListCtrl<CFileData>::CancelSort()
+{
+	if (!m_sortPending) {
+		return;
+	}
+
+	m_sortCancelled = true;
+	m_sortTask.join();
+	m_sortPending = false;
+	++m_sortGeneration;
+
+	// Header has to reflect the order that is actually displayed
+	if (m_pendingSortColumn != m_sortColumn) {
+		int const pendingVisibleColumn = GetColumnVisibleIndex(m_pendingSortColumn);
+		if (pendingVisibleColumn != -1) {
+			SetHeaderSortIconIndex(pendingVisibleColumn, -1);
+		}
+	}
+	int const visibleColumn = GetColumnVisibleIndex(m_sortColumn);
+	if (visibleColumn != -1) {
+		SetHeaderSortIconIndex(visibleColumn, m_sortDirection);
+	}
+}
+
 template<class CFileData> void CFileListCtrl<CFileData>::SortList_UpdateSelections(bool* selections, int focused_item, unsigned int focused_index)
 {
 	if (focused_item >= 0) {
@@ -474,9 +627,25 @@ template<class CFileData> NameSortMode CFileListCtrl<CFileData>::GetNameSortMode
 		break;
 	}
 
+	if (nameSortMode != m_sortKeyMode) {
+		CancelSort();
+		for (auto & data : m_fileData) {
+			data.sortKey.clear();
+		}
+		m_sortKeyMode = nameSortMode;
+	}
+
 	return nameSortMode;
 }
 
+template<class CFileData> std::string const& CFileListCtrl<CFileData>::GetSortKey(CFileData & data, std::wstring_view const& name)
+{
+	if (data.sortKey.empty()) {
+		data.sortKey = CFileListCtrlSortBase::MakeSortKey(name, m_sortKeyMode);
+	}
+	return data.sortKey;
+}
+
 template<class CFileData> void CFileListCtrl<CFileData>::OnColumnClicked(wxListEvent &event)
 {
 	int col = m_pVisibleColumnMapping[event.GetColumn()];
@@ -507,7 +676,7 @@ template<class CFileData> void CFileListCtrl<CFileData>::OnColumnClicked(wxListE
 		dir = m_sortDirection;
 	}
 
-	SortList(col, dir);
+	SortList(col, dir, true, true);
 	RefreshListOnly(false);
 }
 
@@ -5,6 +5,10 @@
 #include "systemimagelist.h"
 #include "listingcomparison.h"
 
+#include <libfilezilla/thread_pool.hpp>
+
+#include <algorithm>
+#include <atomic>
 #include <cstring>
 #include <deque>
 #include <memory>
@@ -22,6 +26,10 @@ public:
 	std::wstring fileType;
 	int icon{-2};
 
+	// Binary collation key of the name, see CFileListCtrlSortBase::MakeSortKey.
+	// Computed on first use, cleared if the name sort mode changes.
+	std::string sortKey;
+
 	// t_fileEntryFlags is defined in listingcomparison.h as it will be used for
 	// both local and remote listings
 	CComparableListing::t_fileEntryFlags comparison_flags{CComparableListing::normal};
@@ -44,6 +52,14 @@ public:
 	virtual bool operator()(int a, int b) const = 0;
 	virtual ~CFileListCtrlSortBase() {} // Without this empty destructor GCC complains
 
+	// Called on the main thread before the object gets handed to a worker
+	// thread. Any lazily computed data the comparison depends on has to be
+	// filled in here.
+	virtual void PrepareBackgroundSort(std::vector<unsigned int> const&) {}
+
+	// Called on the worker thread prior to sorting the given indexes.
+	virtual void Precompute(std::vector<unsigned int> const&) {}
+
 	#define CMP(f, data1, data2) \
 		{\
 			int res = this->f(data1, data2);\
@@ -139,6 +155,98 @@ public:
 		return res;         //same length, compare first different digit in the sequence*/
 	}
 
+	// Builds a binary key such that comparing two keys bytewise yields the
+	// same order as CmpNatural on the original names.
+	// Letters are case-folded and UTF-8 encoded, runs of digits are encoded
+	// as a '0' marker followed by the number of significant digits and the
+	// digits themselves. Counts of leading zeros follow after a terminating
+	// null byte as tie-breaker.
+	static std::string MakeNaturalSortKey(std::wstring_view const& str)
+	{
+		std::string key;
+		key.reserve(str.size() + 4);
+
+		std::string zeros;
+
+		wchar_t const* p = str.data();
+		wchar_t const* const end = p + str.size();
+		while (p != end) {
+			if (wxIsdigit(*p)) {
+				unsigned char zeroCount = 0;
+				for (; *p == '0' && (p + 1) != end && wxIsdigit(*(p + 1)); ++p) {
+					if (zeroCount < 255) {
+						++zeroCount;
+					}
+				}
+				wchar_t const* digits = p;
+				while (p != end && wxIsdigit(*p)) {
+					++p;
+				}
+				size_t const len = std::min(static_cast<size_t>(p - digits), size_t(0xffff));
+				key += '0';
+				key += static_cast<char>(len >> 8);
+				key += static_cast<char>(len & 0xff);
+				for (size_t i = 0; i < len; ++i) {
+					key += static_cast<char>(digits[i]);
+				}
+				zeros += static_cast<char>(zeroCount);
+			}
+			else {
+				wchar_t const* text = p;
+				while (p != end && !wxIsdigit(*p)) {
+					++p;
+				}
+				std::wstring folded(text, p);
+				for (auto & c : folded) {
+					c = static_cast<wchar_t>(wxTolower(c));
+				}
+				key += fz::to_utf8(folded);
+			}
+		}
+
+		if (!zeros.empty()) {
+			key += '\0';
+			key += zeros;
+		}
+
+		return key;
+	}
+
+	// Builds a key for the given name sort mode. Comparing keys bytewise
+	// yields the same order as the corresponding comparison function.
+	static std::string MakeSortKey(std::wstring_view const& str, NameSortMode mode)
+	{
+		switch (mode)
+		{
+		case NameSortMode::case_sensitive:
+			return fz::to_utf8(str);
+
+		default:
+		case NameSortMode::case_insensitive:
+			{
+				std::wstring folded(str);
+				for (auto & c : folded) {
+					c = static_cast<wchar_t>(wxTolower(c));
+				}
+				std::string key = fz::to_utf8(folded);
+
+				// Like CmpNoCase, fall back to case-sensitive comparison
+				key += '\0';
+				key += fz::to_utf8(str);
+				return key;
+			}
+
+		case NameSortMode::natural:
+			return MakeNaturalSortKey(str);
+		}
+	}
+
+	static int CmpSortKey(std::string_view const& key1, std::string_view const& key2)
+	{
+		// Bytewise, like memcmp
+		return key1.compare(key2);
+	}
+
 	typedef int (* CompareFunction)(std::wstring_view const&, std::wstring_view const&);
 	static CompareFunction GetCmpFunction(NameSortMode mode)
 	{
@@ -175,15 +283,15 @@ inline int DoCmpName(value_type const& data1, value_type const& data2, NameSortM
 	}
 }
 
-template<typename Listing>
+template<typename Listing, typename DataEntry>
 class CFileListCtrlSort : public CFileListCtrlSortBase
 {
 public:
 	typedef Listing List;
 	typedef typename Listing::value_type value_type;
 
-	CFileListCtrlSort(Listing const& listing, DirSortMode dirSortMode, NameSortMode nameSortMode)
-		: m_listing(listing), m_dirSortMode(dirSortMode), m_nameSortMode(nameSortMode)
+	CFileListCtrlSort(Listing const& listing, std::vector<DataEntry>& fileData, DirSortMode dirSortMode, NameSortMode nameSortMode)
+		: m_listing(listing), m_fileData(fileData), m_dirSortMode(dirSortMode), m_nameSortMode(nameSortMode)
 	{
 	}
 
@@ -231,10 +339,31 @@ public:
 		}
 	}
 
-	template<typename value_type>
-	inline int CmpName(value_type const& data1, value_type const& data2) const
+	inline std::string const& SortKey(unsigned int index) const
+	{
+		std::string & key = m_fileData[index].sortKey;
+		if (key.empty()) {
+			key = MakeSortKey(m_listing[index].name, m_nameSortMode);
+		}
+		return key;
+	}
+
+	inline int CmpName(int a, int b) const
+	{
+		int const res = CmpSortKey(SortKey(a), SortKey(b));
+		if (res) {
+			return res;
+		}
+
+		// Tie-breaker, e.g. for entries of the same name but in different paths
+		return DoCmpName(m_listing[a], m_listing[b], m_nameSortMode);
+	}
+
+	virtual void Precompute(std::vector<unsigned int> const& indexes) override
 	{
-		return DoCmpName(data1, data2, m_nameSortMode);
+		for (auto const& index : indexes) {
+			SortKey(index);
+		}
 	}
 
 	inline int CmpSize(const value_type &data1, const value_type &data2) const
@@ -271,6 +400,7 @@ public:
 
 protected:
 	Listing const& m_listing;
+	std::vector<DataEntry>& m_fileData;
 
 	DirSortMode const m_dirSortMode;
 	NameSortMode const m_nameSortMode;
@@ -293,11 +423,11 @@ public:
 };
 
 template<typename Listing, typename DataEntry>
-class CFileListCtrlSortName : public CFileListCtrlSort<Listing>
+class CFileListCtrlSortName : public CFileListCtrlSort<Listing, DataEntry>
 {
 public:
-	CFileListCtrlSortName(Listing const& listing, std::vector<DataEntry>&, CFileListCtrlSortBase::DirSortMode dirSortMode, NameSortMode nameSortMode, CFileListCtrl<DataEntry>* const)
-		: CFileListCtrlSort<Listing>(listing, dirSortMode, nameSortMode)
+	CFileListCtrlSortName(Listing const& listing, std::vector<DataEntry>& fileData, CFileListCtrlSortBase::DirSortMode dirSortMode, NameSortMode nameSortMode, CFileListCtrl<DataEntry>* const)
+		: CFileListCtrlSort<Listing, DataEntry>(listing, fileData, dirSortMode, nameSortMode)
 	{
 	}
 
@@ -308,16 +438,16 @@ public:
 
 		CMP(CmpDir, data1, data2);
 
-		CMP_LESS(CmpName, data1, data2);
+		CMP_LESS(CmpName, a, b);
 	}
 };
 
 template<typename Listing, typename DataEntry>
-class CFileListCtrlSortSize : public CFileListCtrlSort<Listing>
+class CFileListCtrlSortSize : public CFileListCtrlSort<Listing, DataEntry>
 {
 public:
-	CFileListCtrlSortSize(Listing const& listing, std::vector<DataEntry>&, CFileListCtrlSortBase::DirSortMode dirSortMode, NameSortMode nameSortMode, CFileListCtrl<DataEntry>* const)
-		: CFileListCtrlSort<Listing>(listing, dirSortMode, nameSortMode)
+	CFileListCtrlSortSize(Listing const& listing, std::vector<DataEntry>& fileData, CFileListCtrlSortBase::DirSortMode dirSortMode, NameSortMode nameSortMode, CFileListCtrl<DataEntry>* const)
+		: CFileListCtrlSort<Listing, DataEntry>(listing, fileData, dirSortMode, nameSortMode)
 	{
 	}
 
@@ -330,16 +460,16 @@ public:
 
 		CMP(CmpSize, data1, data2);
 
-		CMP_LESS(CmpName, data1, data2);
+		CMP_LESS(CmpName, a, b);
 	}
 };
 
 template<typename Listing, typename DataEntry>
-class CFileListCtrlSortType : public CFileListCtrlSort<Listing>
+class CFileListCtrlSortType : public CFileListCtrlSort<Listing, DataEntry>
 {
 public:
 	CFileListCtrlSortType(Listing const& listing, std::vector<DataEntry>& fileData, CFileListCtrlSortBase::DirSortMode dirSortMode, NameSortMode nameSortMode, CFileListCtrl<DataEntry>* const pListView)
-		: CFileListCtrlSort<Listing>(listing, dirSortMode, nameSortMode), m_pListView(pListView), m_fileData(fileData)
+		: CFileListCtrlSort<Listing, DataEntry>(listing, fileData, dirSortMode, nameSortMode), m_pListView(pListView)
 	{
 	}
 
@@ -350,8 +480,8 @@ public:
 
 		CMP(CmpDir, data1, data2);
 
-		DataEntry &type1 = m_fileData[a];
-		DataEntry &type2 = m_fileData[b];
+		DataEntry &type1 = this->m_fileData[a];
+		DataEntry &type2 = this->m_fileData[b];
 		if (type1.fileType.empty()) {
 			type1.fileType = m_pListView->GetType(data1.name, data1.is_dir());
 		}
@@ -361,20 +491,31 @@ public:
 
 		CMP(CmpStringNoCase, type1.fileType, type2.fileType);
 
-		CMP_LESS(CmpName, data1, data2);
+		CMP_LESS(CmpName, a, b);
+	}
+
+	virtual void PrepareBackgroundSort(std::vector<unsigned int> const& indexes) override
+	{
+		// Type lookups are not thread-safe
+		for (auto const& index : indexes) {
+			DataEntry & data = this->m_fileData[index];
+			if (data.fileType.empty()) {
+				typename Listing::value_type const& entry = this->m_listing[index];
+				data.fileType = m_pListView->GetType(entry.name, entry.is_dir());
+			}
+		}
 	}
 
 protected:
 	CFileListCtrl<DataEntry>* const m_pListView;
-	std::vector<DataEntry>& m_fileData;
 };
 
 template<typename Listing, typename DataEntry>
-class CFileListCtrlSortTime : public CFileListCtrlSort<Listing>
+class CFileListCtrlSortTime : public CFileListCtrlSort<Listing, DataEntry>
 {
 public:
-	CFileListCtrlSortTime(Listing const& listing, std::vector<DataEntry>&, CFileListCtrlSortBase::DirSortMode dirSortMode, NameSortMode nameSortMode, CFileListCtrl<DataEntry>* const)
-		: CFileListCtrlSort<Listing>(listing, dirSortMode, nameSortMode)
+	CFileListCtrlSortTime(Listing const& listing, std::vector<DataEntry>& fileData, CFileListCtrlSortBase::DirSortMode dirSortMode, NameSortMode nameSortMode, CFileListCtrl<DataEntry>* const)
+		: CFileListCtrlSort<Listing, DataEntry>(listing, fileData, dirSortMode, nameSortMode)
 	{
 	}
 
@@ -387,16 +528,16 @@ public:
 
 		CMP(CmpTime, data1, data2);
 
-		CMP_LESS(CmpName, data1, data2);
+		CMP_LESS(CmpName, a, b);
 	}
 };
 
 template<typename Listing, typename DataEntry>
-class CFileListCtrlSortPermissions : public CFileListCtrlSort<Listing>
+class CFileListCtrlSortPermissions : public CFileListCtrlSort<Listing, DataEntry>
 {
 public:
-	CFileListCtrlSortPermissions(Listing const& listing, std::vector<DataEntry>&, CFileListCtrlSortBase::DirSortMode dirSortMode, NameSortMode nameSortMode, CFileListCtrl<DataEntry>* const)
-		: CFileListCtrlSort<Listing>(listing, dirSortMode, nameSortMode)
+	CFileListCtrlSortPermissions(Listing const& listing, std::vector<DataEntry>& fileData, CFileListCtrlSortBase::DirSortMode dirSortMode, NameSortMode nameSortMode, CFileListCtrl<DataEntry>* const)
+		: CFileListCtrlSort<Listing, DataEntry>(listing, fileData, dirSortMode, nameSortMode)
 	{
 	}
 
@@ -409,16 +550,16 @@ public:
 
 		CMP(CmpStringNoCase, *data1.permissions, *data2.permissions);
 
-		CMP_LESS(CmpName, data1, data2);
+		CMP_LESS(CmpName, a, b);
 	}
 };
 
 template<typename Listing, typename DataEntry>
-class CFileListCtrlSortOwnerGroup : public CFileListCtrlSort<Listing>
+class CFileListCtrlSortOwnerGroup : public CFileListCtrlSort<Listing, DataEntry>
 {
 public:
-	CFileListCtrlSortOwnerGroup(Listing const& listing, std::vector<DataEntry>&, CFileListCtrlSortBase::DirSortMode dirSortMode, NameSortMode nameSortMode, CFileListCtrl<DataEntry>* const)
-		: CFileListCtrlSort<Listing>(listing, dirSortMode, nameSortMode)
+	CFileListCtrlSortOwnerGroup(Listing const& listing, std::vector<DataEntry>& fileData, CFileListCtrlSortBase::DirSortMode dirSortMode, NameSortMode nameSortMode, CFileListCtrl<DataEntry>* const)
+		: CFileListCtrlSort<Listing, DataEntry>(listing, fileData, dirSortMode, nameSortMode)
 	{
 	}
 
@@ -431,17 +572,16 @@ public:
 
 		CMP(CmpStringNoCase, *data1.ownerGroup, *data2.ownerGroup);
 
-		CMP_LESS(CmpName, data1, data2);
+		CMP_LESS(CmpName, a, b);
 	}
 };
 
 template<typename Listing, typename DataEntry>
-class CFileListCtrlSortPath : public CFileListCtrlSort<Listing>
+class CFileListCtrlSortPath : public CFileListCtrlSort<Listing, DataEntry>
 {
 public:
 	CFileListCtrlSortPath(Listing const& listing, std::vector<DataEntry>& fileData, CFileListCtrlSortBase::DirSortMode dirSortMode, NameSortMode nameSortMode, CFileListCtrl<DataEntry>* const)
-		: CFileListCtrlSort<Listing>(listing, dirSortMode, nameSortMode)
-		, m_fileData(fileData)
+		: CFileListCtrlSort<Listing, DataEntry>(listing, fileData, dirSortMode, nameSortMode)
 	{
 	}
 
@@ -457,18 +597,16 @@ public:
 			return false;
 		}
 
-		CMP_LESS(CmpName, data1, data2);
+		CMP_LESS(CmpName, a, b);
 	}
-	std::vector<DataEntry>& m_fileData;
 };
 
 template<typename Listing, typename DataEntry>
-class CFileListCtrlSortNamePath : public CFileListCtrlSort<Listing>
+class CFileListCtrlSortNamePath : public CFileListCtrlSort<Listing, DataEntry>
 {
 public:
 	CFileListCtrlSortNamePath(Listing const& listing, std::vector<DataEntry>& fileData, CFileListCtrlSortBase::DirSortMode dirSortMode, NameSortMode nameSortMode, CFileListCtrl<DataEntry>* const)
-		: CFileListCtrlSort<Listing>(listing, dirSortMode, nameSortMode)
-		, m_fileData(fileData)
+		: CFileListCtrlSort<Listing, DataEntry>(listing, fileData, dirSortMode, nameSortMode)
 	{
 	}
 
@@ -478,7 +616,7 @@ public:
 		typename Listing::value_type const& data2 = this->m_listing[b];
 
 		CMP(CmpDir, data1, data2);
-		CMP(CmpName, data1, data2);
+		CMP(CmpName, a, b);
 
 		if (data1.path < data2.path) {
 			return true;
@@ -487,9 +625,8 @@ public:
 			return false;
 		}
 
-		CMP_LESS(CmpName, data1, data2);
+		CMP_LESS(CmpName, a, b);
 	}
-	std::vector<DataEntry>& m_fileData;
 };
 
 namespace genericTypes {
@@ -505,7 +642,7 @@ template<class CFileData> class CFileListCtrl : public wxListCtrlEx, public CCom
 	template<typename Listing, typename DataEntry> friend class CFileListCtrlSortType;
 public:
 	CFileListCtrl(wxWindow* pParent, CQueueView *pQueue, COptionsBase & options, bool border = false);
-	virtual ~CFileListCtrl() = default;
+	virtual ~CFileListCtrl();
 
 	void SetFilelistStatusBar(CFilelistStatusBar* pFilelistStatusBar) { m_pFilelistStatusBar = pFilelistStatusBar; }
 	CFilelistStatusBar* GetFilelistStatusBar() { return m_pFilelistStatusBar; }
@@ -535,11 +672,26 @@ protected:
 	int m_sortDirection{};
 
 	void InitSort(interfaceOptions optionID); // Has to be called after initializing columns
-	void SortList(int column = -1, int direction = -1, bool updateSelections = true);
+	void SortList(int column = -1, int direction = -1, bool updateSelections = true, bool background = false);
 	CFileListCtrlSortBase::DirSortMode GetDirSortMode();
+
+	// Also invalidates the cached sort keys if the mode has changed
 	NameSortMode GetNameSortMode();
+
+	// Returns the cached collation key of the entry, computing it if needed.
+	std::string const& GetSortKey(CFileData & data, std::wstring_view const& name);
+	NameSortMode m_sortKeyMode{NameSortMode::case_insensitive};
 	virtual std::unique_ptr<CFileListCtrlSortBase> GetSortComparisonObject() = 0;
 
+	// If a thread pool is returned, interactively sorting large listings
+	// happens in the background. The old order is displayed until the
+	// sorted index mapping is available.
+	virtual fz::thread_pool* GetSortThreadPool() { return nullptr; }
+
+	// Stops a pending background sort. Needs to be called before m_fileData
+	// or the underlying listing get modified.
+	void CancelSort();
+
 	// An empty path denotes a virtual file
 	std::wstring GetType(std::wstring const& name, bool dir, std::wstring const& path = std::wstring());
 
@@ -548,6 +700,7 @@ protected:
 	virtual void OnPostScroll();
 	virtual void OnExitComparisonMode();
 	virtual void CompareAddFile(t_fileEntryFlags flags);
+	virtual void RestartComparison() override { m_comparisonIndex = -1; }
 
 	int m_comparisonIndex{-1};
 
@@ -580,8 +733,18 @@ protected:
 private:
 	void UpdateSelections(int min, int max);
 
+	bool* SortList_RememberSelections(int & focused_item, unsigned int & focused_index);
 	void SortList_UpdateSelections(bool* selections, int focused_item, unsigned int focused_index);
 
+	bool StartBackgroundSort(int column, int direction);
+	void OnBackgroundSortDone(unsigned int generation, int column, int direction, std::vector<unsigned int> & mapping);
+
+	fz::async_task m_sortTask;
+	std::atomic<bool> m_sortCancelled{};
+	unsigned int m_sortGeneration{};
+	bool m_sortPending{};
+	int m_pendingSortColumn{-1};
+
 	// If this is set to true, don't process selection changed events
 	bool m_insideSetSelection{};
 
@@ -7,6 +7,7 @@
 #include <vector>
 
 class CCommandLine;
+class CFileWatcher;
 class COptions;
 class CThemeProvider;
 class CWrapEngine;
@@ -40,6 +41,8 @@ public:
 
 	CWrapEngine* GetWrapEngine();
 
+	CFileWatcher* GetFileWatcher() { return fileWatcher_.get(); }
+
 	const CCommandLine* GetCommandLine() const { return m_pCommandLine.get(); }
 
 	void ShowStartupProfile();
@@ -70,6 +73,8 @@ protected:
 	std::vector<std::pair<fz::monotonic_clock, std::string>> m_startupProfile;
 
 	std::unique_ptr<CThemeProvider> themeProvider_;
+
+	std::unique_ptr<CFileWatcher> fileWatcher_;
 };
 
 DECLARE_APP(CFileZillaApp)
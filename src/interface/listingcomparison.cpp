@@ -3,6 +3,7 @@
 #include "filelistctrl.h"
 #include "Options.h"
 #include "state.h"
+#include "../commonui/directory_comparison.h"
 #include "../commonui/filter.h"
 
 CComparableListing::CComparableListing(wxWindow* pParent)
@@ -88,98 +89,151 @@ bool CComparisonManager::CompareListings()
 		return true;
 	}
 
-	fz::duration const threshold = fz::duration::from_minutes( COptions::Get()->get_int(OPTION_COMPARISON_THRESHOLD) );
-
 	m_pLeft->StartComparison();
 	m_pRight->StartComparison();
 
-	std::wstring localPath, remotePath;
-	std::wstring_view localFile, remoteFile;
-	bool localDir = false;
-	bool remoteDir = false;
-	int64_t localSize, remoteSize;
-	fz::datetime localDate, remoteDate;
-
 	int const dirSortMode = COptions::Get()->get_int(OPTION_FILELIST_DIRSORT);
 	auto const nameSortMode = static_cast<NameSortMode>(COptions::Get()->get_int(OPTION_FILELIST_NAMESORT));
 
-	bool gotLocal = m_pLeft->get_next_file(localFile, localPath, localDir, localSize, localDate);
-	bool gotRemote = m_pRight->get_next_file(remoteFile, remotePath, remoteDir, remoteSize, remoteDate);
+	// Entries get matched by directory_comparison. The sort order of the
+	// listings is only needed to interleave the entries without counterpart.
+	struct listed_entry final
+	{
+		std::wstring_view name;
+		std::string_view key;
+		std::wstring path;
+		bool dir{};
+	};
+
+	auto const collect = [](CComparableListing & listing, std::vector<listed_entry> & entries, comparison_tree & tree) {
+		while (true) {
+			listed_entry e;
+			int64_t size{-1};
+			fz::datetime date;
+			if (!listing.get_next_file(e.name, e.key, e.path, e.dir, size, date)) {
+				break;
+			}
+			tree.add(e.path, std::wstring(e.name), e.dir, size, date);
+			entries.emplace_back(std::move(e));
+		}
+	};
+
+	std::vector<listed_entry> left, right;
+	comparison_tree leftTree, rightTree;
+	collect(*m_pLeft, left, leftTree);
+	collect(*m_pRight, right, rightTree);
+
+	directory_comparison::options o;
+	o.compare_mode = m_comparisonMode ? directory_comparison::mode::date : directory_comparison::mode::size;
+	o.threshold = fz::duration::from_minutes(COptions::Get()->get_int(OPTION_COMPARISON_THRESHOLD));
+	// Only natural sort treats names differing in case as equal
+	o.fold_case = nameSortMode == NameSortMode::natural;
+
+	auto const res = directory_comparison::compare(std::move(leftTree), std::move(rightTree), o);
+
+	size_t const npos = directory_comparison::result::npos;
+	std::vector<size_t> leftMatch(left.size(), npos);
+	std::vector<size_t> rightMatch(right.size(), npos);
+	std::vector<directory_comparison::status> states(left.size());
+	for (size_t i = 0; i < res->size(); ++i) {
+		auto const& item = (*res)[i];
+		if (item.left != npos && item.right != npos) {
+			leftMatch[item.left] = item.right;
+			rightMatch[item.right] = item.left;
+			states[item.left] = item.state;
+		}
+	}
 
-	while (gotLocal && gotRemote) {
-		int cmp = CompareFiles(dirSortMode, nameSortMode, localPath, localFile, remotePath, remoteFile, localDir, remoteDir);
-		if (!cmp) {
-			if (!m_comparisonMode) {
-				const CComparableListing::t_fileEntryFlags flag = (localDir || localSize == remoteSize) ? CComparableListing::normal : CComparableListing::different;
+	m_pLeft->RestartComparison();
+	m_pRight->RestartComparison();
+
+	// CompareAddFile refers to the entry last returned by get_next_file
+	auto const next = [](CComparableListing & listing) {
+		std::wstring_view name;
+		std::string_view key;
+		std::wstring path;
+		bool dir{};
+		int64_t size{};
+		fz::datetime date;
+		listing.get_next_file(name, key, path, dir, size, date);
+	};
+
+	auto const& leftEntries = res->left_tree().entries;
+	auto const& rightEntries = res->right_tree().entries;
+
+	size_t i = 0;
+	size_t j = 0;
+	while (i < left.size() || j < right.size()) {
+		if (i < left.size() && j < right.size() && leftMatch[i] == j) {
+			CComparableListing::t_fileEntryFlags localFlag = CComparableListing::normal;
+			CComparableListing::t_fileEntryFlags remoteFlag = CComparableListing::normal;
+			switch (states[i]) {
+			case directory_comparison::status::different:
+				localFlag = CComparableListing::different;
+				remoteFlag = CComparableListing::different;
+				break;
+			case directory_comparison::status::left_newer:
+				localFlag = CComparableListing::newer;
+				break;
+			case directory_comparison::status::right_newer:
+				remoteFlag = CComparableListing::newer;
+				break;
+			default:
+				break;
+			}
 
-				if (!m_hideIdentical || flag != CComparableListing::normal || localFile == L"..") {
-					m_pLeft->CompareAddFile(flag);
-					m_pRight->CompareAddFile(flag);
-				}
+			bool show = !m_hideIdentical || localFlag != CComparableListing::normal || remoteFlag != CComparableListing::normal || left[i].name == L"..";
+			if (m_comparisonMode && !show) {
+				// Entries with a date on only one side cannot be compared, they are not identical either
+				show = leftEntries[i].time.empty() != rightEntries[j].time.empty();
 			}
-			else {
-				if (localDate.empty() || remoteDate.empty()) {
-					if (!m_hideIdentical || !localDate.empty() || !remoteDate.empty() || localFile == L"..") {
-						const CComparableListing::t_fileEntryFlags flag = CComparableListing::normal;
-						m_pLeft->CompareAddFile(flag);
-						m_pRight->CompareAddFile(flag);
-					}
-				}
-				else {
-					CComparableListing::t_fileEntryFlags localFlag, remoteFlag;
-
-					int dateCmp = localDate.compare(remoteDate);
-					if (dateCmp < 0) {
-						localDate += threshold;
-					}
-					else if (dateCmp > 0 ) {
-						remoteDate += threshold;
-					}
-					int adjustedDateCmp = localDate.compare(remoteDate);
-					if (dateCmp && dateCmp == -adjustedDateCmp) {
-						dateCmp = 0;
-					}
-
-					localFlag = CComparableListing::normal;
-					remoteFlag = CComparableListing::normal;
-					if (dateCmp < 0 ) {
-						remoteFlag = CComparableListing::newer;
-					}
-					else if (dateCmp > 0) {
-						localFlag = CComparableListing::newer;
-					}
-					if (!m_hideIdentical || localFlag != CComparableListing::normal || remoteFlag != CComparableListing::normal || localFile == L"..") {
-						m_pLeft->CompareAddFile(localFlag);
-						m_pRight->CompareAddFile(remoteFlag);
-					}
-				}
+
+			next(*m_pLeft);
+			next(*m_pRight);
+			if (show) {
+				m_pLeft->CompareAddFile(localFlag);
+				m_pRight->CompareAddFile(remoteFlag);
 			}
-			gotLocal = m_pLeft->get_next_file(localFile, localPath, localDir, localSize, localDate);
-			gotRemote = m_pRight->get_next_file(remoteFile, remotePath, remoteDir, remoteSize, remoteDate);
+			++i;
+			++j;
 			continue;
 		}
 
-		if (cmp < 0) {
+		bool lonelyLeft;
+		if (i >= left.size()) {
+			lonelyLeft = false;
+		}
+		else if (j >= right.size()) {
+			lonelyLeft = true;
+		}
+		else if (leftMatch[i] == npos && rightMatch[j] == npos) {
+			lonelyLeft = CompareFiles(dirSortMode, nameSortMode, left[i].path, left[i].name, left[i].key, right[j].path, right[j].name, right[j].key, left[i].dir, right[j].dir) < 0;
+		}
+		else if (leftMatch[i] != npos && rightMatch[j] != npos) {
+			// The listings disagree on the order of matching entries, which
+			// needs different sort orders on both sides. Show them as unmatched.
+			rightMatch[leftMatch[i]] = npos;
+			leftMatch[i] = npos;
+			lonelyLeft = true;
+		}
+		else {
+			// The entry with a counterpart has to wait for it
+			lonelyLeft = leftMatch[i] == npos;
+		}
+
+		if (lonelyLeft) {
+			next(*m_pLeft);
 			m_pLeft->CompareAddFile(CComparableListing::lonely);
 			m_pRight->CompareAddFile(CComparableListing::fill);
-			gotLocal = m_pLeft->get_next_file(localFile, localPath, localDir, localSize, localDate);
+			++i;
 		}
 		else {
+			next(*m_pRight);
 			m_pLeft->CompareAddFile(CComparableListing::fill);
 			m_pRight->CompareAddFile(CComparableListing::lonely);
-			gotRemote = m_pRight->get_next_file(remoteFile, remotePath, remoteDir, remoteSize, remoteDate);
+			++j;
 		}
 	}
-	while (gotLocal) {
-		m_pLeft->CompareAddFile(CComparableListing::lonely);
-		m_pRight->CompareAddFile(CComparableListing::fill);
-		gotLocal = m_pLeft->get_next_file(localFile, localPath, localDir, localSize, localDate);
-	}
-	while (gotRemote) {
-		m_pLeft->CompareAddFile(CComparableListing::fill);
-		m_pRight->CompareAddFile(CComparableListing::lonely);
-		gotRemote = m_pRight->get_next_file(remoteFile, remotePath, remoteDir, remoteSize, remoteDate);
-	}
 
 	m_pRight->FinishComparison();
 	m_pLeft->FinishComparison();
@@ -187,7 +241,7 @@ bool CComparisonManager::CompareListings()
 	return true;
 }
 
-int CComparisonManager::CompareFiles(int const dirSortMode, NameSortMode const nameSortMode, std::wstring_view const& local_path, std::wstring_view const& local, std::wstring_view const& remote_path, std::wstring_view const& remote, bool localDir, bool remoteDir)
+int CComparisonManager::CompareFiles(int const dirSortMode, NameSortMode const nameSortMode, std::wstring_view const& local_path, std::wstring_view const& local, std::string_view const& localKey, std::wstring_view const& remote_path, std::wstring_view const& remote, std::string_view const& remoteKey, bool localDir, bool remoteDir)
 {
 	switch (dirSortMode)
 	{
@@ -206,8 +260,15 @@ int CComparisonManager::CompareFiles(int const dirSortMode, NameSortMode const n
 		break;
 	}
 
+	// Same order as used by the file list sort objects: Sort keys first,
+	// names as tie-breaker.
+	int cmp = CFileListCtrlSortBase::CmpSortKey(localKey, remoteKey);
+	if (cmp) {
+		return cmp;
+	}
+
 	auto const f = CFileListCtrlSortBase::GetCmpFunction(nameSortMode);
-	auto cmp = f(local, remote);
+	cmp = f(local, remote);
 	if (!cmp) {
 		return f(local_path, remote_path);
 	}
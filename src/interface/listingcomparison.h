@@ -29,8 +29,11 @@ public:
 
 	virtual bool CanStartComparison() = 0;
 	virtual void StartComparison() = 0;
-	virtual bool get_next_file(std::wstring_view & name, std::wstring & path, bool &dir, int64_t &size, fz::datetime& date) = 0;
+	// sortKey receives the collation key of the name, see CFileListCtrlSortBase::MakeSortKey
+	virtual bool get_next_file(std::wstring_view & name, std::string_view & sortKey, std::wstring & path, bool &dir, int64_t &size, fz::datetime& date) = 0;
 	virtual void CompareAddFile(t_fileEntryFlags flags) = 0;
+	// Makes get_next_file start over at the first entry
+	virtual void RestartComparison() = 0;
 	virtual void FinishComparison() = 0;
 	virtual void ScrollTopItem(int item) = 0;
 	virtual void OnExitComparisonMode() = 0;
@@ -75,7 +78,7 @@ public:
 	void SetHideIdentical(bool hideIdentical) { m_hideIdentical = hideIdentical; }
 
 protected:
-	int CompareFiles(int const dirSortMode, NameSortMode const nameSortMode, std::wstring_view const& local_path, std::wstring_view const& local, std::wstring_view const& remote_path, std::wstring_view const& remote, bool localDir, bool remoteDir);
+	int CompareFiles(int const dirSortMode, NameSortMode const nameSortMode, std::wstring_view const& local_path, std::wstring_view const& local, std::string_view const& localKey, std::wstring_view const& remote_path, std::wstring_view const& remote, std::string_view const& remoteKey, bool localDir, bool remoteDir);
 
 	CState& m_state;
 
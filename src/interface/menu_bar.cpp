@@ -113,6 +113,7 @@ CMenuBar::CMenuBar(CMainFrame& mainFrame, COptions& options)
 	transfer->AppendSeparator();
 	accel.FromString(L"CTRL+M");
 	transfer->Append(XRCID("ID_MENU_TRANSFER_MANUAL"), _("&Manual transfer..."))->SetAccel(&accel);
+	transfer->Append(XRCID("ID_MENU_TRANSFER_SYNCHRONIZE"), _("S&ynchronize directories..."));
 
 	wxMenu* server = new wxMenu;
 	Append(server, _("&Server"));
@@ -160,6 +161,7 @@ CMenuBar::CMenuBar(CMainFrame& mainFrame, COptions& options)
 		debug->Append(XRCID("ID_CLEARCACHE_LAYOUT"), _("Clear &layout cache"));
 		debug->Append(XRCID("ID_CIPHERS"), _("&TLS Ciphers"), _("Shows available TLS ciphers"));
 		debug->Append(XRCID("ID_CLEAR_UPDATER"), _("Clear auto&update data"));
+		debug->Append(XRCID("ID_EXPORT_TRACE"), _("&Export performance trace..."), _("Saves the recorded performance trace as Chrome trace JSON"));
 		Append(debug, _("&Debug"));
 	}
 
@@ -576,6 +578,7 @@ void CMenuBar::UpdateMenubarState()
 	Enable(XRCID("ID_MENU_SERVER_DISCONNECT"), site && idle);
 	Enable(XRCID("ID_CANCEL"), site && !idle);
 	Enable(XRCID("ID_MENU_SERVER_CMD"), site && idle);
+	Enable(XRCID("ID_MENU_TRANSFER_SYNCHRONIZE"), site && idle);
 	Enable(XRCID("ID_MENU_FILE_COPYSITEMANAGER"), site.operator bool());
 	Enable(XRCID("ID_TOOLBAR_SYNCHRONIZED_BROWSING"), site.operator bool());
 
@@ -355,7 +355,9 @@ wxString const& CFileItem::GetStatusMessage() const
 		_("Could not write to local file"),
 		_("Could not start transfer"),
 		_("Transferring"),
-		_("Creating directory")
+		_("Creating directory"),
+		_("Checksum verified"),
+		_("Checksum mismatch")
 	};
 
 	return statusTexts[std::underlying_type_t<Status>(m_status)];
@@ -438,12 +440,18 @@ void CServerItem::AddFileItemToList(CFileItem* pItem)
 		return;
 	}
 
-	m_fileList[pItem->queued() ? 0 : 1][static_cast<int>(pItem->GetPriority())].push_back(pItem);
+	pItem->m_scheduleOrder = ++m_backOrder;
+	GetFileList(*pItem, pItem->GetPriority()).push_back(pItem);
+}
+
+std::deque<CFileItem*>& CServerItem::GetFileList(CFileItem const& item, QueuePriority priority)
+{
+	return m_fileList[item.queued() ? 0 : 1][item.Download() ? 0 : 1][static_cast<int>(priority)];
 }
 
 void CServerItem::RemoveFileItemFromList(CFileItem* pItem, bool forward)
 {
-	std::deque<CFileItem*>& fileList = m_fileList[pItem->queued() ? 0 : 1][static_cast<int>(pItem->GetPriority())];
+	std::deque<CFileItem*>& fileList = GetFileList(*pItem, pItem->GetPriority());
 	if (forward) {
 		for (auto iter = fileList.begin(); iter != fileList.end(); ++iter) {
 			if (*iter == pItem) {
@@ -534,14 +542,18 @@ void CServerItem::Sort(int col, bool reverse)
 	m_maxCachedIndex = -1;
 
 	// Rebuild m_fileList
-	for (size_t i = 0; i < static_cast<size_t>(QueuePriority::count); ++i) {
-		m_fileList[0][i].clear();
-		m_fileList[1][i].clear();
+	for (int i = 0; i < 2; ++i) {
+		for (int j = 0; j < 2; ++j) {
+			for (int k = 0; k < static_cast<int>(QueuePriority::count); ++k) {
+				m_fileList[i][j][k].clear();
+			}
+		}
 	}
+	m_frontOrder = 0;
+	m_backOrder = 0;
 
 	for (auto it = m_children.cbegin() + m_removed_at_front; it != m_children.cend(); ++it) {
-		CFileItem *pItem = static_cast<CFileItem*>(*it);
-		m_fileList[pItem->queued() ? 0 : 1][static_cast<int>(pItem->GetPriority())].push_back(pItem);
+		AddFileItemToList(static_cast<CFileItem*>(*it));
 	}
 }
 
@@ -610,27 +622,28 @@ CQueueItem* CServerItem::GetChild(unsigned int item, bool recursive)
 }
 
 namespace {
-CFileItem* DoGetIdleChild(std::deque<CFileItem*> const* fileList, TransferDirection direction)
+// Only has to skip over items in progress, so this does not depend on the
+// number of queued items.
+CFileItem* GetIdleItem(std::deque<CFileItem*> const& fileList)
 {
-	int i = 0;
-	for (i = static_cast<int>(QueuePriority::count) - 1; i >= 0; --i) {
-		for (auto const& item : fileList[i]) {
-			if (item->IsActive()) {
-				continue;
-			}
-
-			if (direction == TransferDirection::both) {
-				return item;
-			}
+	for (auto const& item : fileList) {
+		if (!item->IsActive()) {
+			return item;
+		}
+	}
+	return 0;
+}
 
-			if (direction == TransferDirection::download) {
-				if (item->Download()) {
-					return item;
-				}
-			}
-			else if (!item->Download()) {
-				return item;
-			}
+CFileItem* DoGetIdleChild(std::deque<CFileItem*> const (*fileList)[static_cast<int>(QueuePriority::count)], TransferDirection direction)
+{
+	for (int i = static_cast<int>(QueuePriority::count) - 1; i >= 0; --i) {
+		CFileItem* download = (direction != TransferDirection::upload) ? GetIdleItem(fileList[0][i]) : 0;
+		CFileItem* upload = (direction != TransferDirection::download) ? GetIdleItem(fileList[1][i]) : 0;
+		if (download && (!upload || download->m_scheduleOrder < upload->m_scheduleOrder)) {
+			return download;
+		}
+		if (upload) {
+			return upload;
 		}
 	}
 	return 0;
@@ -670,21 +683,28 @@ bool CServerItem::RemoveChild(CQueueItem* pItem, bool destroy, bool forward)
 
 void CServerItem::QueueImmediateFiles()
 {
-	for (int i = 0; i < static_cast<int>(QueuePriority::count); ++i) {
-		std::deque<CFileItem*> activeList;
-		std::deque<CFileItem*>& fileList = m_fileList[1][i];
-		for (auto iter = fileList.rbegin(); iter != fileList.rend(); ++iter) {
-			CFileItem* item = *iter;
-			wxASSERT(!item->queued());
-			if (item->IsActive()) {
-				activeList.push_front(item);
-			}
-			else {
-				item->set_queued(true);
-				m_fileList[0][i].push_front(item);
+	// Move the items in front of all queued items, keeping their relative order
+	int64_t const offset = m_backOrder - m_frontOrder + 1;
+	m_frontOrder -= offset;
+
+	for (int d = 0; d < 2; ++d) {
+		for (int i = 0; i < static_cast<int>(QueuePriority::count); ++i) {
+			std::deque<CFileItem*> activeList;
+			std::deque<CFileItem*>& fileList = m_fileList[1][d][i];
+			for (auto iter = fileList.rbegin(); iter != fileList.rend(); ++iter) {
+				CFileItem* item = *iter;
+				wxASSERT(!item->queued());
+				if (item->IsActive()) {
+					activeList.push_front(item);
+				}
+				else {
+					item->set_queued(true);
+					item->m_scheduleOrder -= offset;
+					m_fileList[0][d][i].push_front(item);
+				}
 			}
+			std::swap(fileList, activeList);
 		}
-		std::swap(fileList, activeList);
 	}
 }
 
@@ -694,15 +714,16 @@ void CServerItem::QueueImmediateFile(CFileItem* pItem)
 		return;
 	}
 
-	std::deque<CFileItem*>& fileList = m_fileList[1][static_cast<int>(pItem->GetPriority())];
+	std::deque<CFileItem*>& fileList = GetFileList(*pItem, pItem->GetPriority());
 	for (auto iter = fileList.begin(); iter != fileList.end(); ++iter) {
 		if (*iter != pItem) {
 			continue;
 		}
 
-		pItem->set_queued(true);
 		fileList.erase(iter);
-		m_fileList[0][static_cast<int>(pItem->GetPriority())].push_front(pItem);
+		pItem->set_queued(true);
+		pItem->m_scheduleOrder = --m_frontOrder;
+		GetFileList(*pItem, pItem->GetPriority()).push_front(pItem);
 		return;
 	}
 	wxASSERT(false);
@@ -723,14 +744,16 @@ int64_t CServerItem::GetTotalSize(int& filesWithUnknownSize, int& queuedFiles) c
 	int64_t totalSize = 0;
 	for (int i = 0; i < static_cast<int>(QueuePriority::count); ++i) {
 		for (int j = 0; j < 2; ++j) {
-			const std::deque<CFileItem*>& fileList = m_fileList[j][i];
-			for (auto const& item : fileList) {
-				int64_t size = item->GetSize();
-				if (size >= 0) {
-					totalSize += size;
-				}
-				else {
-					filesWithUnknownSize++;
+			for (int d = 0; d < 2; ++d) {
+				const std::deque<CFileItem*>& fileList = m_fileList[j][d][i];
+				for (auto const& item : fileList) {
+					int64_t size = item->GetSize();
+					if (size >= 0) {
+						totalSize += size;
+					}
+					else {
+						filesWithUnknownSize++;
+					}
 				}
 			}
 		}
@@ -790,10 +813,14 @@ void CServerItem::DetachChildren()
 	m_removed_at_front = 0;
 
 	for (int i = 0; i < 2; ++i) {
-		for (int j = 0; j < static_cast<int>(QueuePriority::count); ++j) {
-			m_fileList[i][j].clear();
+		for (int d = 0; d < 2; ++d) {
+			for (int j = 0; j < static_cast<int>(QueuePriority::count); ++j) {
+				m_fileList[i][d][j].clear();
+			}
 		}
 	}
+	m_frontOrder = 0;
+	m_backOrder = 0;
 }
 
 void CServerItem::SetPriority(QueuePriority priority)
@@ -809,25 +836,26 @@ void CServerItem::SetPriority(QueuePriority priority)
 	}
 
 	for (int i = 0; i < 2; ++i)
-		for (int j = 0; j < static_cast<int>(QueuePriority::count); ++j) {
-			if (j != static_cast<int>(priority)) {
-				std::move(m_fileList[i][j].begin(), m_fileList[i][j].end(), std::back_inserter(m_fileList[i][static_cast<int>(priority)]));
-				m_fileList[i][j].clear();
+		for (int d = 0; d < 2; ++d)
+			for (int j = 0; j < static_cast<int>(QueuePriority::count); ++j) {
+				if (j != static_cast<int>(priority)) {
+					std::move(m_fileList[i][d][j].begin(), m_fileList[i][d][j].end(), std::back_inserter(m_fileList[i][d][static_cast<int>(priority)]));
+					m_fileList[i][d][j].clear();
+				}
 			}
-		}
 }
 
 void CServerItem::SetChildPriority(CFileItem* pItem, QueuePriority oldPriority, QueuePriority newPriority)
 {
-	int i = pItem->queued() ? 0 : 1;
-
-	for (auto iter = m_fileList[i][static_cast<int>(oldPriority)].begin(); iter != m_fileList[i][static_cast<int>(oldPriority)].end(); ++iter) {
+	std::deque<CFileItem*>& fileList = GetFileList(*pItem, oldPriority);
+	for (auto iter = fileList.begin(); iter != fileList.end(); ++iter) {
 		if (*iter != pItem) {
 			continue;
 		}
 
-		m_fileList[i][static_cast<int>(oldPriority)].erase(iter);
-		m_fileList[i][static_cast<int>(newPriority)].push_back(pItem);
+		fileList.erase(iter);
+		pItem->m_scheduleOrder = ++m_backOrder;
+		GetFileList(*pItem, newPriority).push_back(pItem);
 		return;
 	}
 
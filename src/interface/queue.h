@@ -115,6 +115,9 @@ public:
 
 	int m_activeCount;
 
+	// Row id in the queue database, 0 if not stored
+	int64_t m_storageId{};
+
 	const std::vector<CQueueItem*>& GetChildren() const { return m_children; }
 
 	void Sort(int col, bool reverse);
@@ -122,13 +125,20 @@ public:
 protected:
 	void AddFileItemToList(CFileItem* pItem);
 	void RemoveFileItemFromList(CFileItem* pItem, bool forward);
+	std::deque<CFileItem*>& GetFileList(CFileItem const& item, QueuePriority priority);
 
 	Site site_;
 
 	// array of item lists, sorted by priority. Used by scheduler to find
 	// next file to transfer
-	// First index specifies whether the item is queued (0) or immediate (1)
-	std::deque<CFileItem*> m_fileList[2][static_cast<int>(QueuePriority::count)];
+	// First index specifies whether the item is queued (0) or immediate (1),
+	// second index whether it is a download (0) or an upload (1)
+	std::deque<CFileItem*> m_fileList[2][2][static_cast<int>(QueuePriority::count)];
+
+	// Bounds of the scheduling order of the items in m_fileList. Keeps
+	// downloads and uploads of the same priority in the order they got added.
+	int64_t m_frontOrder{};
+	int64_t m_backOrder{};
 
 	friend class CQueueItem;
 
@@ -228,9 +238,12 @@ public:
 		local_file_unwriteable,
 		could_not_start,
 		transferring,
-		creating_dir
+		creating_dir,
+		checksum_verified,
+		checksum_mismatch
 	};
 
+	Status GetStatus() const { return m_status; }
 	wxString const& GetStatusMessage() const;
 	void SetStatusMessage(Status status);
 
@@ -248,6 +261,12 @@ public:
 	unsigned char m_errorCount{};
 	t_EngineData* m_pEngineData{};
 
+	// Position in the scheduling order, maintained by the server item
+	int64_t m_scheduleOrder{};
+
+	// Row id in the queue database, 0 if not stored
+	int64_t m_storageId{};
+
 
 	inline bool made_progress() const { return flags_ & queue_flags::made_progess; }
 	inline void set_made_progress(bool made_progress)
@@ -5,12 +5,134 @@
 
 #include <sqlite3.h>
 
+#include <deque>
 #include <unordered_map>
+#include <unordered_set>
 
+#include <libfilezilla/local_filesys.hpp>
 #include <libfilezilla/uri.hpp>
 
+#include <wx/utils.h>
+
+#ifdef FZ_WINDOWS
+#include <libfilezilla/glue/windows.hpp>
+#else
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <unistd.h>
+#endif
+
 #define INVALID_DATA -1
 
+namespace {
+// Each session holds an exclusive lock on its own lock file for as long as
+// the instance runs. The operating system drops the lock once the process
+// exits or crashes, so unlike a pid it cannot be mistaken for an unrelated
+// process that happens to reuse the pid.
+class session_lock final
+{
+public:
+	session_lock() = default;
+	~session_lock()
+	{
+		unlock();
+	}
+
+	session_lock(session_lock const&) = delete;
+	session_lock& operator=(session_lock const&) = delete;
+
+	static std::wstring filename(int64_t session)
+	{
+		return CQueueStorage::GetDatabaseFilename() + fz::sprintf(L"-session%d.lock", session);
+	}
+
+	bool lock(int64_t session)
+	{
+		unlock();
+		file_ = filename(session);
+#ifdef FZ_WINDOWS
+		handle_ = CreateFileW(file_.c_str(), GENERIC_WRITE, 0, nullptr, OPEN_ALWAYS, FILE_ATTRIBUTE_TEMPORARY, nullptr);
+		return handle_ != INVALID_HANDLE_VALUE;
+#else
+		fd_ = open(fz::to_native(file_).c_str(), O_CREAT | O_RDWR | O_CLOEXEC, 0600);
+		if (fd_ == -1) {
+			return false;
+		}
+		if (flock(fd_, LOCK_EX | LOCK_NB) != 0) {
+			close(fd_);
+			fd_ = -1;
+			return false;
+		}
+		return true;
+#endif
+	}
+
+	void unlock()
+	{
+		if (file_.empty()) {
+			return;
+		}
+#ifdef FZ_WINDOWS
+		if (handle_ != INVALID_HANDLE_VALUE) {
+			CloseHandle(handle_);
+			handle_ = INVALID_HANDLE_VALUE;
+			fz::remove_file(fz::to_native(file_));
+		}
+#else
+		if (fd_ != -1) {
+			// Remove before unlocking, another instance could otherwise lock the file
+			// in between and take us for a crashed session.
+			fz::remove_file(fz::to_native(file_));
+			close(fd_);
+			fd_ = -1;
+		}
+#endif
+		file_.clear();
+	}
+
+	// Returns true if the given session is held by a running instance.
+	// Lock files of sessions that are no longer running get removed.
+	static bool alive(int64_t session)
+	{
+		std::wstring const file = filename(session);
+#ifdef FZ_WINDOWS
+		HANDLE h = CreateFileW(file.c_str(), GENERIC_WRITE, 0, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_TEMPORARY, nullptr);
+		if (h == INVALID_HANDLE_VALUE) {
+			return GetLastError() == ERROR_SHARING_VIOLATION;
+		}
+		CloseHandle(h);
+#else
+		int fd = open(fz::to_native(file).c_str(), O_RDWR | O_CLOEXEC);
+		if (fd == -1) {
+			// Without a lock file, the session cannot have a running owner
+			return false;
+		}
+		if (flock(fd, LOCK_EX | LOCK_NB) != 0) {
+			bool const locked = errno == EWOULDBLOCK;
+			close(fd);
+			if (locked) {
+				return true;
+			}
+		}
+		else {
+			close(fd);
+		}
+#endif
+		fz::remove_file(fz::to_native(file));
+		return false;
+	}
+
+private:
+	std::wstring file_;
+#ifdef FZ_WINDOWS
+	HANDLE handle_{INVALID_HANDLE_VALUE};
+#else
+	int fd_{-1};
+#endif
+};
+}
+
 enum class Column_type
 {
 	text,
@@ -53,7 +175,8 @@ namespace server_table_column_names
 		post_login_commands,
 		name,
 		parameters,
-		site_path
+		site_path,
+		session
 	};
 }
 
@@ -76,7 +199,8 @@ _column server_table_columns[] = {
 	{ "post_login_commands", Column_type::text, 0 },
 	{ "name", Column_type::text, 0 },
 	{ "parameters", Column_type::text, 0 },
-	{ "site_path", Column_type::text, default_null }
+	{ "site_path", Column_type::text, default_null },
+	{ "session", Column_type::integer, default_null }
 };
 
 namespace file_table_column_names
@@ -125,6 +249,12 @@ _column path_table_columns[] = {
 	{ "path", Column_type::text, not_null }
 };
 
+// Each running instance owns the servers referencing its session
+_column session_table_columns[] = {
+	{ "id", Column_type::integer, not_null | autoincrement },
+	{ "pid", Column_type::integer, not_null }
+};
+
 class CQueueStorage::Impl final
 {
 public:
@@ -136,9 +266,17 @@ public:
 	sqlite3_stmt* PrepareStatement(std::string const& query);
 	sqlite3_stmt* PrepareInsertStatement(std::string const& name, _column const*, unsigned int count);
 
-	bool SaveServer(CServerItem const& item);
+	bool SaveServer(CServerItem & item);
 	bool SaveFile(CFileItem const& item);
 	bool SaveDirectory(CFolderItem const& item);
+	bool UpdateFile(CFileItem const& item);
+	bool DeleteServer(int64_t id);
+
+	bool InsertItem(CServerItem & server, CFileItem & item);
+	bool RewriteServer(CServerItem & server);
+
+	bool Execute(sqlite3_stmt* statement);
+	bool Execute(std::string const& query);
 
 	int64_t SaveLocalPath(CLocalPath const& path);
 	int64_t SaveRemotePath(CServerPath const& path);
@@ -169,6 +307,9 @@ public:
 	bool BeginTransaction();
 	bool EndTransaction(bool roolback);
 
+	bool ClaimQueue();
+	bool Flush();
+
 	void Close();
 
 	sqlite3* db_{};
@@ -178,6 +319,11 @@ public:
 	sqlite3_stmt* insertLocalPathQuery_{};
 	sqlite3_stmt* insertRemotePathQuery_{};
 
+	sqlite3_stmt* updateFileQuery_{};
+	sqlite3_stmt* deleteFileQuery_{};
+	sqlite3_stmt* deleteServerFilesQuery_{};
+	sqlite3_stmt* deleteServerQuery_{};
+
 	sqlite3_stmt* selectServersQuery_{};
 	sqlite3_stmt* selectFilesQuery_{};
 	sqlite3_stmt* selectLocalPathQuery_{};
@@ -191,6 +337,39 @@ public:
 
 	std::map<int64_t, CLocalPath> reverseLocalPaths_;
 	std::map<int64_t, CServerPath> reverseRemotePaths_;
+
+	// Id of the row in the sessions table of this instance
+	int64_t session_{};
+	session_lock sessionLock_;
+
+	// Changes are only collected after the queue got claimed
+	bool tracking_{};
+
+	// Changes not yet written, per server in order of the first change
+	struct server_changes final
+	{
+		CServerItem* server{};
+
+		// Write all items of the server anew
+		bool rewrite{};
+
+		// New items in the order they got added. Only those still
+		// in pending get written, removed items get erased from it.
+		std::deque<CFileItem*> inserts;
+		std::unordered_set<CFileItem*> pending;
+
+		std::unordered_set<CFileItem*> updates;
+	};
+	server_changes& GetChanges(CServerItem & server);
+
+	std::vector<server_changes> changes_;
+	std::unordered_map<CServerItem*, size_t> changeIndex_;
+
+	std::vector<int64_t> deletedFiles_;
+	std::vector<int64_t> deletedServers_;
+
+	// Drop all rows of this session before writing the changes
+	bool purge_{};
 };
 
 
@@ -209,6 +388,7 @@ void CQueueStorage::Impl::ReadLocalPaths()
 			CLocalPath localPath;
 			if (id > 0 && !localPathRaw.empty() && localPath.SetPath(localPathRaw)) {
 				reverseLocalPaths_[id] = localPath;
+				localPaths_[localPath.GetPath()] = id;
 			}
 		}
 	}
@@ -233,6 +413,7 @@ void CQueueStorage::Impl::ReadRemotePaths()
 			CServerPath remotePath;
 			if (id > 0 && !remotePathRaw.empty() && remotePath.SetSafePath(remotePathRaw)) {
 				reverseRemotePaths_[id] = remotePath;
+				remotePaths_[remotePath.GetSafePath()] = id;
 			}
 		}
 	}
@@ -293,7 +474,7 @@ bool CQueueStorage::Impl::MigrateSchema()
 	bool ret = sqlite3_exec(db_, "PRAGMA user_version", int_callback, &version, 0) == SQLITE_OK;
 
 	if (ret) {
-		if (version > 6) {
+		if (version > 7) {
 			ret = false;
 		}
 		else if (version > 0) {
@@ -320,9 +501,12 @@ bool CQueueStorage::Impl::MigrateSchema()
 				ret &= sqlite3_exec(db_, "DROP TABLE files", 0, 0, 0) == SQLITE_OK;
 				ret &= sqlite3_exec(db_, "ALTER TABLE files2 RENAME TO files", 0, 0, 0) == SQLITE_OK;
 			}
+			if (ret && version < 7) {
+				ret = sqlite3_exec(db_, "ALTER TABLE servers ADD COLUMN session INTEGER DEFAULT NULL", 0, 0, 0) == SQLITE_OK;
+			}
 		}
-		if (ret && version != 6) {
-			ret = sqlite3_exec(db_, "PRAGMA user_version = 6", 0, 0, 0) == SQLITE_OK;
+		if (ret && version != 7) {
+			ret = sqlite3_exec(db_, "PRAGMA user_version = 7", 0, 0, 0) == SQLITE_OK;
 		}
 	}
 
@@ -472,6 +656,15 @@ void CQueueStorage::Impl::CreateTables()
 		{
 		}
 	}
+
+	{
+		std::string query("CREATE TABLE IF NOT EXISTS sessions ");
+		query += CreateColumnDefs(session_table_columns, sizeof(session_table_columns) / sizeof(_column));
+
+		if (sqlite3_exec(db_, query.c_str(), 0, 0, 0) != SQLITE_OK)
+		{
+		}
+	}
 }
 
 sqlite3_stmt* CQueueStorage::Impl::PrepareInsertStatement(std::string const& name, _column const* columns, unsigned int count)
@@ -533,6 +726,24 @@ bool CQueueStorage::Impl::PrepareStatements()
 		return false;
 	}
 
+	{
+		// Parameter indexes match the column indexes, same as for the insert statement
+		std::string query = fz::sprintf("UPDATE files SET target_file=?%d, size=?%d, error_count=?%d, priority=?%d, flags=?%d, default_exists_action=?%d WHERE id=?%d",
+			file_table_column_names::target_file, file_table_column_names::size, file_table_column_names::error_count,
+			file_table_column_names::priority, file_table_column_names::flags, file_table_column_names::default_exists_action,
+			sizeof(file_table_columns) / sizeof(_column));
+		if (!(updateFileQuery_ = PrepareStatement(query))) {
+			return false;
+		}
+	}
+
+	deleteFileQuery_ = PrepareStatement("DELETE FROM files WHERE id=:id");
+	deleteServerFilesQuery_ = PrepareStatement("DELETE FROM files WHERE server=:server");
+	deleteServerQuery_ = PrepareStatement("DELETE FROM servers WHERE id=:id");
+	if (!deleteFileQuery_ || !deleteServerFilesQuery_ || !deleteServerQuery_) {
+		return false;
+	}
+
 	{
 		std::string query = "SELECT ";
 		for (unsigned int i = 0; i < (sizeof(server_table_columns) / sizeof(_column)); ++i) {
@@ -542,7 +753,7 @@ bool CQueueStorage::Impl::PrepareStatements()
 			query += server_table_columns[i].name;
 		}
 
-		query += " FROM servers ORDER BY id ASC";
+		query += " FROM servers WHERE session=:session ORDER BY id ASC";
 
 		if (!(selectServersQuery_ = PrepareStatement(query))) {
 			return false;
@@ -623,7 +834,7 @@ bool CQueueStorage::Impl::BindNull(sqlite3_stmt* statement, int index)
 }
 
 
-bool CQueueStorage::Impl::SaveServer(CServerItem const& item)
+bool CQueueStorage::Impl::SaveServer(CServerItem & item)
 {
 	bool kiosk_mode = COptions::Get()->get_int(OPTION_DEFAULT_KIOSKMODE) != 0;
 
@@ -767,6 +978,8 @@ bool CQueueStorage::Impl::SaveServer(CServerItem const& item)
 		Bind(insertServerQuery_, server_table_column_names::site_path, site_path);
 	}
 
+	Bind(insertServerQuery_, server_table_column_names::session, session_);
+
 	int res;
 	do {
 		res = sqlite3_step(insertServerQuery_);
@@ -776,19 +989,7 @@ bool CQueueStorage::Impl::SaveServer(CServerItem const& item)
 
 	bool ret = res == SQLITE_DONE;
 	if (ret) {
-		sqlite3_int64 serverId = sqlite3_last_insert_rowid(db_);
-		Bind(insertFileQuery_, file_table_column_names::server, static_cast<int64_t>(serverId));
-
-		const std::vector<CQueueItem*>& children = item.GetChildren();
-		for (std::vector<CQueueItem*>::const_iterator it = children.begin() + item.GetRemovedAtFront(); it != children.end(); ++it) {
-			CQueueItem & childItem = **it;
-			if (childItem.GetType() == QueueItemType::File) {
-				ret &= SaveFile(static_cast<CFileItem&>(childItem));
-			}
-			else if (childItem.GetType() == QueueItemType::Folder) {
-				ret &= SaveDirectory(static_cast<CFolderItem&>(childItem));
-			}
-		}
+		item.m_storageId = sqlite3_last_insert_rowid(db_);
 	}
 	return ret;
 }
@@ -893,6 +1094,263 @@ bool CQueueStorage::Impl::SaveDirectory(CFolderItem const& directory)
 }
 
 
+bool CQueueStorage::Impl::UpdateFile(CFileItem const& file)
+{
+	if (file.m_storageId <= 0) {
+		return true;
+	}
+
+	bool const folder = file.GetType() == QueueItemType::Folder;
+
+	auto const& targetFile = file.GetTargetFile();
+	if (targetFile && !folder) {
+		Bind(updateFileQuery_, file_table_column_names::target_file, *targetFile);
+	}
+	else {
+		BindNull(updateFileQuery_, file_table_column_names::target_file);
+	}
+	if (file.GetSize() != -1 && !folder) {
+		Bind(updateFileQuery_, file_table_column_names::size, file.GetSize());
+	}
+	else {
+		BindNull(updateFileQuery_, file_table_column_names::size);
+	}
+	if (file.m_errorCount) {
+		Bind(updateFileQuery_, file_table_column_names::error_count, file.m_errorCount);
+	}
+	else {
+		BindNull(updateFileQuery_, file_table_column_names::error_count);
+	}
+	Bind(updateFileQuery_, file_table_column_names::priority, static_cast<int>(file.GetPriority()));
+	Bind(updateFileQuery_, file_table_column_names::flags, static_cast<int64_t>(file.flags() - queue_flags::mask));
+	if (file.m_defaultFileExistsAction != CFileExistsNotification::unknown && !folder) {
+		Bind(updateFileQuery_, file_table_column_names::default_exists_action, file.m_defaultFileExistsAction);
+	}
+	else {
+		BindNull(updateFileQuery_, file_table_column_names::default_exists_action);
+	}
+	Bind(updateFileQuery_, static_cast<int>(sizeof(file_table_columns) / sizeof(_column)), file.m_storageId);
+
+	return Execute(updateFileQuery_);
+}
+
+
+bool CQueueStorage::Impl::DeleteServer(int64_t id)
+{
+	Bind(deleteServerFilesQuery_, 1, id);
+	bool ret = Execute(deleteServerFilesQuery_);
+
+	Bind(deleteServerQuery_, 1, id);
+	ret &= Execute(deleteServerQuery_);
+
+	return ret;
+}
+
+
+bool CQueueStorage::Impl::InsertItem(CServerItem & server, CFileItem & item)
+{
+	if (item.m_edit != CEditHandler::none) {
+		return true;
+	}
+
+	if (server.m_storageId <= 0 && !SaveServer(server)) {
+		return false;
+	}
+	Bind(insertFileQuery_, file_table_column_names::server, server.m_storageId);
+
+	bool ret;
+	if (item.GetType() == QueueItemType::Folder) {
+		ret = SaveDirectory(static_cast<CFolderItem&>(item));
+	}
+	else {
+		ret = SaveFile(item);
+	}
+	if (ret) {
+		item.m_storageId = sqlite3_last_insert_rowid(db_);
+	}
+
+	return ret;
+}
+
+
+bool CQueueStorage::Impl::RewriteServer(CServerItem & server)
+{
+	bool ret = true;
+	if (server.m_storageId > 0) {
+		ret &= DeleteServer(server.m_storageId);
+		server.m_storageId = 0;
+	}
+
+	const std::vector<CQueueItem*>& children = server.GetChildren();
+	for (auto it = children.begin() + server.GetRemovedAtFront(); it != children.end(); ++it) {
+		CQueueItem & childItem = **it;
+		if (childItem.GetType() == QueueItemType::File || childItem.GetType() == QueueItemType::Folder) {
+			ret &= InsertItem(server, static_cast<CFileItem&>(childItem));
+		}
+	}
+
+	return ret;
+}
+
+
+bool CQueueStorage::Impl::Execute(sqlite3_stmt* statement)
+{
+	int res;
+	do {
+		res = sqlite3_step(statement);
+	} while (res == SQLITE_BUSY);
+
+	sqlite3_reset(statement);
+
+	return res == SQLITE_DONE;
+}
+
+
+bool CQueueStorage::Impl::Execute(std::string const& query)
+{
+	return sqlite3_exec(db_, query.c_str(), 0, 0, 0) == SQLITE_OK;
+}
+
+
+CQueueStorage::Impl::server_changes& CQueueStorage::Impl::GetChanges(CServerItem & server)
+{
+	auto it = changeIndex_.find(&server);
+	if (it != changeIndex_.end()) {
+		return changes_[it->second];
+	}
+
+	changeIndex_[&server] = changes_.size();
+	changes_.emplace_back();
+	changes_.back().server = &server;
+	return changes_.back();
+}
+
+
+bool CQueueStorage::Impl::ClaimQueue()
+{
+	if (!db_) {
+		return false;
+	}
+
+	// The caller holds MUTEX_QUEUE, so no other instance can be between
+	// adding its session and locking it.
+	unsigned long const pid = wxGetProcessId();
+
+	// Find sessions of instances that are no longer running
+	std::vector<int64_t> stale;
+	bool others{};
+	sqlite3_stmt* selectSessionsQuery = PrepareStatement("SELECT id FROM sessions");
+	if (!selectSessionsQuery) {
+		return false;
+	}
+
+	int res;
+	do {
+		res = sqlite3_step(selectSessionsQuery);
+		if (res == SQLITE_ROW) {
+			int64_t const id = GetColumnInt64(selectSessionsQuery, 0);
+			if (session_lock::alive(id)) {
+				others = true;
+			}
+			else {
+				stale.push_back(id);
+			}
+		}
+	}
+	while (res == SQLITE_BUSY || res == SQLITE_ROW);
+	sqlite3_finalize(selectSessionsQuery);
+
+	bool ret = true;
+	for (auto const& id : stale) {
+		ret &= Execute(fz::sprintf("DELETE FROM sessions WHERE id=%d", id));
+	}
+
+	ret &= Execute(fz::sprintf("INSERT INTO sessions (pid) VALUES (%d)", pid));
+	if (!ret) {
+		return false;
+	}
+	session_ = sqlite3_last_insert_rowid(db_);
+	if (!sessionLock_.lock(session_)) {
+		// Other instances would take over our queue
+		Execute(fz::sprintf("DELETE FROM sessions WHERE id=%d", session_));
+		session_ = 0;
+		return false;
+	}
+
+	// Take over the queues of instances that have exited or crashed
+	ret &= Execute(fz::sprintf("UPDATE servers SET session=%d WHERE session IS NULL OR session NOT IN (SELECT id FROM sessions)", session_));
+
+	if (!others) {
+		// No one else can be referencing these
+		ret &= Execute("DELETE FROM local_paths WHERE id NOT IN (SELECT local_path FROM files WHERE local_path IS NOT NULL)");
+		ret &= Execute("DELETE FROM remote_paths WHERE id NOT IN (SELECT remote_path FROM files WHERE remote_path IS NOT NULL)");
+	}
+
+	tracking_ = ret;
+	return ret;
+}
+
+
+bool CQueueStorage::Impl::Flush()
+{
+	if (changes_.empty() && deletedFiles_.empty() && deletedServers_.empty() && !purge_) {
+		return true;
+	}
+
+	if (!BeginTransaction()) {
+		// Try again later
+		return false;
+	}
+
+	bool ret = true;
+	if (purge_) {
+		ret &= Execute(fz::sprintf("DELETE FROM files WHERE server IN (SELECT id FROM servers WHERE session=%d)", session_));
+		ret &= Execute(fz::sprintf("DELETE FROM servers WHERE session=%d", session_));
+	}
+
+	for (auto const& id : deletedServers_) {
+		ret &= DeleteServer(id);
+	}
+
+	for (auto const& id : deletedFiles_) {
+		Bind(deleteFileQuery_, 1, id);
+		ret &= Execute(deleteFileQuery_);
+	}
+
+	for (auto & changes : changes_) {
+		if (!changes.server) {
+			// Server got removed
+			continue;
+		}
+
+		if (changes.rewrite) {
+			ret &= RewriteServer(*changes.server);
+			continue;
+		}
+
+		for (auto * item : changes.inserts) {
+			if (changes.pending.erase(item)) {
+				ret &= InsertItem(*changes.server, *item);
+			}
+		}
+		for (auto * item : changes.updates) {
+			ret &= UpdateFile(*item);
+		}
+	}
+
+	// Even on previous failure, we want to at least try to commit the data we have so far
+	ret &= EndTransaction(false);
+
+	changes_.clear();
+	changeIndex_.clear();
+	deletedFiles_.clear();
+	deletedServers_.clear();
+	purge_ = false;
+
+	return ret;
+}
+
+
 std::wstring CQueueStorage::Impl::GetColumnText(sqlite3_stmt* statement, int index)
 {
 	std::wstring ret;
@@ -1154,6 +1612,10 @@ void CQueueStorage::Impl::Close()
 	sqlite3_finalize(insertFileQuery_);
 	sqlite3_finalize(insertLocalPathQuery_);
 	sqlite3_finalize(insertRemotePathQuery_);
+	sqlite3_finalize(updateFileQuery_);
+	sqlite3_finalize(deleteFileQuery_);
+	sqlite3_finalize(deleteServerFilesQuery_);
+	sqlite3_finalize(deleteServerQuery_);
 	sqlite3_finalize(selectServersQuery_);
 	sqlite3_finalize(selectFilesQuery_);
 	sqlite3_finalize(selectLocalPathQuery_);
@@ -1162,6 +1624,10 @@ void CQueueStorage::Impl::Close()
 	insertFileQuery_ = 0;
 	insertLocalPathQuery_ = 0;
 	insertRemotePathQuery_ = 0;
+	updateFileQuery_ = 0;
+	deleteFileQuery_ = 0;
+	deleteServerFilesQuery_ = 0;
+	deleteServerQuery_ = 0;
 	selectServersQuery_ = 0;
 	selectFilesQuery_ = 0;
 	selectLocalPathQuery_ = 0;
@@ -1179,6 +1645,15 @@ CQueueStorage::CQueueStorage()
 	}
 
 	if (sqlite3_exec(d_->db_, "PRAGMA encoding=\"UTF-16le\"", 0, 0, 0) == SQLITE_OK) {
+		// Changes get written in small, frequent transactions. With a write-ahead
+		// log these do not need to rewrite pages of the database file.
+		sqlite3_exec(d_->db_, "PRAGMA journal_mode=WAL", 0, 0, 0);
+		sqlite3_exec(d_->db_, "PRAGMA synchronous=NORMAL", 0, 0, 0);
+
+		// Other instances share the database. Let SQLite wait for their
+		// transactions instead of failing or spinning on SQLITE_BUSY.
+		sqlite3_busy_timeout(d_->db_, 5000);
+
 		d_->MigrateSchema();
 		d_->CreateTables();
 		d_->PrepareStatements();
@@ -1191,25 +1666,132 @@ CQueueStorage::~CQueueStorage()
 	delete d_;
 }
 
-bool CQueueStorage::SaveQueue(std::vector<CServerItem*> const& queue)
+bool CQueueStorage::ClaimQueue()
 {
-	d_->ClearCaches();
+	return d_->ClaimQueue();
+}
 
-	bool ret = true;
-	if (sqlite3_exec(d_->db_, "BEGIN TRANSACTION", 0, 0, 0) == SQLITE_OK) {
-		for (auto const& serverItem : queue) {
-			ret &= d_->SaveServer(*serverItem);
-		}
+void CQueueStorage::StopTracking()
+{
+	d_->tracking_ = false;
+	d_->changes_.clear();
+	d_->changeIndex_.clear();
+	d_->deletedFiles_.clear();
+	d_->deletedServers_.clear();
+	d_->purge_ = false;
+}
 
-		// Even on previous failure, we want to at least try to commit the data we have so far
-		ret &= sqlite3_exec(d_->db_, "END TRANSACTION", 0, 0, 0) == SQLITE_OK;
+void CQueueStorage::AddItem(CServerItem & server, CFileItem & item)
+{
+	if (!d_->tracking_ || item.m_storageId > 0 || item.m_edit != CEditHandler::none) {
+		return;
+	}
 
-		d_->ClearCaches();
+	auto & changes = d_->GetChanges(server);
+	if (!changes.rewrite && changes.pending.insert(&item).second) {
+		changes.inserts.push_back(&item);
 	}
-	else {
-		ret = false;
+}
+
+void CQueueStorage::UpdateItem(CFileItem & item)
+{
+	if (!d_->tracking_ || item.m_storageId <= 0) {
+		// Not yet written, will be written in its current state
+		return;
+	}
+
+	auto & changes = d_->GetChanges(*static_cast<CServerItem*>(item.GetTopLevelItem()));
+	if (!changes.rewrite) {
+		changes.updates.insert(&item);
+	}
+}
+
+void CQueueStorage::RemoveItem(CFileItem & item)
+{
+	if (!d_->tracking_) {
+		return;
+	}
+
+	auto it = d_->changeIndex_.find(static_cast<CServerItem*>(item.GetTopLevelItem()));
+	if (it != d_->changeIndex_.end()) {
+		auto & changes = d_->changes_[it->second];
+		changes.pending.erase(&item);
+		changes.updates.erase(&item);
+	}
+
+	if (item.m_storageId > 0) {
+		d_->deletedFiles_.push_back(item.m_storageId);
+		item.m_storageId = 0;
+	}
+}
+
+void CQueueStorage::RemoveServer(CServerItem const* server, int64_t storageId)
+{
+	if (!d_->tracking_) {
+		return;
+	}
+
+	auto it = d_->changeIndex_.find(const_cast<CServerItem*>(server));
+	if (it != d_->changeIndex_.end()) {
+		d_->changes_[it->second] = Impl::server_changes();
+		d_->changeIndex_.erase(it);
+	}
+
+	if (storageId > 0) {
+		d_->deletedServers_.push_back(storageId);
+	}
+}
+
+void CQueueStorage::RewriteServer(CServerItem & server)
+{
+	if (!d_->tracking_) {
+		return;
+	}
+
+	auto & changes = d_->GetChanges(server);
+	changes.rewrite = true;
+	changes.inserts.clear();
+	changes.pending.clear();
+	changes.updates.clear();
+}
+
+void CQueueStorage::Purge()
+{
+	if (d_->tracking_) {
+		d_->purge_ = true;
+	}
+}
+
+bool CQueueStorage::HasChanges() const
+{
+	return !d_->changes_.empty() || !d_->deletedFiles_.empty() || !d_->deletedServers_.empty() || d_->purge_;
+}
+
+bool CQueueStorage::Flush()
+{
+	if (!d_->tracking_) {
+		return true;
+	}
+
+	return d_->Flush();
+}
+
+bool CQueueStorage::Release()
+{
+	if (!d_->tracking_) {
+		return true;
 	}
 
+	bool ret = d_->Flush();
+
+	ret &= d_->Execute(fz::sprintf("UPDATE servers SET session=NULL WHERE session=%d", d_->session_));
+	ret &= d_->Execute(fz::sprintf("DELETE FROM sessions WHERE id=%d", d_->session_));
+
+	StopTracking();
+	d_->sessionLock_.unlock();
+	d_->session_ = 0;
+	d_->ClearCaches();
+
 	return ret;
 }
 
@@ -1222,6 +1804,7 @@ int64_t CQueueStorage::GetServer(Site& site, bool fromBeginning)
 			d_->ReadLocalPaths();
 			d_->ReadRemotePaths();
 			sqlite3_reset(d_->selectServersQuery_);
+			sqlite3_bind_int64(d_->selectServersQuery_, 1, d_->session_);
 		}
 
 		for (;;) {
@@ -1300,33 +1883,6 @@ int64_t CQueueStorage::GetFile(CFileItem** pItem, int64_t server)
 	return ret;
 }
 
-bool CQueueStorage::Clear()
-{
-	if (!d_->db_) {
-		return false;
-	}
-
-	if (sqlite3_exec(d_->db_, "DELETE FROM files", 0, 0, 0) != SQLITE_OK) {
-		return false;
-	}
-
-	if (sqlite3_exec(d_->db_, "DELETE FROM servers", 0, 0, 0) != SQLITE_OK) {
-		return false;
-	}
-
-	if (sqlite3_exec(d_->db_, "DELETE FROM local_paths", 0, 0, 0) != SQLITE_OK) {
-		return false;
-	}
-
-	if (sqlite3_exec(d_->db_, "DELETE FROM remote_paths", 0, 0, 0) != SQLITE_OK) {
-		return false;
-	}
-
-	d_->ClearCaches();
-
-	return true;
-}
-
 std::wstring CQueueStorage::GetDatabaseFilename()
 {
 	return COptions::Get()->get_string(OPTION_DEFAULT_SETTINGSDIR) + L"queue.sqlite3";
@@ -1342,7 +1898,3 @@ bool CQueueStorage::EndTransaction(bool rollback)
 	return d_->EndTransaction(rollback);
 }
 
-bool CQueueStorage::Vacuum()
-{
-	return sqlite3_exec(d_->db_, "VACUUM", 0, 0, 0) == SQLITE_OK;
-}
@@ -24,11 +24,10 @@ public:
 	// Call after finishing loading
 	bool EndTransaction(bool rollback = false);
 
-	bool Clear(); // Also clears caches
-
-	bool Vacuum();
-
-	bool SaveQueue(std::vector<CServerItem*> const& queue);
+	// Registers this instance and takes over the queues left behind by
+	// instances that are no longer running. Call before loading, only
+	// servers of this instance are loaded.
+	bool ClaimQueue();
 
 	// > 0 = server id
 	//   0 = No server
@@ -37,6 +36,35 @@ public:
 
 	int64_t GetFile(CFileItem** pItem, int64_t server);
 
+	// Once the queue has been claimed, changes to it get collected and
+	// written in a single transaction by Flush.
+	// Loaded items need to have their storage id set, items without
+	// one are considered new.
+	void AddItem(CServerItem & server, CFileItem & item);
+	void UpdateItem(CFileItem & item);
+
+	// Call before the item gets removed from the queue
+	void RemoveItem(CFileItem & item);
+
+	// The server item may already be deleted, it is not dereferenced
+	void RemoveServer(CServerItem const* server, int64_t storageId);
+
+	// For changes affecting many items of a server, e.g. sorting
+	void RewriteServer(CServerItem & server);
+
+	// Drops everything stored for this instance with the next flush,
+	// followed by RewriteServer for all servers that should be kept.
+	void Purge();
+
+	// Discards collected changes and stops collecting
+	void StopTracking();
+
+	bool HasChanges() const;
+	bool Flush();
+
+	// Flushes and hands the queue over to the next instance to claim it
+	bool Release();
+
 	static std::wstring GetDatabaseFilename();
 
 private:
@@ -11,8 +11,14 @@ struct COptionsPageDebug::impl final
 	wxCheckBox* debugMenu_{};
 	wxChoice* level_{};
 	wxCheckBox* rawListing_{};
+	wxCheckBox* trace_{};
 };
 
+namespace {
+// Spans kept per engine if tracing gets enabled here
+int const default_trace_buffer_size = 100000;
+}
+
 COptionsPageDebug::COptionsPageDebug()
 	: impl_(std::make_unique<impl>())
 {
@@ -59,6 +65,12 @@ bool COptionsPageDebug::CreateControls(wxWindow* parent)
 	impl_->rawListing_ = new wxCheckBox(box, nullID, _("Show &raw directory listing"));
 	inner->Add(impl_->rawListing_);
 
+	inner->AddSpacer(lay.gap);
+
+	impl_->trace_ = new wxCheckBox(box, nullID, _("Record &performance trace"));
+	inner->Add(impl_->trace_);
+	inner->Add(new wxStaticText(box, nullID, _("The trace can be exported from the debug menu and viewed in a Chrome trace viewer.")));
+
 	return true;
 }
 
@@ -67,6 +79,7 @@ bool COptionsPageDebug::LoadPage()
 	impl_->debugMenu_->SetValue(m_pOptions->get_bool(OPTION_DEBUG_MENU));
 	impl_->level_->SetSelection(m_pOptions->get_int(OPTION_LOGGING_DEBUGLEVEL));
 	impl_->rawListing_->SetValue(m_pOptions->get_bool(OPTION_LOGGING_RAWLISTING));
+	impl_->trace_->SetValue(m_pOptions->get_int(OPTION_TRACE_BUFFER_SIZE) > 0);
 	return true;
 }
 
@@ -75,6 +88,12 @@ bool COptionsPageDebug::SavePage()
 	m_pOptions->set(OPTION_DEBUG_MENU, impl_->debugMenu_->GetValue());
 	m_pOptions->set(OPTION_LOGGING_DEBUGLEVEL, impl_->level_->GetSelection());
 	m_pOptions->set(OPTION_LOGGING_RAWLISTING, impl_->rawListing_->GetValue());
+	if (!impl_->trace_->GetValue()) {
+		m_pOptions->set(OPTION_TRACE_BUFFER_SIZE, 0);
+	}
+	else if (m_pOptions->get_int(OPTION_TRACE_BUFFER_SIZE) <= 0) {
+		m_pOptions->set(OPTION_TRACE_BUFFER_SIZE, default_trace_buffer_size);
+	}
 
 	return true;
 }
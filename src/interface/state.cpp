@@ -7,6 +7,7 @@
 #include "filezillaapp.h"
 #include "local_recursive_operation.h"
 #include "remote_recursive_operation.h"
+#include "sync_operation.h"
 #include "listingcomparison.h"
 #include "xrc_helper.h"
 
@@ -228,6 +229,7 @@ CState::CState(CMainFrame &mainFrame)
 
 	m_pLocalRecursiveOperation = new CLocalRecursiveOperation(*this);
 	m_pRemoteRecursiveOperation = new CRemoteRecursiveOperation(*this);
+	m_pSyncOperation = new CSyncOperation(*this, m_mainFrame);
 
 	m_localDir.SetPath(std::wstring(1, CLocalPath::path_separator));
 }
@@ -235,6 +237,8 @@ CState::CState(CMainFrame &mainFrame)
 CState::~CState()
 {
 	delete m_pComparisonManager;
+	// Stop before the engine goes away, it is used by the worker
+	delete m_pSyncOperation;
 	delete m_pCommandQueue;
 	engine_.reset();
 	delete m_pLocalRecursiveOperation;
@@ -557,6 +561,7 @@ bool CState::Connect(Site const& site, CServerPath const& path, bool compare)
 		m_pCommandQueue->Cancel();
 	}
 	m_pRemoteRecursiveOperation->StopRecursiveOperation();
+	m_pSyncOperation->stop();
 	SetSyncBrowse(false);
 	m_changeDirFlags.compare = compare;
 
@@ -605,6 +610,7 @@ bool CState::CreateEngine()
 
 void CState::DestroyEngine()
 {
+	m_pSyncOperation->stop();
 	delete m_pCommandQueue;
 	m_pCommandQueue = 0;
 	engine_.reset();
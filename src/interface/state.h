@@ -61,6 +61,7 @@ class CStateEventHandler;
 class CRemoteDataObject;
 class CRemoteRecursiveOperation;
 class CComparisonManager;
+class CSyncOperation;
 
 class CStateFilterManager final : public CFilterManager
 {
@@ -181,6 +182,7 @@ public:
 
 	CLocalRecursiveOperation* GetLocalRecursiveOperation() { return m_pLocalRecursiveOperation; }
 	CRemoteRecursiveOperation* GetRemoteRecursiveOperation() { return m_pRemoteRecursiveOperation; }
+	CSyncOperation* GetSyncOperation() { return m_pSyncOperation; }
 
 	void NotifyHandlers(t_statechange_notifications notification, std::wstring const& data = std::wstring(), void const* data2 = 0);
 
@@ -239,6 +241,7 @@ protected:
 
 	CLocalRecursiveOperation* m_pLocalRecursiveOperation;
 	CRemoteRecursiveOperation* m_pRemoteRecursiveOperation;
+	CSyncOperation* m_pSyncOperation;
 
 	CComparisonManager* m_pComparisonManager;
 
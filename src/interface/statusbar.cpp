@@ -17,10 +17,11 @@
 
 #include <algorithm>
 
-static const int statbarWidths[3] = {
-	-1, 0, 0
+static const int statbarWidths[4] = {
+	-1, 0, 0, 0
 };
 #define FIELD_QUEUESIZE 1
+#define FIELD_QUEUESTATS 2
 
 BEGIN_EVENT_TABLE(wxStatusBarEx, wxStatusBar)
 EVT_SIZE(wxStatusBarEx::OnSize)
@@ -342,12 +343,13 @@ CStatusBar::CStatusBar(wxTopLevelWindow* pParent, activity_logger& al, COptionsB
 	CContextManager::Get()->RegisterHandler(this, STATECHANGE_CHANGEDCONTEXT, false);
 	CContextManager::Get()->RegisterHandler(this, STATECHANGE_ENCRYPTION, true);
 
-	const int count = 3;
+	const int count = 4;
 	SetFieldsCount(count);
 	int array[count];
 	array[0] = wxSB_FLAT;
 	array[1] = wxSB_NORMAL;
-	array[2] = wxSB_FLAT;
+	array[2] = wxSB_NORMAL;
+	array[3] = wxSB_FLAT;
 	SetStatusStyles(count, array);
 
 	SetStatusWidths(count, statbarWidths);
@@ -406,6 +408,58 @@ void CStatusBar::DoDisplayQueueSize()
 	SetStatusText(queueSize, FIELD_QUEUESIZE);
 }
 
+void CStatusBar::DisplayConnectionPool(int hits, int misses, fz::duration const& averageConnectTime)
+{
+	if (averageConnectTime) {
+		m_connectionPoolText = wxString::Format(_("Connections: %d reused, %d new, %d ms"), hits, misses, static_cast<int>(averageConnectTime.get_milliseconds()));
+	}
+	else {
+		m_connectionPoolText = wxString::Format(_("Connections: %d reused, %d new"), hits, misses);
+	}
+	DisplayQueueStats();
+}
+
+void CStatusBar::DisplaySchedulerStats(fz::duration const& averageWait, fz::duration const& longestWait)
+{
+	m_schedulerText = wxString::Format(_("Wait for slot: %d ms, longest %d ms"), static_cast<int>(averageWait.get_milliseconds()), static_cast<int>(longestWait.get_milliseconds()));
+	DisplayQueueStats();
+}
+
+void CStatusBar::DisplayQueueStats()
+{
+	if (m_queue_size_timer.IsRunning()) {
+		m_queue_stats_changed = true;
+	}
+	else {
+		DoDisplayQueueStats();
+		m_queue_size_timer.Start(200, true);
+	}
+}
+
+void CStatusBar::DoDisplayQueueStats()
+{
+	m_queue_stats_changed = false;
+
+	wxString text = m_connectionPoolText;
+	if (!m_schedulerText.empty()) {
+		if (!text.empty()) {
+			text += _T("; ");
+		}
+		text += m_schedulerText;
+	}
+
+	// Only grow, so that the other fields do not move back and forth
+	wxClientDC dc(this);
+	dc.SetFont(GetFont());
+	int const width = dc.GetTextExtent(text).x + 10;
+	if (width > m_queueStatsWidth) {
+		m_queueStatsWidth = width;
+		SetFieldWidth(FIELD_QUEUESTATS, width);
+	}
+
+	SetStatusText(text, FIELD_QUEUESTATS);
+}
+
 void CStatusBar::DisplayDataType()
 {
 	Site site;
@@ -708,8 +762,13 @@ void CStatusBar::OnSpeedLimitsConfigure(wxCommandEvent&)
 
 void CStatusBar::OnTimer(wxTimerEvent&)
 {
-	if (m_queue_size_changed && !m_queue_size_timer.IsRunning()) {
-		DoDisplayQueueSize();
+	if ((m_queue_size_changed || m_queue_stats_changed) && !m_queue_size_timer.IsRunning()) {
+		if (m_queue_size_changed) {
+			DoDisplayQueueSize();
+		}
+		if (m_queue_stats_changed) {
+			DoDisplayQueueStats();
+		}
 		m_queue_size_timer.Start(200, true);
 	}
 }
@@ -766,6 +825,17 @@ void CStatusBar::UpdateActivityTooltip()
 	wxString tooltipText;
 	tooltipText.Printf(_("Network activity:") + L"\n    " + _("Download: %s/s") + L"\n    " + _("Upload: %s/s"), dlSpeed, upSpeed);
 
+	auto const decoding = activity_logger_.decoding_totals();
+	if (decoding.first) {
+		std::wstring const encoded = CSizeFormat::Format(decoding.first, true, format,
+														  options_.get_int(OPTION_SIZE_USETHOUSANDSEP) != 0,
+														  options_.get_int(OPTION_SIZE_DECIMALPLACES));
+		std::wstring const decoded = CSizeFormat::Format(decoding.second, true, format,
+														  options_.get_int(OPTION_SIZE_USETHOUSANDSEP) != 0,
+														  options_.get_int(OPTION_SIZE_DECIMALPLACES));
+		tooltipText += L"\n" + wxString::Format(_("Compressed responses: %s received, %s decoded"), encoded, decoded);
+	}
+
 	activityLeds_[0]->SetToolTip(tooltipText);
 	activityLeds_[1]->SetToolTip(tooltipText);
 }
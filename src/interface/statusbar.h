@@ -98,6 +98,12 @@ public:
 
 	void DisplayQueueSize(int64_t totalSize, bool hasUnknown);
 
+	// Queue connections handed over already logged in and newly opened ones
+	void DisplayConnectionPool(int hits, int misses, fz::duration const& averageConnectTime);
+
+	// Time servers with free connection slots waited for a transfer to start
+	void DisplaySchedulerStats(fz::duration const& averageWait, fz::duration const& longestWait);
+
 	void OnHandleLeftClick(wxWindow* wnd);
 	void OnHandleRightClick(wxWindow* wnd);
 
@@ -117,6 +123,8 @@ protected:
 	virtual void OnStateChange(CState* pState, t_statechange_notifications notification, std::wstring const& data, const void* data2) override;
 
 	void DoDisplayQueueSize();
+	void DisplayQueueStats();
+	void DoDisplayQueueStats();
 
 	COptionsBase& options_;
 
@@ -125,6 +133,9 @@ protected:
 	int m_sizeFormatDecimalPlaces;
 	int64_t m_size{};
 	bool m_hasUnknownFiles{};
+	wxString m_connectionPoolText;
+	wxString m_schedulerText;
+	int m_queueStatsWidth{};
 
 	activity_logger& activity_logger_;
 
@@ -136,6 +147,7 @@ protected:
 	wxTimer m_queue_size_timer;
 	wxTimer activityTimer_;
 	bool m_queue_size_changed{};
+	bool m_queue_stats_changed{};
 
 	std::array<std::pair<fz::monotonic_clock, std::pair<uint64_t, uint64_t>>, 20> past_activity_;
 	size_t past_activity_index_{};
@@ -0,0 +1,119 @@
+#include "filezilla.h"
+#include "sync_dialog.h"
+
+struct CSyncDialog::impl final
+{
+	wxRadioButton* upload_{};
+	wxRadioButton* download_{};
+	wxRadioButton* newer_{};
+	wxCheckBox* mirror_{};
+	wxCheckBox* dates_{};
+};
+
+CSyncDialog::CSyncDialog()
+	: impl_(std::make_unique<impl>())
+{
+}
+
+CSyncDialog::~CSyncDialog()
+{
+}
+
+bool CSyncDialog::Run(wxWindow* parent, sync_operation::options & o)
+{
+	if (!Create(parent, -1, _("Synchronize directories"))) {
+		return false;
+	}
+
+	auto& lay = layout();
+	auto main = lay.createMain(this, 1);
+
+	main->Add(new wxStaticText(this, -1, _("Synchronize the current local and remote directories including their subdirectories.")));
+
+	auto direction = lay.createFlex(1);
+	main->Add(direction);
+	impl_->upload_ = new wxRadioButton(this, -1, _("&Upload local changes"), wxDefaultPosition, wxDefaultSize, wxRB_GROUP);
+	direction->Add(impl_->upload_);
+	impl_->download_ = new wxRadioButton(this, -1, _("&Download remote changes"));
+	direction->Add(impl_->download_);
+	impl_->newer_ = new wxRadioButton(this, -1, _("Transfer &newer files in both directions"));
+	direction->Add(impl_->newer_);
+
+	impl_->dates_ = new wxCheckBox(this, -1, _("&Compare modification times, not just sizes"));
+	main->Add(impl_->dates_);
+
+	impl_->mirror_ = new wxCheckBox(this, -1, _("&Mirror: Delete files and directories that only exist on the target side"));
+	main->Add(impl_->mirror_);
+
+	main->Add(new wxStaticText(this, -1, _("Remote directories that have not been listed yet are skipped.")));
+
+	auto buttons = lay.createButtonSizer(this, main, true);
+
+	auto ok = new wxButton(this, wxID_OK, _("&OK"));
+	ok->SetDefault();
+	buttons->AddButton(ok);
+	ok->Bind(wxEVT_BUTTON, &CSyncDialog::OnOK, this);
+
+	auto cancel = new wxButton(this, wxID_CANCEL, _("Cancel"));
+	buttons->AddButton(cancel);
+
+	buttons->Realize();
+
+	GetSizer()->Fit(this);
+
+	switch (o.dir) {
+	case sync_operation::direction::download:
+		impl_->download_->SetValue(true);
+		break;
+	case sync_operation::direction::newer:
+		impl_->newer_->SetValue(true);
+		break;
+	default:
+		impl_->upload_->SetValue(true);
+		break;
+	}
+	impl_->dates_->SetValue(o.compare_dates);
+	impl_->mirror_->SetValue(o.mirror && o.dir != sync_operation::direction::newer);
+	impl_->mirror_->Enable(o.dir != sync_operation::direction::newer);
+
+	impl_->upload_->Bind(wxEVT_RADIOBUTTON, &CSyncDialog::OnDirection, this);
+	impl_->download_->Bind(wxEVT_RADIOBUTTON, &CSyncDialog::OnDirection, this);
+	impl_->newer_->Bind(wxEVT_RADIOBUTTON, &CSyncDialog::OnDirection, this);
+
+	if (ShowModal() != wxID_OK) {
+		return false;
+	}
+
+	if (impl_->download_->GetValue()) {
+		o.dir = sync_operation::direction::download;
+	}
+	else if (impl_->newer_->GetValue()) {
+		o.dir = sync_operation::direction::newer;
+	}
+	else {
+		o.dir = sync_operation::direction::upload;
+	}
+	o.compare_dates = impl_->dates_->GetValue();
+	o.mirror = impl_->mirror_->IsEnabled() && impl_->mirror_->GetValue();
+
+	return true;
+}
+
+void CSyncDialog::OnDirection(wxCommandEvent&)
+{
+	impl_->mirror_->Enable(!impl_->newer_->GetValue());
+}
+
+void CSyncDialog::OnOK(wxCommandEvent&)
+{
+	if (impl_->mirror_->IsEnabled() && impl_->mirror_->GetValue()) {
+		wxString const msg = impl_->upload_->GetValue()
+			? _("Files and directories that do not exist locally will be deleted from the server.\nReally continue?")
+			: _("Files and directories that do not exist on the server will be deleted from your computer.\nReally continue?");
+		if (wxMessageBoxEx(msg, _("Confirmation needed"), wxICON_QUESTION | wxYES_NO, this) != wxYES) {
+			return;
+		}
+	}
+
+	EndDialog(wxID_OK);
+}
@@ -0,0 +1,24 @@
+#ifndef FILEZILLA_INTERFACE_SYNC_DIALOG_HEADER
+#define FILEZILLA_INTERFACE_SYNC_DIALOG_HEADER
+
+#include "dialogex.h"
+#include "../commonui/sync_operation.h"
+
+// Asks for the direction and mode of a directory synchronization
+class CSyncDialog final : public wxDialogEx
+{
+public:
+	CSyncDialog();
+	virtual ~CSyncDialog();
+
+	bool Run(wxWindow* parent, sync_operation::options & o);
+
+protected:
+	struct impl;
+	std::unique_ptr<impl> impl_;
+
+	void OnDirection(wxCommandEvent& event);
+	void OnOK(wxCommandEvent& event);
+};
+
+#endif
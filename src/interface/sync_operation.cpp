@@ -0,0 +1,222 @@
+#include "filezilla.h"
+#include "sync_operation.h"
+
+#include "commandqueue.h"
+#include "file_utils.h"
+#include "Mainfrm.h"
+#include "QueueView.h"
+#include "remote_recursive_operation.h"
+#include "StatusView.h"
+
+CSyncOperation::CSyncOperation(CState& state, CMainFrame& mainFrame)
+: sync_operation(state.pool_)
+, CStateEventHandler(state)
+, state_(state)
+, mainFrame_(mainFrame)
+{
+	state.RegisterHandler(this, STATECHANGE_REMOTE_IDLE);
+}
+
+CSyncOperation::~CSyncOperation()
+{
+	stop();
+}
+
+bool CSyncOperation::StartSync(options const& o, bool immediate)
+{
+	if (!m_pQueue || Busy() || !state_.engine_ || !state_.IsRemoteConnected()) {
+		return false;
+	}
+
+	// Lists the remote tree before planning and deletes remote directories afterwards
+	auto* recursiveOperation = state_.GetRemoteRecursiveOperation();
+	if (!recursiveOperation || recursiveOperation->GetOperationMode() != recursive_operation::recursive_none) {
+		return false;
+	}
+
+	Site const& site = state_.GetSite();
+	if (!site) {
+		return false;
+	}
+	site_ = site;
+	m_immediate = immediate;
+	m_options = o;
+	m_localRoot = state_.GetLocalDir();
+	m_remoteRoot = state_.GetRemotePath();
+	m_remoteDirsToDelete.clear();
+	m_deletions = 0;
+
+	if (m_localRoot.empty() || m_remoteRoot.empty()) {
+		return false;
+	}
+
+	// Directories that have not been browsed yet are not cached. Listing
+	// directories which are cached does not involve the server.
+	recursion_root root(m_remoteRoot, false);
+	root.add_dir_to_visit_restricted(m_remoteRoot, std::wstring(), true);
+	recursiveOperation->AddRecursionRoot(std::move(root));
+	m_listing = true;
+	recursiveOperation->StartRecursiveOperation(recursive_operation::recursive_list, o.filters);
+	if (m_listing && !recursiveOperation->IsActive()) {
+		m_listing = false;
+		return false;
+	}
+
+	if (m_immediate) {
+		m_actionAfterBlocker = m_pQueue->GetActionAfterBlocker();
+	}
+
+	return true;
+}
+
+void CSyncOperation::OnStateChange(t_statechange_notifications notification, std::wstring const&, const void*)
+{
+	if (notification != STATECHANGE_REMOTE_IDLE || !m_listing || !state_.IsRemoteIdle()) {
+		return;
+	}
+	m_listing = false;
+
+	if (!state_.engine_ || !state_.IsRemoteConnected()) {
+		if (mainFrame_.GetStatusView()) {
+			mainFrame_.GetStatusView()->AddToLog(logmsg::error, fztranslate("Synchronization failed, the connection to the server has been lost"), fz::datetime::now());
+		}
+		stop();
+		return;
+	}
+
+	StartPlanning();
+}
+
+void CSyncOperation::StartPlanning()
+{
+	// Cache lookups are safe to do from the worker, the engine locks its mutex.
+	CFileZillaEngine* engine = state_.engine_.get();
+	auto lister = [engine](CServerPath const& path, CDirectoryListing & listing) {
+		return engine->CacheLookup(path, listing) == FZ_REPLY_OK;
+	};
+
+	if (!start(m_localRoot, m_remoteRoot, m_options, std::move(lister))) {
+		stop();
+	}
+}
+
+void CSyncOperation::stop()
+{
+	if (m_listing) {
+		m_listing = false;
+		if (auto* recursiveOperation = state_.GetRemoteRecursiveOperation()) {
+			recursiveOperation->StopRecursiveOperation();
+		}
+	}
+	sync_operation::stop();
+	m_actionAfterBlocker.reset();
+	m_remoteDirsToDelete.clear();
+}
+
+void CSyncOperation::on_planned_directory()
+{
+	CallAfter(&CSyncOperation::OnPlannedDirectory);
+}
+
+void CSyncOperation::OnPlannedDirectory()
+{
+	if (!active()) {
+		return;
+	}
+
+	std::vector<directory_plan> plans;
+	bool const finished = take_plans(plans, 5000);
+
+	size_t queued{};
+	for (auto const& plan : plans) {
+		std::list<fz::native_string> localDeletions;
+		std::vector<std::wstring> remoteFileDeletions;
+		recursion_root remoteDirDeletions(plan.remotePath, false);
+
+		for (auto const& a : plan.actions) {
+			std::wstring const& target = a.target.empty() ? a.name : a.target;
+			switch (a.type) {
+			case action_type::upload:
+				m_pQueue->QueueFile(!m_immediate, false, a.name, target, plan.localPath, plan.remotePath, site_, a.size);
+				++queued;
+				break;
+			case action_type::download:
+				m_pQueue->QueueFile(!m_immediate, true, a.name, target, plan.localPath, plan.remotePath, site_, a.size);
+				++queued;
+				break;
+			case action_type::delete_local:
+				localDeletions.push_back(fz::to_native(plan.localPath.GetPath() + a.name));
+				++m_deletions;
+				break;
+			case action_type::delete_remote:
+				if (a.dir) {
+					remoteDirDeletions.add_dir_to_visit(plan.remotePath, a.name, CLocalPath(), true);
+				}
+				else {
+					remoteFileDeletions.push_back(a.name);
+				}
+				++m_deletions;
+				break;
+			}
+		}
+
+		if (!localDeletions.empty()) {
+			// Already confirmed when the synchronization was started
+			gui_recursive_remove rmd(nullptr);
+			rmd.remove(localDeletions);
+		}
+		if (!remoteFileDeletions.empty()) {
+			state_.m_pCommandQueue->ProcessCommand(new CDeleteCommand(plan.remotePath, std::move(remoteFileDeletions)));
+		}
+		if (!remoteDirDeletions.empty()) {
+			m_remoteDirsToDelete.push_back(std::move(remoteDirDeletions));
+		}
+	}
+
+	if (queued) {
+		m_pQueue->QueueFile_Finish(m_immediate);
+	}
+
+	if (finished) {
+		std::wstring const failed = failed_directory();
+		if (!failed.empty()) {
+			if (mainFrame_.GetStatusView()) {
+				mainFrame_.GetStatusView()->AddToLog(logmsg::error, fz::sprintf(fztranslate("Synchronization failed, could not list \"%s\""), failed), fz::datetime::now());
+			}
+			stop();
+			return;
+		}
+
+		auto const s = get_stats();
+		if (mainFrame_.GetStatusView()) {
+			mainFrame_.GetStatusView()->AddToLog(logmsg::status, fz::sprintf(fztranslate("Synchronization planned: %d directories and %d entries compared in %d ms (%d entries per second), %d actions"),
+				s.directories, s.entries, s.elapsed.get_milliseconds(), s.entries_per_second(), s.actions), fz::datetime::now());
+			if (s.unreadable_directories) {
+				mainFrame_.GetStatusView()->AddToLog(logmsg::error, fz::sprintf(fztranslate("%d local directories could not be listed and were skipped"), s.unreadable_directories), fz::datetime::now());
+			}
+			if (s.conflicts) {
+				mainFrame_.GetStatusView()->AddToLog(logmsg::error, fz::sprintf(fztranslate("%d entries are a file on one side and a directory on the other and were skipped"), s.conflicts), fz::datetime::now());
+			}
+			if (m_deletions) {
+				mainFrame_.GetStatusView()->AddToLog(logmsg::status, fz::sprintf(fztranslate("%d files and directories scheduled for deletion"), m_deletions), fz::datetime::now());
+			}
+		}
+
+		auto remoteDirs = std::move(m_remoteDirsToDelete);
+		stop();
+
+		if (!remoteDirs.empty()) {
+			auto* recursiveOperation = state_.GetRemoteRecursiveOperation();
+			if (recursiveOperation && state_.IsRemoteConnected()) {
+				for (auto & root : remoteDirs) {
+					recursiveOperation->AddRecursionRoot(std::move(root));
+				}
+				recursiveOperation->StartRecursiveOperation(recursive_operation::recursive_delete, m_options.filters);
+			}
+		}
+	}
+	else if (!plans.empty()) {
+		// More may be waiting, the worker only notifies if the queue was empty
+		CallAfter(&CSyncOperation::OnPlannedDirectory);
+	}
+}
@@ -0,0 +1,55 @@
+#ifndef FILEZILLA_INTERFACE_SYNC_OPERATION_HEADER
+#define FILEZILLA_INTERFACE_SYNC_OPERATION_HEADER
+
+#include "state.h"
+#include "../commonui/remote_recursive_operation.h"
+#include "../commonui/sync_operation.h"
+
+class CActionAfterBlocker;
+class CMainFrame;
+class CQueueView;
+
+// Synchronizes the current local and remote directories by adding the
+// required transfers to the queue. In mirror mode, entries missing on the
+// source side get deleted on the target side.
+//
+// The remote tree is listed by the remote recursive operation first, so that
+// planning finds every remote directory in the cache.
+class CSyncOperation final : public sync_operation, public wxEvtHandler, public CStateEventHandler
+{
+public:
+	CSyncOperation(CState& state, CMainFrame& mainFrame);
+	virtual ~CSyncOperation();
+
+	void SetQueue(CQueueView* pQueue) { m_pQueue = pQueue; }
+
+	bool StartSync(options const& o, bool immediate = true);
+	void stop() override;
+
+	bool Busy() const { return m_listing || active(); }
+
+protected:
+	void on_planned_directory() override;
+	void OnStateChange(t_statechange_notifications notification, std::wstring const&, const void*) override;
+
+	void StartPlanning();
+	void OnPlannedDirectory();
+
+	bool m_immediate{true};
+	CState& state_;
+	CMainFrame& mainFrame_;
+	CQueueView* m_pQueue{};
+	Site site_;
+	std::shared_ptr<CActionAfterBlocker> m_actionAfterBlocker;
+
+	options m_options;
+	CLocalPath m_localRoot;
+	CServerPath m_remoteRoot;
+	bool m_listing{};
+
+	// Remote directories get deleted by the remote recursive operation once planning has finished
+	std::vector<recursion_root> m_remoteDirsToDelete;
+	uint64_t m_deletions{};
+};
+
+#endif
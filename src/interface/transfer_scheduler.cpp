@@ -0,0 +1,177 @@
+#include "filezilla.h"
+#include "transfer_scheduler.h"
+
+#include <algorithm>
+
+namespace {
+// Virtual time a transfer costs at weight 1
+int64_t const transfer_cost = 1 << 20;
+}
+
+bool CTransferScheduler::entry::operator<(entry const& op) const
+{
+	if (priority != op.priority) {
+		return priority > op.priority;
+	}
+	if (virtual_time != op.virtual_time) {
+		return virtual_time < op.virtual_time;
+	}
+	return seq < op.seq;
+}
+
+void CTransferScheduler::Insert(CServerItem* server, server_state & state)
+{
+	state.it_ = ready_.insert(entry{state.priority_, state.virtual_time_, ++seq_, server}).first;
+	state.where_ = where::ready;
+}
+
+void CTransferScheduler::Erase(server_state & state)
+{
+	if (state.where_ == where::ready) {
+		ready_.erase(state.it_);
+		state.it_ = ready_.end();
+	}
+	state.where_ = where::idle;
+}
+
+void CTransferScheduler::Ready(CServerItem* server, QueuePriority priority)
+{
+	auto & state = servers_[server];
+	if (state.where_ == where::ready) {
+		if (priority > state.priority_) {
+			Erase(state);
+			state.priority_ = priority;
+			Insert(server, state);
+		}
+		return;
+	}
+
+	if (state.where_ == where::parked) {
+		state.priority_ = std::max(state.priority_, priority);
+	}
+	else {
+		state.priority_ = priority;
+	}
+	state.virtual_time_ = std::max(state.virtual_time_, virtual_clock_);
+	state.ready_since_ = fz::monotonic_clock::now();
+	Insert(server, state);
+}
+
+void CTransferScheduler::Update(CServerItem* server, QueuePriority priority)
+{
+	auto it = servers_.find(server);
+	if (it == servers_.end() || it->second.where_ != where::ready || it->second.priority_ == priority) {
+		return;
+	}
+
+	Erase(it->second);
+	it->second.priority_ = priority;
+	Insert(server, it->second);
+}
+
+void CTransferScheduler::Idle(CServerItem* server)
+{
+	auto it = servers_.find(server);
+	if (it != servers_.end()) {
+		Erase(it->second);
+	}
+}
+
+void CTransferScheduler::Park(CServerItem* server, wait_reason reason)
+{
+	auto it = servers_.find(server);
+	if (it == servers_.end()) {
+		return;
+	}
+
+	Erase(it->second);
+	it->second.where_ = where::parked;
+	it->second.reason_ = reason;
+	parked_[static_cast<int>(reason)].push_back(server);
+}
+
+void CTransferScheduler::Unpark(wait_reason reason)
+{
+	auto parked = std::move(parked_[static_cast<int>(reason)]);
+	parked_[static_cast<int>(reason)].clear();
+
+	for (auto * server : parked) {
+		auto it = servers_.find(server);
+		if (it == servers_.end() || it->second.where_ != where::parked || it->second.reason_ != reason) {
+			// Got readied or parked for another reason in the meantime
+			continue;
+		}
+		Ready(server, it->second.priority_);
+	}
+}
+
+void CTransferScheduler::Remove(CServerItem* server)
+{
+	auto it = servers_.find(server);
+	if (it == servers_.end()) {
+		return;
+	}
+
+	if (it->second.where_ == where::parked) {
+		auto & parked = parked_[static_cast<int>(it->second.reason_)];
+		parked.erase(std::remove(parked.begin(), parked.end(), server), parked.end());
+	}
+	Erase(it->second);
+	servers_.erase(it);
+}
+
+void CTransferScheduler::Clear()
+{
+	ready_.clear();
+	for (auto & parked : parked_) {
+		parked.clear();
+	}
+	for (auto & server : servers_) {
+		server.second.where_ = where::idle;
+		server.second.it_ = ready_.end();
+	}
+}
+
+CServerItem* CTransferScheduler::Top() const
+{
+	if (ready_.empty()) {
+		return nullptr;
+	}
+	return ready_.begin()->server;
+}
+
+QueuePriority CTransferScheduler::TopPriority() const
+{
+	if (ready_.empty()) {
+		return QueuePriority::lowest;
+	}
+	return ready_.begin()->priority;
+}
+
+void CTransferScheduler::Started(CServerItem* server, int weight, fz::monotonic_clock const& passStart)
+{
+	auto it = servers_.find(server);
+	if (it == servers_.end()) {
+		return;
+	}
+	auto & state = it->second;
+
+	fz::monotonic_clock const now = fz::monotonic_clock::now();
+	if (state.where_ == where::ready) {
+		fz::duration const wait = now - state.ready_since_;
+		stats_.total_wait += wait;
+		stats_.max_wait = std::max(stats_.max_wait, wait);
+		stats_.total_selection += now - passStart;
+		++stats_.started;
+	}
+
+	virtual_clock_ = std::max(virtual_clock_, state.virtual_time_);
+	state.virtual_time_ += transfer_cost / std::max(weight, 1);
+	state.ready_since_ = now;
+
+	// Re-insert with the advanced virtual time
+	if (state.where_ == where::ready) {
+		Erase(state);
+		Insert(server, state);
+	}
+}
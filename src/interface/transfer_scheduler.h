@@ -0,0 +1,127 @@
+#ifndef FILEZILLA_INTERFACE_TRANSFER_SCHEDULER_HEADER
+#define FILEZILLA_INTERFACE_TRANSFER_SCHEDULER_HEADER
+
+#include "queue.h"
+
+#include <libfilezilla/time.hpp>
+
+#include <set>
+#include <unordered_map>
+#include <vector>
+
+/*
+ * Decides on which server the next transfer gets started.
+ *
+ * Servers that may be able to start a transfer are kept in a ready set,
+ * ordered by the highest priority of their idle items. Among servers of
+ * equal priority, transfer slots are shared in proportion to their weight
+ * using start-time fair queueing: every started transfer advances the
+ * virtual time of its server by the inverse of its weight and the server
+ * with the smallest virtual time goes next. A server with a huge backlog
+ * thus cannot starve the others.
+ *
+ * Servers that cannot start a transfer right now are parked until the
+ * resource they wait for is released, so that a scheduling pass does not
+ * have to look at all servers.
+ */
+class CTransferScheduler final
+{
+public:
+	enum class wait_reason
+	{
+		connection, // Server is at its connection limit
+		download,   // Only downloads are left but the download limit got reached
+		upload,     // Only uploads are left but the upload limit got reached
+
+		count
+	};
+
+	// Adds the server to the ready set. The priority has to be at least
+	// as high as the priority of its idle items, if the server is ready
+	// already, it keeps the higher of the two.
+	void Ready(CServerItem* server, QueuePriority priority);
+
+	// Changes the priority of a server in the ready set
+	void Update(CServerItem* server, QueuePriority priority);
+
+	// Takes a server without idle items out of the ready set
+	void Idle(CServerItem* server);
+
+	void Park(CServerItem* server, wait_reason reason);
+
+	// Returns all servers waiting for the reason to the ready set
+	void Unpark(wait_reason reason);
+
+	// Has to be called before a server item gets deleted
+	void Remove(CServerItem* server);
+
+	// Takes all servers out of the ready set, their virtual times are kept
+	void Clear();
+
+	// Returns the next server to start a transfer on, nullptr if there is none
+	CServerItem* Top() const;
+	QueuePriority TopPriority() const;
+
+	// Charges the server for a started transfer. The pass start is the
+	// time at which the search for the transfer began.
+	void Started(CServerItem* server, int weight, fz::monotonic_clock const& passStart);
+
+	struct stats final
+	{
+		int started{};
+
+		// Time servers spent in the ready set until a transfer got started
+		fz::duration total_wait;
+		fz::duration max_wait;
+
+		// Time taken to find the transfer
+		fz::duration total_selection;
+	};
+
+	stats const& GetStats() const { return stats_; }
+	void ResetStats() { stats_ = stats(); }
+
+private:
+	struct entry final
+	{
+		QueuePriority priority{};
+		int64_t virtual_time{};
+		uint64_t seq{};
+		CServerItem* server{};
+
+		bool operator<(entry const& op) const;
+	};
+
+	enum class where
+	{
+		idle,
+		ready,
+		parked
+	};
+
+	struct server_state final
+	{
+		where where_{where::idle};
+		wait_reason reason_{};
+		QueuePriority priority_{};
+		int64_t virtual_time_{};
+		fz::monotonic_clock ready_since_;
+		std::set<entry>::iterator it_;
+	};
+
+	void Insert(CServerItem* server, server_state & state);
+	void Erase(server_state & state);
+
+	std::set<entry> ready_;
+	std::unordered_map<CServerItem*, server_state> servers_;
+	std::vector<CServerItem*> parked_[static_cast<int>(wait_reason::count)];
+
+	// Start tag of the most recently started transfer. Servers joining the
+	// ready set begin at this time, they cannot claim time they were idle.
+	int64_t virtual_clock_{};
+	uint64_t seq_{};
+
+	stats stats_;
+};
+
+#endif
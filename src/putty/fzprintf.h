@@ -1,4 +1,4 @@
-#define FZSFTP_PROTOCOL_VERSION 11
+#define FZSFTP_PROTOCOL_VERSION 13
 
 typedef enum
 {
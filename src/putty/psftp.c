@@ -530,6 +530,257 @@ int sftp_put_file(char *fname, char *outfname, int restart)
     return err ? 0 : 1;
 }
 
+/*
+ * Size of the blocks compared by dput, and the number of blocks whose
+ * hashes get requested at once.
+ */
+#define DELTA_BLOCK_SIZE 65536
+#define DELTA_BLOCKS_PER_REQUEST 1024
+
+static const ssh_hashalg *check_file_hashalg(const char *name)
+{
+    if (!strcmp(name, "sha256"))
+        return &ssh_sha256;
+    if (!strcmp(name, "sha1"))
+        return &ssh_sha1;
+    if (!strcmp(name, "md5"))
+        return &ssh_md5;
+    return NULL;
+}
+
+/*
+ * Reads until the buffer is full or the end of the file is reached.
+ */
+static int read_block(RFile *file, char *buffer, int len)
+{
+    int got = 0;
+
+    while (got < len) {
+        int ret = read_from_file(file, buffer + got, len - got);
+        if (ret < 0)
+            return -1;
+        if (!ret)
+            break;
+        got += ret;
+    }
+
+    return got;
+}
+
+/*
+ * Upload a file over an existing one, only writing the blocks whose
+ * hashes differ from the ones the server reports for the remote file.
+ * Falls back to a normal upload if the server cannot hash files.
+ */
+int sftp_delta_put_file(char *fname, char *outfname)
+{
+    struct fxp_handle *fh;
+    struct fxp_xfer *xfer;
+    struct sftp_packet *pktin;
+    struct sftp_request *req;
+    struct fxp_attrs attrs;
+    RFile *file = 0;
+    const ssh_hashalg *alg = NULL;
+    unsigned char *hashes = NULL;
+    size_t hashsize = 0;
+    uint64_t hashcount = 0, remote_size = 0, offset = 0, unchanged = 0;
+    bool err = false, eof;
+    char *block = NULL;
+    int blocklen = 0, blockpos = 0;
+    long permissions;
+
+    if (!fxp_has_check_file())
+        return sftp_put_file(fname, outfname, 0);
+
+    /* check-file-handle needs read access */
+    attrs.flags = 0;
+    req = fxp_open_send(outfname,
+                        SSH_FXF_READ | SSH_FXF_WRITE | SSH_FXF_CREAT,
+                        &attrs);
+    pktin = sftp_wait_for_reply(req);
+    fh = fxp_open_recv(pktin, req);
+
+    if (!fh) {
+        fzprintf(sftpError, "%s: open for write: %s", outfname, fxp_error());
+        return 0;
+    }
+
+    req = fxp_fstat_send(fh);
+    pktin = sftp_wait_for_reply(req);
+    if (fxp_fstat_recv(pktin, req, &attrs) &&
+        (attrs.flags & SSH_FILEXFER_ATTR_SIZE)) {
+        remote_size = attrs.size;
+    }
+
+    while (offset < remote_size) {
+        char *algname;
+        unsigned char *data;
+        size_t len;
+        uint64_t length, count;
+
+        length = (uint64_t)DELTA_BLOCK_SIZE * DELTA_BLOCKS_PER_REQUEST;
+        if (length > remote_size - offset)
+            length = remote_size - offset;
+        count = (length + DELTA_BLOCK_SIZE - 1) / DELTA_BLOCK_SIZE;
+
+        req = fxp_check_file_send(fh, "sha256,sha1,md5", offset, length,
+                                  DELTA_BLOCK_SIZE);
+        pktin = sftp_wait_for_reply(req);
+        if (!fxp_check_file_recv(pktin, req, &algname, &data, &len)) {
+            fzprintf(sftpInfo, "check-file: %s", fxp_error());
+            break;
+        }
+
+        if (!alg)
+            alg = check_file_hashalg(algname);
+        if (!alg || alg != check_file_hashalg(algname) ||
+            len != count * alg->hlen) {
+            fzprintf(sftpInfo, "check-file: unusable reply using %s",
+                     algname);
+            sfree(algname);
+            sfree(data);
+            break;
+        }
+        sfree(algname);
+
+        hashes = sresize(hashes, hashsize + len, unsigned char);
+        memcpy(hashes + hashsize, data, len);
+        sfree(data);
+        hashsize += len;
+        hashcount += count;
+        offset += length;
+    }
+
+    if (!hashcount) {
+        /* Nothing to compare against, upload everything */
+        req = fxp_close_send(fh);
+        pktin = sftp_wait_for_reply(req);
+        fxp_close_recv(pktin, req);
+        sfree(hashes);
+        return sftp_put_file(fname, outfname, 0);
+    }
+
+    file = open_existing_file(fname, 0, NULL, NULL, &permissions);
+    if (!file) {
+        fzprintf(sftpError, "local: unable to open %s", fname);
+        err = true;
+        goto cleanup;
+    }
+    fzprintf(sftpInfo, "local:%s => remote:%s\n", fname, outfname);
+
+    block = snewn(DELTA_BLOCK_SIZE, char);
+    offset = 0;
+    xfer = xfer_upload_init(fh, 0);
+    eof = false;
+    while ((!err && !eof) || !xfer_done(xfer)) {
+        int len, ret;
+
+        while (xfer_upload_ready(xfer) && !err && !eof) {
+            if (blockpos == blocklen) {
+                /*
+                 * Read the next block and skip it if the server
+                 * already has it.
+                 */
+                uint64_t index = offset / DELTA_BLOCK_SIZE;
+                uint64_t remote_len = 0;
+
+                blockpos = 0;
+                blocklen = read_block(file, block, DELTA_BLOCK_SIZE);
+                if (blocklen == -1) {
+                    fzprintf(sftpError, "error while reading local file");
+                    blocklen = 0;
+                    err = true;
+                    break;
+                } else if (blocklen == 0) {
+                    eof = true;
+                    break;
+                }
+
+                if (offset < remote_size) {
+                    remote_len = remote_size - offset;
+                    if (remote_len > DELTA_BLOCK_SIZE)
+                        remote_len = DELTA_BLOCK_SIZE;
+                }
+                if (index < hashcount && remote_len == (uint64_t)blocklen) {
+                    unsigned char digest[MAX_HASH_LEN];
+                    ssh_hash *h = ssh_hash_new(alg);
+                    put_data(h, block, blocklen);
+                    ssh_hash_final(h, digest);
+                    if (!memcmp(digest, hashes + index * alg->hlen,
+                                alg->hlen)) {
+                        xfer_upload_skip(xfer, blocklen);
+                        unchanged += blocklen;
+                        blockpos = blocklen;
+                    }
+                }
+                offset += blocklen;
+                continue;
+            }
+
+            len = blocklen - blockpos;
+            if (len > 4096*4)
+                len = 4096*4;
+            xfer_upload_data(xfer, block + blockpos, len);
+            blockpos += len;
+            if (pending_receive() >= 5)
+                break;
+        }
+
+        if (toplevel_callback_pending() && !err && !eof) {
+            run_toplevel_callbacks();
+            continue;
+        }
+
+        if (!xfer_done(xfer)) {
+            pktin = sftp_recv();
+            ret = xfer_upload_gotpkt(xfer, pktin);
+            if (ret <= 0) {
+                if (ret == INT_MIN)        /* pktin not even freed */
+                    sfree(pktin);
+                if (!err) {
+                    fzprintf(sftpError, "error while writing: %s", fxp_error());
+                    err = true;
+                }
+            }
+        }
+    }
+
+    xfer_cleanup(xfer);
+
+    if (!err && offset < remote_size) {
+        /* The local file got shorter */
+        attrs.flags = SSH_FILEXFER_ATTR_SIZE;
+        attrs.size = offset;
+        req = fxp_fsetstat_send(fh, attrs);
+        pktin = sftp_wait_for_reply(req);
+        if (!fxp_fsetstat_recv(pktin, req)) {
+            fzprintf(sftpError, "truncate %s: %s", outfname, fxp_error());
+            err = true;
+        }
+    }
+
+    if (!err) {
+        fzprintf(sftpInfo, "dput: %"PRIu64" of %"PRIu64" bytes unchanged",
+                 unchanged, offset);
+    }
+
+  cleanup:
+    req = fxp_close_send(fh);
+    pktin = sftp_wait_for_reply(req);
+    if (!fxp_close_recv(pktin, req)) {
+        if (!err) {
+            fzprintf(sftpError, "error while writing: %s", fxp_error());
+            err = true;
+        }
+    }
+
+    close_rfile(file);
+    sfree(block);
+    sfree(hashes);
+
+    return err ? 0 : 1;
+}
+
 /* ----------------------------------------------------------------------
  * Actual sftp commands.
  */
@@ -854,7 +1105,7 @@ int sftp_cmd_reget(struct sftp_command *cmd)
  * differs in that it interprets all its arguments as files to
  * transfer (never as a different remote name for a local file).
  */
-int sftp_general_put(struct sftp_command *cmd, int restart)
+int sftp_general_put(struct sftp_command *cmd, int restart, bool delta)
 {
     char *fname, *origoutfname, *outfname;
     int ret;
@@ -879,17 +1130,24 @@ int sftp_general_put(struct sftp_command *cmd, int restart)
         fzprintf(sftpError, "%s: canonify: %s", origoutfname, fxp_error());
         return 0;
     }
-    ret = sftp_put_file(fname, outfname, restart);
+    if (delta)
+        ret = sftp_delta_put_file(fname, outfname);
+    else
+        ret = sftp_put_file(fname, outfname, restart);
     sfree(outfname);
     return ret;
 }
 int sftp_cmd_put(struct sftp_command *cmd)
 {
-    return sftp_general_put(cmd, false);
+    return sftp_general_put(cmd, false, false);
 }
 int sftp_cmd_reput(struct sftp_command *cmd)
 {
-    return sftp_general_put(cmd, true);
+    return sftp_general_put(cmd, true, false);
+}
+int sftp_cmd_dput(struct sftp_command *cmd)
+{
+    return sftp_general_put(cmd, false, true);
 }
 
 int sftp_cmd_mkdir(struct sftp_command *cmd)
@@ -1458,6 +1716,9 @@ static struct sftp_cmd_lookup {
     {
         "delete", sftp_cmd_rm
     },
+    {
+        "dput", sftp_cmd_dput
+    },
     {
         "exit", sftp_cmd_quit
     },
@@ -2205,6 +2466,9 @@ int psftp_main(int argc, char *argv[])
         } else if (strcmp(argv[i], "-V") == 0 ||
                    strcmp(argv[i], "--version") == 0) {
             version();
+        } else if (strcmp(argv[i], "-keepalive") == 0 && i + 1 < argc) {
+            // FZ: Seconds between SSH keepalives while the connection is idle
+            conf_set_int(conf, CONF_ping_interval, atoi(argv[++i]));
         } else if (strcmp(argv[i], "--") == 0) {
             i++;
             break;
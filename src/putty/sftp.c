@@ -17,6 +17,7 @@
 
 static const char *fxp_error_message;
 static int fxp_errtype;
+static bool fxp_check_file_ext;
 
 static void fxp_internal_error(const char *msg);
 
@@ -309,16 +310,29 @@ bool fxp_init(void)
         return false;
     }
     /*
-     * In principle, this packet might also contain extension-
-     * string pairs. We should work through them and look for any
-     * we recognise. In practice we don't currently do so because
-     * we know we don't recognise _any_.
+     * The rest of the packet consists of extension-string pairs.
+     * The only one we care about is check-file, which lets us ask
+     * the server for block hashes of a file.
      */
+    fxp_check_file_ext = false;
+    while (get_avail(pktin)) {
+        ptrlen name = get_string(pktin);
+        get_string(pktin);
+        if (get_err(pktin))
+            break;
+        if (ptrlen_eq_string(name, "check-file"))
+            fxp_check_file_ext = true;
+    }
     sftp_pkt_free(pktin);
 
     return true;
 }
 
+bool fxp_has_check_file(void)
+{
+    return fxp_check_file_ext;
+}
+
 /*
  * Canonify a pathname.
  */
@@ -684,6 +698,66 @@ bool fxp_fsetstat_recv(struct sftp_packet *pktin, struct sftp_request *req)
     return id == 1;
 }
 
+/*
+ * Ask for the hashes of the blocks of an open file, using the
+ * check-file-handle extension. The server picks the first algorithm
+ * of the comma-separated list it supports. The handle must have been
+ * opened for reading.
+ */
+struct sftp_request *fxp_check_file_send(struct fxp_handle *handle,
+                                         const char *algs, uint64_t offset,
+                                         uint64_t length,
+                                         unsigned long block_size)
+{
+    struct sftp_request *req = sftp_alloc_request();
+    struct sftp_packet *pktout;
+
+    pktout = sftp_pkt_init(SSH_FXP_EXTENDED);
+    put_uint32(pktout, req->id);
+    put_stringz(pktout, "check-file-handle");
+    put_string(pktout, handle->hstring, handle->hlen);
+    put_stringz(pktout, algs);
+    put_uint64(pktout, offset);
+    put_uint64(pktout, length);
+    put_uint32(pktout, block_size);
+    sftp_send(pktout);
+
+    return req;
+}
+
+/*
+ * On success, returns the name of the algorithm used and the
+ * concatenated hashes of the blocks, both to be freed by the caller.
+ */
+bool fxp_check_file_recv(struct sftp_packet *pktin, struct sftp_request *req,
+                         char **alg, unsigned char **hashes, size_t *len)
+{
+    sfree(req);
+    if (pktin->type == SSH_FXP_EXTENDED_REPLY) {
+        ptrlen name, algname, data;
+
+        name = get_string(pktin);
+        algname = get_string(pktin);
+        if (get_err(pktin) || !ptrlen_eq_string(name, "check-file")) {
+            fxp_internal_error("malformed check-file reply");
+            sftp_pkt_free(pktin);
+            return false;
+        }
+        data = get_data(pktin, get_avail(pktin));
+
+        *alg = mkstr(algname);
+        *len = data.len;
+        *hashes = snewn(data.len ? data.len : 1, unsigned char);
+        memcpy(*hashes, data.ptr, data.len);
+        sftp_pkt_free(pktin);
+        return true;
+    } else {
+        fxp_got_status(pktin);
+        sftp_pkt_free(pktin);
+        return false;
+    }
+}
+
 /*
  * Read from a file. Returns the number of bytes read, or -1 on an
  * error, or possibly 0 if EOF. (I'm not entirely sure whether it
@@ -1171,6 +1245,20 @@ void xfer_upload_data(struct fxp_xfer *xfer, char *buffer, int len)
 #endif
 }
 
+/*
+ * Moves past data the server already has, counting it as sent.
+ */
+void xfer_upload_skip(struct fxp_xfer *xfer, int len)
+{
+    xfer->offset += len;
+    xfer->sent_interval += len;
+    if (xfer->sent_interval >= 0x40000000 ||
+        fz_timer_check(&xfer->send_timer)) {
+        fzprintf(sftpTransfer, "%d", xfer->sent_interval);
+        xfer->sent_interval = 0;
+    }
+}
+
 /*
  * Returns INT_MIN to indicate that it didn't even get as far as
  * fxp_write_recv and hence has not freed pktin.
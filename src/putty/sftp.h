@@ -168,6 +168,11 @@ int fxp_error_type(void);
  */
 bool fxp_init(void);
 
+/*
+ * Whether the server announced the check-file extension.
+ */
+bool fxp_has_check_file(void);
+
 /*
  * Canonify a pathname. Concatenate the two given path elements
  * with a separating slash, unless the second is NULL.
@@ -243,6 +248,17 @@ struct sftp_request *fxp_fsetstat_send(struct fxp_handle *handle,
                                        struct fxp_attrs attrs);
 bool fxp_fsetstat_recv(struct sftp_packet *pktin, struct sftp_request *req);
 
+/*
+ * Get the hashes of the blocks of a file. A length of 0 means up to
+ * the end of the file.
+ */
+struct sftp_request *fxp_check_file_send(struct fxp_handle *handle,
+                                         const char *algs, uint64_t offset,
+                                         uint64_t length,
+                                         unsigned long block_size);
+bool fxp_check_file_recv(struct sftp_packet *pktin, struct sftp_request *req,
+                         char **alg, unsigned char **hashes, size_t *len);
+
 /*
  * Read from a file.
  */
@@ -306,6 +322,7 @@ bool xfer_download_data(struct fxp_xfer *xfer, void **buf, int *len);
 struct fxp_xfer *xfer_upload_init(struct fxp_handle *fh, uint64_t offset);
 bool xfer_upload_ready(struct fxp_xfer *xfer);
 void xfer_upload_data(struct fxp_xfer *xfer, char *buffer, int len);
+void xfer_upload_skip(struct fxp_xfer *xfer, int len);
 int xfer_upload_gotpkt(struct fxp_xfer *xfer, struct sftp_packet *pktin);
 
 bool xfer_done(struct fxp_xfer *xfer);
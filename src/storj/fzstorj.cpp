@@ -3,12 +3,17 @@
 #include <libfilezilla/file.hpp>
 #include <libfilezilla/format.hpp>
 #include <libfilezilla/mutex.hpp>
+#include <libfilezilla/thread.hpp>
 
 #define UPLINK_DISABLE_NAMESPACE_COMPAT
 typedef bool _Bool;
 #include <uplink/uplink.h>
 
+#include <algorithm>
 #include <memory>
+#include <vector>
+
+#include <string.h>
 
 #ifndef FZ_WINDOWS
 #include <sys/mman.h>
@@ -41,9 +46,8 @@ void fzprintf(storjEvent event, Args &&... args)
 	fflush(stdout);
 }
 
-void print_error(std::string_view fmt, UplinkError const* err)
+void print_error(std::string_view fmt, std::string_view msg)
 {
-	std::string_view msg(err->message, fz::strlen(err->message));
 	auto lines = fz::strtok_view(msg, "\r\n");
 
 	fzprintf(storjEvent::Error, fmt, lines.empty() ? std::string_view() : lines.front());
@@ -54,6 +58,130 @@ void print_error(std::string_view fmt, UplinkError const* err)
 	}
 }
 
+void print_error(std::string_view fmt, UplinkError const* err)
+{
+	print_error(fmt, std::string_view(err->message, fz::strlen(err->message)));
+}
+
+/*
+ * Staging buffers between the thread doing the network I/O of a transfer
+ * and the main thread, which exchanges buffers with the engine. That way
+ * the network is kept busy while waiting for the engine to hand out the
+ * next buffer.
+ *
+ * The producer fills slots in order, the consumer empties them in order,
+ * possibly in multiple steps. Either side can abort the transfer, which
+ * wakes up the other side.
+ */
+class transfer_ring final
+{
+public:
+	static constexpr size_t slot_count{4};
+	static constexpr size_t slot_size{256 * 1024};
+
+	transfer_ring()
+		: memory_(slot_count * slot_size)
+	{}
+
+	// Waits for a free slot of slot_size bytes, nullptr if aborted
+	uint8_t* reserve()
+	{
+		fz::scoped_lock l(mtx_);
+		while (!aborted_ && count_ == slot_count) {
+			free_cond_.wait(l);
+		}
+		if (aborted_) {
+			return nullptr;
+		}
+		return memory_.data() + ((first_ + count_) % slot_count) * slot_size;
+	}
+
+	// Passes on the reserved slot
+	void commit(size_t size)
+	{
+		fz::scoped_lock l(mtx_);
+		sizes_[(first_ + count_) % slot_count] = size;
+		++count_;
+		ready_cond_.signal(l);
+	}
+
+	// Called by the producer after the last commit
+	void finish()
+	{
+		fz::scoped_lock l(mtx_);
+		finished_ = true;
+		ready_cond_.signal(l);
+	}
+
+	// Waits for data, false once everything got consumed or if aborted
+	bool peek(uint8_t *& data, size_t & size)
+	{
+		fz::scoped_lock l(mtx_);
+		while (!aborted_ && !count_ && !finished_) {
+			ready_cond_.wait(l);
+		}
+		if (aborted_ || !count_) {
+			return false;
+		}
+		data = memory_.data() + first_ * slot_size + offset_;
+		size = sizes_[first_] - offset_;
+		return true;
+	}
+
+	void consume(size_t size)
+	{
+		fz::scoped_lock l(mtx_);
+		offset_ += size;
+		if (offset_ >= sizes_[first_]) {
+			offset_ = 0;
+			first_ = (first_ + 1) % slot_count;
+			--count_;
+			free_cond_.signal(l);
+		}
+	}
+
+	// The error is reported by the main thread once the other side is done
+	void abort(std::string const& error = std::string())
+	{
+		fz::scoped_lock l(mtx_);
+		if (!aborted_) {
+			aborted_ = true;
+			error_ = error;
+		}
+		ready_cond_.signal(l);
+		free_cond_.signal(l);
+	}
+
+	bool aborted() const
+	{
+		fz::scoped_lock l(mtx_);
+		return aborted_;
+	}
+
+	std::string error() const
+	{
+		fz::scoped_lock l(mtx_);
+		return error_;
+	}
+
+private:
+	mutable fz::mutex mtx_{false};
+
+	// Each waited on by one side only
+	fz::condition ready_cond_;
+	fz::condition free_cond_;
+
+	std::vector<uint8_t> memory_;
+	size_t sizes_[slot_count]{};
+	size_t first_{};
+	size_t count_{};
+	size_t offset_{};
+
+	bool finished_{};
+	bool aborted_{};
+	std::string error_;
+};
+
 bool getLine(std::string & line)
 {
 	line.clear();
@@ -213,18 +341,60 @@ void downloadObject(UplinkProject *project, std::string bucket, std::string cons
 
 	UplinkDownload *download = download_result.download;
 
+	transfer_ring ring;
+	fz::thread receiver;
+	bool const started = receiver.run([&]() {
+		while (uint8_t* slot = ring.reserve()) {
+			size_t size{};
+			bool eof{};
+			while (size < transfer_ring::slot_size) {
+				UplinkReadResult result = uplink_download_read(download, slot + size, transfer_ring::slot_size - size);
+				if (result.error) {
+					if (result.error->code == EOF) {
+						eof = true;
+					}
+					else {
+						ring.abort(std::string(result.error->message, fz::strlen(result.error->message)));
+					}
+					uplink_free_read_result(result);
+					break;
+				}
+
+				size += result.bytes_read;
+				uplink_free_read_result(result);
+			}
+
+			if (ring.aborted()) {
+				return;
+			}
+			if (size) {
+				ring.commit(size);
+			}
+			if (eof) {
+				ring.finish();
+				return;
+			}
+		}
+	});
+	if (!started) {
+		fzprintf(storjEvent::Error, "Could not start download thread");
+		close_and_free_download(download_result, true);
+		return;
+	}
+
 	size_t capacity{};
 	size_t written{};
 	uint8_t* buffer{};
 
+	bool engine_error{};
 	while (true) {
 		if (written == capacity) {
 			fzprintf(storjEvent::io_nextbuf, "%u", written);
 			std::string line;
 			if (!getLine(line) || line.empty() || line[0] != '-' || line[1] == '-') {
-				fzprintf(storjEvent::Error, "Could not get next buffer");
-				close_and_free_download(download_result, true);
-				return;
+				engine_error = true;
+				ring.abort();
+				break;
 			}
 			line = line.substr(1);
 			buffer = memory + fz::to_integral<uintptr_t>(next_argument(line));
@@ -232,22 +402,28 @@ void downloadObject(UplinkProject *project, std::string bucket, std::string cons
 			written = 0;
 		}
 
-		UplinkReadResult result = uplink_download_read(download, buffer + written, capacity - written);
-
-		if (result.error) {
-			if (result.error->code == EOF) {
-				uplink_free_read_result(result);
-				break;
-			}
-			print_error("download failed receiving data: %s", result.error);
-			uplink_free_read_result(result);
-			close_and_free_download(download_result, true);
-
-			return;
+		uint8_t* data{};
+		size_t size{};
+		if (!ring.peek(data, size)) {
+			break;
 		}
+		size = std::min(size, capacity - written);
+		memcpy(buffer + written, data, size);
+		written += size;
+		ring.consume(size);
+	}
 
-		written += result.bytes_read;
-		uplink_free_read_result(result);
+	receiver.join();
+
+	if (engine_error) {
+		fzprintf(storjEvent::Error, "Could not get next buffer");
+		close_and_free_download(download_result, true);
+		return;
+	}
+	if (ring.aborted()) {
+		print_error("download failed receiving data: %s", ring.error());
+		close_and_free_download(download_result, true);
+		return;
 	}
 
 	if (!close_and_free_download(download_result, false)) {
@@ -283,43 +459,77 @@ void uploadObject(UplinkProject *project, std::string const& bucket, std::string
 	UplinkUpload *upload = upload_result.upload;
 
 	if (memory) {
-		size_t remaining{};
-		uint8_t * buffer{};
-		while (true) {
-			if (!remaining) {
-				fzprintf(storjEvent::io_nextbuf, "0");
-				std::string line;
-				if (!getLine(line) || line.empty() || line[0] != '-' || line[1] == '-') {
-					fzprintf(storjEvent::Error, "Could not get next buffer");
-					uplink_free_upload_result(upload_result);
+		transfer_ring ring;
+		fz::thread sender;
+		bool const started = sender.run([&]() {
+			uint8_t* data{};
+			size_t size{};
+			while (ring.peek(data, size)) {
+				UplinkWriteResult result = uplink_upload_write(upload, data, size);
+				if (result.error) {
+					ring.abort(std::string(result.error->message, fz::strlen(result.error->message)));
+					uplink_free_write_result(result);
 					return;
 				}
-				line = line.substr(1);
-				buffer = memory + fz::to_integral<uintptr_t>(next_argument(line));
-				remaining = fz::to_integral<size_t>(next_argument(line));
-				if (!remaining) {
-					break;
+				if (!result.bytes_written) {
+					ring.abort("upload_write did not write anything");
+					uplink_free_write_result(result);
+					return;
 				}
-			}
-			UplinkWriteResult result = uplink_upload_write(upload, buffer, remaining);
 
-			if (result.error) {
-				print_error("upload failed: %s", result.error);
+				ring.consume(result.bytes_written);
+				fzprintf(storjEvent::Transfer, "%u", result.bytes_written);
 				uplink_free_write_result(result);
-				uplink_free_upload_result(upload_result);
-				return;
 			}
+		});
+		if (!started) {
+			fzprintf(storjEvent::Error, "Could not start upload thread");
+			uplink_free_upload_result(upload_result);
+			return;
+		}
 
-			if (!result.bytes_written) {
-				fzprintf(storjEvent::Error, "upload_write did not write anything");
-				uplink_free_write_result(result);
-				uplink_free_upload_result(upload_result);
-				return;
+		bool engine_error{};
+		while (!ring.aborted()) {
+			fzprintf(storjEvent::io_nextbuf, "0");
+			std::string line;
+			if (!getLine(line) || line.empty() || line[0] != '-' || line[1] == '-') {
+				engine_error = true;
+				ring.abort();
+				break;
+			}
+			line = line.substr(1);
+			uint8_t const* buffer = memory + fz::to_integral<uintptr_t>(next_argument(line));
+			size_t remaining = fz::to_integral<size_t>(next_argument(line));
+			if (!remaining) {
+				ring.finish();
+				break;
 			}
-			remaining -= result.bytes_written;
 
-			fzprintf(storjEvent::Transfer, "%u", result.bytes_written);
-			uplink_free_write_result(result);
+			// The engine reuses the buffer once the next one is requested
+			while (remaining) {
+				uint8_t* slot = ring.reserve();
+				if (!slot) {
+					break;
+				}
+				size_t const size = std::min(remaining, transfer_ring::slot_size);
+				memcpy(slot, buffer, size);
+				ring.commit(size);
+				buffer += size;
+				remaining -= size;
+			}
+		}
+
+		sender.join();
+
+		if (engine_error) {
+			fzprintf(storjEvent::Error, "Could not get next buffer");
+			uplink_free_upload_result(upload_result);
+			return;
+		}
+		if (ring.aborted()) {
+			print_error("upload failed: %s", ring.error());
+			uplink_free_upload_result(upload_result);
+			return;
 		}
 	}
 
@@ -0,0 +1,131 @@
+#include "../src/include/libfilezilla_engine.h"
+#include "../src/engine/checksum.h"
+
+#include <libfilezilla/encode.hpp>
+
+#include <cppunit/extensions/HelperMacros.h>
+
+/*
+ * This testsuite asserts that checksums get computed incrementally and
+ * that the checksums reported by servers are parsed correctly.
+ */
+
+class CChecksumTest final : public CppUnit::TestFixture
+{
+	CPPUNIT_TEST_SUITE(CChecksumTest);
+	CPPUNIT_TEST(testNames);
+	CPPUNIT_TEST(testAccumulator);
+	CPPUNIT_TEST(testFtpReply);
+	CPPUNIT_TEST(testHttpDigest);
+	CPPUNIT_TEST_SUITE_END();
+
+public:
+	void setUp() {}
+	void tearDown() {}
+
+	void testNames();
+	void testAccumulator();
+	void testFtpReply();
+	void testHttpDigest();
+
+private:
+	std::string Hex(std::vector<uint8_t> const& digest)
+	{
+		return fz::hex_encode<std::string>(digest);
+	}
+
+	std::string Compute(checksum_algorithm alg, std::string const& data, size_t step)
+	{
+		checksum_accumulator acc(alg);
+		for (size_t i = 0; i < data.size(); i += step) {
+			std::string const part = data.substr(i, step);
+			acc.update(reinterpret_cast<unsigned char const*>(part.c_str()), part.size());
+		}
+		CPPUNIT_ASSERT_EQUAL(uint64_t(data.size()), acc.size());
+		return Hex(acc.digest());
+	}
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(CChecksumTest);
+
+void CChecksumTest::testNames()
+{
+	CPPUNIT_ASSERT(checksum_from_name(L"SHA-256") == checksum_algorithm::sha256);
+	CPPUNIT_ASSERT(checksum_from_name(L"sha256") == checksum_algorithm::sha256);
+	CPPUNIT_ASSERT(checksum_from_name(L"Sha-1") == checksum_algorithm::sha1);
+	CPPUNIT_ASSERT(checksum_from_name(L"SHA-512") == checksum_algorithm::sha512);
+	CPPUNIT_ASSERT(checksum_from_name(L"MD5") == checksum_algorithm::md5);
+	CPPUNIT_ASSERT(checksum_from_name(L"crc32") == checksum_algorithm::crc32);
+	CPPUNIT_ASSERT(checksum_from_name(L"SHA-3") == checksum_algorithm::none);
+	CPPUNIT_ASSERT(checksum_from_name(L"") == checksum_algorithm::none);
+
+	CPPUNIT_ASSERT_EQUAL(std::wstring(L"SHA-256"), checksum_name(checksum_algorithm::sha256));
+	CPPUNIT_ASSERT_EQUAL(std::wstring(L"CRC32"), checksum_name(checksum_algorithm::crc32));
+}
+
+void CChecksumTest::testAccumulator()
+{
+	for (size_t step : {1, 2, 5, 1000}) {
+		CPPUNIT_ASSERT_EQUAL(std::string("cbf43926"), Compute(checksum_algorithm::crc32, "123456789", step));
+		CPPUNIT_ASSERT_EQUAL(std::string("900150983cd24fb0d6963f7d28e17f72"), Compute(checksum_algorithm::md5, "abc", step));
+		CPPUNIT_ASSERT_EQUAL(std::string("a9993e364706816aba3e25717850c26c9cd0d89d"), Compute(checksum_algorithm::sha1, "abc", step));
+		CPPUNIT_ASSERT_EQUAL(std::string("ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad"), Compute(checksum_algorithm::sha256, "abc", step));
+	}
+
+	// Leading zeroes of CRCs are kept
+	CPPUNIT_ASSERT_EQUAL(std::string("00000000"), Compute(checksum_algorithm::crc32, "", 1));
+
+	// The digest does not change once taken
+	checksum_accumulator acc(checksum_algorithm::md5);
+	acc.update(reinterpret_cast<unsigned char const*>("abc"), 3);
+	auto const digest = acc.digest();
+	acc.update(reinterpret_cast<unsigned char const*>("abc"), 3);
+	CPPUNIT_ASSERT(digest == acc.digest());
+}
+
+void CChecksumTest::testFtpReply()
+{
+	std::vector<uint8_t> digest;
+
+	CPPUNIT_ASSERT(ParseChecksumReply(L"213 SHA-256 0-2 ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad abc.txt", checksum_algorithm::sha256, digest));
+	CPPUNIT_ASSERT_EQUAL(std::string("ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad"), Hex(digest));
+
+	CPPUNIT_ASSERT(ParseChecksumReply(L"213 MD5 0-2 900150983CD24FB0D6963F7D28E17F72 abc.txt", checksum_algorithm::md5, digest));
+	CPPUNIT_ASSERT_EQUAL(std::string("900150983cd24fb0d6963f7d28e17f72"), Hex(digest));
+
+	CPPUNIT_ASSERT(ParseChecksumReply(L"250 CBF43926", checksum_algorithm::crc32, digest));
+	CPPUNIT_ASSERT_EQUAL(std::string("cbf43926"), Hex(digest));
+
+	CPPUNIT_ASSERT(ParseChecksumReply(L"250 0x1234", checksum_algorithm::crc32, digest));
+	CPPUNIT_ASSERT_EQUAL(std::string("00001234"), Hex(digest));
+
+	CPPUNIT_ASSERT(ParseChecksumReply(L"250 a9993e364706816aba3e25717850c26c9cd0d89d", checksum_algorithm::sha1, digest));
+	CPPUNIT_ASSERT_EQUAL(std::string("a9993e364706816aba3e25717850c26c9cd0d89d"), Hex(digest));
+
+	// Wrong length, errors and garbage
+	CPPUNIT_ASSERT(!ParseChecksumReply(L"250 a9993e364706816aba3e25717850c26c9cd0d89d", checksum_algorithm::sha256, digest));
+	CPPUNIT_ASSERT(!ParseChecksumReply(L"550 File not found", checksum_algorithm::md5, digest));
+	CPPUNIT_ASSERT(!ParseChecksumReply(L"213 SHA-256 0-2 zz7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad", checksum_algorithm::sha256, digest));
+	CPPUNIT_ASSERT(!ParseChecksumReply(L"213", checksum_algorithm::crc32, digest));
+}
+
+void CChecksumTest::testHttpDigest()
+{
+	std::vector<uint8_t> digest;
+
+	CPPUNIT_ASSERT(ParseHttpDigest("sha-256=:ungWv48Bz+pBQUDeXa4iI7ADYaOWF3qctBD/YfIAFa0=:", "", "", digest) == checksum_algorithm::sha256);
+	CPPUNIT_ASSERT_EQUAL(std::string("ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad"), Hex(digest));
+
+	CPPUNIT_ASSERT(ParseHttpDigest("", "MD5=kAFQmDzST7DWlj99KOF/cg==, SHA=qZk+NkcGgWq6PiVxeFDCbJzQ2J0=", "", digest) == checksum_algorithm::sha1);
+	CPPUNIT_ASSERT_EQUAL(std::string("a9993e364706816aba3e25717850c26c9cd0d89d"), Hex(digest));
+
+	CPPUNIT_ASSERT(ParseHttpDigest("", "", " kAFQmDzST7DWlj99KOF/cg== ", digest) == checksum_algorithm::md5);
+	CPPUNIT_ASSERT_EQUAL(std::string("900150983cd24fb0d6963f7d28e17f72"), Hex(digest));
+
+	// The strongest one wins
+	CPPUNIT_ASSERT(ParseHttpDigest("sha-256=:ungWv48Bz+pBQUDeXa4iI7ADYaOWF3qctBD/YfIAFa0=:", "", "kAFQmDzST7DWlj99KOF/cg==", digest) == checksum_algorithm::sha256);
+
+	// Unknown algorithms and malformed values get ignored
+	CPPUNIT_ASSERT(ParseHttpDigest("unixsum=:MTIz:", "UNIXsum=30637", "", digest) == checksum_algorithm::none);
+	CPPUNIT_ASSERT(ParseHttpDigest("sha-256=:kAFQmDzST7DWlj99KOF/cg==:", "", "not base64!", digest) == checksum_algorithm::none);
+}
@@ -24,6 +24,7 @@ class CNaturalSortTest final : public CppUnit::TestFixture
 	CPPUNIT_TEST(testSeq);
 	CPPUNIT_TEST(testPair);
 	CPPUNIT_TEST(testFractional);
+	CPPUNIT_TEST(testSortKeyEquivalence);
 	CPPUNIT_TEST_SUITE_END();
 
 public:
@@ -38,6 +39,10 @@ public:
 	void testSeq();
 	void testPair();
 	void testFractional();
+	void testSortKeyEquivalence();
+
+protected:
+	static int sign(int v) { return (v > 0) - (v < 0); }
 };
 
 CPPUNIT_TEST_SUITE_REGISTRATION(CNaturalSortTest);
@@ -141,3 +146,31 @@ void CNaturalSortTest::testFractional()
 	CPPUNIT_ASSERT(CFileListCtrlSortBase::CmpNatural(_T("1.1"), _T("1.3")) < 0);
 	CPPUNIT_ASSERT(CFileListCtrlSortBase::CmpNatural(_T("1.3"), _T("1.15")) < 0);
 }
+
+void CNaturalSortTest::testSortKeyEquivalence()
+{
+	// Comparing sort keys has to give the same results as the comparison functions.
+	// Excluded are names differing only in leading zeros of a number followed by the
+	// end of one of the names, CmpNatural is not transitive in that case.
+	std::vector<std::wstring> const names = {
+		L"", L"a", L"A", L"b", L"B", L"ab", L"aB", L"afFasFAc", L"aFfaSFaC",
+		L"0", L"1", L"2", L"3", L"02", L"10", L"15", L"17", L"25", L"021", L"2100", L"02005",
+		L"abc1xx", L"abc2xx", L"abc1bb", L"abc2aa", L"abc2", L"1abc", L"1def", L"10def",
+		L"a0", L"a1", L"a1a", L"a1b", L"a2", L"a10", L"a20",
+		L"x2-g8", L"x2-y7", L"x2-y08", L"x8-y8",
+		L"1.001", L"1.002", L"1.1", L"1.3", L"1.15",
+		L"file", L"file.txt", L"File.TXT", L"file_1.txt", L"file-2.txt", L"file 10.txt",
+		L" leading", L"~tilde", L".hidden", L"Z", L"z9", L"z10"
+	};
+
+	for (auto const& mode : { NameSortMode::case_insensitive, NameSortMode::case_sensitive, NameSortMode::natural }) {
+		auto const f = CFileListCtrlSortBase::GetCmpFunction(mode);
+		for (auto const& a : names) {
+			std::string const keyA = CFileListCtrlSortBase::MakeSortKey(a, mode);
+			for (auto const& b : names) {
+				std::string const keyB = CFileListCtrlSortBase::MakeSortKey(b, mode);
+				CPPUNIT_ASSERT_EQUAL(sign(f(a, b)), sign(CFileListCtrlSortBase::CmpSortKey(keyA, keyB)));
+			}
+		}
+	}
+}
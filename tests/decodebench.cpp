@@ -0,0 +1,195 @@
+#include "../src/engine/http/contentencoding.h"
+
+#include <libfilezilla/buffer.hpp>
+#include <libfilezilla/format.hpp>
+#include <libfilezilla/time.hpp>
+
+#include <algorithm>
+#include <iostream>
+#include <random>
+#include <string>
+
+#ifdef FZ_WINDOWS
+#include <windows.h>
+#else
+#include <sys/resource.h>
+#endif
+
+#include <zlib.h>
+
+/*
+ * Measures the cost of decoding compressed HTTP responses.
+ *
+ * Decodes a gzip-compressed WebDAV-style listing in memory, in the same steps
+ * the HTTP engine uses, until the given amount of data has been decoded.
+ * Reports the decoding rate and the CPU time per decoded and per received
+ * byte.
+ */
+
+namespace {
+void usage()
+{
+	std::cerr << "Usage: decodebench [options]\n"
+		"  --size SIZE        Amount of data to decode, with optional k, M or G\n"
+		"                     suffix, default 1G\n";
+}
+
+bool parse_size(std::string_view s, uint64_t & size)
+{
+	uint64_t mult = 1;
+	if (!s.empty()) {
+		switch (s.back()) {
+		case 'k':
+		case 'K':
+			mult = 1024;
+			break;
+		case 'm':
+		case 'M':
+			mult = 1024 * 1024;
+			break;
+		case 'g':
+		case 'G':
+			mult = 1024 * 1024 * 1024;
+			break;
+		default:
+			break;
+		}
+		if (mult != 1) {
+			s.remove_suffix(1);
+		}
+	}
+	if (s.empty()) {
+		return false;
+	}
+	size = fz::to_integral<uint64_t>(s, static_cast<uint64_t>(-1));
+	if (size == static_cast<uint64_t>(-1)) {
+		return false;
+	}
+	size *= mult;
+	return true;
+}
+
+// User plus system time of the process
+fz::duration cpu_time()
+{
+#ifdef FZ_WINDOWS
+	FILETIME creation, exit, kernel, user;
+	if (!GetProcessTimes(GetCurrentProcess(), &creation, &exit, &kernel, &user)) {
+		return fz::duration();
+	}
+	auto const to_int = [](FILETIME const& t) {
+		return (static_cast<int64_t>(t.dwHighDateTime) << 32) | t.dwLowDateTime;
+	};
+	// In 100ns intervals
+	return fz::duration::from_microseconds((to_int(kernel) + to_int(user)) / 10);
+#else
+	rusage usage{};
+	if (getrusage(RUSAGE_SELF, &usage)) {
+		return fz::duration();
+	}
+	return fz::duration::from_microseconds(
+		static_cast<int64_t>(usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1000000 +
+		usage.ru_utime.tv_usec + usage.ru_stime.tv_usec);
+#endif
+}
+
+double seconds(fz::duration const& d)
+{
+	return static_cast<double>(d.get_microseconds()) / 1000000.0;
+}
+
+// Compressed like servers typically do
+std::string gzip(std::string const& in)
+{
+	z_stream stream{};
+	if (deflateInit2(&stream, 6, Z_DEFLATED, 16 + MAX_WBITS, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+		return std::string();
+	}
+
+	std::string out(deflateBound(&stream, static_cast<uLong>(in.size())), 0);
+	stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(in.data()));
+	stream.avail_in = static_cast<uInt>(in.size());
+	stream.next_out = reinterpret_cast<Bytef*>(&out[0]);
+	stream.avail_out = static_cast<uInt>(out.size());
+	int const res = deflate(&stream, Z_FINISH);
+	out.resize(stream.total_out);
+	deflateEnd(&stream);
+
+	return res == Z_STREAM_END ? out : std::string();
+}
+
+// Decodes a compressed WebDAV-style listing over and over, in the steps
+// the HTTP engine uses
+bool run_decode(uint64_t size)
+{
+	std::mt19937 gen(42);
+	std::string text;
+	for (size_t i = 0; text.size() < 4 * 1024 * 1024; ++i) {
+		text += fz::sprintf("<d:response><d:href>/dir/file%u.dat</d:href><d:propstat><d:prop><d:getcontentlength>%u</d:getcontentlength>"
+			"<d:getlastmodified>Mon, 12 Jan 2026 %02u:%02u:%02u GMT</d:getlastmodified></d:prop></d:propstat></d:response>\n",
+			i, gen() % 100000000, gen() % 24, gen() % 60, gen() % 60);
+	}
+	std::string const compressed = gzip(text);
+	if (compressed.empty()) {
+		std::cerr << "Could not compress the test data\n";
+		return false;
+	}
+
+	size_t const step = 64 * 1024;
+	uint64_t encoded{};
+	uint64_t decoded{};
+	fz::buffer out;
+
+	auto const start = fz::monotonic_clock::now();
+	auto const cpu_start = cpu_time();
+	while (decoded < size) {
+		auto decoder = CHttpContentDecoder::create("gzip");
+		size_t pos{};
+		while (pos < compressed.size() || decoder->pending()) {
+			size_t const n = std::min(step, compressed.size() - pos);
+			unsigned char const* p = reinterpret_cast<unsigned char const*>(compressed.data()) + pos;
+			size_t len = n;
+			if (!decoder->decode(p, len, out, step)) {
+				std::cerr << "Could not decode the test data\n";
+				return false;
+			}
+			pos += n - len;
+			out.clear();
+		}
+		if (!decoder->finished() || decoder->decoded() != text.size()) {
+			std::cerr << "Decoded data is incomplete\n";
+			return false;
+		}
+		encoded += decoder->encoded();
+		decoded += decoder->decoded();
+	}
+	auto const time = fz::monotonic_clock::now() - start;
+	auto const cpu = cpu_time() - cpu_start;
+
+	double const decode_seconds = std::max(seconds(time), 0.000001);
+	std::cout << fz::sprintf("Decoding of %.1f MB gzip into %.1f MB, ratio %.1f, in %.3f s\n",
+		static_cast<double>(encoded) / 1000000.0, static_cast<double>(decoded) / 1000000.0,
+		static_cast<double>(decoded) / static_cast<double>(encoded), decode_seconds);
+	std::cout << fz::sprintf("  %.1f MB/s decoded, CPU %.3f s, %.2f ns per decoded byte, %.2f ns per received byte\n",
+		static_cast<double>(decoded) / 1000000.0 / decode_seconds, seconds(cpu),
+		static_cast<double>(cpu.get_microseconds()) * 1000.0 / static_cast<double>(decoded),
+		static_cast<double>(cpu.get_microseconds()) * 1000.0 / static_cast<double>(encoded));
+
+	return true;
+}
+}
+
+int main(int argc, char* argv[])
+{
+	uint64_t size = 1024 * 1024 * 1024;
+	for (int i = 1; i < argc; ++i) {
+		std::string const arg = argv[i];
+		if (arg == "--size" && i + 1 < argc && parse_size(argv[++i], size) && size) {
+			continue;
+		}
+		usage();
+		return 1;
+	}
+
+	return run_decode(size) ? 0 : 1;
+}
@@ -0,0 +1,113 @@
+#include "../src/include/libfilezilla_engine.h"
+#include "../src/engine/directorycache.h"
+
+#include <cppunit/extensions/HelperMacros.h>
+
+/*
+ * This testsuite asserts that the directory cache records the changes it
+ * makes to cached listings.
+ */
+
+class CDirectoryCacheTest final : public CppUnit::TestFixture
+{
+	CPPUNIT_TEST_SUITE(CDirectoryCacheTest);
+	CPPUNIT_TEST(testChanges);
+	CPPUNIT_TEST(testChangesLost);
+	CPPUNIT_TEST_SUITE_END();
+
+public:
+	void setUp();
+	void tearDown() {}
+
+	void testChanges();
+	void testChangesLost();
+
+protected:
+	CServer server_;
+	CServerPath path_;
+	CDirectoryCache cache_;
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(CDirectoryCacheTest);
+
+void CDirectoryCacheTest::setUp()
+{
+	server_ = CServer(FTP, DEFAULT, L"localhost", 21);
+	path_ = CServerPath(L"/foo");
+
+	std::vector<fz::shared_value<CDirentry>> entries;
+	for (auto const& name : { L"a", L"b", L"c" }) {
+		CDirentry entry;
+		entry.name = name;
+		entry.size = 1;
+		entries.emplace_back(std::move(entry));
+	}
+
+	CDirectoryListing listing;
+	listing.path = path_;
+	listing.m_firstListTime = fz::monotonic_clock::now();
+	listing.Assign(std::move(entries));
+	cache_.Store(listing, server_);
+}
+
+void CDirectoryCacheTest::testChanges()
+{
+	CDirectoryListing before;
+	bool outdated{};
+	CPPUNIT_ASSERT(cache_.Lookup(before, server_, path_, true, outdated));
+
+	cache_.UpdateFile(server_, path_, L"d", true, CDirectoryCache::file, 5);
+	cache_.RemoveFile(server_, path_, L"b");
+	cache_.Rename(server_, path_, L"a", path_, L"e");
+	cache_.UpdateFile(server_, path_, L"sub", true, CDirectoryCache::dir);
+
+	CDirectoryListing after;
+	CPPUNIT_ASSERT(cache_.Lookup(after, server_, path_, true, outdated));
+	CPPUNIT_ASSERT_EQUAL(before.revision() + 4, after.revision());
+
+	std::vector<CDirectoryListing::change> changes;
+	CPPUNIT_ASSERT(after.GetChanges(before.revision(), changes));
+	CPPUNIT_ASSERT_EQUAL(size_t(4), changes.size());
+
+	CPPUNIT_ASSERT(changes[0].type == CDirectoryListing::change_type::added);
+	CPPUNIT_ASSERT_EQUAL(size_t(3), changes[0].index);
+	CPPUNIT_ASSERT(changes[0].name == L"d");
+
+	CPPUNIT_ASSERT(changes[1].type == CDirectoryListing::change_type::removed);
+	CPPUNIT_ASSERT_EQUAL(size_t(1), changes[1].index);
+	CPPUNIT_ASSERT(changes[1].name == L"b");
+
+	CPPUNIT_ASSERT(changes[2].type == CDirectoryListing::change_type::modified);
+	CPPUNIT_ASSERT_EQUAL(size_t(0), changes[2].index);
+	CPPUNIT_ASSERT(changes[2].name == L"e");
+
+	CPPUNIT_ASSERT(changes[3].type == CDirectoryListing::change_type::added);
+	CPPUNIT_ASSERT(changes[3].dir);
+	CPPUNIT_ASSERT(changes[3].name == L"sub");
+
+	// Nothing changed since
+	CPPUNIT_ASSERT(after.GetChanges(after.revision(), changes));
+	CPPUNIT_ASSERT(changes.empty());
+
+	// Unrelated revision
+	CPPUNIT_ASSERT(!before.GetChanges(after.revision(), changes));
+}
+
+void CDirectoryCacheTest::testChangesLost()
+{
+	CDirectoryListing before;
+	bool outdated{};
+	CPPUNIT_ASSERT(cache_.Lookup(before, server_, path_, true, outdated));
+
+	for (int i = 0; i < 5000; ++i) {
+		cache_.UpdateFile(server_, path_, L"a", false, CDirectoryCache::file);
+	}
+
+	CDirectoryListing after;
+	CPPUNIT_ASSERT(cache_.Lookup(after, server_, path_, true, outdated));
+
+	std::vector<CDirectoryListing::change> changes;
+	CPPUNIT_ASSERT(!after.GetChanges(before.revision(), changes));
+	CPPUNIT_ASSERT(after.GetChanges(after.revision() - 1, changes));
+	CPPUNIT_ASSERT_EQUAL(size_t(1), changes.size());
+}
@@ -0,0 +1,661 @@
+#include "../src/include/libfilezilla_engine.h"
+#include "../src/include/engine_context.h"
+#include "../src/include/engine_options.h"
+#include "../src/include/reader.h"
+#include "../src/include/writer.h"
+
+#include "loopback_server.h"
+
+#include <libfilezilla/buffer.hpp>
+#include <libfilezilla/file.hpp>
+#include <libfilezilla/format.hpp>
+#include <libfilezilla/local_filesys.hpp>
+#include <libfilezilla/time.hpp>
+
+#include <condition_variable>
+#include <iostream>
+#include <mutex>
+#include <random>
+#include <set>
+
+#ifdef FZ_WINDOWS
+#include <windows.h>
+#else
+#include <sys/resource.h>
+#endif
+
+/*
+ * End-to-end throughput benchmark of the engine.
+ *
+ * Transfers a set of files with a configurable size distribution from or to
+ * an in-process loopback FTP(S) server using a number of parallel engines,
+ * then repeatedly lists a large directory. Local files get accessed either
+ * by the threaded readers and writers or through memory mappings. Reports data and file rates,
+ * listing entries per second and the CPU time spent per transferred byte.
+ *
+ * Without TLS, files get sent and received without copying them through the
+ * engine's buffers on Linux, compare with --no-zero-copy.
+ *
+ * The CPU time includes the loopback server, which shares the process.
+ */
+
+namespace {
+struct settings
+{
+	size_t files{200};
+	std::vector<std::pair<uint64_t, unsigned int>> sizes{{4 * 1024, 70}, {1024 * 1024, 25}, {64 * 1024 * 1024, 5}};
+	size_t parallel{4};
+	size_t listing_entries{100000};
+	size_t listings{5};
+	bool upload{};
+	bool tls{};
+	bool memory{};
+	bool from_files{};
+	bool mmap{};
+	bool zero_copy{true};
+	std::wstring dir;
+	std::wstring trace;
+	bool verbose{};
+};
+
+void usage()
+{
+	std::cerr << "Usage: enginebench [options]\n"
+		"  --files N          Number of files to transfer, default 200\n"
+		"  --sizes SPEC       Comma-separated size:weight pairs with optional k, M or G\n"
+		"                     suffix, default 4k:70,1M:25,64M:5\n"
+		"  --parallel N       Number of parallel engines, default 4\n"
+		"  --list-entries N   Entries in the listed directory, default 100000\n"
+		"  --listings N       Number of times the directory gets listed, default 5\n"
+		"  --upload           Upload instead of download\n"
+		"  --tls              Use explicit FTP over TLS\n"
+		"  --memory           Download into memory instead of files\n"
+		"  --from-files       Upload from local files instead of memory\n"
+		"  --mmap             Access local files through memory mappings instead of\n"
+		"                     reading and writing them in worker threads\n"
+		"  --no-zero-copy     Pass plain FTP data through the buffers instead of\n"
+		"                     using sendfile and splice where available\n"
+		"  --dir PATH         Directory for downloaded files, default the current directory\n"
+		"  --trace FILE       Save a performance trace of the run as Chrome trace JSON\n"
+		"  --verbose          Print engine errors\n";
+}
+
+bool parse_size(std::string_view s, uint64_t & size)
+{
+	uint64_t mult = 1;
+	if (!s.empty()) {
+		switch (s.back()) {
+		case 'k':
+		case 'K':
+			mult = 1024;
+			break;
+		case 'm':
+		case 'M':
+			mult = 1024 * 1024;
+			break;
+		case 'g':
+		case 'G':
+			mult = 1024 * 1024 * 1024;
+			break;
+		default:
+			break;
+		}
+		if (mult != 1) {
+			s.remove_suffix(1);
+		}
+	}
+	if (s.empty()) {
+		return false;
+	}
+	size = fz::to_integral<uint64_t>(s, static_cast<uint64_t>(-1));
+	if (size == static_cast<uint64_t>(-1)) {
+		return false;
+	}
+	size *= mult;
+	return true;
+}
+
+bool parse_sizes(std::string const& spec, settings & s)
+{
+	s.sizes.clear();
+	for (auto const& token : fz::strtok_view(spec, ",")) {
+		auto pos = token.find(':');
+		uint64_t size{};
+		if (!parse_size(token.substr(0, pos), size)) {
+			return false;
+		}
+		unsigned int weight = 1;
+		if (pos != std::string_view::npos) {
+			weight = fz::to_integral<unsigned int>(token.substr(pos + 1));
+		}
+		if (weight) {
+			s.sizes.emplace_back(size, weight);
+		}
+	}
+	return !s.sizes.empty();
+}
+
+bool parse_args(int argc, char* argv[], settings & s)
+{
+	for (int i = 1; i < argc; ++i) {
+		std::string const arg = argv[i];
+		bool const has_value = i + 1 < argc;
+		if (arg == "--upload") {
+			s.upload = true;
+		}
+		else if (arg == "--tls") {
+			s.tls = true;
+		}
+		else if (arg == "--memory") {
+			s.memory = true;
+		}
+		else if (arg == "--from-files") {
+			s.from_files = true;
+		}
+		else if (arg == "--mmap") {
+			s.mmap = true;
+		}
+		else if (arg == "--no-zero-copy") {
+			s.zero_copy = false;
+		}
+		else if (arg == "--verbose") {
+			s.verbose = true;
+		}
+		else if (!has_value) {
+			return false;
+		}
+		else if (arg == "--files") {
+			s.files = fz::to_integral<size_t>(argv[++i]);
+		}
+		else if (arg == "--sizes") {
+			if (!parse_sizes(argv[++i], s)) {
+				return false;
+			}
+		}
+		else if (arg == "--parallel") {
+			s.parallel = fz::to_integral<size_t>(argv[++i]);
+			if (!s.parallel) {
+				return false;
+			}
+		}
+		else if (arg == "--list-entries") {
+			s.listing_entries = fz::to_integral<size_t>(argv[++i]);
+		}
+		else if (arg == "--listings") {
+			s.listings = fz::to_integral<size_t>(argv[++i]);
+		}
+		else if (arg == "--dir") {
+			s.dir = fz::to_wstring(std::string(argv[++i]));
+		}
+		else if (arg == "--trace") {
+			s.trace = fz::to_wstring(std::string(argv[++i]));
+		}
+		else {
+			return false;
+		}
+	}
+	return true;
+}
+
+// Deterministic, so that runs can be compared
+std::vector<uint64_t> plan_files(settings const& s)
+{
+	std::vector<unsigned int> weights;
+	for (auto const& size : s.sizes) {
+		weights.push_back(size.second);
+	}
+
+	std::mt19937 gen(42);
+	std::discrete_distribution<size_t> dist(weights.begin(), weights.end());
+
+	std::vector<uint64_t> ret;
+	ret.reserve(s.files);
+	for (size_t i = 0; i < s.files; ++i) {
+		ret.push_back(s.sizes[dist(gen)].first);
+	}
+	return ret;
+}
+
+// User plus system time of the process
+fz::duration cpu_time()
+{
+#ifdef FZ_WINDOWS
+	FILETIME creation, exit, kernel, user;
+	if (!GetProcessTimes(GetCurrentProcess(), &creation, &exit, &kernel, &user)) {
+		return fz::duration();
+	}
+	auto const to_int = [](FILETIME const& t) {
+		return (static_cast<int64_t>(t.dwHighDateTime) << 32) | t.dwLowDateTime;
+	};
+	// In 100ns intervals
+	return fz::duration::from_microseconds((to_int(kernel) + to_int(user)) / 10);
+#else
+	rusage usage{};
+	if (getrusage(RUSAGE_SELF, &usage)) {
+		return fz::duration();
+	}
+	return fz::duration::from_microseconds(
+		static_cast<int64_t>(usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1000000 +
+		usage.ru_utime.tv_usec + usage.ru_stime.tv_usec);
+#endif
+}
+
+double seconds(fz::duration const& d)
+{
+	return static_cast<double>(d.get_microseconds()) / 1000000.0;
+}
+
+class bench_options final : public COptionsBase
+{
+public:
+	bench_options()
+	{
+		fz::scoped_write_lock l(mtx_);
+		add_missing(l);
+	}
+
+	virtual void notify_changed() override {}
+};
+
+class converter final : public CustomEncodingConverterBase
+{
+public:
+	virtual std::wstring toLocal(std::wstring const&, char const* buffer, size_t len) const override
+	{
+		return fz::to_wstring(std::string(buffer, len));
+	}
+
+	virtual std::string toServer(std::wstring const&, wchar_t const* buffer, size_t len) const override
+	{
+		return fz::to_string(std::wstring(buffer, len));
+	}
+};
+
+class bench final
+{
+public:
+	bench(settings const& s, CFileZillaEngineContext & context, unsigned int port, std::vector<uint64_t> const& files)
+		: s_(s)
+		, context_(context)
+		, files_(files)
+		, server_(s.tls ? FTPES : INSECURE_FTP, DEFAULT, L"127.0.0.1", port)
+	{
+		server_.SetUser(L"bench");
+		credentials_.logonType_ = LogonType::normal;
+		credentials_.SetPass(L"bench");
+
+		if (s_.upload) {
+			uint64_t max{};
+			for (auto const& size : files_) {
+				max = std::max(max, size);
+			}
+			upload_data_.assign(static_cast<size_t>(max), 'x');
+		}
+	}
+
+	~bench()
+	{
+		for (auto const& size : upload_files_) {
+			fz::remove_file(fz::to_native(upload_file(size)));
+		}
+	}
+
+	bool run();
+
+private:
+	struct worker
+	{
+		std::unique_ptr<CFileZillaEngine> engine_;
+		bool connected_{};
+		bool busy_{};
+		size_t file_{};
+		fz::buffer buffer_;
+	};
+
+	void wakeup();
+	bool process(worker & w);
+	void on_operation(worker & w, COperationNotification const& n);
+	void on_async_request(worker & w, std::unique_ptr<CAsyncRequestNotification> && n);
+	void execute(worker & w, CCommand const& cmd);
+	void next(worker & w);
+
+	std::wstring local_file(size_t file) const;
+
+	// One local file per size to upload from
+	std::wstring upload_file(uint64_t size) const;
+	bool create_upload_files();
+
+	settings const& s_;
+	CFileZillaEngineContext & context_;
+	std::vector<uint64_t> const& files_;
+
+	CServer server_;
+	Credentials credentials_;
+	std::string upload_data_;
+	std::set<uint64_t> upload_files_;
+
+	std::vector<std::unique_ptr<worker>> workers_;
+
+	std::mutex mutex_;
+	std::condition_variable cond_;
+	bool signalled_{};
+
+	size_t next_file_{};
+	size_t listings_done_{};
+	bool listing_phase_{};
+
+	size_t succeeded_{};
+	size_t failed_{};
+	uint64_t bytes_{};
+};
+
+void bench::wakeup()
+{
+	std::lock_guard<std::mutex> l(mutex_);
+	signalled_ = true;
+	cond_.notify_one();
+}
+
+std::wstring bench::local_file(size_t file) const
+{
+	std::wstring ret = s_.dir;
+	if (!ret.empty() && ret.back() != '/' && ret.back() != '\\') {
+		ret += '/';
+	}
+	return ret + L"enginebench_" + loopback_server::file_name(file, files_[file]);
+}
+
+std::wstring bench::upload_file(uint64_t size) const
+{
+	std::wstring ret = s_.dir;
+	if (!ret.empty() && ret.back() != '/' && ret.back() != '\\') {
+		ret += '/';
+	}
+	return ret + fz::sprintf(L"enginebench_upload_%u", size);
+}
+
+bool bench::create_upload_files()
+{
+	for (auto const& size : files_) {
+		if (!upload_files_.insert(size).second) {
+			continue;
+		}
+
+		fz::file f(fz::to_native(upload_file(size)), fz::file::writing, fz::file::empty);
+		if (!f.opened()) {
+			return false;
+		}
+		for (uint64_t written = 0; written < size;) {
+			size_t const chunk = static_cast<size_t>(std::min(size - written, static_cast<uint64_t>(upload_data_.size())));
+			if (f.write(upload_data_.data(), static_cast<int64_t>(chunk)) != static_cast<int64_t>(chunk)) {
+				return false;
+			}
+			written += chunk;
+		}
+	}
+	return true;
+}
+
+void bench::execute(worker & w, CCommand const& cmd)
+{
+	w.busy_ = true;
+	int res = w.engine_->Execute(cmd);
+	if (res != FZ_REPLY_WOULDBLOCK) {
+		on_operation(w, COperationNotification(res, cmd.GetId()));
+	}
+}
+
+void bench::next(worker & w)
+{
+	if (!listing_phase_) {
+		if (next_file_ < files_.size()) {
+			w.file_ = next_file_++;
+			std::wstring const name = loopback_server::file_name(w.file_, files_[w.file_]);
+			if (s_.upload && s_.from_files) {
+				std::wstring const file = upload_file(files_[w.file_]);
+				reader_factory_holder reader = s_.mmap ? reader_factory_holder(mmap_reader_factory(file)) : reader_factory_holder(file_reader_factory(file));
+				execute(w, CFileTransferCommand(reader, CServerPath(L"/upload"), name, transfer_flags::none));
+			}
+			else if (s_.upload) {
+				std::string_view data(upload_data_.data(), static_cast<size_t>(files_[w.file_]));
+				execute(w, CFileTransferCommand(reader_factory_holder(memory_reader_factory(name, data)), CServerPath(L"/upload"), name, transfer_flags::none));
+			}
+			else if (s_.memory) {
+				w.buffer_.clear();
+				execute(w, CFileTransferCommand(writer_factory_holder(memory_writer_factory(name, w.buffer_)), CServerPath(L"/files"), name, transfer_flags::download));
+			}
+			else {
+				writer_factory_holder writer = s_.mmap ? writer_factory_holder(mmap_writer_factory(local_file(w.file_))) : writer_factory_holder(file_writer_factory(local_file(w.file_)));
+				execute(w, CFileTransferCommand(writer, CServerPath(L"/files"), name, transfer_flags::download));
+			}
+		}
+		return;
+	}
+
+	// Listings are done sequentially by the first engine
+	if (&w == workers_.front().get() && listings_done_ < s_.listings) {
+		execute(w, CListCommand(CServerPath(L"/list"), std::wstring(), LIST_FLAG_REFRESH));
+	}
+}
+
+void bench::on_operation(worker & w, COperationNotification const& n)
+{
+	w.busy_ = false;
+
+	if (n.commandId_ == Command::connect) {
+		if (n.replyCode_ != FZ_REPLY_OK) {
+			std::cerr << "Could not connect to the loopback server\n";
+			return;
+		}
+		w.connected_ = true;
+	}
+	else if (n.commandId_ == Command::transfer) {
+		if (n.replyCode_ == FZ_REPLY_OK) {
+			++succeeded_;
+			bytes_ += files_[w.file_];
+			if (!s_.upload && !s_.memory) {
+				fz::remove_file(fz::to_native(local_file(w.file_)));
+			}
+		}
+		else {
+			++failed_;
+		}
+	}
+	else if (n.commandId_ == Command::list) {
+		++listings_done_;
+		if (n.replyCode_ != FZ_REPLY_OK) {
+			std::cerr << "Listing failed\n";
+		}
+	}
+
+	next(w);
+}
+
+void bench::on_async_request(worker & w, std::unique_ptr<CAsyncRequestNotification> && n)
+{
+	switch (n->GetRequestID()) {
+	case reqId_fileexists:
+		static_cast<CFileExistsNotification&>(*n).overwriteAction = CFileExistsNotification::overwrite;
+		break;
+	case reqId_certificate:
+		static_cast<CCertificateNotification&>(*n).trusted_ = true;
+		break;
+	case reqId_insecure_connection:
+		static_cast<CInsecureConnectionNotification&>(*n).allow_ = true;
+		break;
+	case reqId_tls_no_resumption:
+		static_cast<FtpTlsNoResumptionNotification&>(*n).allow_ = true;
+		break;
+	default:
+		break;
+	}
+	w.engine_->SetAsyncRequestReply(std::move(n));
+}
+
+bool bench::process(worker & w)
+{
+	std::vector<std::unique_ptr<CNotification>> notifications;
+	if (!w.engine_->GetNotifications(notifications)) {
+		return false;
+	}
+
+	for (auto & notification : notifications) {
+		if (!notification) {
+			continue;
+		}
+		switch (notification->GetID()) {
+		case nId_operation:
+			on_operation(w, static_cast<COperationNotification const&>(*notification));
+			break;
+		case nId_asyncrequest:
+			on_async_request(w, std::unique_ptr<CAsyncRequestNotification>(static_cast<CAsyncRequestNotification*>(notification.release())));
+			break;
+		case nId_logmsg:
+			if (s_.verbose) {
+				auto const& msg = static_cast<CLogmsgNotification const&>(*notification);
+				if (msg.msgType == logmsg::error) {
+					std::cerr << fz::to_utf8(msg.msg) << "\n";
+				}
+			}
+			break;
+		default:
+			break;
+		}
+	}
+	return true;
+}
+
+bool bench::run()
+{
+	if (s_.upload && s_.from_files && !create_upload_files()) {
+		std::cerr << "Could not create the files to upload\n";
+		return false;
+	}
+
+	for (size_t i = 0; i < s_.parallel; ++i) {
+		auto w = std::make_unique<worker>();
+		w->engine_ = std::make_unique<CFileZillaEngine>(context_, [this](CFileZillaEngine*) { wakeup(); });
+		workers_.push_back(std::move(w));
+	}
+
+	auto const wait = [this]() {
+		std::unique_lock<std::mutex> l(mutex_);
+		cond_.wait_for(l, std::chrono::seconds(1), [this]() { return signalled_; });
+		signalled_ = false;
+	};
+
+	auto const busy = [this]() {
+		for (auto const& w : workers_) {
+			if (w->busy_) {
+				return true;
+			}
+		}
+		return false;
+	};
+
+	auto const pump = [&]() {
+		while (busy()) {
+			wait();
+			for (auto & w : workers_) {
+				process(*w);
+			}
+		}
+	};
+
+	for (auto & w : workers_) {
+		execute(*w, CConnectCommand(server_, ServerHandle(), credentials_, false));
+	}
+	pump();
+
+	for (auto const& w : workers_) {
+		if (!w->connected_) {
+			return false;
+		}
+	}
+
+	auto start = fz::monotonic_clock::now();
+	auto cpu_start = cpu_time();
+	for (auto & w : workers_) {
+		next(*w);
+	}
+	pump();
+	auto const transfer_time = fz::monotonic_clock::now() - start;
+	auto const transfer_cpu = cpu_time() - cpu_start;
+
+	listing_phase_ = true;
+	start = fz::monotonic_clock::now();
+	cpu_start = cpu_time();
+	next(*workers_.front());
+	pump();
+	auto const listing_time = fz::monotonic_clock::now() - start;
+	auto const listing_cpu = cpu_time() - cpu_start;
+
+	double const transfer_seconds = std::max(seconds(transfer_time), 0.000001);
+	std::cout << fz::sprintf("%s of %u files%s%s, %u failed, %.1f MB in %.3f s\n",
+		s_.upload ? "Upload" : "Download", succeeded_ + failed_, s_.mmap ? " through memory mappings" : "", s_.zero_copy ? "" : " without zero-copy", failed_,
+		static_cast<double>(bytes_) / 1000000.0, transfer_seconds);
+	std::cout << fz::sprintf("  %.1f MB/s, %.1f files/s\n",
+		static_cast<double>(bytes_) / 1000000.0 / transfer_seconds,
+		static_cast<double>(succeeded_) / transfer_seconds);
+	if (bytes_) {
+		std::cout << fz::sprintf("  CPU %.3f s, %.2f ns per byte\n",
+			seconds(transfer_cpu), static_cast<double>(transfer_cpu.get_microseconds()) * 1000.0 / static_cast<double>(bytes_));
+	}
+
+	if (s_.listings && listings_done_) {
+		double const listing_seconds = std::max(seconds(listing_time), 0.000001);
+		uint64_t const entries = static_cast<uint64_t>(s_.listing_entries) * listings_done_;
+		std::cout << fz::sprintf("Listing of %u entries %u times in %.3f s\n", s_.listing_entries, listings_done_, listing_seconds);
+		std::cout << fz::sprintf("  %.0f entries/s, CPU %.3f s\n",
+			static_cast<double>(entries) / listing_seconds, seconds(listing_cpu));
+	}
+
+	return !failed_;
+}
+}
+
+int main(int argc, char* argv[])
+{
+	settings s;
+	if (!parse_args(argc, argv, s)) {
+		usage();
+		return 1;
+	}
+
+	auto const files = plan_files(s);
+
+	bench_options options;
+	options.set(OPTION_LOGGING_DEBUGLEVEL, 0);
+	options.set(OPTION_ZERO_COPY, s.zero_copy ? 1 : 0);
+	if (!s.trace.empty()) {
+		options.set(OPTION_TRACE_BUFFER_SIZE, 1000000);
+	}
+
+	converter conv;
+	CFileZillaEngineContext context(options, conv);
+
+	loopback_server server(context.GetEventLoop(), context.GetThreadPool(), s.tls);
+	server.set_files(files);
+	server.set_listing_entries(s.listing_entries);
+
+	unsigned int const port = server.listen();
+	if (!port) {
+		std::cerr << "Could not start the loopback server\n";
+		return 1;
+	}
+
+	bench b(s, context, port, files);
+	bool success = b.run();
+
+	// Before the engines are gone along with their spans
+	if (!s.trace.empty()) {
+		std::string const trace = context.ExportTrace();
+		fz::file f(fz::to_native(s.trace), fz::file::writing, fz::file::empty);
+		if (!f.opened() || f.write(trace.data(), static_cast<int64_t>(trace.size())) != static_cast<int64_t>(trace.size())) {
+			std::cerr << "Could not write the trace\n";
+			success = false;
+		}
+	}
+
+	return success ? 0 : 1;
+}
@@ -0,0 +1,158 @@
+#include "../src/include/libfilezilla_engine.h"
+#include "../src/engine/http/contentencoding.h"
+
+#include <cppunit/extensions/HelperMacros.h>
+
+#include <zlib.h>
+
+/*
+ * This testsuite asserts that compressed response bodies get decoded
+ * regardless of how the data arrives, and that malformed or truncated data
+ * is detected.
+ */
+
+class CHttpContentEncodingTest final : public CppUnit::TestFixture
+{
+	CPPUNIT_TEST_SUITE(CHttpContentEncodingTest);
+	CPPUNIT_TEST(testCodings);
+	CPPUNIT_TEST(testRoundtrip);
+	CPPUNIT_TEST(testMultipleMembers);
+	CPPUNIT_TEST(testTruncated);
+	CPPUNIT_TEST(testMalformed);
+	CPPUNIT_TEST_SUITE_END();
+
+public:
+	void setUp();
+	void tearDown() {}
+
+	void testCodings();
+	void testRoundtrip();
+	void testMultipleMembers();
+	void testTruncated();
+	void testMalformed();
+
+private:
+	std::string text_;
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(CHttpContentEncodingTest);
+
+namespace {
+// window_bits as for deflateInit2: 31 for gzip, 15 for zlib, -15 for raw deflate
+std::string encode(std::string const& in, int window_bits)
+{
+	z_stream stream{};
+	if (deflateInit2(&stream, 6, Z_DEFLATED, window_bits, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+		return std::string();
+	}
+
+	std::string out(deflateBound(&stream, static_cast<uLong>(in.size())) + 32, 0);
+	stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(in.data()));
+	stream.avail_in = static_cast<uInt>(in.size());
+	stream.next_out = reinterpret_cast<Bytef*>(&out[0]);
+	stream.avail_out = static_cast<uInt>(out.size());
+	int const res = deflate(&stream, Z_FINISH);
+	out.resize(stream.total_out);
+	deflateEnd(&stream);
+
+	return res == Z_STREAM_END ? out : std::string();
+}
+
+// Feeds the data in pieces of the given size, with output limited to
+// max_out bytes per call.
+bool decode(CHttpContentDecoder & decoder, std::string const& in, size_t step, size_t max_out, std::string & out)
+{
+	fz::buffer buffer;
+	size_t pos{};
+	while (pos < in.size() || decoder.pending()) {
+		size_t const n = std::min(step, in.size() - pos);
+		unsigned char const* p = reinterpret_cast<unsigned char const*>(in.data()) + pos;
+		size_t len = n;
+		if (!decoder.decode(p, len, buffer, max_out)) {
+			return false;
+		}
+		pos += n - len;
+	}
+	out.assign(reinterpret_cast<char const*>(buffer.get()), buffer.size());
+	return true;
+}
+}
+
+void CHttpContentEncodingTest::setUp()
+{
+	if (text_.empty()) {
+		for (int i = 0; i < 2000; ++i) {
+			text_ += "<d:response><d:href>/dir/file" + std::to_string(i) + "</d:href></d:response>\n";
+		}
+	}
+}
+
+void CHttpContentEncodingTest::testCodings()
+{
+	CPPUNIT_ASSERT(CHttpContentDecoder::create("gzip"));
+	CPPUNIT_ASSERT(CHttpContentDecoder::create("x-gzip"));
+	CPPUNIT_ASSERT(CHttpContentDecoder::create(" Deflate "));
+	CPPUNIT_ASSERT(!CHttpContentDecoder::create("br"));
+	CPPUNIT_ASSERT(!CHttpContentDecoder::create("identity"));
+	CPPUNIT_ASSERT(!CHttpContentDecoder::create("deflate, gzip"));
+}
+
+void CHttpContentEncodingTest::testRoundtrip()
+{
+	struct variant
+	{
+		char const* coding;
+		int window_bits;
+	};
+	for (auto const& v : {variant{"gzip", 31}, variant{"deflate", 15}, variant{"deflate", -15}}) {
+		std::string const compressed = encode(text_, v.window_bits);
+		CPPUNIT_ASSERT(!compressed.empty());
+
+		for (size_t step : {size_t(1), size_t(1000), compressed.size()}) {
+			for (size_t max_out : {size_t(1), size_t(65536)}) {
+				auto decoder = CHttpContentDecoder::create(v.coding);
+				std::string out;
+				CPPUNIT_ASSERT(decode(*decoder, compressed, step, max_out, out));
+				CPPUNIT_ASSERT(decoder->finished());
+				CPPUNIT_ASSERT(out == text_);
+				CPPUNIT_ASSERT_EQUAL(uint64_t(compressed.size()), decoder->encoded());
+				CPPUNIT_ASSERT_EQUAL(uint64_t(text_.size()), decoder->decoded());
+			}
+		}
+	}
+}
+
+void CHttpContentEncodingTest::testMultipleMembers()
+{
+	std::string const compressed = encode("foo", 31) + encode("bar", 31);
+
+	auto decoder = CHttpContentDecoder::create("gzip");
+	std::string out;
+	CPPUNIT_ASSERT(decode(*decoder, compressed, 5, 100, out));
+	CPPUNIT_ASSERT(decoder->finished());
+	CPPUNIT_ASSERT_EQUAL(std::string("foobar"), out);
+}
+
+void CHttpContentEncodingTest::testTruncated()
+{
+	std::string compressed = encode(text_, 31);
+	compressed.resize(compressed.size() / 2);
+
+	auto decoder = CHttpContentDecoder::create("gzip");
+	std::string out;
+	CPPUNIT_ASSERT(decode(*decoder, compressed, 4096, 65536, out));
+	CPPUNIT_ASSERT(!decoder->finished());
+}
+
+void CHttpContentEncodingTest::testMalformed()
+{
+	auto decoder = CHttpContentDecoder::create("gzip");
+	std::string out;
+	CPPUNIT_ASSERT(!decode(*decoder, text_, 4096, 65536, out));
+
+	std::string compressed = encode(text_, 15);
+	compressed[10] ^= 0x55;
+	compressed[11] ^= 0x55;
+	decoder = CHttpContentDecoder::create("deflate");
+	CPPUNIT_ASSERT(!decode(*decoder, compressed, 4096, 65536, out));
+}
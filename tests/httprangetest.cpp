@@ -0,0 +1,63 @@
+#include "../src/include/libfilezilla_engine.h"
+#include "../src/engine/http/ranges.h"
+
+#include <cppunit/extensions/HelperMacros.h>
+
+/*
+ * This testsuite asserts that Content-Range headers of partial responses
+ * are parsed correctly.
+ */
+
+class CHttpRangeTest final : public CppUnit::TestFixture
+{
+	CPPUNIT_TEST_SUITE(CHttpRangeTest);
+	CPPUNIT_TEST(testContentRange);
+	CPPUNIT_TEST(testInvalidContentRange);
+	CPPUNIT_TEST_SUITE_END();
+
+public:
+	void setUp() {}
+	void tearDown() {}
+
+	void testContentRange();
+	void testInvalidContentRange();
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(CHttpRangeTest);
+
+void CHttpRangeTest::testContentRange()
+{
+	uint64_t first{};
+	uint64_t last{};
+	uint64_t total{};
+
+	CPPUNIT_ASSERT(ParseContentRange("bytes 0-8388607/20000000", first, last, total));
+	CPPUNIT_ASSERT_EQUAL(uint64_t(0), first);
+	CPPUNIT_ASSERT_EQUAL(uint64_t(8388607), last);
+	CPPUNIT_ASSERT_EQUAL(uint64_t(20000000), total);
+
+	CPPUNIT_ASSERT(ParseContentRange("Bytes 100-100/101", first, last, total));
+	CPPUNIT_ASSERT_EQUAL(uint64_t(100), first);
+	CPPUNIT_ASSERT_EQUAL(uint64_t(100), last);
+	CPPUNIT_ASSERT_EQUAL(uint64_t(101), total);
+
+	CPPUNIT_ASSERT(ParseContentRange("bytes 5-9/*", first, last, total));
+	CPPUNIT_ASSERT_EQUAL(uint64_t(5), first);
+	CPPUNIT_ASSERT_EQUAL(uint64_t(9), last);
+	CPPUNIT_ASSERT_EQUAL(aio_base::nosize, total);
+}
+
+void CHttpRangeTest::testInvalidContentRange()
+{
+	uint64_t first{};
+	uint64_t last{};
+	uint64_t total{};
+
+	CPPUNIT_ASSERT(!ParseContentRange("", first, last, total));
+	CPPUNIT_ASSERT(!ParseContentRange("bytes */1000", first, last, total));
+	CPPUNIT_ASSERT(!ParseContentRange("items 0-9/10", first, last, total));
+	CPPUNIT_ASSERT(!ParseContentRange("bytes 9-0/10", first, last, total));
+	CPPUNIT_ASSERT(!ParseContentRange("bytes 0-10/10", first, last, total));
+	CPPUNIT_ASSERT(!ParseContentRange("bytes 0-9", first, last, total));
+	CPPUNIT_ASSERT(!ParseContentRange("bytes -1-9/10", first, last, total));
+}
@@ -0,0 +1,763 @@
+#include "loopback_server.h"
+
+#include <libfilezilla/format.hpp>
+#include <libfilezilla/string.hpp>
+#include <libfilezilla/tls_layer.hpp>
+
+#include <algorithm>
+
+namespace {
+struct session_done_event_type;
+typedef fz::simple_event<session_done_event_type, fz::event_handler*> session_done_event;
+
+size_t const chunk_size = 256 * 1024;
+
+// Downloads are fed from this
+std::string const& filler()
+{
+	static std::string const data(chunk_size, 'x');
+	return data;
+}
+
+bool size_from_name(std::string const& name, uint64_t & size)
+{
+	auto pos = name.rfind('_');
+	if (pos == std::string::npos) {
+		return false;
+	}
+	size = fz::to_integral<uint64_t>(name.substr(pos + 1), static_cast<uint64_t>(-1));
+	return size != static_cast<uint64_t>(-1);
+}
+
+std::string entry_name(size_t index, uint64_t size)
+{
+	return fz::sprintf("f%06u_%u", index, size);
+}
+}
+
+class loopback_server::session final : public fz::event_handler
+{
+public:
+	session(loopback_server & server, std::unique_ptr<fz::socket> && socket);
+	virtual ~session();
+
+private:
+	enum class transfer
+	{
+		none,
+		send,
+		receive,
+
+		// Waiting for the client to close the data connection
+		closing
+	};
+
+	virtual void operator()(fz::event_base const& ev) override;
+	void on_socket_event(fz::socket_event_source* source, fz::socket_event_flag t, int error);
+
+	void on_control_read();
+	void process_command(std::string const& line);
+	void reply(std::string const& msg);
+	void flush();
+
+	std::string resolve(std::string const& path) const;
+
+	void open_passive(bool extended);
+	void on_data_connection();
+	void on_data_event(fz::socket_event_flag t, int error);
+	void start_transfer(transfer t, std::string && buffer, uint64_t filler_size);
+	void continue_transfer();
+	void send_data();
+	void receive_data();
+	void drain_data();
+	void finish_transfer(bool success);
+	void reset_data();
+
+	void done();
+
+	loopback_server & server_;
+
+	std::unique_ptr<fz::socket> socket_;
+	std::unique_ptr<fz::tls_layer> tls_;
+	fz::socket_interface* control_{};
+
+	std::string input_;
+	std::string output_;
+	bool start_tls_{};
+	bool done_{};
+
+	std::unique_ptr<fz::listen_socket> listen_socket_;
+	std::unique_ptr<fz::socket> data_socket_;
+	std::unique_ptr<fz::tls_layer> data_tls_;
+	fz::socket_interface* data_{};
+	bool data_connected_{};
+
+	transfer transfer_{transfer::none};
+	std::string data_buffer_;
+	size_t data_offset_{};
+	uint64_t filler_remaining_{};
+	bool shutting_down_{};
+	std::vector<char> receive_buffer_;
+
+	std::string cwd_{"/"};
+	uint64_t rest_{};
+	bool prot_{};
+};
+
+loopback_server::session::session(loopback_server & server, std::unique_ptr<fz::socket> && socket)
+	: fz::event_handler(server.event_loop_)
+	, server_(server)
+	, socket_(std::move(socket))
+	, control_(socket_.get())
+{
+	socket_->set_event_handler(this);
+	reply("220 Loopback server ready");
+}
+
+loopback_server::session::~session()
+{
+	remove_handler();
+}
+
+void loopback_server::session::operator()(fz::event_base const& ev)
+{
+	fz::dispatch<fz::socket_event>(ev, this, &session::on_socket_event);
+}
+
+void loopback_server::session::on_socket_event(fz::socket_event_source* source, fz::socket_event_flag t, int error)
+{
+	if (done_) {
+		return;
+	}
+
+	if (listen_socket_ && source == listen_socket_.get()) {
+		if (t == fz::socket_event_flag::connection) {
+			on_data_connection();
+		}
+		return;
+	}
+
+	if (data_ && (source == data_socket_.get() || source == data_tls_.get())) {
+		on_data_event(t, error);
+		return;
+	}
+
+	if (error) {
+		done();
+		return;
+	}
+
+	switch (t) {
+	case fz::socket_event_flag::connection:
+		// TLS handshake has completed
+		on_control_read();
+		break;
+	case fz::socket_event_flag::read:
+		on_control_read();
+		break;
+	case fz::socket_event_flag::write:
+		flush();
+		break;
+	default:
+		break;
+	}
+}
+
+void loopback_server::session::on_control_read()
+{
+	char buffer[4096];
+	while (!done_ && !start_tls_) {
+		int error;
+		int read = control_->read(buffer, sizeof(buffer), error);
+		if (read < 0) {
+			if (error != EAGAIN) {
+				done();
+			}
+			return;
+		}
+		if (!read) {
+			done();
+			return;
+		}
+
+		input_.append(buffer, read);
+
+		size_t pos;
+		while (!done_ && !start_tls_ && (pos = input_.find("\r\n")) != std::string::npos) {
+			std::string line = input_.substr(0, pos);
+			input_.erase(0, pos + 2);
+			process_command(line);
+		}
+
+		if (input_.size() > 8192) {
+			done();
+		}
+	}
+}
+
+void loopback_server::session::process_command(std::string const& line)
+{
+	auto pos = line.find(' ');
+	std::string const cmd = fz::str_toupper_ascii(line.substr(0, pos));
+	std::string const arg = (pos == std::string::npos) ? std::string() : line.substr(pos + 1);
+
+	if (cmd == "AUTH") {
+		if (!server_.tls_ || tls_ || fz::str_toupper_ascii(arg) != "TLS") {
+			reply("504 Auth type not supported");
+		}
+		else {
+			// The handshake starts once the reply has been sent
+			start_tls_ = true;
+			reply("234 Using authentication type TLS");
+		}
+	}
+	else if (cmd == "PBSZ") {
+		reply("200 PBSZ=0");
+	}
+	else if (cmd == "PROT") {
+		if (!tls_) {
+			reply("503 Security data exchange not complete");
+		}
+		else if (arg == "P" || arg == "C") {
+			prot_ = arg == "P";
+			reply("200 Protection level set to " + arg);
+		}
+		else {
+			reply("504 Protection level not supported");
+		}
+	}
+	else if (cmd == "USER") {
+		reply("331 Password required");
+	}
+	else if (cmd == "PASS") {
+		reply("230 Login successful");
+	}
+	else if (cmd == "SYST") {
+		reply("215 UNIX Type: L8");
+	}
+	else if (cmd == "FEAT") {
+		std::string features = "211-Features:\r\n MDTM\r\n REST STREAM\r\n SIZE\r\n MLST type*;size*;modify*;\r\n UTF8\r\n EPSV\r\n";
+		if (server_.tls_) {
+			features += " AUTH TLS\r\n PBSZ\r\n PROT\r\n";
+		}
+		reply(features + "211 End");
+	}
+	else if (cmd == "OPTS" || cmd == "CLNT" || cmd == "NOOP") {
+		reply("200 OK");
+	}
+	else if (cmd == "TYPE") {
+		reply("200 Type set to " + arg);
+	}
+	else if (cmd == "PWD") {
+		reply("257 \"" + cwd_ + "\" is current directory");
+	}
+	else if (cmd == "CWD") {
+		cwd_ = resolve(arg);
+		reply("250 CWD successful");
+	}
+	else if (cmd == "CDUP") {
+		cwd_ = resolve("..");
+		reply("250 CDUP successful");
+	}
+	else if (cmd == "REST") {
+		rest_ = fz::to_integral<uint64_t>(arg);
+		reply("350 Restarting");
+	}
+	else if (cmd == "SIZE") {
+		uint64_t size{};
+		if (size_from_name(arg, size)) {
+			reply(fz::sprintf("213 %u", size));
+		}
+		else {
+			reply("550 File not found");
+		}
+	}
+	else if (cmd == "MDTM") {
+		reply("213 20200101000000");
+	}
+	else if (cmd == "PASV" || cmd == "EPSV") {
+		open_passive(cmd == "EPSV");
+	}
+	else if (cmd == "MLSD" || cmd == "LIST" || cmd == "NLST") {
+		// Ignore options of LIST
+		std::string dir = (arg.empty() || arg[0] == '-') ? cwd_ : resolve(arg);
+
+		listing_format format = listing_format::nlst;
+		if (cmd == "MLSD") {
+			format = listing_format::mlsd;
+		}
+		else if (cmd == "LIST") {
+			format = listing_format::list;
+		}
+		start_transfer(transfer::send, server_.listing(dir, format), 0);
+	}
+	else if (cmd == "RETR") {
+		uint64_t size{};
+		if (!size_from_name(arg, size)) {
+			reply("550 File not found");
+		}
+		else {
+			start_transfer(transfer::send, std::string(), size - std::min(rest_, size));
+		}
+		rest_ = 0;
+	}
+	else if (cmd == "STOR" || cmd == "APPE") {
+		start_transfer(transfer::receive, std::string(), 0);
+		rest_ = 0;
+	}
+	else if (cmd == "DELE" || cmd == "RMD" || cmd == "RNTO" || cmd == "MFMT") {
+		reply("250 OK");
+	}
+	else if (cmd == "MKD") {
+		reply("257 \"" + resolve(arg) + "\" created");
+	}
+	else if (cmd == "RNFR") {
+		reply("350 Ready for RNTO");
+	}
+	else if (cmd == "QUIT") {
+		reply("221 Goodbye");
+		done();
+	}
+	else {
+		reply("502 Command not implemented");
+	}
+}
+
+void loopback_server::session::reply(std::string const& msg)
+{
+	output_ += msg;
+	output_ += "\r\n";
+	flush();
+}
+
+void loopback_server::session::flush()
+{
+	while (!output_.empty()) {
+		int error;
+		int written = control_->write(output_.data(), static_cast<unsigned int>(output_.size()), error);
+		if (written < 0) {
+			if (error != EAGAIN) {
+				done();
+			}
+			return;
+		}
+		output_.erase(0, written);
+	}
+
+	if (start_tls_) {
+		start_tls_ = false;
+
+		tls_ = std::make_unique<fz::tls_layer>(event_loop_, this, *socket_, nullptr, server_.logger_);
+		control_ = tls_.get();
+		if (!tls_->set_certificate(server_.key_, server_.cert_, fz::native_string()) || !tls_->server_handshake()) {
+			done();
+		}
+	}
+}
+
+std::string loopback_server::session::resolve(std::string const& path) const
+{
+	if (path.empty()) {
+		return cwd_;
+	}
+
+	std::string ret;
+	if (path[0] != '/') {
+		ret = cwd_;
+	}
+
+	for (auto const& segment : fz::strtok(path, "/")) {
+		if (segment == "..") {
+			auto pos = ret.rfind('/');
+			if (pos != std::string::npos) {
+				ret.erase(pos);
+			}
+		}
+		else if (segment != ".") {
+			if (ret.empty() || ret.back() != '/') {
+				ret += '/';
+			}
+			ret += segment;
+		}
+	}
+
+	if (ret.empty()) {
+		ret = "/";
+	}
+	return ret;
+}
+
+void loopback_server::session::open_passive(bool extended)
+{
+	reset_data();
+
+	auto const ip = socket_->local_ip();
+
+	listen_socket_ = std::make_unique<fz::listen_socket>(server_.pool_, this);
+	int error{};
+	int port{};
+	if (listen_socket_->bind(ip)) {
+		error = listen_socket_->listen(socket_->address_family(), 0);
+		if (!error) {
+			port = listen_socket_->local_port(error);
+		}
+	}
+	if (port <= 0) {
+		listen_socket_.reset();
+		reply("421 Could not create socket");
+		return;
+	}
+
+	if (extended) {
+		reply(fz::sprintf("229 Entering Extended Passive Mode (|||%d|)", port));
+	}
+	else {
+		std::string address = ip;
+		std::replace(address.begin(), address.end(), '.', ',');
+		reply(fz::sprintf("227 Entering Passive Mode (%s,%d,%d)", address, port / 256, port % 256));
+	}
+}
+
+void loopback_server::session::on_data_connection()
+{
+	int error{};
+	data_socket_ = listen_socket_->accept(error);
+	listen_socket_.reset();
+	if (!data_socket_) {
+		if (transfer_ != transfer::none) {
+			finish_transfer(false);
+		}
+		return;
+	}
+	data_socket_->set_event_handler(this);
+
+	if (prot_) {
+		// Data connections resume the TLS session of the control connection
+		data_tls_ = std::make_unique<fz::tls_layer>(event_loop_, this, *data_socket_, nullptr, server_.logger_);
+		data_ = data_tls_.get();
+		if (!data_tls_->set_certificate(server_.key_, server_.cert_, fz::native_string()) ||
+			!data_tls_->server_handshake(tls_->get_session_parameters()))
+		{
+			finish_transfer(false);
+		}
+		return;
+	}
+
+	data_ = data_socket_.get();
+	data_connected_ = true;
+	continue_transfer();
+}
+
+void loopback_server::session::on_data_event(fz::socket_event_flag t, int error)
+{
+	if (error) {
+		if (transfer_ == transfer::send || transfer_ == transfer::receive) {
+			finish_transfer(false);
+		}
+		else {
+			reset_data();
+		}
+		return;
+	}
+
+	switch (t) {
+	case fz::socket_event_flag::connection:
+		data_connected_ = true;
+		continue_transfer();
+		break;
+	case fz::socket_event_flag::read:
+		if (transfer_ == transfer::receive) {
+			receive_data();
+		}
+		else if (transfer_ == transfer::closing) {
+			drain_data();
+		}
+		break;
+	case fz::socket_event_flag::write:
+		if (transfer_ == transfer::send) {
+			send_data();
+		}
+		break;
+	default:
+		break;
+	}
+}
+
+void loopback_server::session::start_transfer(transfer t, std::string && buffer, uint64_t filler_size)
+{
+	// Either waiting for the data connection or having an unused one
+	if (!listen_socket_ && !(data_ && transfer_ == transfer::none)) {
+		reply("425 Use PASV or EPSV first");
+		return;
+	}
+
+	transfer_ = t;
+	data_buffer_ = std::move(buffer);
+	data_offset_ = 0;
+	filler_remaining_ = filler_size;
+	shutting_down_ = false;
+
+	reply("150 Opening data connection");
+	continue_transfer();
+}
+
+void loopback_server::session::continue_transfer()
+{
+	if (!data_connected_) {
+		return;
+	}
+
+	if (transfer_ == transfer::send) {
+		send_data();
+	}
+	else if (transfer_ == transfer::receive) {
+		receive_data();
+	}
+}
+
+void loopback_server::session::send_data()
+{
+	auto const& fill = filler();
+	while (!shutting_down_) {
+		char const* p;
+		size_t len;
+		bool const from_buffer = data_offset_ < data_buffer_.size();
+		if (from_buffer) {
+			p = data_buffer_.data() + data_offset_;
+			len = std::min(data_buffer_.size() - data_offset_, chunk_size);
+		}
+		else if (filler_remaining_) {
+			p = fill.data();
+			len = static_cast<size_t>(std::min(filler_remaining_, static_cast<uint64_t>(fill.size())));
+		}
+		else {
+			shutting_down_ = true;
+			break;
+		}
+
+		int error;
+		int written = data_->write(p, static_cast<unsigned int>(len), error);
+		if (written < 0) {
+			if (error != EAGAIN) {
+				finish_transfer(false);
+			}
+			return;
+		}
+
+		if (from_buffer) {
+			data_offset_ += written;
+		}
+		else {
+			filler_remaining_ -= written;
+		}
+		server_.sent_ += written;
+	}
+
+	int res = data_->shutdown();
+	if (res != EAGAIN) {
+		finish_transfer(!res);
+	}
+}
+
+void loopback_server::session::receive_data()
+{
+	if (receive_buffer_.empty()) {
+		receive_buffer_.resize(chunk_size);
+	}
+
+	while (true) {
+		int error;
+		int read = data_->read(receive_buffer_.data(), static_cast<unsigned int>(receive_buffer_.size()), error);
+		if (read < 0) {
+			if (error != EAGAIN) {
+				finish_transfer(false);
+			}
+			return;
+		}
+		if (!read) {
+			finish_transfer(true);
+			return;
+		}
+		server_.received_ += read;
+	}
+}
+
+void loopback_server::session::drain_data()
+{
+	char buffer[1024];
+	while (true) {
+		int error;
+		int read = data_->read(buffer, sizeof(buffer), error);
+		if (read < 0 && error == EAGAIN) {
+			return;
+		}
+		if (read <= 0) {
+			reset_data();
+			return;
+		}
+	}
+}
+
+void loopback_server::session::finish_transfer(bool success)
+{
+	bool const sent = transfer_ == transfer::send;
+
+	reply(success ? "226 Transfer complete" : "426 Connection closed; transfer aborted");
+
+	if (success && sent) {
+		// Closing right away could reset the connection before the client
+		// has read everything, wait for it to close first.
+		transfer_ = transfer::closing;
+		data_buffer_.clear();
+		drain_data();
+	}
+	else {
+		reset_data();
+	}
+}
+
+void loopback_server::session::reset_data()
+{
+	data_ = nullptr;
+	data_tls_.reset();
+	data_socket_.reset();
+	listen_socket_.reset();
+	data_connected_ = false;
+
+	transfer_ = transfer::none;
+	data_buffer_.clear();
+	data_offset_ = 0;
+	filler_remaining_ = 0;
+	shutting_down_ = false;
+}
+
+void loopback_server::session::done()
+{
+	if (!done_) {
+		done_ = true;
+		server_.send_event<session_done_event>(this);
+	}
+}
+
+loopback_server::loopback_server(fz::event_loop & loop, fz::thread_pool & pool, bool tls)
+	: fz::event_handler(loop)
+	, pool_(pool)
+	, tls_(tls)
+{
+	if (tls_) {
+		auto const cert = fz::tls_layer::generate_selfsigned_certificate(fz::native_string(), "CN=localhost", {"localhost"});
+		key_ = cert.first;
+		cert_ = cert.second;
+	}
+}
+
+loopback_server::~loopback_server()
+{
+	remove_handler();
+
+	sessions_.clear();
+	listen_socket_.reset();
+}
+
+unsigned int loopback_server::listen()
+{
+	if (tls_ && (key_.empty() || cert_.empty())) {
+		return 0;
+	}
+
+	listen_socket_ = std::make_unique<fz::listen_socket>(pool_, this);
+	if (!listen_socket_->bind("127.0.0.1") || listen_socket_->listen(fz::address_type::ipv4, 0)) {
+		listen_socket_.reset();
+		return 0;
+	}
+
+	int error{};
+	int port = listen_socket_->local_port(error);
+	if (port <= 0) {
+		listen_socket_.reset();
+		return 0;
+	}
+	return static_cast<unsigned int>(port);
+}
+
+void loopback_server::set_files(std::vector<uint64_t> const& sizes)
+{
+	fz::scoped_lock l(mutex_);
+	files_ = sizes;
+}
+
+void loopback_server::set_listing_entries(size_t entries)
+{
+	fz::scoped_lock l(mutex_);
+	listing_entries_ = entries;
+}
+
+std::wstring loopback_server::file_name(size_t index, uint64_t size)
+{
+	return fz::to_wstring(entry_name(index, size));
+}
+
+void loopback_server::operator()(fz::event_base const& ev)
+{
+	fz::dispatch<fz::socket_event, session_done_event>(ev, this,
+		&loopback_server::on_socket_event,
+		&loopback_server::on_session_done);
+}
+
+void loopback_server::on_socket_event(fz::socket_event_source*, fz::socket_event_flag t, int error)
+{
+	if (t != fz::socket_event_flag::connection || error || !listen_socket_) {
+		return;
+	}
+
+	while (true) {
+		int accept_error{};
+		auto socket = listen_socket_->accept(accept_error);
+		if (!socket) {
+			break;
+		}
+		sessions_.emplace_back(std::make_unique<session>(*this, std::move(socket)));
+	}
+}
+
+void loopback_server::on_session_done(fz::event_handler* s)
+{
+	for (auto it = sessions_.begin(); it != sessions_.end(); ++it) {
+		if (it->get() == s) {
+			sessions_.erase(it);
+			break;
+		}
+	}
+}
+
+std::string loopback_server::listing(std::string const& dir, listing_format format)
+{
+	std::vector<uint64_t> sizes;
+	{
+		fz::scoped_lock l(mutex_);
+		if (dir == "/list") {
+			sizes.assign(listing_entries_, 1024);
+		}
+		else if (dir == "/files") {
+			sizes = files_;
+		}
+	}
+
+	std::string ret;
+	ret.reserve(sizes.size() * 80);
+	for (size_t i = 0; i < sizes.size(); ++i) {
+		auto const name = entry_name(i, sizes[i]);
+		switch (format) {
+		case listing_format::mlsd:
+			ret += fz::sprintf("type=file;size=%u;modify=20200101000000; %s\r\n", sizes[i], name);
+			break;
+		case listing_format::list:
+			ret += fz::sprintf("-rw-r--r-- 1 ftp ftp %u Jan 01  2020 %s\r\n", sizes[i], name);
+			break;
+		case listing_format::nlst:
+			ret += name + "\r\n";
+			break;
+		}
+	}
+	return ret;
+}
@@ -0,0 +1,84 @@
+#ifndef FILEZILLA_TESTS_LOOPBACK_SERVER_HEADER
+#define FILEZILLA_TESTS_LOOPBACK_SERVER_HEADER
+
+#include <libfilezilla/event_handler.hpp>
+#include <libfilezilla/logger.hpp>
+#include <libfilezilla/mutex.hpp>
+#include <libfilezilla/socket.hpp>
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <vector>
+
+/*
+ * Stand-in for an FTP server, serving synthetic content over loopback
+ * so that the engine can be benchmarked without network and disk effects
+ * on the server side.
+ *
+ * Every login succeeds. Directory /files contains the configured files,
+ * /list the configured number of listing entries and every other directory
+ * is empty.
+ * File names end in their size, e.g. f000012_1048576, downloads consist of
+ * filler bytes and uploaded data is discarded.
+ *
+ * With TLS enabled, AUTH TLS and PROT P are supported using a self-signed
+ * certificate. Data connections resume the session of the control connection.
+ */
+class loopback_server final : public fz::event_handler
+{
+public:
+	loopback_server(fz::event_loop & loop, fz::thread_pool & pool, bool tls);
+	virtual ~loopback_server();
+
+	// Returns the port listened on, 0 on failure
+	unsigned int listen();
+
+	void set_files(std::vector<uint64_t> const& sizes);
+	void set_listing_entries(size_t entries);
+
+	static std::wstring file_name(size_t index, uint64_t size);
+
+	uint64_t bytes_sent() const { return sent_; }
+	uint64_t bytes_received() const { return received_; }
+
+private:
+	class session;
+	friend class session;
+
+	virtual void operator()(fz::event_base const& ev) override;
+	void on_socket_event(fz::socket_event_source* source, fz::socket_event_flag t, int error);
+	void on_session_done(fz::event_handler* s);
+
+	enum class listing_format
+	{
+		mlsd,
+		list,
+		nlst
+	};
+	std::string listing(std::string const& dir, listing_format format);
+
+	fz::thread_pool & pool_;
+	bool const tls_;
+
+	std::string key_;
+	std::string cert_;
+
+	std::unique_ptr<fz::listen_socket> listen_socket_;
+	std::vector<std::unique_ptr<session>> sessions_;
+
+	fz::mutex mutex_;
+	std::vector<uint64_t> files_;
+	size_t listing_entries_{};
+
+	std::atomic<uint64_t> sent_{};
+	std::atomic<uint64_t> received_{};
+
+	class null_logger final : public fz::logger_interface
+	{
+	public:
+		virtual void do_log(fz::logmsg::type, std::wstring &&) override {}
+	} logger_;
+};
+
+#endif
@@ -0,0 +1,218 @@
+#include "../src/interface/filezilla.h"
+#include <wx/imaglist.h>
+#include <wx/scrolwin.h>
+#include <wx/listctrl.h>
+
+#include "../src/interface/filelistctrl.h"
+#include "../src/include/engine_options.h"
+#include "../src/include/serverpath.h"
+
+#include <libfilezilla/format.hpp>
+#include <libfilezilla/thread_pool.hpp>
+#include <libfilezilla/time.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <iostream>
+#include <set>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+/*
+ * Timings of individual hot spots, kept out of the unit tests to keep
+ * those fast and quiet. Each measurement compares the current code against
+ * the approach it replaced.
+ */
+
+namespace {
+double milliseconds(fz::duration const& d)
+{
+	return static_cast<double>(d.get_microseconds()) / 1000.0;
+}
+
+// Sorting names with CmpNatural against sorting precomputed sort keys
+bool bench_sort_keys()
+{
+	std::vector<std::wstring> names;
+	for (int i = 0; i < 50000; ++i) {
+		names.push_back(fz::sprintf(L"%s%d_part%d.%s", (i % 3) ? L"Image" : L"image", (i * 7919) % 50000, i % 13, (i % 2) ? L"jpg" : L"PNG"));
+	}
+
+	auto const start = fz::monotonic_clock::now();
+
+	std::vector<std::wstring> byCmp = names;
+	std::sort(byCmp.begin(), byCmp.end(), [](std::wstring const& a, std::wstring const& b) {
+		return CFileListCtrlSortBase::CmpNatural(a, b) < 0;
+	});
+
+	auto const cmpDone = fz::monotonic_clock::now();
+
+	std::vector<std::pair<std::string, size_t>> keys;
+	keys.reserve(names.size());
+	for (size_t i = 0; i < names.size(); ++i) {
+		keys.emplace_back(CFileListCtrlSortBase::MakeSortKey(names[i], NameSortMode::natural), i);
+	}
+	std::sort(keys.begin(), keys.end(), [](auto const& a, auto const& b) {
+		return CFileListCtrlSortBase::CmpSortKey(a.first, b.first) < 0;
+	});
+
+	auto const keysDone = fz::monotonic_clock::now();
+
+	std::cout << fz::sprintf("Sorting %u names: CmpNatural %.1f ms, sort keys %.1f ms\n",
+		names.size(), milliseconds(cmpDone - start), milliseconds(keysDone - cmpDone));
+
+	for (size_t i = 0; i < names.size(); ++i) {
+		if (CFileListCtrlSortBase::CmpNatural(byCmp[i], names[keys[i].second])) {
+			std::cerr << "Sort keys and CmpNatural disagree\n";
+			return false;
+		}
+	}
+	return true;
+}
+
+class bench_options final : public COptionsBase
+{
+public:
+	bench_options()
+	{
+		fz::scoped_write_lock l(mtx_);
+		add_missing(l);
+	}
+
+	virtual void notify_changed() override {}
+};
+
+// Concurrent get_int against reads that each take a reader lock, like get_int used to
+bool bench_option_reads()
+{
+	bench_options options;
+
+	int const threads = 4;
+	int const reads = 2000000;
+
+	fz::thread_pool pool;
+	std::atomic<int64_t> sum{};
+
+	auto const run = [&](auto && f) {
+		auto const start = fz::monotonic_clock::now();
+		std::vector<fz::async_task> tasks;
+		for (int i = 0; i < threads; ++i) {
+			tasks.emplace_back(pool.spawn(f));
+		}
+		for (int i = 0; i < 1000; ++i) {
+			options.set(OPTION_TIMEOUT, (i % 2) ? 30 : 40);
+		}
+		for (auto & t : tasks) {
+			t.join();
+		}
+		return fz::monotonic_clock::now() - start;
+	};
+
+	fz::rwmutex mtx;
+	int value = 20;
+	auto const locked = run([&]() {
+		int64_t s{};
+		for (int i = 0; i < reads; ++i) {
+			fz::scoped_read_lock l(mtx);
+			s += value;
+		}
+		sum += s;
+	});
+
+	auto const snapshot = run([&]() {
+		int64_t s{};
+		for (int i = 0; i < reads; ++i) {
+			s += options.get_int(OPTION_TIMEOUT);
+		}
+		sum += s;
+	});
+
+	std::cout << fz::sprintf("%d threads reading %d options each: rwmutex %.1f ms, get_int %.1f ms\n",
+		threads, reads, milliseconds(locked), milliseconds(snapshot));
+
+	return sum > 0;
+}
+
+// Common CServerPath operations, with std::set against std::unordered_set
+bool bench_server_paths()
+{
+	std::vector<CServerPath> paths;
+	for (int i = 0; i < 20000; ++i) {
+		CServerPath path(fz::sprintf(L"/home/user/projects/project%d/src/module%d", i % 200, i % 13));
+		path.AddSegment(fz::sprintf(L"dir%d", i));
+		paths.push_back(path);
+	}
+
+	auto const start = fz::monotonic_clock::now();
+
+	size_t equal{};
+	for (int round = 0; round < 10; ++round) {
+		for (size_t i = 1; i < paths.size(); ++i) {
+			if (paths[i] == paths[i - 1]) {
+				++equal;
+			}
+		}
+	}
+
+	auto const equalDone = fz::monotonic_clock::now();
+
+	size_t parents{};
+	for (int round = 0; round < 10; ++round) {
+		for (auto const& path : paths) {
+			CServerPath parent = path;
+			while (parent.HasParent()) {
+				parent.MakeParent();
+				++parents;
+			}
+		}
+	}
+
+	auto const parentsDone = fz::monotonic_clock::now();
+
+	CServerPath const root(L"/home/user/projects/project7");
+	size_t subdirs{};
+	for (int round = 0; round < 10; ++round) {
+		for (auto const& path : paths) {
+			if (path.IsSubdirOf(root, false)) {
+				++subdirs;
+			}
+		}
+	}
+
+	auto const subdirsDone = fz::monotonic_clock::now();
+
+	std::set<CServerPath> ordered;
+	for (auto const& path : paths) {
+		ordered.insert(path.GetParent());
+	}
+
+	auto const orderedDone = fz::monotonic_clock::now();
+
+	std::unordered_set<CServerPath> hashed;
+	for (auto const& path : paths) {
+		hashed.insert(path.GetParent());
+	}
+
+	auto const hashedDone = fz::monotonic_clock::now();
+
+	std::cout << fz::sprintf("%u paths: operator== %.1f ms, MakeParent %.1f ms, IsSubdirOf %.1f ms, std::set %.1f ms, std::unordered_set %.1f ms\n",
+		paths.size(), milliseconds(equalDone - start), milliseconds(parentsDone - equalDone), milliseconds(subdirsDone - parentsDone),
+		milliseconds(orderedDone - subdirsDone), milliseconds(hashedDone - orderedDone));
+
+	if (equal || parents != 10 * 7 * paths.size() || subdirs != 10 * 100 || ordered.size() != hashed.size()) {
+		std::cerr << "Unexpected CServerPath results\n";
+		return false;
+	}
+	return true;
+}
+}
+
+int main()
+{
+	bool success = true;
+	success &= bench_sort_keys();
+	success &= bench_option_reads();
+	success &= bench_server_paths();
+	return success ? 0 : 1;
+}
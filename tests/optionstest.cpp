@@ -0,0 +1,126 @@
+#include "../src/include/engine_options.h"
+
+#include <libfilezilla/thread_pool.hpp>
+
+#include <cppunit/extensions/HelperMacros.h>
+#include <atomic>
+#include <vector>
+
+/*
+ * This testsuite asserts the correctness of the
+ * lock-free option reads in COptionsBase
+ */
+
+class COptionsTest final : public CppUnit::TestFixture
+{
+	CPPUNIT_TEST_SUITE(COptionsTest);
+	CPPUNIT_TEST(testGetSet);
+	CPPUNIT_TEST(testGeneration);
+	CPPUNIT_TEST(testConcurrentGetInt);
+	CPPUNIT_TEST_SUITE_END();
+
+public:
+	void setUp() {}
+	void tearDown() {}
+
+	void testGetSet();
+	void testGeneration();
+	void testConcurrentGetInt();
+
+protected:
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(COptionsTest);
+
+namespace {
+class test_options final : public COptionsBase
+{
+public:
+	test_options()
+	{
+		fz::scoped_write_lock l(mtx_);
+		add_missing(l);
+	}
+
+	virtual void notify_changed() override {}
+};
+}
+
+void COptionsTest::testGetSet()
+{
+	test_options options;
+
+	CPPUNIT_ASSERT_EQUAL(20, options.get_int(OPTION_TIMEOUT));
+
+	options.set(OPTION_TIMEOUT, 30);
+	CPPUNIT_ASSERT_EQUAL(30, options.get_int(OPTION_TIMEOUT));
+
+	// The validator raises values below 10
+	options.set(OPTION_TIMEOUT, 5);
+	CPPUNIT_ASSERT_EQUAL(10, options.get_int(OPTION_TIMEOUT));
+
+	// Out of range, gets discarded
+	options.set(OPTION_TIMEOUT, 10000);
+	CPPUNIT_ASSERT_EQUAL(10, options.get_int(OPTION_TIMEOUT));
+
+	// Setting through the string interface has to update the numeric value as well
+	options.set(OPTION_TIMEOUT, L"42");
+	CPPUNIT_ASSERT_EQUAL(42, options.get_int(OPTION_TIMEOUT));
+	CPPUNIT_ASSERT(options.get_string(OPTION_TIMEOUT) == L"42");
+
+	CPPUNIT_ASSERT(options.get_bool(OPTION_USEPASV));
+	options.set(OPTION_USEPASV, false);
+	CPPUNIT_ASSERT(!options.get_bool(OPTION_USEPASV));
+}
+
+void COptionsTest::testGeneration()
+{
+	test_options options;
+
+	uint64_t const generation = options.generation();
+
+	// Unchanged value
+	options.set(OPTION_TIMEOUT, 20);
+	CPPUNIT_ASSERT_EQUAL(generation, options.generation());
+
+	options.set(OPTION_TIMEOUT, 25);
+	CPPUNIT_ASSERT(options.generation() > generation);
+}
+
+void COptionsTest::testConcurrentGetInt()
+{
+	test_options options;
+
+	int const threads = 4;
+	int const reads = 100000;
+
+	fz::thread_pool pool;
+	std::atomic<bool> invalid{};
+	std::atomic<int64_t> sum{};
+
+	// Readers have to see either the old or the new value, never anything else
+	std::vector<fz::async_task> tasks;
+	for (int i = 0; i < threads; ++i) {
+		tasks.emplace_back(pool.spawn([&]() {
+			int64_t s{};
+			for (int n = 0; n < reads; ++n) {
+				int const v = options.get_int(OPTION_TIMEOUT);
+				if (v != 20 && v != 30 && v != 40) {
+					invalid = true;
+				}
+				s += v;
+			}
+			sum += s;
+		}));
+	}
+	for (int i = 0; i < 1000; ++i) {
+		options.set(OPTION_TIMEOUT, (i % 2) ? 30 : 40);
+	}
+	for (auto & t : tasks) {
+		t.join();
+	}
+
+	CPPUNIT_ASSERT(!invalid);
+	CPPUNIT_ASSERT(sum > 0);
+	CPPUNIT_ASSERT_EQUAL(30, options.get_int(OPTION_TIMEOUT));
+}
@@ -1,6 +1,7 @@
 #include "../src/engine/directorylistingparser.h"
 #include <cppunit/extensions/HelperMacros.h>
 #include <list>
+#include <unordered_set>
 
 /*
  * This testsuite asserts the correctness of the CServerPath class.
@@ -16,6 +17,8 @@ class CServerPathTest final : public CppUnit::TestFixture
 	CPPUNIT_TEST(testGetCommonParent);
 	CPPUNIT_TEST(testFormatFilename);
 	CPPUNIT_TEST(testChangePath);
+	CPPUNIT_TEST(testIsSubdirOf);
+	CPPUNIT_TEST(testHash);
 	CPPUNIT_TEST_SUITE_END();
 
 public:
@@ -29,6 +32,8 @@ public:
 	void testGetCommonParent();
 	void testFormatFilename();
 	void testChangePath();
+	void testIsSubdirOf();
+	void testHash();
 
 protected:
 };
@@ -686,3 +691,77 @@ void CServerPathTest::testChangePath()
 	}
 
 }
+
+void CServerPathTest::testIsSubdirOf()
+{
+	CServerPath const unix1(L"/");
+	CServerPath const unix2(L"/foo");
+	CServerPath const unix3(L"/foo/bar");
+	CServerPath const unix4(L"/foo/baz/bar");
+	CServerPath const unix5(L"/FOO/bar");
+
+	CPPUNIT_ASSERT(unix3.IsSubdirOf(unix2, false));
+	CPPUNIT_ASSERT(unix3.IsSubdirOf(unix1, false));
+	CPPUNIT_ASSERT(unix4.IsSubdirOf(unix2, false));
+	CPPUNIT_ASSERT(!unix4.IsSubdirOf(unix3, false));
+	CPPUNIT_ASSERT(!unix2.IsSubdirOf(unix3, false));
+	CPPUNIT_ASSERT(!unix3.IsSubdirOf(unix3, false));
+	CPPUNIT_ASSERT(unix3.IsSubdirOf(unix3, false, true));
+	CPPUNIT_ASSERT(!unix1.IsSubdirOf(unix1, false, true));
+	CPPUNIT_ASSERT(unix2.IsParentOf(unix4, false));
+
+	CPPUNIT_ASSERT(!unix5.IsSubdirOf(unix2, false));
+	CPPUNIT_ASSERT(unix5.IsSubdirOf(unix2, true));
+
+	CServerPath const dos1(L"c:\\foo");
+	CServerPath const dos2(L"c:\\foo\\bar");
+	CServerPath const dos3(L"d:\\foo\\bar");
+	CPPUNIT_ASSERT(dos2.IsSubdirOf(dos1, false));
+	CPPUNIT_ASSERT(!dos3.IsSubdirOf(dos1, false));
+
+	CServerPath const vms1(L"FOO:[BAR]");
+	CServerPath const vms2(L"FOO:[BAR.BAZ]");
+	CServerPath const vms3(L"BAR:[BAR.BAZ]");
+	CPPUNIT_ASSERT(vms2.IsSubdirOf(vms1, false));
+	CPPUNIT_ASSERT(!vms3.IsSubdirOf(vms1, false));
+
+	// Different types never match
+	CServerPath const unix6(L"/foo/bar/baz", UNIX);
+	CServerPath const cygwin1(L"/foo", CYGWIN);
+	CPPUNIT_ASSERT(!unix6.IsSubdirOf(cygwin1, false));
+}
+
+void CServerPathTest::testHash()
+{
+	CServerPath unix1(L"/foo/bar");
+	CServerPath unix2(L"/foo");
+	unix2.AddSegment(L"bar");
+	CServerPath unix3(L"/foo/bar/baz");
+	unix3.MakeParent();
+
+	CPPUNIT_ASSERT(unix1 == unix2);
+	CPPUNIT_ASSERT(unix1 == unix3);
+	CPPUNIT_ASSERT_EQUAL(unix1.hash(), unix2.hash());
+	CPPUNIT_ASSERT_EQUAL(unix1.hash(), unix3.hash());
+
+	CServerPath const unix4(L"/foo/baz");
+	CPPUNIT_ASSERT(unix1 != unix4);
+
+	// Same segments, different type
+	CServerPath const cygwin1(L"/foo/bar", CYGWIN);
+	CPPUNIT_ASSERT(unix1 != cygwin1);
+
+	std::unordered_set<CServerPath> set;
+	CPPUNIT_ASSERT(set.insert(unix1).second);
+	CPPUNIT_ASSERT(!set.insert(unix2).second);
+	CPPUNIT_ASSERT(set.insert(unix4).second);
+	CPPUNIT_ASSERT(set.insert(cygwin1).second);
+	CPPUNIT_ASSERT(set.insert(CServerPath()).second);
+	CPPUNIT_ASSERT_EQUAL(size_t(4), set.size());
+
+	// Safe paths have to round-trip to the same path
+	CServerPath safe;
+	CPPUNIT_ASSERT(safe.SetSafePath(unix1.GetSafePath()));
+	CPPUNIT_ASSERT(safe == unix1);
+	CPPUNIT_ASSERT_EQUAL(unix1.hash(), safe.hash());
+}